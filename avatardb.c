@@ -19,6 +19,7 @@
 #include <gweb/config.h>
 #include <gweb/json_api.h>
 #include <gweb/mysqldb_api.h>
+#include <gweb/storage.h>
 
 #include "json-c/json.h"
 #include "libs3.h"
@@ -205,6 +206,7 @@ avatardb_handle_uploaded_block (void **priv, const char *key, const char *data,
                                 int *status)
 {
     struct http_upload_avatar *meta = NULL;
+    int count;
 
     if (!priv)
         return -1;
@@ -227,9 +229,11 @@ avatardb_handle_uploaded_block (void **priv, const char *key, const char *data,
 
         /*
          * Check if UID is valid before downloading the image to
-         * cache. *TBD* Abstract the DB fetch APIs.
+         * cache.
          */
-        if (!gweb_mysql_check_uid_email(meta->id, NULL)) {
+        count = gweb_storage_check_uid(meta->id);
+
+        if (count <= 0) {
             log_debug("[avatardb] invalid UID: %s", meta->id);
             return -1;
         }
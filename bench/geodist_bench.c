@@ -0,0 +1,366 @@
+/*
+ * Neighbour search benchmark
+ *
+ * Without arguments, times the distance kernels over N random points
+ * around a city sized area: per-point libm, the scalar batch and the
+ * AVX2 batch, and checks that they agree on the points in range.
+ *
+ * With -db, loads N points into a scratch GeoBench table on the
+ * configured database (~/.gwebrc or GWEBRC_CONFIG) and compares the
+ * libgeod_inverse UDF query with the bounding box fetch ranked by the
+ * kernel, over a number of search origins. The table is dropped after.
+ *
+ *   geodist_bench [-db] [-n points] [-r radius] [-q queries]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include <mysql.h>
+
+#include <gweb/common.h>
+#include <gweb/config.h>
+#include <gweb/geodist.h>
+
+#define BENCH_LATITUDE          (12.97)
+#define BENCH_LONGITUDE         (77.59)
+#define BENCH_SPREAD_DEG        (0.5)
+#define BENCH_INSERT_ROWS       (2000)
+#define BENCH_PAGE_ROWS         (21)
+
+struct bench_hit {
+    int idx;
+    double distance;
+};
+
+static double *g_lat, *g_lon, *g_hav;
+
+static double
+bench_now (void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double
+bench_rand (double spread)
+{
+    return (2.0 * rand() / RAND_MAX - 1.0) * spread;
+}
+
+static int
+bench_hit_cmp (const void *a, const void *b)
+{
+    const struct bench_hit *ha = a, *hb = b;
+
+    if (ha->distance != hb->distance) {
+        return (ha->distance < hb->distance) ? -1 : 1;
+    }
+    return ha->idx - hb->idx;
+}
+
+/* Haversine pass, exact recheck of the candidates, sort */
+static int
+bench_rank (double lat0, double lon0, const double *lat, const double *lon,
+            int n, double radius, struct bench_hit *hits,
+            void (*kernel)(double, double, const double *, const double *,
+                           double *, int))
+{
+    double hav_max = gweb_geodist_hav(radius) * (1 + 1e-6), distance;
+    int idx, nr_hits = 0;
+
+    kernel(lat0, lon0, lat, lon, g_hav, n);
+
+    for (idx = 0; idx < n; idx++) {
+        if (g_hav[idx] >= hav_max) {
+            continue;
+        }
+        distance = gweb_geodist(lat0, lon0, lat[idx], lon[idx]);
+        if (distance < radius) {
+            hits[nr_hits].idx = idx;
+            hits[nr_hits++].distance = distance;
+        }
+    }
+    qsort(hits, nr_hits, sizeof(struct bench_hit), bench_hit_cmp);
+
+    return nr_hits;
+}
+
+static int
+bench_kernels (int n, double radius, int queries)
+{
+    struct bench_hit *hits;
+    double start, t_libm = 0, t_scalar = 0, t_avx2 = 0;
+    double lat0, lon0;
+    int q, idx, nr_libm, nr_scalar, nr_avx2 = 0, mismatch = 0;
+
+    if ((hits = malloc(n * sizeof(struct bench_hit))) == NULL) {
+        return -1;
+    }
+
+    for (q = 0; q < queries; q++) {
+        lat0 = BENCH_LATITUDE + bench_rand(BENCH_SPREAD_DEG);
+        lon0 = BENCH_LONGITUDE + bench_rand(BENCH_SPREAD_DEG);
+
+        start = bench_now();
+        for (nr_libm = idx = 0; idx < n; idx++) {
+            if (gweb_geodist(lat0, lon0, g_lat[idx], g_lon[idx]) < radius) {
+                nr_libm++;
+            }
+        }
+        t_libm += bench_now() - start;
+
+        start = bench_now();
+        nr_scalar = bench_rank(lat0, lon0, g_lat, g_lon, n, radius, hits,
+                               gweb_geodist_hav_scalar);
+        t_scalar += bench_now() - start;
+
+#ifdef GWEB_GEODIST_AVX2
+        if (strcmp(gweb_geodist_kernel(), "avx2") == 0) {
+            start = bench_now();
+            nr_avx2 = bench_rank(lat0, lon0, g_lat, g_lon, n, radius, hits,
+                                 gweb_geodist_hav_avx2);
+            t_avx2 += bench_now() - start;
+            mismatch += (nr_avx2 != nr_libm);
+        }
+#endif
+        mismatch += (nr_scalar != nr_libm);
+    }
+
+    printf("%d points, radius %.0f m, %d queries, last query %d hits\n",
+           n, radius, queries, nr_libm);
+    printf("  libm per point   %8.2f ms/query\n", t_libm * 1e3 / queries);
+    printf("  scalar batch     %8.2f ms/query\n", t_scalar * 1e3 / queries);
+    if (t_avx2 > 0) {
+        printf("  avx2 batch       %8.2f ms/query\n", t_avx2 * 1e3 / queries);
+    } else {
+        printf("  avx2 batch       not available\n");
+    }
+    printf("  hit count mismatches: %d\n", mismatch);
+
+    free(hits);
+    return mismatch ? -1 : 0;
+}
+
+static int
+bench_query (MYSQL *con, const char *qry)
+{
+    if (mysql_query(con, qry)) {
+        fprintf(stderr, "%s: %s\n", qry, mysql_error(con));
+        return -1;
+    }
+    return 0;
+}
+
+static int
+bench_load (MYSQL *con, int n)
+{
+    char *qrybuf;
+    int idx, len = 0, ret = -1;
+
+    if (bench_query(con, "DROP TABLE IF EXISTS GeoBench") ||
+        bench_query(con, "CREATE TABLE GeoBench (UID VARCHAR(16) BINARY NOT NULL, "
+                    "Location POINT NOT NULL, PRIMARY KEY (UID), "
+                    "SPATIAL INDEX (Location))")) {
+        return -1;
+    }
+
+    if ((qrybuf = malloc(BENCH_INSERT_ROWS * 96 + 64)) == NULL) {
+        return -1;
+    }
+
+    for (idx = 0; idx < n; idx++) {
+        if (len == 0) {
+            len = sprintf(qrybuf, "INSERT INTO GeoBench VALUES ");
+        } else {
+            qrybuf[len++] = ',';
+        }
+        len += sprintf(qrybuf + len, "('B%09d', Point(%.17g, %.17g))", idx,
+                       g_lat[idx], g_lon[idx]);
+
+        if ((idx + 1) % BENCH_INSERT_ROWS == 0 || idx == n - 1) {
+            if (bench_query(con, qrybuf)) {
+                goto __bail_out;
+            }
+            len = 0;
+        }
+    }
+    ret = bench_query(con, "ANALYZE TABLE GeoBench");
+    mysql_free_result(mysql_store_result(con));
+
+__bail_out:
+    free(qrybuf);
+    return ret;
+}
+
+/* Rows in range through the UDF, one page like the handler asks */
+static int
+bench_udf (MYSQL *con, double lat0, double lon0, double radius)
+{
+    char qrybuf[512];
+    MYSQL_RES *res;
+    int nr_rows;
+
+    sprintf(qrybuf, "SELECT UID, libgeod_inverse(ST_X(Location), ST_Y(Location), "
+            "%.17g, %.17g) Distance FROM GeoBench HAVING Distance < %.17g "
+            "ORDER BY Distance, UID LIMIT %d", lat0, lon0, radius,
+            BENCH_PAGE_ROWS);
+    if (bench_query(con, qrybuf) || (res = mysql_store_result(con)) == NULL) {
+        return -1;
+    }
+    nr_rows = mysql_num_rows(res);
+    mysql_free_result(res);
+
+    return nr_rows;
+}
+
+static int
+bench_bbox (MYSQL *con, double lat0, double lon0, double radius,
+            struct bench_hit *hits, double *lat, double *lon)
+{
+    char qrybuf[512];
+    double dlat, dlon;
+    MYSQL_RES *res;
+    MYSQL_ROW row;
+    int n = 0, nr_hits;
+
+    dlat = radius / (GWEB_GEO_EARTH_RADIUS * M_PI / 180);
+    dlon = dlat / cos((fabs(lat0) + dlat) * M_PI / 180);
+
+    sprintf(qrybuf, "SELECT ST_X(Location), ST_Y(Location) FROM GeoBench "
+            "WHERE MBRContains(ST_Envelope(LineString(Point(%.17g, %.17g), "
+            "Point(%.17g, %.17g))), Location)", lat0 - dlat, lon0 - dlon,
+            lat0 + dlat, lon0 + dlon);
+    if (bench_query(con, qrybuf) || (res = mysql_store_result(con)) == NULL) {
+        return -1;
+    }
+    while ((row = mysql_fetch_row(res)) != NULL) {
+        lat[n] = atof(row[0]);
+        lon[n++] = atof(row[1]);
+    }
+    mysql_free_result(res);
+
+    nr_hits = bench_rank(lat0, lon0, lat, lon, n, radius, hits,
+                         gweb_geodist_hav_batch);
+
+    return (nr_hits < BENCH_PAGE_ROWS) ? nr_hits : BENCH_PAGE_ROWS;
+}
+
+static int
+bench_db (int argc, char *argv[], int n, double radius, int queries)
+{
+    struct mysql_config *cfg;
+    struct bench_hit *hits;
+    double start, t_udf = 0, t_bbox = 0, lat0, lon0;
+    double *lat, *lon;
+    int q, nr_udf, nr_bbox, mismatch = 0, ret = -1;
+    MYSQL *con;
+
+    if (config_parse_and_load(argc, argv) || (cfg = config_load_mysqldb()) == NULL) {
+        fprintf(stderr, "No MySQL connect information found\n");
+        return -1;
+    }
+
+    if ((con = mysql_init(NULL)) == NULL ||
+        mysql_real_connect(con, cfg->host, cfg->username, cfg->password,
+                           cfg->database, 0, NULL, 0) == NULL) {
+        fprintf(stderr, "connect: %s\n", con ? mysql_error(con) : "no memory");
+        return -1;
+    }
+
+    hits = malloc(n * sizeof(struct bench_hit));
+    lat = malloc(n * sizeof(double));
+    lon = malloc(n * sizeof(double));
+    if (!hits || !lat || !lon) {
+        goto __bail_out;
+    }
+
+    start = bench_now();
+    if (bench_load(con, n)) {
+        goto __bail_out;
+    }
+    printf("%d points loaded in %.1f s\n", n, bench_now() - start);
+
+    for (q = 0; q < queries; q++) {
+        lat0 = BENCH_LATITUDE + bench_rand(BENCH_SPREAD_DEG);
+        lon0 = BENCH_LONGITUDE + bench_rand(BENCH_SPREAD_DEG);
+
+        start = bench_now();
+        nr_udf = bench_udf(con, lat0, lon0, radius);
+        t_udf += bench_now() - start;
+
+        start = bench_now();
+        nr_bbox = bench_bbox(con, lat0, lon0, radius, hits, lat, lon);
+        t_bbox += bench_now() - start;
+
+        if (nr_udf < 0 || nr_bbox < 0) {
+            goto __bail_out;
+        }
+        /* Spherical vs geodesic distance may differ right at the edge */
+        mismatch += (nr_udf != nr_bbox);
+    }
+
+    printf("radius %.0f m, %d queries, %s kernel\n", radius, queries,
+           gweb_geodist_kernel());
+    printf("  UDF per row      %8.2f ms/query\n", t_udf * 1e3 / queries);
+    printf("  bbox + kernel    %8.2f ms/query\n", t_bbox * 1e3 / queries);
+    printf("  page size mismatches: %d\n", mismatch);
+    ret = 0;
+
+__bail_out:
+    bench_query(con, "DROP TABLE IF EXISTS GeoBench");
+    mysql_close(con);
+    free(hits);
+    free(lat);
+    free(lon);
+    return ret;
+}
+
+int main (int argc, char *argv[])
+{
+    int idx, n = 1000000, queries = 20, use_db = 0;
+    double radius = 5000;
+
+    for (idx = 1; idx < argc; idx++) {
+        if (strcmp(argv[idx], "-db") == 0) {
+            use_db = 1;
+        } else if (strcmp(argv[idx], "-n") == 0 && idx + 1 < argc) {
+            n = atoi(argv[++idx]);
+        } else if (strcmp(argv[idx], "-r") == 0 && idx + 1 < argc) {
+            radius = atof(argv[++idx]);
+        } else if (strcmp(argv[idx], "-q") == 0 && idx + 1 < argc) {
+            queries = atoi(argv[++idx]);
+        } else {
+            fprintf(stderr, "usage: %s [-db] [-n points] [-r radius] [-q queries]\n",
+                    argv[0]);
+            return -1;
+        }
+    }
+
+    if (n <= 0 || queries <= 0 || radius <= 0) {
+        return -1;
+    }
+
+    g_lat = malloc(n * sizeof(double));
+    g_lon = malloc(n * sizeof(double));
+    g_hav = malloc(n * sizeof(double));
+    if (!g_lat || !g_lon || !g_hav) {
+        fprintf(stderr, "unable to allocate memory!\n");
+        return -1;
+    }
+
+    srand(1);
+    for (idx = 0; idx < n; idx++) {
+        g_lat[idx] = BENCH_LATITUDE + bench_rand(BENCH_SPREAD_DEG);
+        g_lon[idx] = BENCH_LONGITUDE + bench_rand(BENCH_SPREAD_DEG);
+    }
+
+    if (use_db) {
+        return bench_db(argc, argv, n, radius, queries);
+    }
+    return bench_kernels(n, radius, queries);
+}
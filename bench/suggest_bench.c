@@ -0,0 +1,344 @@
+/*
+ * Friend of friend suggestion benchmark
+ *
+ * Builds a synthetic power-law connection graph by preferential
+ * attachment (each new user connects to m users picked in proportion
+ * to their connections), held as ascending adjacency arrays like the
+ * index of mysqldb_graph.c. Then:
+ *
+ *  - times the intersection kernels (scalar merge, AVX2 blocks, and
+ *    the dispatch with its galloping path for skewed sizes) on
+ *    (friends of a user, friends of a candidate) pairs, and checks
+ *    that they agree;
+ *
+ *  - times gweb_suggest_rank() over random users against counting
+ *    every friend of friend path into a dense array and sorting, the
+ *    in-process form of the GROUP BY self-join (which needs a counter
+ *    per user for each query in flight), and checks the mutual count
+ *    of every suggestion against that count.
+ *
+ *   suggest_bench [-n users] [-m connections] [-q queries] [-k suggestions]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <gweb/suggest.h>
+
+#define BENCH_MAX_PAIRS         (200000)
+
+struct bench_graph {
+    uint32_t nr;
+    uint32_t *offsets;
+    uint32_t *peers;
+};
+
+struct bench_pair {
+    uint32_t a, b;
+};
+
+static double
+bench_now (void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t
+bench_rand (uint32_t n)
+{
+    return (uint32_t)(((uint64_t)rand() << 31 | rand()) % n);
+}
+
+static int
+bench_vid_cmp (const void *a, const void *b)
+{
+    uint32_t va = *(const uint32_t *)a, vb = *(const uint32_t *)b;
+
+    return (va > vb) - (va < vb);
+}
+
+static inline uint32_t
+bench_degree (const struct bench_graph *graph, uint32_t vid)
+{
+    return graph->offsets[vid + 1] - graph->offsets[vid];
+}
+
+/* Preferential attachment, then both directions sorted without repeats */
+static int
+bench_build (struct bench_graph *graph, uint32_t n, uint32_t m)
+{
+    uint32_t *ends, *fill, nr_ends = 0, vid, edge, peer, idx, start, end, nr_peers = 0;
+    size_t nr_edges = (size_t)n * m;
+
+    ends = malloc(2 * nr_edges * sizeof(uint32_t));
+    fill = calloc(n + 1, sizeof(uint32_t));
+    graph->nr = n;
+    graph->offsets = calloc(n + 1, sizeof(uint32_t));
+    graph->peers = malloc(2 * nr_edges * sizeof(uint32_t));
+    if (!ends || !fill || !graph->offsets || !graph->peers) {
+        return -1;
+    }
+
+    /* A pair of ends per edge, a random end is a degree weighted user */
+    for (vid = 1; vid < n; vid++) {
+        for (edge = 0; edge < m; edge++) {
+            peer = nr_ends ? ends[bench_rand(nr_ends)] : 0;
+            if (peer == vid) {
+                peer = bench_rand(vid);
+            }
+            ends[nr_ends++] = vid;
+            ends[nr_ends++] = peer;
+        }
+    }
+
+    for (idx = 0; idx < nr_ends; idx++) {
+        graph->offsets[ends[idx] + 1]++;
+    }
+    for (vid = 0; vid < n; vid++) {
+        graph->offsets[vid + 1] += graph->offsets[vid];
+    }
+    for (idx = 0; idx < nr_ends; idx += 2) {
+        graph->peers[graph->offsets[ends[idx]] + fill[ends[idx]]++] = ends[idx + 1];
+        graph->peers[graph->offsets[ends[idx + 1]] + fill[ends[idx + 1]]++] = ends[idx];
+    }
+
+    /* Compacted in place, offsets[vid + 1] is still the old end */
+    for (start = vid = 0; vid < n; vid++, start = end) {
+        end = graph->offsets[vid + 1];
+        qsort(&graph->peers[start], end - start, sizeof(uint32_t), bench_vid_cmp);
+        graph->offsets[vid] = nr_peers;
+        for (idx = start; idx < end; idx++) {
+            if (idx == start || graph->peers[nr_peers - 1] != graph->peers[idx]) {
+                graph->peers[nr_peers++] = graph->peers[idx];
+            }
+        }
+    }
+    graph->offsets[n] = nr_peers;
+
+    free(ends);
+    free(fill);
+    return 0;
+}
+
+static int
+bench_kernels (const struct bench_graph *graph, int queries)
+{
+    struct bench_pair *pairs;
+    uint32_t u, f, c, nr_pairs = 0, *counts, idx;
+    uint64_t work = 0;
+    double start, t_scalar, t_avx2 = 0, t_dispatch;
+    int mismatch = 0;
+
+    pairs = malloc(BENCH_MAX_PAIRS * sizeof(struct bench_pair));
+    counts = malloc(BENCH_MAX_PAIRS * sizeof(uint32_t));
+    if (!pairs || !counts) {
+        return -1;
+    }
+
+    while (nr_pairs < BENCH_MAX_PAIRS && queries--) {
+        u = bench_rand(graph->nr);
+        for (idx = 0; idx < 64 && nr_pairs < BENCH_MAX_PAIRS; idx++) {
+            f = graph->peers[graph->offsets[u] + bench_rand(bench_degree(graph, u))];
+            c = graph->peers[graph->offsets[f] + bench_rand(bench_degree(graph, f))];
+            pairs[nr_pairs].a = u;
+            pairs[nr_pairs++].b = c;
+            work += bench_degree(graph, u) + bench_degree(graph, c);
+        }
+    }
+
+#define BENCH_PAIR(fn, p)                                               \
+    fn(&graph->peers[graph->offsets[(p).a]], bench_degree(graph, (p).a), \
+       &graph->peers[graph->offsets[(p).b]], bench_degree(graph, (p).b))
+
+    start = bench_now();
+    for (idx = 0; idx < nr_pairs; idx++) {
+        counts[idx] = BENCH_PAIR(gweb_suggest_intersect_scalar, pairs[idx]);
+    }
+    t_scalar = bench_now() - start;
+
+#ifdef GWEB_SUGGEST_AVX2
+    if (strcmp(gweb_suggest_kernel(), "avx2") == 0) {
+        start = bench_now();
+        for (idx = 0; idx < nr_pairs; idx++) {
+            mismatch += (BENCH_PAIR(gweb_suggest_intersect_avx2, pairs[idx]) !=
+                         counts[idx]);
+        }
+        t_avx2 = bench_now() - start;
+    }
+#endif
+
+    start = bench_now();
+    for (idx = 0; idx < nr_pairs; idx++) {
+        mismatch += (BENCH_PAIR(gweb_suggest_intersect, pairs[idx]) != counts[idx]);
+    }
+    t_dispatch = bench_now() - start;
+
+#undef BENCH_PAIR
+
+    printf("%u intersections, %.1f ids each on average\n", nr_pairs,
+           (double)work / nr_pairs);
+    printf("  scalar merge     %8.1f ns/pair\n", t_scalar * 1e9 / nr_pairs);
+    if (t_avx2 > 0) {
+        printf("  avx2 blocks      %8.1f ns/pair\n", t_avx2 * 1e9 / nr_pairs);
+    } else {
+        printf("  avx2 blocks      not available\n");
+    }
+    printf("  dispatch         %8.1f ns/pair (%s, galloping when skewed)\n",
+           t_dispatch * 1e9 / nr_pairs, gweb_suggest_kernel());
+    printf("  count mismatches: %d\n", mismatch);
+
+    free(pairs);
+    free(counts);
+    return mismatch ? -1 : 0;
+}
+
+/* Every path u - f - c counted, the way a GROUP BY over a self-join does */
+static int
+bench_count_paths (const struct bench_graph *graph, uint32_t u, uint32_t *counts,
+                   uint32_t *touched, struct gweb_suggestion *top, int k)
+{
+    uint32_t idx, jdx, f, c, nr_touched = 0;
+    int nr = 0, pos;
+
+    for (idx = graph->offsets[u]; idx < graph->offsets[u + 1]; idx++) {
+        f = graph->peers[idx];
+        for (jdx = graph->offsets[f]; jdx < graph->offsets[f + 1]; jdx++) {
+            c = graph->peers[jdx];
+            if (counts[c]++ == 0) {
+                touched[nr_touched++] = c;
+            }
+        }
+    }
+    counts[u] = 0;
+    for (idx = graph->offsets[u]; idx < graph->offsets[u + 1]; idx++) {
+        counts[graph->peers[idx]] = 0;
+    }
+
+    /* Insertion into a sorted top k, as a LIMIT would keep */
+    for (idx = 0; idx < nr_touched; idx++) {
+        c = touched[idx];
+        if (counts[c] == 0 || (nr == k && counts[c] <= top[k - 1].mutual)) {
+            continue;
+        }
+        for (pos = (nr < k) ? nr++ : k - 1;
+             pos > 0 && top[pos - 1].mutual < counts[c]; pos--) {
+            top[pos] = top[pos - 1];
+        }
+        top[pos].vid = c;
+        top[pos].mutual = counts[c];
+    }
+    return nr;
+}
+
+static int
+bench_rank (const struct bench_graph *graph, int queries, int k)
+{
+    struct gweb_suggest_graph view = { graph->nr, graph->offsets, graph->peers };
+    struct gweb_suggestion *top, *paths;
+    uint32_t *counts, *touched, u, idx;
+    double start, t, t_rank = 0, t_paths = 0, max_rank = 0, max_paths = 0;
+    int q, nr, nr_paths, mismatch = 0, empty = 0;
+
+    top = malloc(k * sizeof(struct gweb_suggestion));
+    paths = malloc(k * sizeof(struct gweb_suggestion));
+    counts = calloc(graph->nr, sizeof(uint32_t));
+    touched = malloc(graph->nr * sizeof(uint32_t));
+    if (!top || !paths || !counts || !touched) {
+        return -1;
+    }
+
+    for (q = 0; q < queries; q++) {
+        u = bench_rand(graph->nr);
+
+        start = bench_now();
+        nr = gweb_suggest_rank(&view, u, &graph->peers[graph->offsets[u]],
+                               bench_degree(graph, u), top, k);
+        t = bench_now() - start;
+        t_rank += t;
+        max_rank = (t > max_rank) ? t : max_rank;
+
+        start = bench_now();
+        nr_paths = bench_count_paths(graph, u, counts, touched, paths, k);
+        t = bench_now() - start;
+        t_paths += t;
+        max_paths = (t > max_paths) ? t : max_paths;
+
+        if (nr < 0) {
+            return -1;
+        }
+        empty += (nr == 0);
+
+        /* Candidates past the fanout bound may differ, counts may not */
+        for (idx = 0; idx < nr; idx++) {
+            mismatch += (top[idx].mutual != counts[top[idx].vid]);
+        }
+        mismatch += (nr_paths && nr && paths[0].mutual < top[0].mutual);
+
+        memset(counts, 0, graph->nr * sizeof(uint32_t));
+    }
+
+    printf("%d rankings, top %d, %d with no suggestion\n", queries, k, empty);
+    printf("  intersect + heap %8.3f ms/query, max %.3f ms\n",
+           t_rank * 1e3 / queries, max_rank * 1e3);
+    printf("  count all paths  %8.3f ms/query, max %.3f ms\n",
+           t_paths * 1e3 / queries, max_paths * 1e3);
+    printf("  mutual count mismatches: %d\n", mismatch);
+
+    free(top);
+    free(paths);
+    free(counts);
+    free(touched);
+    return mismatch ? -1 : 0;
+}
+
+int main (int argc, char *argv[])
+{
+    struct bench_graph graph;
+    int idx, n = 1000000, m = 8, queries = 1000, k = 20;
+    uint32_t vid, max_degree = 0;
+    double start;
+
+    for (idx = 1; idx < argc; idx++) {
+        if (strcmp(argv[idx], "-n") == 0 && idx + 1 < argc) {
+            n = atoi(argv[++idx]);
+        } else if (strcmp(argv[idx], "-m") == 0 && idx + 1 < argc) {
+            m = atoi(argv[++idx]);
+        } else if (strcmp(argv[idx], "-q") == 0 && idx + 1 < argc) {
+            queries = atoi(argv[++idx]);
+        } else if (strcmp(argv[idx], "-k") == 0 && idx + 1 < argc) {
+            k = atoi(argv[++idx]);
+        } else {
+            fprintf(stderr, "usage: %s [-n users] [-m connections] [-q queries] "
+                    "[-k suggestions]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    if (n <= 1 || m <= 0 || queries <= 0 || k <= 0) {
+        return -1;
+    }
+
+    srand(1);
+    start = bench_now();
+    if (bench_build(&graph, n, m) < 0) {
+        fprintf(stderr, "unable to allocate memory!\n");
+        return -1;
+    }
+    for (vid = 0; vid < graph.nr; vid++) {
+        if (bench_degree(&graph, vid) > max_degree) {
+            max_degree = bench_degree(&graph, vid);
+        }
+    }
+    printf("%d users, %u connections, max %u per user, built in %.1f s\n",
+           n, graph.offsets[n] / 2, max_degree, bench_now() - start);
+
+    if (bench_kernels(&graph, queries * 10) < 0 ||
+        bench_rank(&graph, queries, k) < 0) {
+        return -1;
+    }
+    return 0;
+}
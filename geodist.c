@@ -0,0 +1,181 @@
+/*
+ * Great-circle distance kernels
+ *
+ * Distances use the haversine formula on a spherical earth:
+ *
+ *   hav = sin^2(dlat/2) + cos(lat0) cos(lat) sin^2(dlon/2)
+ *   d   = 2 R asin(sqrt(hav))
+ *
+ * hav grows with d, so a radius filter compares hav against the term
+ * of the radius and asin is left to the points that pass. The batch
+ * kernel works on separate latitude/longitude arrays; the AVX2 variant
+ * handles four points per step with polynomial sin/cos, accurate to
+ * about 1e-7 relative (worst near the poles), so callers filter with
+ * some slack and recheck with gweb_geodist().
+ */
+#define _GNU_SOURCE
+#include <math.h>
+
+#include <gweb/geodist.h>
+
+#ifdef GWEB_GEODIST_AVX2
+#include <immintrin.h>
+#endif
+
+#define DEG2RAD     (M_PI / 180)
+
+double
+gweb_geodist (double lat1, double lon1, double lat2, double lon2)
+{
+    double slat = sin((lat2 - lat1) * DEG2RAD / 2);
+    double slon = sin((lon2 - lon1) * DEG2RAD / 2);
+
+    return gweb_geodist_from_hav(slat * slat + cos(lat1 * DEG2RAD) *
+                                 cos(lat2 * DEG2RAD) * slon * slon);
+}
+
+/* Haversine term of a distance, 1 past the antipode */
+double
+gweb_geodist_hav (double distance)
+{
+    double half = distance / (2 * GWEB_GEO_EARTH_RADIUS);
+
+    if (half >= M_PI / 2) {
+        return 1;
+    }
+    return sin(half) * sin(half);
+}
+
+double
+gweb_geodist_from_hav (double hav)
+{
+    if (hav > 1) {
+        hav = 1;
+    }
+    return 2 * GWEB_GEO_EARTH_RADIUS * asin(sqrt(hav));
+}
+
+void
+gweb_geodist_hav_scalar (double lat0, double lon0, const double *lat,
+                         const double *lon, double *hav, int n)
+{
+    double cos0 = cos(lat0 * DEG2RAD), slat, slon;
+    int idx;
+
+    for (idx = 0; idx < n; idx++) {
+        slat = sin((lat[idx] - lat0) * DEG2RAD / 2);
+        slon = sin((lon[idx] - lon0) * DEG2RAD / 2);
+        hav[idx] = slat * slat + cos0 * cos(lat[idx] * DEG2RAD) * slon * slon;
+    }
+}
+
+#ifdef GWEB_GEODIST_AVX2
+
+#define GWEB_AVX2   __attribute__((target("avx2,fma")))
+
+/* sin(x), |x| <= pi/2, Taylor series to x^13 */
+static inline GWEB_AVX2 __m256d
+gweb_geodist_sin_pd (__m256d x)
+{
+    __m256d x2 = _mm256_mul_pd(x, x);
+    __m256d p = _mm256_set1_pd(1.0 / 6227020800.0);
+
+    p = _mm256_fmadd_pd(p, x2, _mm256_set1_pd(-1.0 / 39916800.0));
+    p = _mm256_fmadd_pd(p, x2, _mm256_set1_pd(1.0 / 362880.0));
+    p = _mm256_fmadd_pd(p, x2, _mm256_set1_pd(-1.0 / 5040.0));
+    p = _mm256_fmadd_pd(p, x2, _mm256_set1_pd(1.0 / 120.0));
+    p = _mm256_fmadd_pd(p, x2, _mm256_set1_pd(-1.0 / 6.0));
+    p = _mm256_fmadd_pd(p, x2, _mm256_set1_pd(1.0));
+
+    return _mm256_mul_pd(p, x);
+}
+
+/* cos(x), |x| <= pi/2, Taylor series to x^14 */
+static inline GWEB_AVX2 __m256d
+gweb_geodist_cos_pd (__m256d x)
+{
+    __m256d x2 = _mm256_mul_pd(x, x);
+    __m256d p = _mm256_set1_pd(-1.0 / 87178291200.0);
+
+    p = _mm256_fmadd_pd(p, x2, _mm256_set1_pd(1.0 / 479001600.0));
+    p = _mm256_fmadd_pd(p, x2, _mm256_set1_pd(-1.0 / 3628800.0));
+    p = _mm256_fmadd_pd(p, x2, _mm256_set1_pd(1.0 / 40320.0));
+    p = _mm256_fmadd_pd(p, x2, _mm256_set1_pd(-1.0 / 720.0));
+    p = _mm256_fmadd_pd(p, x2, _mm256_set1_pd(1.0 / 24.0));
+    p = _mm256_fmadd_pd(p, x2, _mm256_set1_pd(-1.0 / 2.0));
+
+    return _mm256_fmadd_pd(p, x2, _mm256_set1_pd(1.0));
+}
+
+GWEB_AVX2 void
+gweb_geodist_hav_avx2 (double lat0, double lon0, const double *lat,
+                       const double *lon, double *hav, int n)
+{
+    const __m256d d2r_half = _mm256_set1_pd(DEG2RAD / 2);
+    const __m256d d2r = _mm256_set1_pd(DEG2RAD);
+    const __m256d half_pi = _mm256_set1_pd(M_PI / 2);
+    const __m256d pi = _mm256_set1_pd(M_PI);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    const __m256d vlat0 = _mm256_set1_pd(lat0);
+    const __m256d vlon0 = _mm256_set1_pd(lon0);
+    const __m256d cos0 = _mm256_set1_pd(cos(lat0 * DEG2RAD));
+    __m256d vlat, vlon, slat, slon, h;
+    int idx;
+
+    for (idx = 0; idx + 4 <= n; idx += 4) {
+        vlat = _mm256_loadu_pd(&lat[idx]);
+        vlon = _mm256_loadu_pd(&lon[idx]);
+
+        /* |dlat/2| <= pi/2 for latitudes in range */
+        slat = gweb_geodist_sin_pd(_mm256_mul_pd(_mm256_sub_pd(vlat, vlat0),
+                                                 d2r_half));
+
+        /* sin^2 is symmetric about pi/2, fold |dlon/2| into [0, pi/2] */
+        h = _mm256_andnot_pd(sign, _mm256_mul_pd(_mm256_sub_pd(vlon, vlon0),
+                                                 d2r_half));
+        h = _mm256_min_pd(h, _mm256_sub_pd(pi, h));
+        slon = gweb_geodist_sin_pd(_mm256_min_pd(h, half_pi));
+
+        slon = _mm256_mul_pd(_mm256_mul_pd(slon, slon),
+                             _mm256_mul_pd(cos0,
+                                           gweb_geodist_cos_pd(_mm256_mul_pd(vlat, d2r))));
+        _mm256_storeu_pd(&hav[idx], _mm256_fmadd_pd(slat, slat, slon));
+    }
+
+    gweb_geodist_hav_scalar(lat0, lon0, &lat[idx], &lon[idx], &hav[idx], n - idx);
+}
+
+#endif /* GWEB_GEODIST_AVX2 */
+
+typedef void (*gweb_geodist_fn) (double, double, const double *, const double *,
+                                 double *, int);
+
+static gweb_geodist_fn
+gweb_geodist_select (void)
+{
+#ifdef GWEB_GEODIST_AVX2
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return gweb_geodist_hav_avx2;
+    }
+#endif
+    return gweb_geodist_hav_scalar;
+}
+
+void
+gweb_geodist_hav_batch (double lat0, double lon0, const double *lat,
+                        const double *lon, double *hav, int n)
+{
+    static gweb_geodist_fn kernel;
+
+    /* Racing threads pick the same kernel */
+    if (kernel == NULL) {
+        kernel = gweb_geodist_select();
+    }
+    kernel(lat0, lon0, lat, lon, hav, n);
+}
+
+const char *
+gweb_geodist_kernel (void)
+{
+    return (gweb_geodist_select() == gweb_geodist_hav_scalar) ? "scalar" : "avx2";
+}
@@ -6,6 +6,44 @@ struct mysql_config {
     const char *username;
     const char *password;
     const char *database;
+
+    /* Connection pool, 0 picks the default */
+    int pool_min;
+    int pool_max;
+    int pool_wait_ms;
+    int pool_validate_secs;
+
+    /* Location write-behind, 0 picks the default */
+    int location_flush_ms;
+    int location_flush_rows;
+
+    /* User card cache entries, 0 picks the default, -1 disables */
+    int card_cache_size;
+
+    /* Profile cache bound and TTL, 0 picks the default, -1 disables */
+    int profile_cache_bytes;
+    int profile_cache_ttl_secs;
+
+    /* Suggestion cache entries and TTL, 0 picks the default, -1 disables */
+    int suggest_cache_size;
+    int suggest_cache_ttl_secs;
+
+    /* Connect preference cache entries and TTL, 0 picks the default, -1 disables */
+    int pref_cache_size;
+    int pref_cache_ttl_secs;
+
+    /*
+     * Read replicas, "role": "replica" entries of db_config. Only the
+     * server, credentials and pool settings of a replica are used.
+     */
+    struct mysql_config *replicas;
+    int nr_replicas;
+
+    /* Read-your-writes window, 0 picks the default, -1 disables */
+    int pin_secs;
+
+    /* Slow query log threshold, 0 picks the default, -1 disables */
+    int slow_query_ms;
 };
 
 struct avatardb_config {
@@ -21,5 +59,6 @@ extern int config_load_dotrc (const char *config_file);
 
 extern struct avatardb_config *config_load_avatardb (void);
 extern struct mysql_config *config_load_mysqldb (void);
+extern const char *config_load_storage (void);
 
 #endif /* CONFIG_H */
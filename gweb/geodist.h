@@ -0,0 +1,31 @@
+#ifndef GEODIST_H
+#define GEODIST_H
+
+/* Mean earth radius, distances are great-circle in meters */
+#define GWEB_GEO_EARTH_RADIUS       (6371008.8)
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#  define GWEB_GEODIST_AVX2
+#endif
+
+extern double gweb_geodist (double lat1, double lon1, double lat2, double lon2);
+extern double gweb_geodist_hav (double distance);
+extern double gweb_geodist_from_hav (double hav);
+
+/*
+ * Haversine term of (lat0, lon0) to each of n points given as
+ * separate latitude and longitude arrays, in degrees. Picks the AVX2
+ * kernel when the CPU has it.
+ */
+extern void gweb_geodist_hav_batch (double lat0, double lon0, const double *lat,
+                                    const double *lon, double *hav, int n);
+extern const char *gweb_geodist_kernel (void);
+
+extern void gweb_geodist_hav_scalar (double lat0, double lon0, const double *lat,
+                                     const double *lon, double *hav, int n);
+#ifdef GWEB_GEODIST_AVX2
+extern void gweb_geodist_hav_avx2 (double lat0, double lon0, const double *lat,
+                                   const double *lon, double *hav, int n);
+#endif
+
+#endif // GEODIST_H
@@ -0,0 +1,43 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+
+/* FNV-1a, for bucketing short string keys such as UIDs */
+static inline uint32_t gweb_hash_string (const char *str)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*str) {
+        hash ^= (unsigned char)*str++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* 64-bit FNV-1a, wide enough to stand in for the key in a set */
+static inline uint64_t gweb_hash64_string (const char *str)
+{
+    uint64_t hash = 14695981039346656037ull;
+
+    while (*str) {
+        hash ^= (unsigned char)*str++;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+/* Same, ASCII case folded, for keys MySQL compares case-insensitively */
+static inline uint64_t gweb_hash64_string_nocase (const char *str)
+{
+    uint64_t hash = 14695981039346656037ull;
+    unsigned char ch;
+
+    while ((ch = (unsigned char)*str++) != 0) {
+        hash ^= (ch >= 'A' && ch <= 'Z') ? ch + ('a' - 'A') : ch;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+#endif // HASH_H
@@ -0,0 +1,22 @@
+#ifndef HASHSET_H
+#define HASHSET_H
+
+#include <stdint.h>
+
+/*
+ * Open addressed set of 64-bit key hashes, 8 bytes a member. Callers
+ * serialize access. A hit may be a hash collision, at 1M members the
+ * odds of one for a given lookup are about 1 in 10^13.
+ */
+struct gweb_hashset {
+    uint64_t *slots;
+    unsigned int mask;
+    unsigned int nr_members;
+};
+
+extern int gweb_hashset_init (struct gweb_hashset *set, unsigned int hint);
+extern void gweb_hashset_free (struct gweb_hashset *set);
+extern int gweb_hashset_add (struct gweb_hashset *set, uint64_t hash);
+extern int gweb_hashset_contains (const struct gweb_hashset *set, uint64_t hash);
+
+#endif // HASHSET_H
@@ -0,0 +1,134 @@
+#ifndef JSON_MAP_H
+#define JSON_MAP_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <gweb/json_api.h>
+
+/*
+ * JSON C map for each of the REST APIs to parse JSON message and push
+ * DB updates. Table and lookups are generated from the API schema,
+ * see schema/gweb_api.schema.
+ */
+struct json_map_info {
+    const char *api_name;
+    const char *get_url;
+
+    /* JSON-C APIs */
+    int (*api_handler) (struct json_object *, j2c_msg_t *);
+    int (*api_get_handler) (void *, j2c_msg_t *);
+    int (*api_resp_handler) (j2c_resp_t *, char **);
+    void (*api_dump_handler) (j2c_msg_t *);
+    void (*api_free_handler) (j2c_msg_t *);
+
+    /* JSON-DB APIs */
+    int api_read_only;          /* may run on a read replica */
+    const char *(*api_key) (const j2c_msg_t *);  /* UID or email, may be NULL */
+    int api_db_op;              /* GWEB_STORAGE_OP_*, see gweb/storage.h */
+    int (*api_db_resp_free) (j2c_resp_t *);
+};
+
+extern const struct json_map_info *gweb_json_lookup_api (const char *api_name);
+extern const struct json_map_info *gweb_json_lookup_get_url (const char *url);
+
+/*
+ * Response buffer used by the generated serializers. Starts at
+ * MAX_RESPONSE_BYTES and grows as needed, the higher POST responder
+ * frees it.
+ */
+#define MAX_RESPONSE_BYTES (2048)
+
+struct json_gen_buf {
+    char *buf;
+    int   len;
+    int   size;
+    int   err;
+};
+
+static inline const char *
+json_gen_get_string (struct json_object *jobj, const char *key)
+{
+    struct json_object *jfield;
+
+    if (!json_object_object_get_ex(jobj, key, &jfield) ||
+        json_object_get_array(jfield) != NULL) {
+        return NULL;
+    }
+
+    return json_object_get_string(jfield);
+}
+
+static inline int
+json_gen_buf_init (struct json_gen_buf *jbuf, int size)
+{
+    jbuf->len = jbuf->err = 0;
+    jbuf->size = size;
+    jbuf->buf = malloc(size);
+
+    return (jbuf->buf == NULL);
+}
+
+static inline void
+json_gen_push (struct json_gen_buf *jbuf, const char *str, int len)
+{
+    char *buf;
+    int size;
+
+    if (jbuf->err) {
+        return;
+    }
+
+    if (jbuf->len + len + 1 > jbuf->size) {
+        for (size = jbuf->size * 2; jbuf->len + len + 1 > size; size *= 2);
+        if ((buf = realloc(jbuf->buf, size)) == NULL) {
+            jbuf->err = 1;
+            return;
+        }
+        jbuf->buf = buf;
+        jbuf->size = size;
+    }
+
+    memcpy(jbuf->buf + jbuf->len, str, len);
+    jbuf->len += len;
+}
+
+/* Push "key":"val", -- prefix carries "key":" */
+static inline void
+json_gen_push_field (struct json_gen_buf *jbuf, const char *prefix, int plen,
+                     const char *val)
+{
+    if (val == NULL) {
+        return;
+    }
+
+    json_gen_push(jbuf, prefix, plen);
+    json_gen_push(jbuf, val, strlen(val));
+    json_gen_push(jbuf, "\",", 2);
+}
+
+static inline void
+json_gen_trim_comma (struct json_gen_buf *jbuf)
+{
+    if (!jbuf->err && jbuf->len && jbuf->buf[jbuf->len-1] == ',') {
+        jbuf->len--;
+    }
+}
+
+static inline int
+json_gen_buf_finish (struct json_gen_buf *jbuf, char **response)
+{
+    json_gen_push(jbuf, "", 1);
+
+    if (jbuf->err) {
+        free(jbuf->buf);
+        *response = NULL;
+        return 1;
+    }
+
+    *response = jbuf->buf;
+
+    return 0;
+}
+
+#endif // JSON_MAP_H
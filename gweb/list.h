@@ -1,10 +1,15 @@
 #ifndef LIST_H
 #define LIST_H
 
+#include <stddef.h>
+
 struct list {
     struct list *next, *prev;
 };
 
+#define list_entry(ptr, type, member)                           \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
 static inline void list_init (struct list *head)
 {
     head->next = head->prev = head;
@@ -25,4 +30,9 @@ static inline void list_remove (struct list *node)
     node->prev = node->next = node;
 }
 
+static inline int list_empty (const struct list *head)
+{
+    return head->next == head;
+}
+
 #endif // LIST_H
@@ -0,0 +1,49 @@
+#ifndef LRU_H
+#define LRU_H
+
+#include <stddef.h>
+
+/*
+ * Bounded LRU map of string keys to values owned by the cache, split
+ * in GWEB_LRU_SHARDS shards each with its own lock. Besides the entry
+ * count, a cache may bound the bytes charged by its values and the
+ * age of its entries (0 for no bound). A NULL cache is a disabled
+ * one: lookups miss and stored values are freed.
+ */
+#define GWEB_LRU_SHARDS             (16)
+#define GWEB_LRU_KEYSZ              (64)
+
+struct gweb_lru;
+
+struct gweb_lru_stats {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long inserts;
+    unsigned long evictions;
+    unsigned long invalidations;
+    unsigned long expirations;
+    int entries;
+    int capacity;
+    size_t bytes;
+    size_t max_bytes;
+};
+
+extern struct gweb_lru *gweb_lru_create (int capacity, size_t max_bytes,
+                                         int ttl_secs, void (*free_value)(void *));
+extern void gweb_lru_destroy (struct gweb_lru *lru);
+
+/*
+ * On a hit, copy() runs on the value under the shard lock and 1 is
+ * returned. On a miss, *gen is set for the gweb_lru_put() that fills
+ * the entry: the value is dropped if the key was invalidated since.
+ */
+extern int gweb_lru_get (struct gweb_lru *lru, const char *key,
+                         void (*copy)(const void *value, void *arg), void *arg,
+                         unsigned long *gen);
+extern void gweb_lru_put (struct gweb_lru *lru, const char *key, void *value,
+                          size_t charge, unsigned long gen);
+extern void gweb_lru_invalidate (struct gweb_lru *lru, const char *key);
+extern void gweb_lru_stats (struct gweb_lru *lru, struct gweb_lru_stats *stats,
+                            int reset);
+
+#endif // LRU_H
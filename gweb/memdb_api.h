@@ -0,0 +1,55 @@
+#ifndef MEMDB_API_H
+#define MEMDB_API_H
+
+#include <gweb/json_struct.h>
+
+struct gweb_memdb;
+
+/* Buckets of each hash table, a power of 2 */
+#define GWEB_MEMDB_HASH_SIZE    (65536)
+
+/*
+ * In-memory storage APIs, same requests and responses as the MySQL
+ * ones (gweb/mysqldb_api.h)
+ */
+extern int gweb_memdb_handle_registration (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                                           j2c_resp_t **j2cresp);
+extern int gweb_memdb_handle_login (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                                    j2c_resp_t **j2cresp);
+extern int gweb_memdb_handle_profile (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                                      j2c_resp_t **j2cresp);
+extern int gweb_memdb_handle_avatar (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                                     j2c_resp_t **j2cresp);
+extern int gweb_memdb_handle_cxn_request (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                                          j2c_resp_t **j2cresp);
+extern int gweb_memdb_handle_cxn_channel (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                                          j2c_resp_t **j2cresp);
+extern int gweb_memdb_handle_cxn_request_query (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                                                j2c_resp_t **j2cresp);
+extern int gweb_memdb_handle_cxn_channel_query (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                                                j2c_resp_t **j2cresp);
+extern int gweb_memdb_handle_uid_query (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                                        j2c_resp_t **j2cresp);
+extern int gweb_memdb_handle_profile_query (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                                            j2c_resp_t **j2cresp);
+extern int gweb_memdb_handle_avatar_query (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                                           j2c_resp_t **j2cresp);
+extern int gweb_memdb_handle_cxn_preference (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                                             j2c_resp_t **j2cresp);
+extern int gweb_memdb_handle_cxn_preference_query (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                                                   j2c_resp_t **j2cresp);
+extern int gweb_memdb_handle_location (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                                       j2c_resp_t **j2cresp);
+extern int gweb_memdb_handle_location_query (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                                             j2c_resp_t **j2cresp);
+extern int gweb_memdb_handle_neighbour_query (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                                              j2c_resp_t **j2cresp);
+extern int gweb_memdb_handle_suggestions_query (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                                                j2c_resp_t **j2cresp);
+extern int gweb_memdb_handle_stats_query (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                                          j2c_resp_t **j2cresp);
+
+extern int gweb_memdb_init (void);
+extern int gweb_memdb_shutdown (void);
+
+#endif // MEMDB_API_H
@@ -1,35 +1,109 @@
 #ifndef MYSQLDB_API_H
 #define MYSQLDB_API_H
 
+#include <stddef.h>
+#include <ctype.h>
+
 #include <gweb/json_struct.h>
 
 #define MAX_MYSQL_QRYSZ    1024
 
+struct gweb_mysql_conn;
+
 /* MySQL transaction error code */
 enum {
     MYSQL_STATUS_OK = 0,
     MYSQL_STATUS_FAIL = 1,
 };
 
+/*
+ * Response status, mapped to the code and description of the response
+ * by gweb_mysql_update_response(). Shared by the storage backends.
+ */
+enum {
+    GWEB_MYSQL_ERR_NO_RECORD = 1,
+    GWEB_MYSQL_ERR_NO_MEMORY,
+    GWEB_MYSQL_ERR_UNKNOWN,
+    GWEB_MYSQL_ERR_DUPLICATE,
+    GWEB_MYSQL_ERR_INVALID,
+    GWEB_MYSQL_OK,
+};
+
+#define MAX_DATETIME_STRSZ   (20)
+
+/* Rows per page of the list APIs */
+#define MYSQL_MAX_CXN_REQUEST_ROWS_PER_QUERY      (20)
+#define MYSQL_MAX_CXN_CHANNEL_ROWS_PER_QUERY      (20)
+#define MYSQL_MAX_CXN_PREFERENCE_ROWS_PER_QUERY   (20)
+#define MYSQL_MAX_NEIGHBOUR_ROWS_PER_QUERY        (20)
+#define MYSQL_MAX_SUGGESTION_ROWS_PER_QUERY       (20)
+
+/* Location defaults when the request leaves them out */
+#define GWEB_DEFAULT_GEO_LOCATION_EXPIRY   (3600) /* 1 hour */
+#define GWEB_DEFAULT_GEO_LOCATION_RADIUS   (500)  /* 500 meter radius */
+
+/* Keys sorting before any row, where the first page starts */
+#define GWEB_CURSOR_MIN_DATE     "1000-01-01 00:00:00"
+#define GWEB_CURSOR_MIN_DISTANCE "-1"
+#define MAX_CURSOR_STRSZ         (256)
+
+/*
+ * Order of the case-insensitive column collations (ChannelId, Flags),
+ * ASCII compared upper cased, so '_' sorts after the letters. Labels
+ * equal under it are the same row to MySQL.
+ */
+static inline int
+gweb_mysql_ci_cmp (const char *a, const char *b)
+{
+    int ca, cb;
+
+    do {
+        ca = toupper((unsigned char)*a++);
+        cb = toupper((unsigned char)*b++);
+    } while (ca && ca == cb);
+
+    return ca - cb;
+}
+
 /*
  * MySQL APIs for queries
  */
-extern int gweb_mysql_handle_registration (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp);
-extern int gweb_mysql_handle_login (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp);
-extern int gweb_mysql_handle_profile (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp);
-extern int gweb_mysql_handle_avatar (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp);
-extern int gweb_mysql_handle_cxn_request (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp);
-extern int gweb_mysql_handle_cxn_channel (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp);
-extern int gweb_mysql_handle_cxn_request_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp);
-extern int gweb_mysql_handle_cxn_channel_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp);
-extern int gweb_mysql_handle_uid_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp);
-extern int gweb_mysql_handle_profile_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp);
-extern int gweb_mysql_handle_avatar_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp);
-extern int gweb_mysql_handle_cxn_preference (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp);
-extern int gweb_mysql_handle_cxn_preference_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp);
-extern int gweb_mysql_handle_location (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp);
-extern int gweb_mysql_handle_location_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp);
-extern int gweb_mysql_handle_neighbour_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp);
+extern int gweb_mysql_handle_registration (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                                           j2c_resp_t **j2cresp);
+extern int gweb_mysql_handle_login (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                                    j2c_resp_t **j2cresp);
+extern int gweb_mysql_handle_profile (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                                      j2c_resp_t **j2cresp);
+extern int gweb_mysql_handle_avatar (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                                     j2c_resp_t **j2cresp);
+extern int gweb_mysql_handle_cxn_request (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                                          j2c_resp_t **j2cresp);
+extern int gweb_mysql_handle_cxn_channel (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                                          j2c_resp_t **j2cresp);
+extern int gweb_mysql_handle_cxn_request_query (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                                                j2c_resp_t **j2cresp);
+extern int gweb_mysql_handle_cxn_channel_query (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                                                j2c_resp_t **j2cresp);
+extern int gweb_mysql_handle_uid_query (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                                        j2c_resp_t **j2cresp);
+extern int gweb_mysql_handle_profile_query (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                                            j2c_resp_t **j2cresp);
+extern int gweb_mysql_handle_avatar_query (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                                           j2c_resp_t **j2cresp);
+extern int gweb_mysql_handle_cxn_preference (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                                             j2c_resp_t **j2cresp);
+extern int gweb_mysql_handle_cxn_preference_query (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                                                   j2c_resp_t **j2cresp);
+extern int gweb_mysql_handle_location (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                                       j2c_resp_t **j2cresp);
+extern int gweb_mysql_handle_location_query (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                                             j2c_resp_t **j2cresp);
+extern int gweb_mysql_handle_neighbour_query (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                                              j2c_resp_t **j2cresp);
+extern int gweb_mysql_handle_suggestions_query (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                                                j2c_resp_t **j2cresp);
+extern int gweb_mysql_handle_stats_query (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                                          j2c_resp_t **j2cresp);
 
 extern int gweb_mysql_free_registration (j2c_resp_t *j2cresp);
 extern int gweb_mysql_free_login (j2c_resp_t *j2cresp);
@@ -47,10 +121,22 @@ extern int gweb_mysql_free_cxn_preference_query (j2c_resp_t *j2cresp);
 extern int gweb_mysql_free_location (j2c_resp_t *j2cresp);
 extern int gweb_mysql_free_location_query (j2c_resp_t *j2cresp);
 extern int gweb_mysql_free_neighbour_query (j2c_resp_t *j2cresp);
+extern int gweb_mysql_free_suggestions_query (j2c_resp_t *j2cresp);
+extern int gweb_mysql_free_stats_query (j2c_resp_t *j2cresp);
+
+/* Response and page cursor helpers, also used by memdb.c */
+extern void gweb_get_utc_datetime (char *dtbuf);
+extern void gweb_mysql_prepare_response (int resp_type, int mysql_code,
+                                         j2c_resp_t **response);
+extern void gweb_mysql_update_response (int resp_type, int mysql_code,
+                                        j2c_resp_t **response);
+extern char *gweb_cursor_encode (int nr_keys, const char *keys[]);
+extern int gweb_cursor_decode (const char *token, char *buf, size_t bufsz,
+                               int nr_keys, const char *keys[]);
+
+extern int gweb_mysql_check_uid_email (struct gweb_mysql_conn *conn,
+                                       const char *uid_str, const char *email);
 
-extern int gweb_mysql_check_uid_email (const char *uid_str, const char *email);
-  
-extern int gweb_mysql_ping (void);
 extern int gweb_mysql_init (void);
 extern int gweb_mysql_shutdown (void);
 			   
@@ -0,0 +1,107 @@
+#ifndef MYSQLDB_CACHE_H
+#define MYSQLDB_CACHE_H
+
+#include <gweb/config.h>
+#include <gweb/lru.h>
+
+struct gweb_mysql_conn;
+struct gweb_graph_suggestion;
+
+/* Cache sizes, overridden from db_config */
+#define GWEB_CARD_CACHE_SIZE        (65536)
+#define GWEB_PROFILE_CACHE_BYTES    (32 << 20)
+#define GWEB_PROFILE_CACHE_TTL      (300)
+#define GWEB_SUGGEST_CACHE_SIZE     (16384)
+#define GWEB_SUGGEST_CACHE_TTL      (600)
+#define GWEB_PREF_CACHE_SIZE        (65536)
+#define GWEB_PREF_CACHE_TTL         (300)
+
+/* Users with more channel preferences are read from MySQL each time */
+#define GWEB_PREF_CACHE_MAX_CHANNELS (64)
+
+/* ChannelId and ChannelFlags are VARCHAR(16) */
+#define GWEB_CXN_PREF_NAMESZ        (24)
+
+/* Name and avatar shown for a UID in lists, fields may be NULL */
+struct gweb_user_card {
+    char *fname;
+    char *lname;
+    char *avatar_url;
+};
+
+/* Connect preferences of a UID, in ChannelId order */
+struct gweb_cxn_pref {
+    char channel[GWEB_CXN_PREF_NAMESZ];
+    char flag[GWEB_CXN_PREF_NAMESZ];
+};
+
+struct gweb_cxn_prefs {
+    int nr;
+    struct gweb_cxn_pref prefs[];
+};
+
+extern int gweb_cache_init (struct mysql_config *cfg);
+extern void gweb_cache_shutdown (void);
+
+extern void gweb_user_card_free (struct gweb_user_card *card);
+
+/*
+ * Read-through: on a miss, read the row and hand it to put() with the
+ * generation returned here. Writers invalidate after they commit.
+ */
+extern int gweb_card_cache_get (const char *uid, struct gweb_user_card *card,
+                                unsigned long *gen);
+extern void gweb_card_cache_put (const char *uid, const char *fname,
+                                 const char *lname, const char *avatar_url,
+                                 unsigned long gen);
+extern void gweb_card_cache_invalidate (const char *uid);
+extern void gweb_card_cache_stats (struct gweb_lru_stats *stats, int reset);
+
+/*
+ * Assembled profile records by UID, as an array of nr_fields strings
+ * (NULL where unset). A hit fills fields with copies the caller frees.
+ */
+extern int gweb_profile_cache_get (const char *uid, char **fields, int nr_fields,
+                                   unsigned long *gen);
+extern void gweb_profile_cache_put (const char *uid, char *const *fields,
+                                    int nr_fields, unsigned long gen);
+extern void gweb_profile_cache_invalidate (const char *uid);
+extern void gweb_profile_cache_stats (struct gweb_lru_stats *stats, int reset);
+
+/*
+ * Ranked suggestions by UID, at most MYSQL_MAX_SUGGESTION_ROWS_PER_QUERY.
+ * Mostly bounded by the TTL: only the two UIDs of a new connection are
+ * invalidated, not those whose mutual counts it changes.
+ */
+extern int gweb_suggest_cache_get (const char *uid,
+                                   struct gweb_graph_suggestion *suggestions,
+                                   int *nr, unsigned long *gen);
+extern void gweb_suggest_cache_put (const char *uid,
+                                    const struct gweb_graph_suggestion *suggestions,
+                                    int nr, unsigned long gen);
+extern void gweb_suggest_cache_invalidate (const char *uid);
+extern void gweb_suggest_cache_stats (struct gweb_lru_stats *stats, int reset);
+
+/*
+ * Connect preferences by UID, read on every accepted request. A hit
+ * sets prefs to a copy the caller frees. Dropped by the preference
+ * write handler once committed, and bounded by a TTL.
+ */
+extern int gweb_pref_cache_get (const char *uid, struct gweb_cxn_prefs **prefs,
+                                unsigned long *gen);
+extern void gweb_pref_cache_put (const char *uid, const struct gweb_cxn_prefs *prefs,
+                                 unsigned long gen);
+extern void gweb_pref_cache_invalidate (const char *uid);
+extern void gweb_pref_cache_stats (struct gweb_lru_stats *stats, int reset);
+
+/*
+ * Registered UIDs and emails. check returns 1 if the UID (or, when
+ * given, the email) is registered, 0 if neither is and -1 if the set
+ * was not loaded.
+ */
+extern int gweb_member_init (struct gweb_mysql_conn *conn);
+extern void gweb_member_add (const char *uid, const char *email);
+extern int gweb_member_check (const char *uid, const char *email);
+extern void gweb_member_stats (int *nr_uids, int *nr_emails);
+
+#endif // MYSQLDB_CACHE_H
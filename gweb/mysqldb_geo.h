@@ -0,0 +1,69 @@
+#ifndef MYSQLDB_GEO_H
+#define MYSQLDB_GEO_H
+
+#include <stdint.h>
+
+#include <gweb/uid.h>
+
+struct gweb_mysql_conn;
+
+/*
+ * Grid cells are GWEB_GEO_CELL_DEG a side (~1.1 km of latitude). A
+ * search needing more than GWEB_GEO_MAX_SCAN_CELLS is left to SQL.
+ */
+#define GWEB_GEO_CELL_DEG           (0.01)
+#define GWEB_GEO_MAX_SCAN_CELLS     (4096)
+#define GWEB_GEO_HASH_SIZE          (4096)
+
+/* Expired rows are deleted this often, or once this many expired */
+#define GWEB_GEO_REAP_SECS          (60)
+#define GWEB_GEO_REAP_ROWS          (1000)
+
+struct gweb_geo_match {
+    char uid[MAX_UID_STRSZ];
+    double latitude;
+    double longitude;
+    double distance;
+    int radius;                 /* lookups only */
+};
+
+/* Search candidates, latitudes and longitudes in separate arrays */
+struct gweb_geo_batch {
+    int nr, size;
+    char (*uid)[MAX_UID_STRSZ];
+    double *lat;
+    double *lon;
+};
+
+struct gweb_geo_bbox {
+    double min_lat, max_lat;
+    double min_lon, max_lon;
+};
+
+extern int gweb_geo_grid_init (struct gweb_mysql_conn *conn);
+extern void gweb_geo_grid_shutdown (void);
+
+extern int gweb_geo_reaper_init (void);
+extern void gweb_geo_reaper_shutdown (void);
+
+extern void gweb_geo_grid_update (const char *uid, double latitude,
+                                  double longitude, const char *seen,
+                                  int expiry, int radius);
+extern int gweb_geo_grid_lookup (const char *uid, struct gweb_geo_match *match);
+extern int gweb_geo_grid_neighbours (const char *uid, double latitude,
+                                     double longitude, double radius,
+                                     double after_distance, const char *after_uid,
+                                     struct gweb_geo_match *matches, int limit);
+
+extern int gweb_geo_valid (double latitude, double longitude);
+extern int gweb_geo_bbox (double latitude, double longitude, double radius,
+                          struct gweb_geo_bbox *box);
+extern int gweb_geo_batch_add (struct gweb_geo_batch *batch, const char *uid,
+                               double latitude, double longitude);
+extern int gweb_geo_batch_rank (struct gweb_geo_batch *batch, double latitude,
+                                double longitude, double radius,
+                                double after_distance, const char *after_uid,
+                                struct gweb_geo_match *matches, int limit);
+extern void gweb_geo_batch_free (struct gweb_geo_batch *batch);
+
+#endif // MYSQLDB_GEO_H
@@ -0,0 +1,85 @@
+#ifndef MYSQLDB_GRAPH_H
+#define MYSQLDB_GRAPH_H
+
+#include <gweb/mysqldb_api.h>
+
+struct gweb_mysql_conn;
+
+/* UIDs, request flags and channel ids (VARCHAR(16)) fit a name */
+#define GWEB_GRAPH_NAMESZ           (24)
+
+/* The delta log is merged this often, or once this long */
+#define GWEB_GRAPH_MERGE_SECS       (30)
+#define GWEB_GRAPH_MERGE_OPS        (4096)
+
+/* Connection requests, and channels between connected users */
+enum {
+    GWEB_GRAPH_REQUEST,
+    GWEB_GRAPH_CHANNEL,
+    GWEB_GRAPH_NR_KINDS,
+};
+
+/* Edges by FromUID, or by ToUID */
+enum {
+    GWEB_GRAPH_OUTBOUND,
+    GWEB_GRAPH_INBOUND,
+    GWEB_GRAPH_NR_DIRS,
+};
+
+/* A list row: the peer UID, SentOn/ConnectedOn and Flags/ChannelId */
+struct gweb_graph_match {
+    char uid[GWEB_GRAPH_NAMESZ];
+    char date[MAX_DATETIME_STRSZ];
+    char label[GWEB_GRAPH_NAMESZ];
+};
+
+extern int gweb_graph_init (struct gweb_mysql_conn *conn);
+extern void gweb_graph_shutdown (void);
+
+extern int gweb_graph_merger_init (void);
+extern void gweb_graph_merger_shutdown (void);
+
+/*
+ * Write hooks, called once the statements they mirror committed. A
+ * repeated request only updates the flag, an existing channel is kept
+ * and disconnect drops every channel from one UID to the other.
+ */
+extern void gweb_graph_request_set (const char *from_uid, const char *to_uid,
+                                    const char *sent, const char *flag);
+extern void gweb_graph_channel_set (const char *from_uid, const char *to_uid,
+                                    const char *connected, const char *channel);
+extern void gweb_graph_channel_disconnect (const char *from_uid, const char *to_uid);
+
+/*
+ * One page of a connection list, in the order and with the keyset of
+ * the CXN_*_LIST_* statements: rows after (after_date, after_uid
+ * [, after_label]) ordered by date, peer UID and label. after_label
+ * is NULL for requests, label filters on flag/channel when set.
+ * Returns the number of matches, or -1 when the graph can not answer
+ * and the caller goes to SQL.
+ */
+extern int gweb_graph_list (int kind, int dir, const char *uid, const char *label,
+                            const char *after_date, const char *after_uid,
+                            const char *after_label,
+                            struct gweb_graph_match *matches, int limit);
+
+/* A suggested UID and the number of connections it shares */
+struct gweb_graph_suggestion {
+    char uid[GWEB_GRAPH_NAMESZ];
+    int mutual;
+};
+
+/*
+ * People you may know: UIDs with a channel to a UID uid has a channel
+ * with, either way, ranked by the connections they share with uid
+ * (suggest.c). The connections of uid include writes not merged yet,
+ * those of the others are as of the last merge. Returns the number of
+ * suggestions, or -1 when the graph can not answer.
+ */
+extern int gweb_graph_suggestions (const char *uid,
+                                   struct gweb_graph_suggestion *suggestions,
+                                   int limit);
+
+extern void gweb_graph_stats (int *nr_uids, long *nr_edges, int *nr_pending);
+
+#endif // MYSQLDB_GRAPH_H
@@ -0,0 +1,36 @@
+#ifndef MYSQLDB_LOCATION_H
+#define MYSQLDB_LOCATION_H
+
+#include <stdint.h>
+
+#include <gweb/config.h>
+#include <gweb/uid.h>
+
+/* Write-behind defaults, overridden from db_config */
+#define GWEB_LOCATION_FLUSH_MS          (2000)
+#define GWEB_LOCATION_FLUSH_ROWS        (512)
+
+/* Pending UIDs beyond which updates are written through */
+#define GWEB_LOCATION_MAX_PENDING       (16384)
+
+#define GWEB_LOCATION_HASH_SIZE         (1024)
+#define GWEB_LOCATION_SEEN_STRSZ        (20)
+
+struct gweb_location {
+    char uid[MAX_UID_STRSZ];
+    double latitude;
+    double longitude;
+    char seen[GWEB_LOCATION_SEEN_STRSZ];
+    int expiry;
+    int radius;
+};
+
+extern int gweb_location_buffer_init (struct mysql_config *cfg);
+extern void gweb_location_buffer_shutdown (void);
+
+extern int gweb_location_buffer_put (const char *uid, double latitude,
+                                     double longitude, const char *seen,
+                                     int expiry, int radius);
+extern int gweb_location_buffer_get (const char *uid, struct gweb_location *loc);
+
+#endif // MYSQLDB_LOCATION_H
@@ -0,0 +1,110 @@
+#ifndef MYSQLDB_POOL_H
+#define MYSQLDB_POOL_H
+
+#include <time.h>
+
+#include <mysql.h>
+#include <errmsg.h>
+
+#include <gweb/list.h>
+#include <gweb/config.h>
+#include <gweb/mysqldb_api.h>
+#include <gweb/stmt_gen.h>
+
+/* Pool defaults, overridden from db_config */
+#define GWEB_MYSQL_POOL_MIN             (2)
+#define GWEB_MYSQL_POOL_MAX             (8)
+#define GWEB_MYSQL_POOL_WAIT_MS         (2000)
+#define GWEB_MYSQL_POOL_VALIDATE_SECS   (30)
+#define GWEB_MYSQL_POOL_MAX_BACKOFF     (60)
+
+/* Read-your-writes window and the number of keys it tracks */
+#define GWEB_MYSQL_PIN_SECS             (5)
+#define GWEB_MYSQL_PIN_SIZE             (65536)
+
+struct gweb_mysql_pool;
+
+/*
+ * Pooled MySQL connection, owned by a single thread between checkout
+ * and return.
+ */
+struct gweb_mysql_conn {
+    struct list node;           /* idle list */
+    struct gweb_mysql_pool *pool;
+    MYSQL *mysql;
+    time_t last_used;
+    int replica;                /* may lag behind the primary */
+
+    int in_txn;                 /* statements may not be replayed */
+    int broken;                 /* closed instead of returned to pool */
+
+    /* Slow query log, see mysqldb_slowlog.c */
+    const char *caller;         /* API handler it is checked out for */
+    char *explain;              /* plan query run on return to the pool */
+    const char *explain_name;
+
+    /* Prepared on first use, see mysqldb_stmt.c */
+    struct gweb_mysql_stmt *stmts[GWEB_STMT_MAX];
+};
+
+extern int gweb_mysql_pool_init (struct mysql_config *cfg);
+extern void gweb_mysql_pool_shutdown (void);
+
+struct gweb_mysql_pool_stats {
+    int nr_replicas;
+    int nr_healthy;
+    unsigned long reads_replica;
+    unsigned long reads_pinned;     /* on the primary, key written lately */
+    unsigned long reads_fallback;   /* on the primary, no replica available */
+};
+
+extern struct gweb_mysql_conn *gweb_mysql_pool_get (void);
+extern struct gweb_mysql_conn *gweb_mysql_pool_get_read (const char *key);
+extern void gweb_mysql_pool_put (struct gweb_mysql_conn *conn);
+extern void gweb_mysql_pool_stats (struct gweb_mysql_pool_stats *stats);
+
+extern void gweb_mysql_pin (const char *key);
+extern int gweb_mysql_pinned (const char *key);
+extern int gweb_mysql_conn_fresh (struct gweb_mysql_conn *conn, const char *key);
+
+extern int gweb_mysql_reconnect (struct gweb_mysql_conn *conn);
+extern int gweb_mysql_query (struct gweb_mysql_conn *conn, const char *qry);
+extern int gweb_mysql_query_template (struct gweb_mysql_conn *conn,
+                                      const char *tmpl, const char *qry);
+
+/* Atomic transactions -- depends on the backend storage engine
+ * (eg. InnoDB). Statements within are never replayed on a new
+ * connection, a lost connection fails the transaction.
+ */
+static inline void
+gweb_mysql_start_transaction (struct gweb_mysql_conn *conn)
+{
+    if (gweb_mysql_query(conn, "START TRANSACTION") == MYSQL_STATUS_OK) {
+        conn->in_txn = 1;
+    }
+}
+
+static inline void
+gweb_mysql_abort_transaction (struct gweb_mysql_conn *conn)
+{
+    gweb_mysql_query(conn, "ROLLBACK");
+    conn->in_txn = 0;
+}
+
+static inline int
+gweb_mysql_commit_transaction (struct gweb_mysql_conn *conn)
+{
+    int ret = gweb_mysql_query(conn, "COMMIT");
+
+    conn->in_txn = 0;
+    return ret;
+}
+
+/* Errors after which the connection is gone for good */
+static inline int
+gweb_mysql_conn_lost (unsigned int err)
+{
+    return (err == CR_SERVER_GONE_ERROR || err == CR_SERVER_LOST);
+}
+
+#endif // MYSQLDB_POOL_H
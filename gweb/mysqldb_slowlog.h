@@ -0,0 +1,63 @@
+#ifndef MYSQLDB_SLOWLOG_H
+#define MYSQLDB_SLOWLOG_H
+
+#include <time.h>
+
+#include <mysql.h>
+
+struct gweb_mysql_conn;
+struct mysql_config;
+
+/* Executions over this are logged, with the plan on first occurrence */
+#define GWEB_SLOWLOG_THRESHOLD_MS   (100)
+
+/*
+ * Latency histogram, bucket b counts executions of [2^b, 2^(b+1))
+ * microseconds. The first bucket also takes anything faster, the last
+ * anything slower (8 s and up).
+ */
+#define GWEB_SLOWLOG_BUCKETS        (24)
+
+/* Distinct text query templates tracked, past that they are not timed */
+#define GWEB_SLOWLOG_MAX_TEXT       (32)
+#define GWEB_SLOWLOG_NAMESZ         (48)
+
+/*
+ * Per-template totals. Rows are the rows returned, or affected for
+ * statements without a result set. Text queries returning rows leave
+ * the count to the caller and are not counted.
+ */
+struct gweb_slowlog_stats {
+    char name[GWEB_SLOWLOG_NAMESZ];
+    unsigned long count;
+    unsigned long rows;
+    unsigned long slow;
+    unsigned long long total_us;
+    unsigned long max_us;
+    unsigned long hist[GWEB_SLOWLOG_BUCKETS];
+};
+
+extern void gweb_slowlog_init (struct mysql_config *cfg);
+extern void gweb_slowlog_shutdown (void);
+
+static inline void
+gweb_slowlog_start (struct timespec *start)
+{
+    clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+extern void gweb_slowlog_stmt (struct gweb_mysql_conn *conn, int id,
+                               MYSQL_BIND *params, const struct timespec *start,
+                               unsigned long rows);
+extern void gweb_slowlog_text (struct gweb_mysql_conn *conn, const char *tmpl,
+                               const char *qry, const struct timespec *start,
+                               unsigned long rows);
+extern void gweb_slowlog_explain (struct gweb_mysql_conn *conn);
+
+extern int gweb_slowlog_threshold_ms (void);
+extern unsigned long gweb_slowlog_stats (struct gweb_slowlog_stats **stats,
+                                         int *nr_stats, int reset);
+extern unsigned long gweb_slowlog_percentile (const struct gweb_slowlog_stats *stats,
+                                              int percent);
+
+#endif // MYSQLDB_SLOWLOG_H
@@ -0,0 +1,73 @@
+#ifndef MYSQLDB_STMT_H
+#define MYSQLDB_STMT_H
+
+#include <string.h>
+
+#include <mysql.h>
+
+#include <gweb/stmt_gen.h>
+
+/* Result columns are fetched as strings, sized from the metadata */
+#define GWEB_MYSQL_STMT_MIN_COLSZ   (32)
+#define GWEB_MYSQL_STMT_MAX_COLSZ   (1024)
+
+/*
+ * Prepared statement, cached per connection and prepared on first
+ * use. Result columns are bound once, a fetched row points into
+ * colbuf and stays valid until the next fetch on this statement.
+ */
+struct gweb_mysql_stmt {
+    MYSQL_STMT *stmt;
+    int id;
+
+    unsigned int nr_cols;
+    MYSQL_BIND *result;
+    unsigned long *length;
+    my_bool *is_null;
+    my_bool *error;
+    char **row;
+    char *colbuf;
+};
+
+extern struct gweb_mysql_stmt *gweb_mysql_stmt_execute (struct gweb_mysql_conn *conn,
+                                                        int id, MYSQL_BIND *params);
+extern MYSQL_ROW gweb_mysql_stmt_fetch (struct gweb_mysql_stmt *st);
+extern int gweb_mysql_stmt_num_rows (struct gweb_mysql_stmt *st);
+extern void gweb_mysql_stmt_done (struct gweb_mysql_stmt *st);
+extern int gweb_mysql_stmt_count (struct gweb_mysql_stmt *st);
+extern void gweb_mysql_stmt_cache_free (struct gweb_mysql_conn *conn);
+extern int gweb_mysql_stmt_print (struct gweb_mysql_conn *conn, char *qry, size_t size,
+                                  const char *sql, MYSQL_BIND *params);
+
+/*
+ * Parameter binders used by the generated wrappers, buffers must stay
+ * valid until the statement is executed.
+ */
+static inline void
+gweb_mysql_bind_string (MYSQL_BIND *bind, const char *str)
+{
+    if (str == NULL) {
+        bind->buffer_type = MYSQL_TYPE_NULL;
+        return;
+    }
+
+    bind->buffer_type = MYSQL_TYPE_STRING;
+    bind->buffer = (char *)str;
+    bind->buffer_length = strlen(str);
+}
+
+static inline void
+gweb_mysql_bind_double (MYSQL_BIND *bind, double *val)
+{
+    bind->buffer_type = MYSQL_TYPE_DOUBLE;
+    bind->buffer = val;
+}
+
+static inline void
+gweb_mysql_bind_int (MYSQL_BIND *bind, int *val)
+{
+    bind->buffer_type = MYSQL_TYPE_LONG;
+    bind->buffer = val;
+}
+
+#endif // MYSQLDB_STMT_H
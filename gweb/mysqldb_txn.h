@@ -0,0 +1,39 @@
+#ifndef MYSQLDB_TXN_H
+#define MYSQLDB_TXN_H
+
+#include <stddef.h>
+
+#include <mysql.h>
+
+struct gweb_mysql_conn;
+
+/* Statement text buffer, grown on demand up to the max */
+#define GWEB_MYSQL_TXN_QRYSZ        (2048)
+#define GWEB_MYSQL_TXN_MAX_QRYSZ    (1 << 20)
+#define GWEB_MYSQL_TXN_MAX_STMTS    (16)
+
+/*
+ * Write transaction sent as one multi-statement packet: START
+ * TRANSACTION, the statements added, then COMMIT. Statements are added
+ * through the generated gweb_txn_<stmt>() wrappers, which take the same
+ * arguments as gweb_stmt_<stmt>() and print the values into the text.
+ * Nothing reaches the server before gweb_mysql_txn_commit().
+ */
+struct gweb_mysql_txn {
+    struct gweb_mysql_conn *conn;
+    char *qry;
+    size_t len, size;
+
+    int nr_stmts;
+    int ids[GWEB_MYSQL_TXN_MAX_STMTS];
+    int failed;                 /* a statement could not be added */
+};
+
+extern void gweb_mysql_txn_begin (struct gweb_mysql_txn *txn,
+                                  struct gweb_mysql_conn *conn);
+extern int gweb_mysql_txn_add (struct gweb_mysql_txn *txn, int id,
+                               MYSQL_BIND *params);
+extern int gweb_mysql_txn_commit (struct gweb_mysql_txn *txn);
+extern void gweb_mysql_txn_abort (struct gweb_mysql_txn *txn);
+
+#endif // MYSQLDB_TXN_H
@@ -4,6 +4,16 @@
 #define GWEB_SERVER_PORT     8800
 #define GWEB_POST_BUFSZ      32768
 
+/*
+ * HTTP runs on the main thread's event loop. Requests touching MySQL
+ * or S3 are suspended and run on DB workers, each checking out its own
+ * DB connection, so no more workers than pooled connections are useful.
+ */
+#define GWEB_SERVER_WORKERS  8
+
+/* Largest JSON request body */
+#define GWEB_JSON_MAXSZ      (1 << 20)
+
 #define KEY_CONTENT_TYPE     "Content-Type"
 #define KEY_CONTENT_JSON     "application/json"
 
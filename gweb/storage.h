@@ -0,0 +1,55 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <gweb/json_struct.h>
+#include <gweb/storage_gen.h>
+
+/*
+ * Storage backends. A backend runs the DB side of every API, one
+ * handler per GWEB_STORAGE_OP_* (see schema/gweb_api.schema). All
+ * backends fill the same response structures, so the serializers and
+ * the gweb_mysql_free_* destructors are shared.
+ *
+ * Handlers run on a session taken from the backend for the request: a
+ * pooled connection for MySQL, the store itself for memdb.
+ */
+struct gweb_storage_handler {
+    const char *name;           /* for logs and the slow query log */
+    int (*handle) (void *session, j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp);
+};
+
+struct gweb_storage_ops {
+    const char *name;           /* db_config "type" selecting it */
+
+    int (*init) (void);
+    int (*shutdown) (void);
+
+    /*
+     * Session for one request, NULL if the backend can not take it.
+     * key is the UID or email the request is about, may be NULL.
+     */
+    void *(*session_get) (const struct gweb_storage_handler *handler,
+                          int read_only, const char *key);
+    void (*session_put) (void *session, int read_only, const char *key);
+
+    /* 1 if the UID is registered, 0 if not, -1 on errors */
+    int (*check_uid) (const char *uid);
+
+    const struct gweb_storage_handler *handlers;  /* by GWEB_STORAGE_OP_* */
+};
+
+/* Generated, storage_gen.c */
+extern const struct gweb_storage_handler gweb_mysql_storage_handlers[GWEB_STORAGE_OP_MAX];
+extern const struct gweb_storage_handler gweb_memdb_storage_handlers[GWEB_STORAGE_OP_MAX];
+
+extern const struct gweb_storage_ops gweb_mysql_storage;
+extern const struct gweb_storage_ops gweb_memdb_storage;
+
+/* Backend in use, set by gweb_storage_init() */
+extern const struct gweb_storage_ops *gweb_storage;
+
+extern int gweb_storage_init (void);
+extern int gweb_storage_shutdown (void);
+extern int gweb_storage_check_uid (const char *uid);
+
+#endif // STORAGE_H
@@ -0,0 +1,63 @@
+#ifndef SUGGEST_H
+#define SUGGEST_H
+
+#include <stdint.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#  define GWEB_SUGGEST_AVX2
+#endif
+
+/* Friends with more connections than this add no candidates */
+#define GWEB_SUGGEST_MAX_FANOUT     (1024)
+
+/* Candidate ids gathered per ranking, later friends are intersected */
+#define GWEB_SUGGEST_MAX_CANDIDATES (65536)
+
+/* Arrays this many times larger are searched, not merged */
+#define GWEB_SUGGEST_SKEW           (32)
+
+/*
+ * Adjacency of numbered vertices: the peers of v are
+ * peers[offsets[v]..offsets[v + 1]), ascending and without repeats.
+ * Vertices from nr_vertices on have none.
+ */
+struct gweb_suggest_graph {
+    uint32_t nr_vertices;
+    const uint32_t *offsets;
+    const uint32_t *peers;
+};
+
+struct gweb_suggestion {
+    uint32_t vid;
+    uint32_t mutual;
+};
+
+/*
+ * Number of values two ascending arrays without repeats share. Picks
+ * the AVX2 kernel when the CPU has it, and searches the larger array
+ * when the sizes are far apart.
+ */
+extern uint32_t gweb_suggest_intersect (const uint32_t *a, uint32_t na,
+                                        const uint32_t *b, uint32_t nb);
+extern const char *gweb_suggest_kernel (void);
+
+extern uint32_t gweb_suggest_intersect_scalar (const uint32_t *a, uint32_t na,
+                                               const uint32_t *b, uint32_t nb);
+extern uint32_t gweb_suggest_intersect_gallop (const uint32_t *a, uint32_t na,
+                                               const uint32_t *b, uint32_t nb);
+#ifdef GWEB_SUGGEST_AVX2
+extern uint32_t gweb_suggest_intersect_avx2 (const uint32_t *a, uint32_t na,
+                                             const uint32_t *b, uint32_t nb);
+#endif
+
+/*
+ * Up to k peers of friends, not self nor one of its friends (ascending,
+ * as in the graph), ranked by the number of friends they share with
+ * self, then by vertex. Returns the number ranked into top, or -1 if
+ * out of memory.
+ */
+extern int gweb_suggest_rank (const struct gweb_suggest_graph *graph, uint32_t self,
+                              const uint32_t *friends, uint32_t nr_friends,
+                              struct gweb_suggestion *top, int k);
+
+#endif // SUGGEST_H
@@ -0,0 +1,48 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <time.h>
+
+#include <gweb/list.h>
+
+/*
+ * Hierarchical timing wheel with one second ticks. Level n slots span
+ * 64^n seconds, four levels reach ~194 days; later deadlines are
+ * parked on the last level and cascaded down until due.
+ */
+#define GWEB_TIMER_LEVELS           (4)
+#define GWEB_TIMER_SLOT_BITS        (6)
+#define GWEB_TIMER_SLOTS            (1 << GWEB_TIMER_SLOT_BITS)
+
+struct gweb_timer {
+    struct list node;           /* wheel slot or expired list */
+    time_t expires;
+};
+
+struct gweb_timer_wheel {
+    time_t now;                 /* deadlines up to here have fired */
+    int nr_timers;
+    struct list slots[GWEB_TIMER_LEVELS][GWEB_TIMER_SLOTS];
+};
+
+static inline void
+gweb_timer_init (struct gweb_timer *timer)
+{
+    list_init(&timer->node);
+}
+
+static inline int
+gweb_timer_pending (const struct gweb_timer *timer)
+{
+    return !list_empty(&timer->node);
+}
+
+extern void gweb_timer_wheel_init (struct gweb_timer_wheel *wheel, time_t now);
+extern void gweb_timer_add (struct gweb_timer_wheel *wheel,
+                            struct gweb_timer *timer, time_t expires);
+extern void gweb_timer_del (struct gweb_timer_wheel *wheel,
+                            struct gweb_timer *timer);
+extern int gweb_timer_wheel_advance (struct gweb_timer_wheel *wheel, time_t now,
+                                     struct list *expired);
+
+#endif // TIMER_WHEEL_H
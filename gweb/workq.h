@@ -0,0 +1,24 @@
+#ifndef WORKQ_H
+#define WORKQ_H
+
+#include <gweb/list.h>
+
+/*
+ * Blocking work off the event loop. run() is called on a worker
+ * thread, done() back on the loop thread from gweb_workq_complete()
+ * once the notify fd turns readable.
+ */
+struct gweb_work {
+    struct list node;           /* pending or completed list */
+    void (*run)(struct gweb_work *work);
+    void (*done)(struct gweb_work *work);
+};
+
+/* Returns the notify fd to poll for completions, -1 on failure */
+extern int gweb_workq_init (int nr_workers);
+extern void gweb_workq_shutdown (void);
+
+extern void gweb_workq_submit (struct gweb_work *work);
+extern int gweb_workq_complete (void);
+
+#endif // WORKQ_H
@@ -8,6 +8,10 @@
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/select.h>
@@ -21,8 +25,10 @@
 #include <gweb/server.h>
 #include <gweb/json_api.h>
 #include <gweb/mysqldb_api.h>
+#include <gweb/storage.h>
 #include <gweb/config.h>
 #include <gweb/avatardb.h>
+#include <gweb/workq.h>
 
 /* Global structures */
 enum {
@@ -38,6 +44,13 @@ enum {
     HTTP_POST_UPLOAD_AVATAR = 1,
 };
 
+/* Backend work of a request, see workq.c */
+enum {
+    HTTP_CXN_RECEIVING = 0,
+    HTTP_CXN_PENDING   = 1,     /* suspended, queued to a DB worker */
+    HTTP_CXN_DONE      = 2,     /* resumed, response ready to queue */
+};
+
 /* Connection info to retain the response structure for POST/PUT/GET
  * messages.
  */
@@ -51,10 +64,19 @@ struct http_cxn_info {
     struct MHD_Connection *connection;
     struct MHD_Response *response;
     struct MHD_PostProcessor *pp;
+
+    /* JSON body gathered for the worker */
+    char *json_request;
+    size_t json_request_len;
+
+    int state;
+    int status;
+    struct gweb_work work;
 };
 
 /* Globals */
 static struct MHD_Daemon *g_daemon;
+static int g_running = 1;
 
 #define HTTP_RESPONSE_404_NOTFOUND		\
     "{\"status\":{\"code\":\"404\","		\
@@ -142,26 +164,19 @@ gweb_build_http_response (struct http_cxn_info *cxn, char *resp, int status)
     }
 }
 
-static int
-post_upload_completion_handler (void *coninfo_cls)
+/* DB worker: S3 and MySQL updates of a finished upload */
+static void
+post_upload_completion_handler (struct http_cxn_info *httpcxn)
 {
-    struct http_cxn_info *httpcxn = coninfo_cls;
-    char *response = NULL;
-    int status = 0;
+    httpcxn->status = 0;
 
     if (httpcxn->upload_type == HTTP_POST_UPLOAD_AVATAR) {
-        if (avatardb_handle_upload_complete(&httpcxn->priv, &response, &status) < 0)
-            status = -1;
+        if (avatardb_handle_upload_complete(&httpcxn->priv, &httpcxn->json_response,
+                                            &httpcxn->status) < 0)
+            httpcxn->status = -1;
 
         avatardb_handle_upload_cleanup(&httpcxn->priv);
-
-        gweb_build_http_response(httpcxn, response, status);
-        if (response) {
-            free(response);
-        }
     }
-
-    return MHD_YES;
 }
 
 static int
@@ -196,6 +211,7 @@ post_upload_handler (void *coninfo_cls, enum MHD_ValueKind kind, const char *key
     return (httpcxn->status_code == MHD_HTTP_NOT_FOUND) ? MHD_NO: MHD_YES;
 }
 
+/* Gather the JSON body, it is parsed and run by a DB worker */
 static int
 json_post_handler (void *coninfo_cls, enum MHD_ValueKind kind, const char *key,
 		   const char *filename, const char *content_type,
@@ -203,30 +219,92 @@ json_post_handler (void *coninfo_cls, enum MHD_ValueKind kind, const char *key,
 		   size_t size)
 {
     struct http_cxn_info *httpcxn = coninfo_cls;
-    char *response = NULL;
-    int status;
+    char *buf;
 
-    if (httpcxn->cxn_type == HTTP_REQ_POST_JSON) {
-        if (gweb_json_post_processor(data, size, &response, &status)) {
+    if (httpcxn->cxn_type != HTTP_REQ_POST_JSON || size == 0) {
+        return MHD_YES;
+    }
+
+    if (httpcxn->json_request_len + size > GWEB_JSON_MAXSZ ||
+        (buf = realloc(httpcxn->json_request,
+                       httpcxn->json_request_len + size + 1)) == NULL) {
+        log_error("JSON request too large or out of memory\n");
+        free(httpcxn->json_request);
+        httpcxn->json_request = NULL;
+        httpcxn->json_request_len = 0;
+        return MHD_NO;
+    }
+
+    memcpy(buf + httpcxn->json_request_len, data, size);
+    httpcxn->json_request_len += size;
+    buf[httpcxn->json_request_len] = '\0';
+    httpcxn->json_request = buf;
+
+    return MHD_YES;
+}
+
+/* DB worker: run the API, the response is built back on the loop */
+static void
+http_work_run (struct gweb_work *work)
+{
+    struct http_cxn_info *httpcxn = list_entry(work, struct http_cxn_info, work);
+
+    httpcxn->status = 0;
+
+    switch (httpcxn->cxn_type) {
+    case HTTP_REQ_POST_JSON:
+        if (gweb_json_post_processor(httpcxn->json_request,
+                                     httpcxn->json_request_len,
+                                     &httpcxn->json_response, &httpcxn->status)) {
             log_error("JSON post processor failed to handle API\n");
-            status = -1;
+            httpcxn->status = -1;
         }
+        break;
 
-    } else if (httpcxn->cxn_type == HTTP_REQ_GET) {
+    case HTTP_REQ_GET:
+        /* Connection values stay put while the connection is suspended */
         if (gweb_json_get_processor(httpcxn->connection, httpcxn->url,
-                                    &response, &status)) {
+                                    &httpcxn->json_response, &httpcxn->status)) {
             log_error("JSON get processor failed to handle API\n");
-            status = -1;
+            httpcxn->status = -1;
         }
+        break;
+
+    case HTTP_REQ_POST_UPLOAD:
+        post_upload_completion_handler(httpcxn);
+        break;
     }
+}
 
-    gweb_build_http_response(httpcxn, response, status);
+static void
+http_work_done (struct gweb_work *work)
+{
+    struct http_cxn_info *httpcxn = list_entry(work, struct http_cxn_info, work);
 
-    if (response) {
-        free(response);
+    /* An upload block may have failed with a response already */
+    if (httpcxn->response) {
+        MHD_destroy_response(httpcxn->response);
+    }
+    gweb_build_http_response(httpcxn, httpcxn->json_response, httpcxn->status);
+    if (httpcxn->json_response) {
+        free(httpcxn->json_response);
+        httpcxn->json_response = NULL;
     }
 
-    return MHD_YES;
+    httpcxn->state = HTTP_CXN_DONE;
+    MHD_resume_connection(httpcxn->connection);
+}
+
+/* Park the connection until a DB worker is done with the request */
+static void
+http_work_submit (struct http_cxn_info *httpcxn)
+{
+    httpcxn->state = HTTP_CXN_PENDING;
+    httpcxn->work.run = http_work_run;
+    httpcxn->work.done = http_work_done;
+
+    MHD_suspend_connection(httpcxn->connection);
+    gweb_workq_submit(&httpcxn->work);
 }
 
 /*
@@ -259,23 +337,32 @@ static int mhd_connection_handler (void *cls,
 #endif
 
     if (httpcxn) {
+        if (httpcxn->state == HTTP_CXN_DONE) {
+            mhd_send_page(httpcxn);
+            return MHD_YES;
+        }
+        if (httpcxn->state == HTTP_CXN_PENDING) {
+            return MHD_YES;
+        }
+
         switch (httpcxn->cxn_type) {
         case HTTP_REQ_POST:
         case HTTP_REQ_POST_UPLOAD:
         case HTTP_REQ_POST_JSON:
             if (httpcxn->pp != NULL) {
-                if (*upload_data_size == 0) {
-                    post_upload_completion_handler(httpcxn);
-                    mhd_send_page(httpcxn);
-                } else {
+                if (*upload_data_size != 0) {
                     MHD_post_process(httpcxn->pp, upload_data, *upload_data_size);
                     *upload_data_size = 0;
+                } else if (httpcxn->cxn_type == HTTP_REQ_POST_UPLOAD ||
+                           httpcxn->json_request != NULL) {
+                    http_work_submit(httpcxn);
+                } else {
+                    mhd_send_page(httpcxn);
                 }
             }
             break;
         case HTTP_REQ_GET:
-            json_post_handler(httpcxn, 0, NULL, NULL, NULL, NULL, NULL, 0, 0);
-            mhd_send_page(httpcxn);
+            http_work_submit(httpcxn);
             break;
         default:
             break;
@@ -378,6 +465,8 @@ mhd_request_completed (void *cls, struct MHD_Connection *connection,
 
     if (httpcxn->json_response)
         free(httpcxn->json_response);
+    if (httpcxn->json_request)
+        free(httpcxn->json_request);
     if (httpcxn->response)
         MHD_destroy_response(httpcxn->response);
     if (httpcxn->pp)
@@ -389,21 +478,37 @@ mhd_request_completed (void *cls, struct MHD_Connection *connection,
     *con_cls = NULL;
 }
 
-static void
-sig_kill_handler (int signum)
+/*
+ * Shutdown signals, blocked in every thread and read from a signalfd
+ * by the event loop. Left to a handler, any thread could take them and
+ * the loop would sleep on until the next request.
+ */
+static int
+gweb_signal_block (void)
 {
-    log_debug("%s: killing daemon!\n", __func__);
+    sigset_t mask;
 
-    if (g_daemon)
-	MHD_stop_daemon(g_daemon);
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR1);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
 
-    gweb_mysql_shutdown();
+    if (pthread_sigmask(SIG_BLOCK, &mask, NULL)) {
+        return -1;
+    }
+    return signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+}
 
-#ifdef LOG_TO_SYSLOG
-    closelog();
-#endif
+/* Stops the event loop, main() shuts down */
+static void
+gweb_signal_read (int signal_fd)
+{
+    struct signalfd_siginfo info;
 
-    exit(0);
+    while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+        log_debug("%s: signal %u, stopping\n", __func__, info.ssi_signo);
+        g_running = 0;
+    }
 }
 
 static void
@@ -449,6 +554,70 @@ daemonize_this_process (void)
 #endif
 }
 
+/*
+ * Event loop: MHD's epoll fd, the DB work queue and shutdown signals.
+ * Completed work resumes its connection before MHD runs, so responses
+ * go out in the same iteration.
+ */
+static int
+gweb_event_loop (struct MHD_Daemon *daemon, int notify_fd, int signal_fd)
+{
+    const union MHD_DaemonInfo *info;
+    struct epoll_event ev, events[3];
+    MHD_UNSIGNED_LONG_LONG mhd_timeout;
+    int epfd, nr_events, timeout, idx;
+
+    if ((info = MHD_get_daemon_info(daemon, MHD_DAEMON_INFO_EPOLL_FD)) == NULL ||
+        (epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        log_error("%s: unable to set up epoll\n", __func__);
+        return -1;
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.fd = info->epoll_fd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, info->epoll_fd, &ev) < 0) {
+        goto __bail_out;
+    }
+    ev.data.fd = notify_fd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, notify_fd, &ev) < 0) {
+        goto __bail_out;
+    }
+    ev.data.fd = signal_fd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, signal_fd, &ev) < 0) {
+        goto __bail_out;
+    }
+
+    while (g_running) {
+        timeout = -1;
+        if (MHD_get_timeout(daemon, &mhd_timeout) == MHD_YES) {
+            timeout = (mhd_timeout > INT_MAX) ? INT_MAX : (int)mhd_timeout;
+        }
+
+        nr_events = epoll_wait(epfd, events, 3, timeout);
+        if (nr_events < 0 && errno != EINTR) {
+            log_error("%s: epoll_wait failed (%d)\n", __func__, errno);
+            break;
+        }
+
+        for (idx = 0; idx < nr_events; idx++) {
+            if (events[idx].data.fd == notify_fd) {
+                gweb_workq_complete();
+            } else if (events[idx].data.fd == signal_fd) {
+                gweb_signal_read(signal_fd);
+            }
+        }
+        MHD_run(daemon);
+    }
+
+    close(epfd);
+    return 0;
+
+__bail_out:
+    log_error("%s: epoll_ctl failed (%d)\n", __func__, errno);
+    close(epfd);
+    return -1;
+}
+
 /*
  * Start the webserver and listen to given port
  */
@@ -456,6 +625,7 @@ int main (int argc, char *argv[])
 {
     struct MHD_Daemon *daemon;
     uint32_t server_port = GWEB_SERVER_PORT;
+    int notify_fd, signal_fd;
 
     /* Quick/Dirty check for port option */
     if (argc == 3 && argv[1][0] == '-' && argv[1][1] == 'p') {
@@ -467,45 +637,65 @@ int main (int argc, char *argv[])
 
     daemonize_this_process();
 
-    daemon = MHD_start_daemon(MHD_USE_SELECT_INTERNALLY,
-		 server_port, NULL, NULL, &mhd_connection_handler, NULL,
-		 MHD_OPTION_EXTERNAL_LOGGER, fprintf, NULL,
-		 MHD_OPTION_NOTIFY_COMPLETED, &mhd_request_completed, NULL,
-		 MHD_OPTION_END);
-    if (daemon == NULL) {
-	log_error("unable to start MHD daemon on port %d\n",
-		  GWEB_SERVER_PORT);
-	return -1;
+    /* Before any thread starts, all of them inherit the mask */
+    if ((signal_fd = gweb_signal_block()) < 0) {
+        log_error("unable to set up shutdown signals\n");
+        return -1;
     }
 
     /* Parse config file */
     config_parse_and_load(argc, argv);
 
-    /* Initialize MySQL */
-    if (gweb_mysql_init()) {
-	log_error("opening MYSQL connection failed\n");
-	if (g_daemon) {
-	    MHD_stop_daemon(g_daemon);
-	}
+    /* Initialize storage, DB pool must be up before requests arrive */
+    if (gweb_storage_init()) {
+	log_error("opening storage backend failed\n");
 	return -1;
     }
 
     if (avatardb_init()) {
         log_error("avatar DB initialization failed\n");
-        if (g_daemon) {
-            MHD_stop_daemon(g_daemon);
-        }
+        gweb_storage_shutdown();
         return -1;
     }
-    
-    g_daemon = daemon;
 
-    signal(SIGUSR1, sig_kill_handler);
+    if ((notify_fd = gweb_workq_init(GWEB_SERVER_WORKERS)) < 0) {
+        log_error("DB work queue initialization failed\n");
+        gweb_storage_shutdown();
+        return -1;
+    }
 
-    while (1) {
-	sleep(60);
+    /* Driven from gweb_event_loop(), no MHD threads */
+    daemon = MHD_start_daemon(MHD_USE_EPOLL | MHD_ALLOW_SUSPEND_RESUME,
+		 server_port, NULL, NULL, &mhd_connection_handler, NULL,
+		 MHD_OPTION_EXTERNAL_LOGGER, fprintf, NULL,
+		 MHD_OPTION_NOTIFY_COMPLETED, &mhd_request_completed, NULL,
+		 MHD_OPTION_END);
+    if (daemon == NULL) {
+	log_error("unable to start MHD daemon on port %d\n",
+		  GWEB_SERVER_PORT);
+        gweb_workq_shutdown();
+	gweb_storage_shutdown();
+	return -1;
     }
 
+    g_daemon = daemon;
+
+    gweb_event_loop(daemon, notify_fd, signal_fd);
+    close(signal_fd);
+
+    log_debug("%s: killing daemon!\n", __func__);
+
+    /* Suspended connections must be resumed before MHD stops */
+    gweb_workq_shutdown();
+    gweb_workq_complete();
+    MHD_stop_daemon(g_daemon);
+
+    gweb_storage_shutdown();
+
+#ifdef LOG_TO_SYSLOG
+    closelog();
+#endif
+
     return 0;
 }
 
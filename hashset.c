@@ -0,0 +1,119 @@
+/*
+ * Set of 64-bit hashes
+ *
+ * Linear probing over a power of two table kept at most half full,
+ * grown by doubling. The value 0 marks an empty slot, a hash of 0 is
+ * stored as 1. Members are never removed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <gweb/hashset.h>
+
+#define GWEB_HASHSET_MIN_SLOTS      (1024)
+
+static uint64_t
+gweb_hashset_key (uint64_t hash)
+{
+    return hash ? hash : 1;
+}
+
+static void
+gweb_hashset_insert (uint64_t *slots, unsigned int mask, uint64_t key)
+{
+    unsigned int idx = (unsigned int)(key ^ (key >> 32)) & mask;
+
+    while (slots[idx] && slots[idx] != key) {
+        idx = (idx + 1) & mask;
+    }
+    slots[idx] = key;
+}
+
+static int
+gweb_hashset_grow (struct gweb_hashset *set, unsigned int nr_slots)
+{
+    uint64_t *slots;
+    unsigned int idx;
+
+    if ((slots = calloc(nr_slots, sizeof(uint64_t))) == NULL) {
+        return -1;
+    }
+
+    for (idx = 0; set->slots && idx <= set->mask; idx++) {
+        if (set->slots[idx]) {
+            gweb_hashset_insert(slots, nr_slots - 1, set->slots[idx]);
+        }
+    }
+
+    free(set->slots);
+    set->slots = slots;
+    set->mask = nr_slots - 1;
+
+    return 0;
+}
+
+/* Sized for hint members without growing */
+int
+gweb_hashset_init (struct gweb_hashset *set, unsigned int hint)
+{
+    unsigned int nr_slots = GWEB_HASHSET_MIN_SLOTS;
+
+    while (nr_slots / 2 < hint) {
+        nr_slots <<= 1;
+    }
+
+    set->slots = NULL;
+    set->nr_members = 0;
+
+    return gweb_hashset_grow(set, nr_slots);
+}
+
+void
+gweb_hashset_free (struct gweb_hashset *set)
+{
+    free(set->slots);
+    set->slots = NULL;
+    set->mask = 0;
+    set->nr_members = 0;
+}
+
+/* Returns 1 if added, 0 if already a member, -1 on failure */
+int
+gweb_hashset_add (struct gweb_hashset *set, uint64_t hash)
+{
+    uint64_t key = gweb_hashset_key(hash);
+
+    if (gweb_hashset_contains(set, hash)) {
+        return 0;
+    }
+
+    if ((set->nr_members + 1) * 2 > set->mask + 1 &&
+        gweb_hashset_grow(set, (set->mask + 1) * 2) < 0) {
+        return -1;
+    }
+
+    gweb_hashset_insert(set->slots, set->mask, key);
+    set->nr_members++;
+
+    return 1;
+}
+
+int
+gweb_hashset_contains (const struct gweb_hashset *set, uint64_t hash)
+{
+    uint64_t key = gweb_hashset_key(hash);
+    unsigned int idx;
+
+    if (set->slots == NULL) {
+        return 0;
+    }
+
+    idx = (unsigned int)(key ^ (key >> 32)) & set->mask;
+    while (set->slots[idx]) {
+        if (set->slots[idx] == key) {
+            return 1;
+        }
+        idx = (idx + 1) & set->mask;
+    }
+    return 0;
+}
@@ -25,12 +25,141 @@ struct config_text {
 
 static struct config_text g_config;
 
-struct mysql_config *config_load_mysqldb (void)
+static char *
+config_dup_string (struct json_object *elem, const char *key)
 {
-    struct mysql_config *mysql;
-    struct json_object *root = g_config.root, *obj, *elem, *cfgnode;
+    struct json_object *cfgnode;
     const char *ptr;
-    int count, idx, found_mysql_cfg = 0;
+
+    if (!json_object_object_get_ex(elem, key, &cfgnode)) {
+        return NULL;
+    }
+    ptr = json_object_get_string(cfgnode);
+
+    return strndup(ptr, strlen(ptr));
+}
+
+/* Settings of one "mysql" entry of db_config */
+static void
+config_load_mysql_node (struct mysql_config *cfg, struct json_object *elem)
+{
+    struct json_object *cfgnode;
+
+    cfg->host = config_dup_string(elem, "host");
+    cfg->username = config_dup_string(elem, "username");
+    cfg->password = config_dup_string(elem, "password");
+    cfg->database = config_dup_string(elem, "database");
+
+    if (json_object_object_get_ex(elem, "pool_min", &cfgnode)) {
+        cfg->pool_min = json_object_get_int(cfgnode);
+    }
+
+    if (json_object_object_get_ex(elem, "pool_max", &cfgnode)) {
+        cfg->pool_max = json_object_get_int(cfgnode);
+    }
+
+    if (json_object_object_get_ex(elem, "pool_wait_ms", &cfgnode)) {
+        cfg->pool_wait_ms = json_object_get_int(cfgnode);
+    }
+
+    if (json_object_object_get_ex(elem, "pool_validate_secs", &cfgnode)) {
+        cfg->pool_validate_secs = json_object_get_int(cfgnode);
+    }
+
+    if (json_object_object_get_ex(elem, "location_flush_ms", &cfgnode)) {
+        cfg->location_flush_ms = json_object_get_int(cfgnode);
+    }
+
+    if (json_object_object_get_ex(elem, "location_flush_rows", &cfgnode)) {
+        cfg->location_flush_rows = json_object_get_int(cfgnode);
+    }
+
+    if (json_object_object_get_ex(elem, "card_cache_size", &cfgnode)) {
+        cfg->card_cache_size = json_object_get_int(cfgnode);
+    }
+
+    if (json_object_object_get_ex(elem, "profile_cache_bytes", &cfgnode)) {
+        cfg->profile_cache_bytes = json_object_get_int(cfgnode);
+    }
+
+    if (json_object_object_get_ex(elem, "profile_cache_ttl_secs", &cfgnode)) {
+        cfg->profile_cache_ttl_secs = json_object_get_int(cfgnode);
+    }
+
+    if (json_object_object_get_ex(elem, "suggest_cache_size", &cfgnode)) {
+        cfg->suggest_cache_size = json_object_get_int(cfgnode);
+    }
+
+    if (json_object_object_get_ex(elem, "suggest_cache_ttl_secs", &cfgnode)) {
+        cfg->suggest_cache_ttl_secs = json_object_get_int(cfgnode);
+    }
+
+    if (json_object_object_get_ex(elem, "pref_cache_size", &cfgnode)) {
+        cfg->pref_cache_size = json_object_get_int(cfgnode);
+    }
+
+    if (json_object_object_get_ex(elem, "pref_cache_ttl_secs", &cfgnode)) {
+        cfg->pref_cache_ttl_secs = json_object_get_int(cfgnode);
+    }
+
+    if (json_object_object_get_ex(elem, "pin_secs", &cfgnode)) {
+        cfg->pin_secs = json_object_get_int(cfgnode);
+    }
+
+    if (json_object_object_get_ex(elem, "slow_query_ms", &cfgnode)) {
+        cfg->slow_query_ms = json_object_get_int(cfgnode);
+    }
+}
+
+/*
+ * Storage backend, the "type" of the first db_config entry. MySQL
+ * unless configured otherwise.
+ */
+const char *config_load_storage (void)
+{
+    struct json_object *root = g_config.root, *obj, *elem, *cfgnode;
+
+    if (!json_object_object_get_ex(root, "db_config", &obj) ||
+        json_object_get_array(obj) == NULL ||
+        (elem = json_object_array_get_idx(obj, 0)) == NULL ||
+        !json_object_object_get_ex(elem, "type", &cfgnode)) {
+        return "mysql";
+    }
+
+    return json_object_get_string(cfgnode);
+}
+
+#define CFG_MYSQL_NONE      (0)
+#define CFG_MYSQL_PRIMARY   (1)
+#define CFG_MYSQL_REPLICA   (2)
+
+static int
+config_mysql_role (struct json_object *elem)
+{
+    struct json_object *cfgnode;
+
+    if (!elem || !json_object_object_get_ex(elem, "type", &cfgnode) ||
+        strcasecmp(json_object_get_string(cfgnode), "mysql") != 0) {
+        return CFG_MYSQL_NONE;
+    }
+
+    if (json_object_object_get_ex(elem, "role", &cfgnode) &&
+        strcasecmp(json_object_get_string(cfgnode), "replica") == 0) {
+        return CFG_MYSQL_REPLICA;
+    }
+
+    return CFG_MYSQL_PRIMARY;
+}
+
+/*
+ * The primary is the first "mysql" entry not marked as a replica, the
+ * replicas take credentials they leave out from the primary.
+ */
+struct mysql_config *config_load_mysqldb (void)
+{
+    struct mysql_config *mysql, *replica;
+    struct json_object *root = g_config.root, *obj, *elem;
+    int count, idx, primary = -1, nr_replicas = 0;
 
     if (!json_object_object_get_ex(root, "db_config", &obj)) {
         log("no database config nodes found!\n");
@@ -44,20 +173,19 @@ struct mysql_config *config_load_mysqldb (void)
 
     count = json_object_array_length(obj);
     for (idx = 0; idx < count; idx++) {
-        elem = json_object_array_get_idx(obj, idx);
-        if (!elem) {
+        switch (config_mysql_role(json_object_array_get_idx(obj, idx))) {
+        case CFG_MYSQL_REPLICA:
+            nr_replicas++;
             break;
-        }
-        if (json_object_object_get_ex(elem, "type", &cfgnode)) {
-            ptr = json_object_get_string(cfgnode);
-            if (strcasecmp(ptr, "mysql") == 0) {
-                found_mysql_cfg = 1;
-                break;
+        case CFG_MYSQL_PRIMARY:
+            if (primary < 0) {
+                primary = idx;
             }
+            break;
         }
     }
 
-    if (!found_mysql_cfg) {
+    if (primary < 0) {
         log("no mysql db config found!\n");
         return NULL;
     }
@@ -67,25 +195,40 @@ struct mysql_config *config_load_mysqldb (void)
         log("memory allocation failed!\n");
         return NULL;
     }
+    config_load_mysql_node(mysql, json_object_array_get_idx(obj, primary));
 
-    if (json_object_object_get_ex(elem, "host", &cfgnode)) {
-        ptr = json_object_get_string(cfgnode);
-        mysql->host = strndup(ptr, strlen(ptr));
+    if (nr_replicas == 0) {
+        return mysql;
     }
 
-    if (json_object_object_get_ex(elem, "username", &cfgnode)) {
-        ptr = json_object_get_string(cfgnode);
-        mysql->username = strndup(ptr, strlen(ptr));
+    mysql->replicas = calloc(sizeof(struct mysql_config), nr_replicas);
+    if (mysql->replicas == NULL) {
+        log("memory allocation failed, replicas ignored!\n");
+        return mysql;
     }
 
-    if (json_object_object_get_ex(elem, "password", &cfgnode)) {
-        ptr = json_object_get_string(cfgnode);
-        mysql->password = strndup(ptr, strlen(ptr));
-    }
+    for (idx = 0; idx < count; idx++) {
+        elem = json_object_array_get_idx(obj, idx);
+        if (config_mysql_role(elem) != CFG_MYSQL_REPLICA) {
+            continue;
+        }
 
-    if (json_object_object_get_ex(elem, "database", &cfgnode)) {
-        ptr = json_object_get_string(cfgnode);
-        mysql->database = strndup(ptr, strlen(ptr));
+        replica = &mysql->replicas[mysql->nr_replicas++];
+        config_load_mysql_node(replica, elem);
+        if (!replica->host) {
+            log("replica without host ignored!\n");
+            mysql->nr_replicas--;
+            continue;
+        }
+        if (!replica->username) {
+            replica->username = mysql->username;
+        }
+        if (!replica->password) {
+            replica->password = mysql->password;
+        }
+        if (!replica->database) {
+            replica->database = mysql->database;
+        }
     }
 
     return mysql;
@@ -0,0 +1,319 @@
+/*
+ * Sharded LRU cache
+ *
+ * Keys hash to a shard, each shard keeps a hash of its entries and a
+ * recency list, most recent at the head. Inserting into a full shard
+ * evicts its least recently used entry.
+ *
+ * Fills race with invalidations: a reader misses, queries MySQL and
+ * stores what it read while a writer changes the row and invalidates
+ * the key in between. Every invalidation bumps the shard generation
+ * and a fill carrying an older generation is dropped, so a stale row
+ * is never cached past the write that replaced it.
+ *
+ * Byte and entry bounds are split evenly over the shards. Entries past
+ * their TTL are dropped when looked up, or evicted in LRU order.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <gweb/hash.h>
+#include <gweb/list.h>
+#include <gweb/lru.h>
+
+struct gweb_lru_entry {
+    struct list node;           /* hash bucket */
+    struct list lru;            /* shard recency list */
+    char key[GWEB_LRU_KEYSZ];
+    void *value;
+    size_t charge;
+    time_t expires;
+};
+
+struct gweb_lru_shard {
+    pthread_mutex_t lock;
+    struct list *buckets;
+    unsigned int mask;
+    struct list lru;
+    int nr_entries;
+    int capacity;
+    size_t bytes;
+    size_t max_bytes;
+    unsigned long gen;
+
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long inserts;
+    unsigned long evictions;
+    unsigned long invalidations;
+    unsigned long expirations;
+};
+
+struct gweb_lru {
+    void (*free_value)(void *);
+    int ttl_secs;
+    struct gweb_lru_shard shards[GWEB_LRU_SHARDS];
+};
+
+static struct gweb_lru_shard *
+gweb_lru_shard (struct gweb_lru *lru, uint32_t hash)
+{
+    return &lru->shards[hash % GWEB_LRU_SHARDS];
+}
+
+/* Called with shard lock held */
+static struct gweb_lru_entry *
+gweb_lru_lookup (struct gweb_lru_shard *shard, uint32_t hash, const char *key)
+{
+    struct list *head = &shard->buckets[(hash / GWEB_LRU_SHARDS) & shard->mask];
+    struct list *pos;
+    struct gweb_lru_entry *entry;
+
+    for (pos = head->next; pos != head; pos = pos->next) {
+        entry = list_entry(pos, struct gweb_lru_entry, node);
+        if (strcmp(entry->key, key) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/* Called with shard lock held */
+static void
+gweb_lru_remove (struct gweb_lru *lru, struct gweb_lru_shard *shard,
+                 struct gweb_lru_entry *entry)
+{
+    list_remove(&entry->node);
+    list_remove(&entry->lru);
+    shard->nr_entries--;
+    shard->bytes -= entry->charge;
+    lru->free_value(entry->value);
+    free(entry);
+}
+
+struct gweb_lru *
+gweb_lru_create (int capacity, size_t max_bytes, int ttl_secs,
+                 void (*free_value)(void *))
+{
+    struct gweb_lru *lru;
+    struct gweb_lru_shard *shard;
+    unsigned int nr_buckets;
+    int idx, bucket;
+
+    if (capacity <= 0 || (lru = calloc(1, sizeof(struct gweb_lru))) == NULL) {
+        return NULL;
+    }
+    lru->free_value = free_value;
+    lru->ttl_secs = ttl_secs;
+
+    for (idx = 0; idx < GWEB_LRU_SHARDS; idx++) {
+        shard = &lru->shards[idx];
+        shard->capacity = (capacity + GWEB_LRU_SHARDS - 1) / GWEB_LRU_SHARDS;
+        shard->max_bytes = (max_bytes + GWEB_LRU_SHARDS - 1) / GWEB_LRU_SHARDS;
+
+        for (nr_buckets = 16; nr_buckets < (unsigned int)shard->capacity; nr_buckets <<= 1)
+            ;
+        if ((shard->buckets = calloc(nr_buckets, sizeof(struct list))) == NULL) {
+            gweb_lru_destroy(lru);
+            return NULL;
+        }
+        shard->mask = nr_buckets - 1;
+        for (bucket = 0; bucket < nr_buckets; bucket++) {
+            list_init(&shard->buckets[bucket]);
+        }
+        list_init(&shard->lru);
+        pthread_mutex_init(&shard->lock, NULL);
+    }
+
+    return lru;
+}
+
+void
+gweb_lru_destroy (struct gweb_lru *lru)
+{
+    struct gweb_lru_shard *shard;
+    int idx;
+
+    if (lru == NULL) {
+        return;
+    }
+
+    for (idx = 0; idx < GWEB_LRU_SHARDS; idx++) {
+        shard = &lru->shards[idx];
+        if (shard->buckets == NULL) {
+            continue;
+        }
+        while (!list_empty(&shard->lru)) {
+            gweb_lru_remove(lru, shard, list_entry(shard->lru.next,
+                                                   struct gweb_lru_entry, lru));
+        }
+        free(shard->buckets);
+        pthread_mutex_destroy(&shard->lock);
+    }
+    free(lru);
+}
+
+int
+gweb_lru_get (struct gweb_lru *lru, const char *key,
+              void (*copy)(const void *value, void *arg), void *arg,
+              unsigned long *gen)
+{
+    struct gweb_lru_shard *shard;
+    struct gweb_lru_entry *entry;
+    uint32_t hash;
+
+    *gen = 0;
+    if (lru == NULL || strlen(key) >= GWEB_LRU_KEYSZ) {
+        return 0;
+    }
+
+    hash = gweb_hash_string(key);
+    shard = gweb_lru_shard(lru, hash);
+
+    pthread_mutex_lock(&shard->lock);
+    entry = gweb_lru_lookup(shard, hash, key);
+    if (entry && entry->expires && entry->expires <= time(NULL)) {
+        gweb_lru_remove(lru, shard, entry);
+        shard->expirations++;
+        entry = NULL;
+    }
+
+    if (entry == NULL) {
+        shard->misses++;
+        *gen = shard->gen;
+        pthread_mutex_unlock(&shard->lock);
+        return 0;
+    }
+
+    /* Move to the head, most recently used */
+    list_remove(&entry->lru);
+    list_add(shard->lru.next, &entry->lru);
+    shard->hits++;
+    copy(entry->value, arg);
+    pthread_mutex_unlock(&shard->lock);
+
+    return 1;
+}
+
+void
+gweb_lru_put (struct gweb_lru *lru, const char *key, void *value,
+              size_t charge, unsigned long gen)
+{
+    struct gweb_lru_shard *shard;
+    struct gweb_lru_entry *entry;
+    uint32_t hash;
+
+    if (lru == NULL || strlen(key) >= GWEB_LRU_KEYSZ) {
+        goto __drop_value;
+    }
+
+    hash = gweb_hash_string(key);
+    shard = gweb_lru_shard(lru, hash);
+
+    pthread_mutex_lock(&shard->lock);
+
+    /*
+     * Invalidated since the miss, what was read may be stale. Values
+     * over the byte bound of a shard are not cached at all.
+     */
+    if (gen != shard->gen || (shard->max_bytes && charge > shard->max_bytes)) {
+        pthread_mutex_unlock(&shard->lock);
+        goto __drop_value;
+    }
+
+    if ((entry = gweb_lru_lookup(shard, hash, key)) != NULL) {
+        gweb_lru_remove(lru, shard, entry);
+    }
+
+    if ((entry = calloc(1, sizeof(struct gweb_lru_entry))) == NULL) {
+        pthread_mutex_unlock(&shard->lock);
+        goto __drop_value;
+    }
+
+    while (shard->nr_entries &&
+           (shard->nr_entries >= shard->capacity ||
+            (shard->max_bytes && shard->bytes + charge > shard->max_bytes))) {
+        gweb_lru_remove(lru, shard, list_entry(shard->lru.prev,
+                                               struct gweb_lru_entry, lru));
+        shard->evictions++;
+    }
+
+    strcpy(entry->key, key);
+    entry->value = value;
+    entry->charge = charge;
+    entry->expires = lru->ttl_secs ? time(NULL) + lru->ttl_secs : 0;
+    shard->bytes += charge;
+    list_add(&shard->buckets[(hash / GWEB_LRU_SHARDS) & shard->mask], &entry->node);
+    list_add(shard->lru.next, &entry->lru);
+    shard->nr_entries++;
+    shard->inserts++;
+
+    pthread_mutex_unlock(&shard->lock);
+    return;
+
+__drop_value:
+    if (lru) {
+        lru->free_value(value);
+    }
+}
+
+void
+gweb_lru_invalidate (struct gweb_lru *lru, const char *key)
+{
+    struct gweb_lru_shard *shard;
+    struct gweb_lru_entry *entry;
+    uint32_t hash;
+
+    if (lru == NULL || strlen(key) >= GWEB_LRU_KEYSZ) {
+        return;
+    }
+
+    hash = gweb_hash_string(key);
+    shard = gweb_lru_shard(lru, hash);
+
+    pthread_mutex_lock(&shard->lock);
+    shard->gen++;
+    if ((entry = gweb_lru_lookup(shard, hash, key)) != NULL) {
+        gweb_lru_remove(lru, shard, entry);
+        shard->invalidations++;
+    }
+    pthread_mutex_unlock(&shard->lock);
+}
+
+/* Totals over all shards, counters are zeroed if reset is set */
+void
+gweb_lru_stats (struct gweb_lru *lru, struct gweb_lru_stats *stats, int reset)
+{
+    struct gweb_lru_shard *shard;
+    int idx;
+
+    memset(stats, 0, sizeof(*stats));
+    if (lru == NULL) {
+        return;
+    }
+
+    for (idx = 0; idx < GWEB_LRU_SHARDS; idx++) {
+        shard = &lru->shards[idx];
+
+        pthread_mutex_lock(&shard->lock);
+        stats->hits += shard->hits;
+        stats->misses += shard->misses;
+        stats->inserts += shard->inserts;
+        stats->evictions += shard->evictions;
+        stats->invalidations += shard->invalidations;
+        stats->expirations += shard->expirations;
+        stats->entries += shard->nr_entries;
+        stats->capacity += shard->capacity;
+        stats->bytes += shard->bytes;
+        stats->max_bytes += shard->max_bytes;
+        if (reset) {
+            shard->hits = shard->misses = shard->inserts = 0;
+            shard->evictions = shard->invalidations = 0;
+            shard->expirations = 0;
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
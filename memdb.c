@@ -0,0 +1,1746 @@
+/*
+ * In-memory storage backend
+ *
+ * Runs every API from process memory, no database involved: for edge
+ * deployments where one process owns the data, and to benchmark the
+ * HTTP/JSON path on its own. Nothing is persisted.
+ *
+ * Users are hashed by UID and by case folded email. Connection
+ * requests and channels are hashed on the unique keys of their MySQL
+ * tables and linked from both users. Lists are sorted at query time
+ * and paged with the same keyset cursors as MySQL, suggestions counted
+ * over the channel lists of the user's connections. Live locations go
+ * to the location grid (mysqldb_geo.c), searches too wide for it scan
+ * all users.
+ *
+ * One rwlock guards the lot, handlers run on the DB workers. The
+ * grid has its own lock, always taken after this one.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <gweb/common.h>
+#include <gweb/hash.h>
+#include <gweb/list.h>
+#include <gweb/uid.h>
+#include <gweb/mysqldb_api.h>
+#include <gweb/mysqldb_geo.h>
+#include <gweb/memdb_api.h>
+#include <gweb/storage.h>
+
+#define MEMDB_HASH_MASK   (GWEB_MEMDB_HASH_SIZE - 1)
+
+#define CXN_REQUEST_FLAG_CLOSED      "closed"
+#define CXN_CHANNEL_BASIC_CONNECT    "connect"
+#define CXN_PREFERENCE_PUBLIC        "public"
+
+#define CXN_OUTBOUND   (1)
+#define CXN_INBOUND    (2)
+
+#define CXN_REQ_IDX(x)   \
+   ((FIELD_CXN_REQUEST_QUERY_RESP_##x) - FIELD_CXN_REQUEST_QUERY_RESP_ARRAY_START - 1)
+
+#define CXN_CHNL_IDX(x)                                                 \
+    ((FIELD_CXN_CHANNEL_QUERY_RESP_##x) - FIELD_CXN_CHANNEL_QUERY_RESP_ARRAY_START - 1)
+
+#define CXN_PREF_IDX(x)                         \
+    ((FIELD_CXN_PREFERENCE_QUERY_RESP_##x) - FIELD_CXN_PREFERENCE_QUERY_RESP_ARRAY_START - 1)
+
+#define CXN_PREF_INS_IDX(x)                                             \
+    ((FIELD_CXN_PREFERENCE_##x) - FIELD_CXN_PREFERENCE_ARRAY_START - 1)
+
+#define NEIGHBOUR_IDX(x)                        \
+    ((FIELD_NEIGHBOUR_QUERY_RESP_##x) - FIELD_NEIGHBOUR_QUERY_RESP_ARRAY_START - 1)
+
+#define SUGGEST_IDX(x)                          \
+    ((FIELD_SUGGESTIONS_QUERY_RESP_##x) - FIELD_SUGGESTIONS_QUERY_RESP_ARRAY_START - 1)
+
+/* Users hold their profile as returned, FIELD_PROFILE_INFO_RESP_* */
+#define MEMDB_FIELD(x)   (FIELD_PROFILE_INFO_RESP_##x)
+#define MEMDB_UID(user)  ((user)->fields[MEMDB_FIELD(UID)])
+
+struct memdb_location {
+    int valid;
+    double latitude;
+    double longitude;
+    char seen[MAX_DATETIME_STRSZ];
+    time_t seen_at;
+    int expiry;                 /* seconds, -1 never expires */
+    int radius;
+};
+
+struct memdb_pref {
+    char *channel;
+    char *flag;
+};
+
+struct memdb_user {
+    struct list uid_node;
+    struct list email_node;     /* only if registered with an email */
+
+    char *password;
+    char *fields[FIELD_PROFILE_INFO_RESP_MAX];
+
+    struct memdb_location location;
+
+    struct memdb_pref *prefs;   /* sorted by channel */
+    int nr_prefs, max_prefs;
+
+    struct list requests_from, requests_to;
+    struct list channels_from, channels_to;
+};
+
+/* Connection request, or channel, between two users */
+struct memdb_link {
+    struct list hash_node;
+    struct list from_node;
+    struct list to_node;
+    struct memdb_user *from;
+    struct memdb_user *to;
+    char date[MAX_DATETIME_STRSZ];
+    char *value;                /* request flag, channel id */
+};
+
+struct gweb_memdb {
+    pthread_rwlock_t lock;
+    int ready;
+
+    struct list *uids;
+    struct list *emails;
+    struct list *requests;      /* by (from, to) */
+    struct list *channels;      /* by (from, to, channel) */
+
+    int nr_users;
+    int nr_emails;
+};
+
+static struct gweb_memdb g_memdb = {
+    .lock = PTHREAD_RWLOCK_INITIALIZER,
+};
+
+/* List row, points into the store, valid under the lock */
+struct memdb_row {
+    const char *date;
+    const char *peer;
+    const char *value;
+    const struct memdb_user *user;
+};
+
+static char *
+memdb_strdup (const char *str)
+{
+    return str ? strdup(str) : NULL;
+}
+
+/* Replace a string, NULL clears it */
+static int
+memdb_set (char **field, const char *value)
+{
+    char *copy = NULL;
+
+    if (value && (copy = strdup(value)) == NULL) {
+        return MYSQL_STATUS_FAIL;
+    }
+    free(*field);
+    *field = copy;
+
+    return MYSQL_STATUS_OK;
+}
+
+static struct memdb_user *
+memdb_user_lookup (struct gweb_memdb *db, const char *uid)
+{
+    struct memdb_user *user;
+    struct list *head, *pos;
+
+    if (uid == NULL) {
+        return NULL;
+    }
+
+    head = &db->uids[gweb_hash_string(uid) & MEMDB_HASH_MASK];
+    for (pos = head->next; pos != head; pos = pos->next) {
+        user = list_entry(pos, struct memdb_user, uid_node);
+        if (strcmp(MEMDB_UID(user), uid) == 0) {
+            return user;
+        }
+    }
+    return NULL;
+}
+
+/* Emails compare case-insensitively, as the Email column does */
+static struct memdb_user *
+memdb_user_by_email (struct gweb_memdb *db, const char *email)
+{
+    struct memdb_user *user;
+    struct list *head, *pos;
+
+    if (email == NULL) {
+        return NULL;
+    }
+
+    head = &db->emails[gweb_hash64_string_nocase(email) & MEMDB_HASH_MASK];
+    for (pos = head->next; pos != head; pos = pos->next) {
+        user = list_entry(pos, struct memdb_user, email_node);
+        if (strcasecmp(user->fields[MEMDB_FIELD(EMAIL)], email) == 0) {
+            return user;
+        }
+    }
+    return NULL;
+}
+
+static void
+memdb_user_free (struct memdb_user *user)
+{
+    int idx;
+
+    for (idx = 0; idx < FIELD_PROFILE_INFO_RESP_MAX; idx++) {
+        free(user->fields[idx]);
+    }
+    for (idx = 0; idx < user->nr_prefs; idx++) {
+        free(user->prefs[idx].channel);
+        free(user->prefs[idx].flag);
+    }
+    free(user->prefs);
+    free(user->password);
+    free(user);
+}
+
+/* Name and avatar of a list peer */
+static void
+memdb_user_card (const struct memdb_user *user, char **fname, char **lname,
+                 char **avatar_url)
+{
+    *fname = memdb_strdup(user->fields[MEMDB_FIELD(FNAME)]);
+    *lname = memdb_strdup(user->fields[MEMDB_FIELD(LNAME)]);
+    *avatar_url = memdb_strdup(user->fields[MEMDB_FIELD(AVATAR_URL)]);
+}
+
+static int
+memdb_location_live (const struct memdb_location *loc, time_t now)
+{
+    return loc->valid && (loc->expiry == -1 || loc->seen_at + loc->expiry >= now);
+}
+
+static uint32_t
+memdb_link_hash (const struct memdb_user *from, const struct memdb_user *to,
+                 const char *channel)
+{
+    uint32_t hash = gweb_hash_string(MEMDB_UID(from)) * 31 +
+        gweb_hash_string(MEMDB_UID(to));
+
+    if (channel) {
+        hash = hash * 31 + gweb_hash_string(channel);
+    }
+    return hash & MEMDB_HASH_MASK;
+}
+
+/* Request from -> to when channel is NULL, else that channel */
+static struct memdb_link *
+memdb_link_lookup (struct list *table, const struct memdb_user *from,
+                   const struct memdb_user *to, const char *channel)
+{
+    struct memdb_link *link;
+    struct list *head, *pos;
+
+    head = &table[memdb_link_hash(from, to, channel)];
+    for (pos = head->next; pos != head; pos = pos->next) {
+        link = list_entry(pos, struct memdb_link, hash_node);
+        if (link->from == from && link->to == to &&
+            (channel == NULL || strcmp(link->value, channel) == 0)) {
+            return link;
+        }
+    }
+    return NULL;
+}
+
+static struct memdb_link *
+memdb_link_add (struct list *table, struct list *from_list, struct list *to_list,
+                struct memdb_user *from, struct memdb_user *to,
+                const char *date, const char *value, int keyed)
+{
+    struct memdb_link *link;
+
+    if ((link = calloc(1, sizeof(struct memdb_link))) == NULL) {
+        return NULL;
+    }
+    if (value && (link->value = strdup(value)) == NULL) {
+        free(link);
+        return NULL;
+    }
+    link->from = from;
+    link->to = to;
+    snprintf(link->date, sizeof(link->date), "%s", date);
+
+    list_add(&table[memdb_link_hash(from, to, keyed ? value : NULL)],
+             &link->hash_node);
+    list_add(from_list, &link->from_node);
+    list_add(to_list, &link->to_node);
+
+    return link;
+}
+
+static void
+memdb_link_free (struct memdb_link *link)
+{
+    list_remove(&link->hash_node);
+    list_remove(&link->from_node);
+    list_remove(&link->to_node);
+    free(link->value);
+    free(link);
+}
+
+static int
+memdb_channel_add (struct gweb_memdb *db, struct memdb_user *from,
+                   struct memdb_user *to, const char *date, const char *channel)
+{
+    /* An existing channel is left as is */
+    if (memdb_link_lookup(db->channels, from, to, channel)) {
+        return MYSQL_STATUS_OK;
+    }
+
+    if (memdb_link_add(db->channels, &from->channels_from, &to->channels_to,
+                       from, to, date, channel, 1) == NULL) {
+        return MYSQL_STATUS_FAIL;
+    }
+    return MYSQL_STATUS_OK;
+}
+
+/*
+ * Connect the users on every channel the accepting user exposes as
+ * public, or on the basic channel if there are none.
+ */
+static int
+memdb_cxn_accept (struct gweb_memdb *db, struct memdb_user *from,
+                  struct memdb_user *to, const char *date)
+{
+    struct memdb_link *link;
+    struct list *pos, *next;
+    int idx, nr_public = 0;
+
+    for (pos = from->channels_from.next; pos != &from->channels_from; pos = next) {
+        next = pos->next;
+        link = list_entry(pos, struct memdb_link, from_node);
+        if (link->to == to) {
+            memdb_link_free(link);
+        }
+    }
+
+    for (idx = 0; idx < to->nr_prefs; idx++) {
+        if (strcasecmp(to->prefs[idx].flag, CXN_PREFERENCE_PUBLIC) != 0) {
+            continue;
+        }
+        nr_public++;
+        if (memdb_channel_add(db, from, to, date,
+                              to->prefs[idx].channel) != MYSQL_STATUS_OK) {
+            return MYSQL_STATUS_FAIL;
+        }
+    }
+
+    if (nr_public == 0) {
+        return memdb_channel_add(db, from, to, date, CXN_CHANNEL_BASIC_CONNECT);
+    }
+    return MYSQL_STATUS_OK;
+}
+
+static int
+memdb_row_cmp (const void *a, const void *b)
+{
+    const struct memdb_row *ra = a, *rb = b;
+    int cmp;
+
+    if ((cmp = strcmp(ra->date, rb->date)) != 0) {
+        return cmp;
+    }
+    if ((cmp = strcmp(ra->peer, rb->peer)) != 0) {
+        return cmp;
+    }
+    return strcmp(ra->value ? ra->value : "", rb->value ? rb->value : "");
+}
+
+/* Whether the row sorts after the first nr_keys cursor keys */
+static int
+memdb_row_after (const struct memdb_row *row, int nr_keys, const char *after[])
+{
+    const char *keys[3] = { row->date, row->peer, row->value ? row->value : "" };
+    int idx, cmp;
+
+    for (idx = 0; idx < nr_keys; idx++) {
+        if ((cmp = strcmp(keys[idx], after[idx])) != 0) {
+            return cmp > 0;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Links of a user, in one direction and with the given value if any,
+ * sorting after the cursor. Sorted by (date, peer UID, value) into
+ * *rows, which the caller frees. Returns the count, at most limit, or
+ * -1 when out of memory.
+ */
+static int
+memdb_link_page (struct list *head, int inbound, const char *value,
+                 int nr_keys, const char *after[], struct memdb_row **rows,
+                 int limit)
+{
+    struct memdb_row *found = NULL, *grown, *row;
+    struct memdb_link *link;
+    struct list *pos;
+    int nr = 0, size = 0;
+
+    for (pos = head->next; pos != head; pos = pos->next) {
+        if (inbound) {
+            link = list_entry(pos, struct memdb_link, to_node);
+        } else {
+            link = list_entry(pos, struct memdb_link, from_node);
+        }
+
+        if (value && (!link->value || strcasecmp(link->value, value) != 0)) {
+            continue;
+        }
+
+        if (nr == size) {
+            size = size ? 2 * size : 32;
+            if ((grown = realloc(found, size * sizeof(*found))) == NULL) {
+                free(found);
+                return -1;
+            }
+            found = grown;
+        }
+
+        row = &found[nr];
+        row->user = inbound ? link->from : link->to;
+        row->peer = MEMDB_UID(row->user);
+        row->date = link->date;
+        row->value = link->value;
+        if (memdb_row_after(row, nr_keys, after)) {
+            nr++;
+        }
+    }
+
+    if (nr) {
+        qsort(found, nr, sizeof(*found), memdb_row_cmp);
+    }
+    *rows = found;
+
+    return (nr > limit) ? limit : nr;
+}
+
+/* Index of the preference for channel, or where it would go */
+static int
+memdb_pref_find (const struct memdb_user *user, const char *channel, int *found)
+{
+    int lo = 0, hi = user->nr_prefs, mid, cmp;
+
+    *found = 0;
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if ((cmp = strcmp(user->prefs[mid].channel, channel)) == 0) {
+            *found = 1;
+            return mid;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static int
+memdb_pref_set (struct memdb_user *user, const char *channel, const char *flag)
+{
+    struct memdb_pref *grown, pref;
+    int idx, found, size;
+
+    idx = memdb_pref_find(user, channel, &found);
+    if (found) {
+        return memdb_set(&user->prefs[idx].flag, flag);
+    }
+
+    if (user->nr_prefs == user->max_prefs) {
+        size = user->max_prefs ? 2 * user->max_prefs : 4;
+        if ((grown = realloc(user->prefs, size * sizeof(*grown))) == NULL) {
+            return MYSQL_STATUS_FAIL;
+        }
+        user->prefs = grown;
+        user->max_prefs = size;
+    }
+
+    pref.channel = strdup(channel);
+    pref.flag = strdup(flag);
+    if (!pref.channel || !pref.flag) {
+        free(pref.channel);
+        free(pref.flag);
+        return MYSQL_STATUS_FAIL;
+    }
+
+    memmove(&user->prefs[idx + 1], &user->prefs[idx],
+            (user->nr_prefs - idx) * sizeof(*user->prefs));
+    user->prefs[idx] = pref;
+    user->nr_prefs++;
+
+    return MYSQL_STATUS_OK;
+}
+
+/* Complete profile of the user, in the profile info response */
+static int
+memdb_profile_info (const struct memdb_user *user, j2c_resp_t *j2cresp)
+{
+    int fld;
+
+    J2C_RESP_TABLE(profile_info, *resp) = &j2cresp->profile_info;
+
+    for (fld = FIELD_PROFILE_INFO_RESP_UID; fld < FIELD_PROFILE_INFO_RESP_MAX; fld++) {
+        if (user->fields[fld] &&
+            (resp->fields[fld] = strdup(user->fields[fld])) == NULL) {
+            return GWEB_MYSQL_ERR_NO_MEMORY;
+        }
+    }
+    return GWEB_MYSQL_OK;
+}
+
+int
+gweb_memdb_handle_registration (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                                j2c_resp_t **j2cresp)
+{
+    int err = GWEB_MYSQL_ERR_UNKNOWN, ret = MYSQL_STATUS_FAIL;
+    char uid_str[MAX_UID_STRSZ];
+    struct memdb_user *user = NULL;
+    const char *email;
+
+    J2C_MSG_TABLE(registration, *jrecord) = &j2cmsg->registration;
+
+    gweb_mysql_prepare_response(JSON_C_REGISTRATION_RESP, GWEB_MYSQL_OK, j2cresp);
+
+    email = jrecord->fields[FIELD_REGISTRATION_EMAIL];
+    gweb_app_get_uid_str(jrecord->fields[FIELD_REGISTRATION_PHONE], email, uid_str);
+
+    pthread_rwlock_wrlock(&db->lock);
+
+    if (memdb_user_lookup(db, uid_str) || memdb_user_by_email(db, email)) {
+        err = GWEB_MYSQL_ERR_DUPLICATE;
+        goto __bail_out;
+    }
+
+    if ((user = calloc(1, sizeof(struct memdb_user))) == NULL) {
+        err = GWEB_MYSQL_ERR_NO_MEMORY;
+        goto __bail_out;
+    }
+    list_init(&user->email_node);
+    list_init(&user->requests_from);
+    list_init(&user->requests_to);
+    list_init(&user->channels_from);
+    list_init(&user->channels_to);
+
+    if (memdb_set(&MEMDB_UID(user), uid_str) != MYSQL_STATUS_OK ||
+        memdb_set(&user->fields[MEMDB_FIELD(FNAME)],
+                  jrecord->fields[FIELD_REGISTRATION_FNAME]) != MYSQL_STATUS_OK ||
+        memdb_set(&user->fields[MEMDB_FIELD(LNAME)],
+                  jrecord->fields[FIELD_REGISTRATION_LNAME]) != MYSQL_STATUS_OK ||
+        memdb_set(&user->fields[MEMDB_FIELD(EMAIL)], email) != MYSQL_STATUS_OK ||
+        memdb_set(&user->fields[MEMDB_FIELD(PHONE)],
+                  jrecord->fields[FIELD_REGISTRATION_PHONE]) != MYSQL_STATUS_OK ||
+        memdb_set(&user->password,
+                  jrecord->fields[FIELD_REGISTRATION_PASSWORD]) != MYSQL_STATUS_OK) {
+        memdb_user_free(user);
+        err = GWEB_MYSQL_ERR_NO_MEMORY;
+        goto __bail_out;
+    }
+
+    list_add(&db->uids[gweb_hash_string(uid_str) & MEMDB_HASH_MASK], &user->uid_node);
+    if (email) {
+        list_add(&db->emails[gweb_hash64_string_nocase(email) & MEMDB_HASH_MASK],
+                 &user->email_node);
+        db->nr_emails++;
+    }
+    db->nr_users++;
+
+    (*j2cresp)->registration.fields[FIELD_REGISTRATION_RESP_UID] = strdup(uid_str);
+
+    err = GWEB_MYSQL_OK;
+    ret = MYSQL_STATUS_OK;
+
+__bail_out:
+    pthread_rwlock_unlock(&db->lock);
+    gweb_mysql_update_response(JSON_C_REGISTRATION_RESP, err, j2cresp);
+    return ret;
+}
+
+int
+gweb_memdb_handle_login (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                         j2c_resp_t **j2cresp)
+{
+    int err = GWEB_MYSQL_ERR_NO_RECORD, ret = MYSQL_STATUS_FAIL;
+    struct memdb_user *user;
+    const char *password;
+
+    J2C_MSG_TABLE(login, *jrecord) = &j2cmsg->login;
+
+    gweb_mysql_prepare_response(JSON_C_PROFILE_INFO_RESP, GWEB_MYSQL_OK, j2cresp);
+
+    if ((password = jrecord->fields[FIELD_LOGIN_PASSWORD]) == NULL) {
+        goto __bail_out;
+    }
+
+    pthread_rwlock_rdlock(&db->lock);
+    user = memdb_user_by_email(db, jrecord->fields[FIELD_LOGIN_EMAIL]);
+    if (user && user->password && strcmp(user->password, password) == 0) {
+        err = memdb_profile_info(user, *j2cresp);
+    }
+    pthread_rwlock_unlock(&db->lock);
+
+    if (err == GWEB_MYSQL_OK) {
+        ret = MYSQL_STATUS_OK;
+    }
+
+__bail_out:
+    gweb_mysql_update_response(JSON_C_PROFILE_INFO_RESP, err, j2cresp);
+    return ret;
+}
+
+int
+gweb_memdb_handle_profile (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                           j2c_resp_t **j2cresp)
+{
+    /* Request field and the profile field it sets */
+    static const int address[][2] = {
+        { FIELD_PROFILE_ADDRESS1, MEMDB_FIELD(ADDRESS1) },
+        { FIELD_PROFILE_ADDRESS2, MEMDB_FIELD(ADDRESS2) },
+        { FIELD_PROFILE_ADDRESS3, MEMDB_FIELD(ADDRESS3) },
+        { FIELD_PROFILE_STATE,    MEMDB_FIELD(STATE) },
+        { FIELD_PROFILE_PINCODE,  MEMDB_FIELD(PINCODE) },
+        { FIELD_PROFILE_COUNTRY,  MEMDB_FIELD(COUNTRY) },
+        { FIELD_PROFILE_FACEBOOK_HANDLE, MEMDB_FIELD(FACEBOOK_HANDLE) },
+        { FIELD_PROFILE_TWITTER_HANDLE,  MEMDB_FIELD(TWITTER_HANDLE) },
+    };
+    int err = GWEB_MYSQL_ERR_UNKNOWN, ret = MYSQL_STATUS_FAIL;
+    struct memdb_user *user;
+    const char *value;
+    size_t idx;
+
+    J2C_MSG_TABLE(profile, *jrecord) = &j2cmsg->profile;
+
+    gweb_mysql_prepare_response(JSON_C_PROFILE_RESP, GWEB_MYSQL_OK, j2cresp);
+
+    pthread_rwlock_wrlock(&db->lock);
+
+    if ((user = memdb_user_lookup(db, jrecord->fields[FIELD_PROFILE_UID])) == NULL) {
+        err = GWEB_MYSQL_ERR_NO_RECORD;
+        goto __bail_out;
+    }
+
+    /* Absent fields are left as is, empty ones are cleared */
+    for (idx = 0; idx < sizeof(address) / sizeof(address[0]); idx++) {
+        if ((value = jrecord->fields[address[idx][0]]) == NULL) {
+            continue;
+        }
+        if (memdb_set(&user->fields[address[idx][1]],
+                      *value ? value : NULL) != MYSQL_STATUS_OK) {
+            goto __bail_out;
+        }
+    }
+
+    err = GWEB_MYSQL_OK;
+    ret = MYSQL_STATUS_OK;
+
+__bail_out:
+    pthread_rwlock_unlock(&db->lock);
+    gweb_mysql_update_response(JSON_C_PROFILE_RESP, err, j2cresp);
+    return ret;
+}
+
+int
+gweb_memdb_handle_avatar (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                          j2c_resp_t **j2cresp)
+{
+    int err = GWEB_MYSQL_ERR_NO_RECORD, ret = MYSQL_STATUS_FAIL;
+    struct memdb_user *user;
+
+    J2C_MSG_TABLE(avatar, *jrecord) = &j2cmsg->avatar;
+
+    gweb_mysql_prepare_response(JSON_C_AVATAR_RESP, GWEB_MYSQL_OK, j2cresp);
+
+    pthread_rwlock_wrlock(&db->lock);
+    if ((user = memdb_user_lookup(db, jrecord->fields[FIELD_AVATAR_UID])) != NULL &&
+        memdb_set(&user->fields[MEMDB_FIELD(AVATAR_URL)],
+                  jrecord->fields[FIELD_AVATAR_URL]) == MYSQL_STATUS_OK) {
+        err = GWEB_MYSQL_OK;
+        ret = MYSQL_STATUS_OK;
+    }
+    pthread_rwlock_unlock(&db->lock);
+
+    gweb_mysql_update_response(JSON_C_AVATAR_RESP, err, j2cresp);
+    return ret;
+}
+
+int
+gweb_memdb_handle_cxn_request (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                               j2c_resp_t **j2cresp)
+{
+    char utc_dt_str[MAX_DATETIME_STRSZ];
+    int err = GWEB_MYSQL_ERR_UNKNOWN, ret = MYSQL_STATUS_FAIL;
+    struct memdb_user *from, *to;
+    struct memdb_link *link;
+    const char *flag;
+
+    J2C_MSG_TABLE(cxn_request, *jrecord) = &j2cmsg->cxn_request;
+
+    gweb_mysql_prepare_response(JSON_C_CXN_REQUEST_RESP, GWEB_MYSQL_OK, j2cresp);
+
+    flag = jrecord->fields[FIELD_CXN_REQUEST_FLAG];
+    gweb_get_utc_datetime(utc_dt_str);
+
+    pthread_rwlock_wrlock(&db->lock);
+
+    from = memdb_user_lookup(db, jrecord->fields[FIELD_CXN_REQUEST_UID]);
+    to = memdb_user_lookup(db, jrecord->fields[FIELD_CXN_REQUEST_TO_UID]);
+    if (!from || !to || from == to) {
+        err = GWEB_MYSQL_ERR_NO_RECORD;
+        goto __bail_out;
+    }
+
+    /* A repeated request only updates the flag */
+    if ((link = memdb_link_lookup(db->requests, from, to, NULL)) != NULL) {
+        if (memdb_set(&link->value, flag) != MYSQL_STATUS_OK) {
+            goto __bail_out;
+        }
+    } else if (memdb_link_add(db->requests, &from->requests_from, &to->requests_to,
+                              from, to, utc_dt_str, flag, 0) == NULL) {
+        goto __bail_out;
+    }
+
+    if (flag && strcmp(flag, CXN_REQUEST_FLAG_CLOSED) == 0 &&
+        memdb_cxn_accept(db, from, to, utc_dt_str) != MYSQL_STATUS_OK) {
+        goto __bail_out;
+    }
+
+    err = GWEB_MYSQL_OK;
+    ret = MYSQL_STATUS_OK;
+
+__bail_out:
+    pthread_rwlock_unlock(&db->lock);
+    gweb_mysql_update_response(JSON_C_CXN_REQUEST_RESP, err, j2cresp);
+    return ret;
+}
+
+int
+gweb_memdb_handle_cxn_channel (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                               j2c_resp_t **j2cresp)
+{
+    char utc_dt_str[MAX_DATETIME_STRSZ];
+    int err = GWEB_MYSQL_ERR_UNKNOWN, ret = MYSQL_STATUS_FAIL;
+    struct memdb_user *from, *to;
+    const char *type;
+
+    J2C_MSG_TABLE(cxn_channel, *jrecord) = &j2cmsg->cxn_channel;
+
+    gweb_mysql_prepare_response(JSON_C_CXN_CHANNEL_RESP, GWEB_MYSQL_OK, j2cresp);
+
+    if ((type = jrecord->fields[FIELD_CXN_CHANNEL_TYPE]) == NULL) {
+        err = GWEB_MYSQL_ERR_NO_RECORD;
+        goto __bail_out;
+    }
+    gweb_get_utc_datetime(utc_dt_str);
+
+    pthread_rwlock_wrlock(&db->lock);
+
+    from = memdb_user_lookup(db, jrecord->fields[FIELD_CXN_CHANNEL_UID]);
+    to = memdb_user_lookup(db, jrecord->fields[FIELD_CXN_CHANNEL_TO_UID]);
+    if (!from || !to || from == to) {
+        err = GWEB_MYSQL_ERR_NO_RECORD;
+    } else if (memdb_channel_add(db, from, to, utc_dt_str, type) == MYSQL_STATUS_OK) {
+        err = GWEB_MYSQL_OK;
+        ret = MYSQL_STATUS_OK;
+    }
+
+    pthread_rwlock_unlock(&db->lock);
+
+__bail_out:
+    gweb_mysql_update_response(JSON_C_CXN_CHANNEL_RESP, err, j2cresp);
+    return ret;
+}
+
+int
+gweb_memdb_handle_cxn_request_query (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                                     j2c_resp_t **j2cresp)
+{
+    int match_count, max_rows, idx, direction = 0;
+    int limit = MYSQL_MAX_CXN_REQUEST_ROWS_PER_QUERY + 1;
+    int err = GWEB_MYSQL_ERR_UNKNOWN, ret = MYSQL_STATUS_FAIL;
+    char buf[32];
+
+    const char *uid = NULL;
+    const char *after[2] = { GWEB_CURSOR_MIN_DATE, "" };
+    char curbuf[MAX_CURSOR_STRSZ];
+
+    struct memdb_user *user;
+    struct memdb_row *rows = NULL;
+
+    J2C_MSG_TABLE(cxn_request_query, *jrecord) = &j2cmsg->cxn_request_query;
+    J2C_RESP_TABLE(cxn_request_query, *resp) = NULL;
+    struct j2c_cxn_request_query_resp_array1 *arr;
+
+    gweb_mysql_prepare_response(JSON_C_CXN_REQUEST_QUERY_RESP, GWEB_MYSQL_OK, j2cresp);
+    resp = &(*j2cresp)->cxn_request_query;
+    resp->nr_array1_records = -1; /* No records */
+
+    if (jrecord->fields[FIELD_CXN_REQUEST_QUERY_FROM_UID]) {
+        uid = jrecord->fields[FIELD_CXN_REQUEST_QUERY_FROM_UID];
+        direction = CXN_OUTBOUND;
+
+    } else if (jrecord->fields[FIELD_CXN_REQUEST_QUERY_TO_UID]) {
+        uid = jrecord->fields[FIELD_CXN_REQUEST_QUERY_TO_UID];
+        direction = CXN_INBOUND;
+    }
+
+    if (gweb_cursor_decode(jrecord->fields[FIELD_CXN_REQUEST_QUERY_CURSOR],
+                           curbuf, sizeof(curbuf), 2, after) < 0) {
+        err = GWEB_MYSQL_ERR_INVALID;
+        goto __bail_out;
+    }
+
+    pthread_rwlock_rdlock(&db->lock);
+
+    if (!direction || (user = memdb_user_lookup(db, uid)) == NULL) {
+        err = GWEB_MYSQL_ERR_NO_RECORD;
+        goto __unlock;
+    }
+
+    match_count = memdb_link_page((direction == CXN_INBOUND) ?
+                                  &user->requests_to : &user->requests_from,
+                                  direction == CXN_INBOUND,
+                                  jrecord->fields[FIELD_CXN_REQUEST_QUERY_FLAG],
+                                  2, after, &rows, limit);
+    if (match_count < 0) {
+        err = GWEB_MYSQL_ERR_NO_MEMORY;
+        goto __unlock;
+    }
+
+    max_rows = (match_count >= MYSQL_MAX_CXN_REQUEST_ROWS_PER_QUERY) ?
+        MYSQL_MAX_CXN_REQUEST_ROWS_PER_QUERY: match_count;
+
+    if (max_rows &&
+        (resp->array1 = calloc(max_rows, sizeof(*resp->array1))) == NULL) {
+        err = GWEB_MYSQL_ERR_NO_MEMORY;
+        goto __unlock;
+    }
+
+    for (idx = 0; idx < max_rows; idx++) {
+        arr = &resp->array1[idx];
+        resp->nr_array1_records = idx + 1;
+
+        arr->fields[CXN_REQ_IDX(UID)] = strdup(rows[idx].peer);
+        arr->fields[CXN_REQ_IDX(DATE)] = strdup(rows[idx].date);
+        arr->fields[CXN_REQ_IDX(FLAG)] = memdb_strdup(rows[idx].value);
+        memdb_user_card(rows[idx].user, &arr->fields[CXN_REQ_IDX(FNAME)],
+                        &arr->fields[CXN_REQ_IDX(LNAME)],
+                        &arr->fields[CXN_REQ_IDX(AVATAR_URL)]);
+    }
+
+    /* One row over the page, the next page starts after the last row */
+    if (match_count > max_rows) {
+        after[0] = rows[max_rows - 1].date;
+        after[1] = rows[max_rows - 1].peer;
+        resp->fields[FIELD_CXN_REQUEST_QUERY_RESP_NEXT_CURSOR] =
+            gweb_cursor_encode(2, after);
+    }
+
+    sprintf(buf, "%d", max_rows);
+    resp->fields[FIELD_CXN_REQUEST_QUERY_RESP_RECORD_COUNT] = strdup(buf);
+    resp->nr_array1_records = max_rows;
+
+    err = GWEB_MYSQL_OK;
+    ret = MYSQL_STATUS_OK;
+
+__unlock:
+    pthread_rwlock_unlock(&db->lock);
+    free(rows);
+__bail_out:
+    gweb_mysql_update_response(JSON_C_CXN_REQUEST_QUERY_RESP, err, j2cresp);
+    return ret;
+}
+
+int
+gweb_memdb_handle_cxn_channel_query (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                                     j2c_resp_t **j2cresp)
+{
+    int match_count, max_rows, idx, direction = 0;
+    int limit = MYSQL_MAX_CXN_CHANNEL_ROWS_PER_QUERY + 1;
+    int err = GWEB_MYSQL_ERR_UNKNOWN, ret = MYSQL_STATUS_FAIL;
+    char buf[32];
+
+    const char *uid = NULL;
+    const char *after[3] = { GWEB_CURSOR_MIN_DATE, "", "" };
+    char curbuf[MAX_CURSOR_STRSZ];
+
+    struct memdb_user *user;
+    struct memdb_row *rows = NULL;
+
+    J2C_MSG_TABLE(cxn_channel_query, *jrecord) = &j2cmsg->cxn_channel_query;
+    J2C_RESP_TABLE(cxn_channel_query, *resp) = NULL;
+    struct j2c_cxn_channel_query_resp_array1 *arr;
+
+    gweb_mysql_prepare_response(JSON_C_CXN_CHANNEL_QUERY_RESP, GWEB_MYSQL_OK, j2cresp);
+    resp = &(*j2cresp)->cxn_channel_query;
+    resp->nr_array1_records = -1; /* No records */
+
+    if (jrecord->fields[FIELD_CXN_CHANNEL_QUERY_FROM_UID]) {
+        uid = jrecord->fields[FIELD_CXN_CHANNEL_QUERY_FROM_UID];
+        direction = CXN_OUTBOUND;
+
+    } else if (jrecord->fields[FIELD_CXN_CHANNEL_QUERY_TO_UID]) {
+        uid = jrecord->fields[FIELD_CXN_CHANNEL_QUERY_TO_UID];
+        direction = CXN_INBOUND;
+    }
+
+    if (gweb_cursor_decode(jrecord->fields[FIELD_CXN_CHANNEL_QUERY_CURSOR],
+                           curbuf, sizeof(curbuf), 3, after) < 0) {
+        err = GWEB_MYSQL_ERR_INVALID;
+        goto __bail_out;
+    }
+
+    pthread_rwlock_rdlock(&db->lock);
+
+    if (!direction || (user = memdb_user_lookup(db, uid)) == NULL) {
+        err = GWEB_MYSQL_ERR_NO_RECORD;
+        goto __unlock;
+    }
+
+    match_count = memdb_link_page((direction == CXN_INBOUND) ?
+                                  &user->channels_to : &user->channels_from,
+                                  direction == CXN_INBOUND,
+                                  jrecord->fields[FIELD_CXN_CHANNEL_QUERY_TYPE],
+                                  3, after, &rows, limit);
+    if (match_count < 0) {
+        err = GWEB_MYSQL_ERR_NO_MEMORY;
+        goto __unlock;
+    }
+
+    max_rows = (match_count >= MYSQL_MAX_CXN_CHANNEL_ROWS_PER_QUERY) ?
+        MYSQL_MAX_CXN_CHANNEL_ROWS_PER_QUERY: match_count;
+
+    if (max_rows &&
+        (resp->array1 = calloc(max_rows, sizeof(*resp->array1))) == NULL) {
+        err = GWEB_MYSQL_ERR_NO_MEMORY;
+        goto __unlock;
+    }
+
+    for (idx = 0; idx < max_rows; idx++) {
+        arr = &resp->array1[idx];
+        resp->nr_array1_records = idx + 1;
+
+        arr->fields[CXN_CHNL_IDX(UID)] = strdup(rows[idx].peer);
+        arr->fields[CXN_CHNL_IDX(DATE)] = strdup(rows[idx].date);
+        arr->fields[CXN_CHNL_IDX(CHANNEL_TYPE)] = memdb_strdup(rows[idx].value);
+        memdb_user_card(rows[idx].user, &arr->fields[CXN_CHNL_IDX(FNAME)],
+                        &arr->fields[CXN_CHNL_IDX(LNAME)],
+                        &arr->fields[CXN_CHNL_IDX(AVATAR_URL)]);
+    }
+
+    /* One row over the page, the next page starts after the last row */
+    if (match_count > max_rows) {
+        after[0] = rows[max_rows - 1].date;
+        after[1] = rows[max_rows - 1].peer;
+        after[2] = rows[max_rows - 1].value;
+        resp->fields[FIELD_CXN_CHANNEL_QUERY_RESP_NEXT_CURSOR] =
+            gweb_cursor_encode(3, after);
+    }
+
+    sprintf(buf, "%d", max_rows);
+    resp->fields[FIELD_CXN_CHANNEL_QUERY_RESP_RECORD_COUNT] = strdup(buf);
+    resp->nr_array1_records = max_rows;
+
+    err = GWEB_MYSQL_OK;
+    ret = MYSQL_STATUS_OK;
+
+__unlock:
+    pthread_rwlock_unlock(&db->lock);
+    free(rows);
+__bail_out:
+    gweb_mysql_update_response(JSON_C_CXN_CHANNEL_QUERY_RESP, err, j2cresp);
+    return ret;
+}
+
+int
+gweb_memdb_handle_uid_query (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                             j2c_resp_t **j2cresp)
+{
+    int err = GWEB_MYSQL_ERR_NO_RECORD, ret = MYSQL_STATUS_FAIL;
+    struct memdb_user *user;
+
+    J2C_MSG_TABLE(uid_query, *jrecord) = &j2cmsg->uid_query;
+
+    gweb_mysql_prepare_response(JSON_C_UID_QUERY_RESP, GWEB_MYSQL_OK, j2cresp);
+
+    pthread_rwlock_rdlock(&db->lock);
+    if ((user = memdb_user_by_email(db, jrecord->fields[FIELD_UID_QUERY_EMAIL])) != NULL) {
+        (*j2cresp)->uid_query.fields[FIELD_UID_QUERY_RESP_UID] = strdup(MEMDB_UID(user));
+        err = GWEB_MYSQL_OK;
+        ret = MYSQL_STATUS_OK;
+    }
+    pthread_rwlock_unlock(&db->lock);
+
+    gweb_mysql_update_response(JSON_C_UID_QUERY_RESP, err, j2cresp);
+    return ret;
+}
+
+int
+gweb_memdb_handle_profile_query (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                                 j2c_resp_t **j2cresp)
+{
+    int err = GWEB_MYSQL_ERR_NO_RECORD, ret = MYSQL_STATUS_FAIL;
+    struct memdb_user *user;
+
+    J2C_MSG_TABLE(profile_query, *jrecord) = &j2cmsg->profile_query;
+
+    gweb_mysql_prepare_response(JSON_C_PROFILE_INFO_RESP, GWEB_MYSQL_OK, j2cresp);
+
+    pthread_rwlock_rdlock(&db->lock);
+    if ((user = memdb_user_lookup(db, jrecord->fields[FIELD_PROFILE_QUERY_UID])) != NULL) {
+        err = memdb_profile_info(user, *j2cresp);
+    }
+    pthread_rwlock_unlock(&db->lock);
+
+    if (err == GWEB_MYSQL_OK) {
+        ret = MYSQL_STATUS_OK;
+    }
+
+    gweb_mysql_update_response(JSON_C_PROFILE_INFO_RESP, err, j2cresp);
+    return ret;
+}
+
+int
+gweb_memdb_handle_avatar_query (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                                j2c_resp_t **j2cresp)
+{
+    int err = GWEB_MYSQL_ERR_NO_RECORD, ret = MYSQL_STATUS_FAIL;
+    struct memdb_user *user;
+    const char *url;
+
+    J2C_MSG_TABLE(avatar_query, *jrecord) = &j2cmsg->avatar_query;
+
+    gweb_mysql_prepare_response(JSON_C_AVATAR_QUERY_RESP, GWEB_MYSQL_OK, j2cresp);
+
+    pthread_rwlock_rdlock(&db->lock);
+    if ((user = memdb_user_lookup(db, jrecord->fields[FIELD_AVATAR_QUERY_UID])) != NULL) {
+        url = user->fields[MEMDB_FIELD(AVATAR_URL)];
+        (*j2cresp)->avatar_query.fields[FIELD_AVATAR_QUERY_RESP_URL] =
+            strdup(url ? url : "");
+        err = GWEB_MYSQL_OK;
+        ret = MYSQL_STATUS_OK;
+    }
+    pthread_rwlock_unlock(&db->lock);
+
+    gweb_mysql_update_response(JSON_C_AVATAR_QUERY_RESP, err, j2cresp);
+    return ret;
+}
+
+int
+gweb_memdb_handle_cxn_preference (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                                  j2c_resp_t **j2cresp)
+{
+    int idx, nr_rows = 0, err = GWEB_MYSQL_ERR_UNKNOWN, ret = MYSQL_STATUS_FAIL;
+    struct memdb_user *user;
+    const char *flag;
+
+    J2C_MSG_TABLE(cxn_preference, *jrecord) = &j2cmsg->cxn_preference;
+    struct j2c_cxn_preference_msg_array1 *arr;
+
+    gweb_mysql_prepare_response(JSON_C_CXN_PREFERENCE_RESP, GWEB_MYSQL_OK, j2cresp);
+
+    pthread_rwlock_wrlock(&db->lock);
+
+    if ((user = memdb_user_lookup(db, jrecord->fields[FIELD_CXN_PREFERENCE_UID])) == NULL) {
+        err = GWEB_MYSQL_ERR_NO_RECORD;
+        goto __bail_out;
+    }
+
+    /* Existing channels take the new flags */
+    for (idx = 0; idx < jrecord->nr_array1_records; idx++) {
+        arr = &jrecord->array1[idx];
+        if (!arr->fields[CXN_PREF_INS_IDX(CHANNEL_TYPE)]) {
+            continue;
+        }
+        flag = arr->fields[CXN_PREF_INS_IDX(FLAG)];
+        if (memdb_pref_set(user, arr->fields[CXN_PREF_INS_IDX(CHANNEL_TYPE)],
+                           flag ? flag : "") != MYSQL_STATUS_OK) {
+            goto __bail_out;
+        }
+        nr_rows++;
+    }
+
+    if (nr_rows == 0) {
+        err = GWEB_MYSQL_ERR_NO_RECORD;
+        goto __bail_out;
+    }
+
+    err = GWEB_MYSQL_OK;
+    ret = MYSQL_STATUS_OK;
+
+__bail_out:
+    pthread_rwlock_unlock(&db->lock);
+    gweb_mysql_update_response(JSON_C_CXN_PREFERENCE_RESP, err, j2cresp);
+    return ret;
+}
+
+int
+gweb_memdb_handle_cxn_preference_query (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                                        j2c_resp_t **j2cresp)
+{
+    int match_count, max_rows, first, found, idx;
+    int err = GWEB_MYSQL_ERR_UNKNOWN, ret = MYSQL_STATUS_FAIL;
+    char buf[32];
+    const char *after[1] = { "" };
+    char curbuf[MAX_CURSOR_STRSZ];
+    struct memdb_user *user;
+    struct memdb_pref *pref;
+
+    J2C_MSG_TABLE(cxn_preference_query, *jrecord) = &j2cmsg->cxn_preference_query;
+    J2C_RESP_TABLE(cxn_preference_query, *resp) = NULL;
+    struct j2c_cxn_preference_query_resp_array1 *arr;
+
+    gweb_mysql_prepare_response(JSON_C_CXN_PREFERENCE_QUERY_RESP, GWEB_MYSQL_OK, j2cresp);
+    resp = &(*j2cresp)->cxn_preference_query;
+    resp->nr_array1_records = -1; /* No records */
+
+    if (gweb_cursor_decode(jrecord->fields[FIELD_CXN_PREFERENCE_QUERY_CURSOR],
+                           curbuf, sizeof(curbuf), 1, after) < 0) {
+        err = GWEB_MYSQL_ERR_INVALID;
+        goto __bail_out;
+    }
+
+    pthread_rwlock_rdlock(&db->lock);
+
+    if ((user = memdb_user_lookup(db, jrecord->fields[FIELD_CXN_PREFERENCE_QUERY_UID])) == NULL) {
+        err = GWEB_MYSQL_ERR_NO_RECORD;
+        goto __unlock;
+    }
+
+    /* Preferences are kept sorted, the page starts past the cursor */
+    first = memdb_pref_find(user, after[0], &found);
+    first += found;
+
+    match_count = user->nr_prefs - first;
+    if (match_count == 0) {
+        err = GWEB_MYSQL_ERR_NO_RECORD;
+        goto __unlock;
+    }
+
+    max_rows = (match_count >= MYSQL_MAX_CXN_PREFERENCE_ROWS_PER_QUERY) ?
+        MYSQL_MAX_CXN_PREFERENCE_ROWS_PER_QUERY: match_count;
+
+    if ((resp->array1 = calloc(max_rows, sizeof(*resp->array1))) == NULL) {
+        err = GWEB_MYSQL_ERR_NO_MEMORY;
+        goto __unlock;
+    }
+
+    for (idx = 0; idx < max_rows; idx++) {
+        arr = &resp->array1[idx];
+        pref = &user->prefs[first + idx];
+        resp->nr_array1_records = idx + 1;
+
+        arr->fields[CXN_PREF_IDX(CHANNEL_TYPE)] = strdup(pref->channel);
+        arr->fields[CXN_PREF_IDX(FLAG)] = strdup(pref->flag);
+    }
+
+    /* Rows left past the page, the next page starts after the last row */
+    if (match_count > max_rows) {
+        after[0] = user->prefs[first + max_rows - 1].channel;
+        resp->fields[FIELD_CXN_PREFERENCE_QUERY_RESP_NEXT_CURSOR] =
+            gweb_cursor_encode(1, after);
+    }
+
+    sprintf(buf, "%d", max_rows);
+    resp->fields[FIELD_CXN_PREFERENCE_QUERY_RESP_RECORD_COUNT] = strdup(buf);
+    resp->nr_array1_records = max_rows;
+
+    err = GWEB_MYSQL_OK;
+    ret = MYSQL_STATUS_OK;
+
+__unlock:
+    pthread_rwlock_unlock(&db->lock);
+__bail_out:
+    gweb_mysql_update_response(JSON_C_CXN_PREFERENCE_QUERY_RESP, err, j2cresp);
+    return ret;
+}
+
+int
+gweb_memdb_handle_location (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                            j2c_resp_t **j2cresp)
+{
+    int err = GWEB_MYSQL_ERR_NO_RECORD, ret = MYSQL_STATUS_FAIL;
+    struct memdb_location *loc;
+    struct memdb_user *user;
+    double latitude, longitude;
+
+    J2C_MSG_TABLE(location, *jrecord) = &j2cmsg->location;
+
+    gweb_mysql_prepare_response(JSON_C_LOCATION_RESP, GWEB_MYSQL_OK, j2cresp);
+
+    /* Sanity tests */
+    if (!jrecord->fields[FIELD_LOCATION_LATITUDE] ||
+        !jrecord->fields[FIELD_LOCATION_LONGITUDE]) {
+        goto __bail_out;
+    }
+
+    latitude = atof(jrecord->fields[FIELD_LOCATION_LATITUDE]);
+    longitude = atof(jrecord->fields[FIELD_LOCATION_LONGITUDE]);
+    if (!gweb_geo_valid(latitude, longitude)) {
+        err = GWEB_MYSQL_ERR_INVALID;
+        goto __bail_out;
+    }
+
+    pthread_rwlock_wrlock(&db->lock);
+
+    if ((user = memdb_user_lookup(db, jrecord->fields[FIELD_LOCATION_UID])) != NULL) {
+        loc = &user->location;
+        loc->valid = 1;
+        loc->latitude = latitude;
+        loc->longitude = longitude;
+        loc->expiry = jrecord->fields[FIELD_LOCATION_EXPIRY] ?
+            atoi(jrecord->fields[FIELD_LOCATION_EXPIRY]) :
+            GWEB_DEFAULT_GEO_LOCATION_EXPIRY;
+        loc->radius = jrecord->fields[FIELD_LOCATION_RADIUS] ?
+            atoi(jrecord->fields[FIELD_LOCATION_RADIUS]) :
+            GWEB_DEFAULT_GEO_LOCATION_RADIUS;
+        loc->seen_at = time(NULL);
+        gweb_get_utc_datetime(loc->seen);
+
+        gweb_geo_grid_update(MEMDB_UID(user), loc->latitude, loc->longitude,
+                             loc->seen, loc->expiry, loc->radius);
+
+        err = GWEB_MYSQL_OK;
+        ret = MYSQL_STATUS_OK;
+    }
+
+    pthread_rwlock_unlock(&db->lock);
+
+__bail_out:
+    gweb_mysql_update_response(JSON_C_LOCATION_RESP, err, j2cresp);
+    return ret;
+}
+
+int
+gweb_memdb_handle_location_query (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                                  j2c_resp_t **j2cresp)
+{
+    int err = GWEB_MYSQL_ERR_NO_RECORD, ret = MYSQL_STATUS_FAIL;
+    struct memdb_location loc;
+    struct memdb_user *user;
+    char numbuf[32];
+
+    J2C_MSG_TABLE(location_query, *jrecord) = &j2cmsg->location_query;
+    J2C_RESP_TABLE(location_query, *resp) = NULL;
+
+    gweb_mysql_prepare_response(JSON_C_LOCATION_QUERY_RESP, GWEB_MYSQL_OK, j2cresp);
+    resp = &(*j2cresp)->location_query;
+
+    pthread_rwlock_rdlock(&db->lock);
+    user = memdb_user_lookup(db, jrecord->fields[FIELD_LOCATION_QUERY_UID]);
+    if (user) {
+        loc = user->location;
+    }
+    pthread_rwlock_unlock(&db->lock);
+
+    if (!user || !loc.valid) {
+        goto __bail_out;
+    }
+
+    snprintf(numbuf, sizeof(numbuf), "%.17g", loc.latitude);
+    resp->fields[FIELD_LOCATION_QUERY_RESP_LATITUDE] = strdup(numbuf);
+    snprintf(numbuf, sizeof(numbuf), "%.17g", loc.longitude);
+    resp->fields[FIELD_LOCATION_QUERY_RESP_LONGITUDE] = strdup(numbuf);
+    resp->fields[FIELD_LOCATION_QUERY_RESP_LOCATION_TIME] = strdup(loc.seen);
+    snprintf(numbuf, sizeof(numbuf), "%d", loc.expiry);
+    resp->fields[FIELD_LOCATION_QUERY_RESP_EXPIRY] = strdup(numbuf);
+    snprintf(numbuf, sizeof(numbuf), "%d", loc.radius);
+    resp->fields[FIELD_LOCATION_QUERY_RESP_RADIUS] = strdup(numbuf);
+
+    err = GWEB_MYSQL_OK;
+    ret = MYSQL_STATUS_OK;
+
+__bail_out:
+    gweb_mysql_update_response(JSON_C_LOCATION_QUERY_RESP, err, j2cresp);
+    return ret;
+}
+
+/* Searches the grid does not take, ranked over every live location */
+static int
+memdb_neighbour_scan (struct gweb_memdb *db, const struct memdb_user *self,
+                      double latitude, double longitude, double distance,
+                      double after_distance, const char *after_uid,
+                      struct gweb_geo_match *matches, int limit)
+{
+    struct gweb_geo_batch batch = { 0 };
+    struct memdb_user *user;
+    struct list *pos;
+    time_t now = time(NULL);
+    int idx, ret = -1;
+
+    for (idx = 0; idx < GWEB_MEMDB_HASH_SIZE; idx++) {
+        for (pos = db->uids[idx].next; pos != &db->uids[idx]; pos = pos->next) {
+            user = list_entry(pos, struct memdb_user, uid_node);
+            if (user == self || !memdb_location_live(&user->location, now)) {
+                continue;
+            }
+            if (gweb_geo_batch_add(&batch, MEMDB_UID(user), user->location.latitude,
+                                   user->location.longitude) != MYSQL_STATUS_OK) {
+                goto __bail_out;
+            }
+        }
+    }
+
+    ret = gweb_geo_batch_rank(&batch, latitude, longitude, distance,
+                              after_distance, after_uid, matches, limit);
+
+__bail_out:
+    gweb_geo_batch_free(&batch);
+    return ret;
+}
+
+int
+gweb_memdb_handle_neighbour_query (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                                   j2c_resp_t **j2cresp)
+{
+    int err = GWEB_MYSQL_ERR_UNKNOWN, ret = MYSQL_STATUS_FAIL;
+    int match_count, max_rows, idx;
+    double distance;
+    char buf[32];
+
+    const char *uid, *radius;
+    const char *after[2] = { GWEB_CURSOR_MIN_DISTANCE, "" };
+    char curbuf[MAX_CURSOR_STRSZ];
+    int limit = MYSQL_MAX_NEIGHBOUR_ROWS_PER_QUERY + 1;
+    struct gweb_geo_match matches[MYSQL_MAX_NEIGHBOUR_ROWS_PER_QUERY + 1];
+
+    struct memdb_user *user, *peer;
+    struct memdb_location *loc;
+
+    J2C_MSG_TABLE(neighbour_query, *jrecord) = &j2cmsg->neighbour_query;
+    J2C_RESP_TABLE(neighbour_query, *resp) = NULL;
+    struct j2c_neighbour_query_resp_array1 *arr;
+
+    gweb_mysql_prepare_response(JSON_C_NEIGHBOUR_QUERY_RESP, GWEB_MYSQL_OK, j2cresp);
+    resp = &(*j2cresp)->neighbour_query;
+    resp->nr_array1_records = -1; /* No records */
+
+    uid = jrecord->fields[FIELD_NEIGHBOUR_QUERY_UID];
+    radius = jrecord->fields[FIELD_NEIGHBOUR_QUERY_RADIUS];
+
+    if (gweb_cursor_decode(jrecord->fields[FIELD_NEIGHBOUR_QUERY_CURSOR],
+                           curbuf, sizeof(curbuf), 2, after) < 0) {
+        err = GWEB_MYSQL_ERR_INVALID;
+        goto __bail_out;
+    }
+
+    pthread_rwlock_rdlock(&db->lock);
+
+    /* Expired locations are reported as no records */
+    if ((user = memdb_user_lookup(db, uid)) == NULL ||
+        !memdb_location_live(&user->location, time(NULL))) {
+        err = GWEB_MYSQL_ERR_NO_RECORD;
+        goto __unlock;
+    }
+    loc = &user->location;
+    distance = radius ? atof(radius) : loc->radius;
+
+    match_count = gweb_geo_grid_neighbours(uid, loc->latitude, loc->longitude,
+                                           distance, atof(after[0]), after[1],
+                                           matches, limit);
+    if (match_count < 0) {
+        match_count = memdb_neighbour_scan(db, user, loc->latitude, loc->longitude,
+                                           distance, atof(after[0]), after[1],
+                                           matches, limit);
+    }
+    if (match_count < 0) {
+        goto __unlock;
+    }
+
+    max_rows = (match_count >= MYSQL_MAX_NEIGHBOUR_ROWS_PER_QUERY) ?
+        MYSQL_MAX_NEIGHBOUR_ROWS_PER_QUERY: match_count;
+
+    if (max_rows &&
+        (resp->array1 = calloc(max_rows, sizeof(*resp->array1))) == NULL) {
+        err = GWEB_MYSQL_ERR_NO_MEMORY;
+        goto __unlock;
+    }
+
+    for (idx = 0; idx < max_rows; idx++) {
+        arr = &resp->array1[idx];
+        resp->nr_array1_records = idx + 1;
+
+        arr->fields[NEIGHBOUR_IDX(UID)] = strdup(matches[idx].uid);
+        snprintf(buf, sizeof(buf), "%.17g", matches[idx].latitude);
+        arr->fields[NEIGHBOUR_IDX(LATITUDE)] = strdup(buf);
+        snprintf(buf, sizeof(buf), "%.17g", matches[idx].longitude);
+        arr->fields[NEIGHBOUR_IDX(LONGITUDE)] = strdup(buf);
+        snprintf(buf, sizeof(buf), "%.17g", matches[idx].distance);
+        arr->fields[NEIGHBOUR_IDX(DISTANCE)] = strdup(buf);
+
+        if ((peer = memdb_user_lookup(db, matches[idx].uid)) != NULL) {
+            memdb_user_card(peer, &arr->fields[NEIGHBOUR_IDX(FNAME)],
+                            &arr->fields[NEIGHBOUR_IDX(LNAME)],
+                            &arr->fields[NEIGHBOUR_IDX(AVATAR_URL)]);
+        }
+
+        /* One match over the page, the next page starts after this row */
+        if (idx == max_rows - 1 && match_count > max_rows) {
+            after[0] = arr->fields[NEIGHBOUR_IDX(DISTANCE)];
+            after[1] = arr->fields[NEIGHBOUR_IDX(UID)];
+            resp->fields[FIELD_NEIGHBOUR_QUERY_RESP_NEXT_CURSOR] =
+                gweb_cursor_encode(2, after);
+        }
+    }
+
+    sprintf(buf, "%d", max_rows);
+    resp->fields[FIELD_NEIGHBOUR_QUERY_RESP_RECORD_COUNT] = strdup(buf);
+    resp->nr_array1_records = max_rows;
+
+    err = GWEB_MYSQL_OK;
+    ret = MYSQL_STATUS_OK;
+
+__unlock:
+    pthread_rwlock_unlock(&db->lock);
+__bail_out:
+    gweb_mysql_update_response(JSON_C_NEIGHBOUR_QUERY_RESP, err, j2cresp);
+    return ret;
+}
+
+struct memdb_suggestion {
+    const struct memdb_user *user;
+    int mutual;
+};
+
+static int
+memdb_user_ptr_cmp (const void *a, const void *b)
+{
+    uintptr_t ua = (uintptr_t)*(const struct memdb_user *const *)a;
+    uintptr_t ub = (uintptr_t)*(const struct memdb_user *const *)b;
+
+    return (ua > ub) - (ua < ub);
+}
+
+/* More connections shared first, then by UID */
+static int
+memdb_suggestion_cmp (const void *a, const void *b)
+{
+    const struct memdb_suggestion *sa = a, *sb = b;
+
+    if (sa->mutual != sb->mutual) {
+        return sb->mutual - sa->mutual;
+    }
+    return strcmp(MEMDB_UID(sa->user), MEMDB_UID(sb->user));
+}
+
+/*
+ * Append the channel peers of user, either way and each once, to
+ * peers[nr..], grown as needed. Returns the new count, or -1.
+ */
+static int
+memdb_channel_peers (const struct memdb_user *user, const struct memdb_user ***peers,
+                     int nr, int *size)
+{
+    const struct list *heads[] = { &user->channels_from, &user->channels_to };
+    const struct memdb_user **grown;
+    const struct memdb_link *link;
+    const struct list *pos;
+    int head, idx, start = nr, nr_unique = nr;
+
+    for (head = 0; head < ARRAY_SIZE(heads); head++) {
+        for (pos = heads[head]->next; pos != heads[head]; pos = pos->next) {
+            if (nr == *size) {
+                *size = *size ? 2 * *size : 64;
+                if ((grown = realloc(*peers, *size * sizeof(**peers))) == NULL) {
+                    return -1;
+                }
+                *peers = grown;
+            }
+            if (head == 0) {
+                link = list_entry(pos, struct memdb_link, from_node);
+                (*peers)[nr++] = link->to;
+            } else {
+                link = list_entry(pos, struct memdb_link, to_node);
+                (*peers)[nr++] = link->from;
+            }
+        }
+    }
+
+    qsort(&(*peers)[start], nr - start, sizeof(**peers), memdb_user_ptr_cmp);
+    for (idx = start; idx < nr; idx++) {
+        if (nr_unique == start || (*peers)[nr_unique - 1] != (*peers)[idx]) {
+            (*peers)[nr_unique++] = (*peers)[idx];
+        }
+    }
+    return nr_unique;
+}
+
+/*
+ * Peers of the user's connections, ranked by how many of them list
+ * each: once sorted, the run of a peer is its count of mutual ones.
+ */
+static int
+memdb_suggestions (const struct memdb_user *self, struct memdb_suggestion *top,
+                   int limit)
+{
+    const struct memdb_user **friends = NULL, **cands = NULL;
+    struct memdb_suggestion *ranked = NULL;
+    int nr_friends, nr_cands = 0, nr_ranked = 0, size = 0, cands_size = 0;
+    int idx, run, nr = -1;
+
+    if ((nr_friends = memdb_channel_peers(self, &friends, 0, &size)) < 0) {
+        goto __bail_out;
+    }
+    for (idx = 0; idx < nr_friends; idx++) {
+        if ((nr_cands = memdb_channel_peers(friends[idx], &cands, nr_cands,
+                                            &cands_size)) < 0) {
+            goto __bail_out;
+        }
+    }
+    qsort(cands, nr_cands, sizeof(*cands), memdb_user_ptr_cmp);
+
+    if ((ranked = malloc((nr_cands + 1) * sizeof(struct memdb_suggestion))) == NULL) {
+        goto __bail_out;
+    }
+    for (idx = 0; idx < nr_cands; idx += run) {
+        for (run = 1; idx + run < nr_cands && cands[idx + run] == cands[idx]; run++)
+            ;
+        if (cands[idx] == self ||
+            bsearch(&cands[idx], friends, nr_friends, sizeof(*friends),
+                    memdb_user_ptr_cmp)) {
+            continue;
+        }
+        ranked[nr_ranked].user = cands[idx];
+        ranked[nr_ranked++].mutual = run;
+    }
+    qsort(ranked, nr_ranked, sizeof(struct memdb_suggestion), memdb_suggestion_cmp);
+
+    nr = (nr_ranked < limit) ? nr_ranked : limit;
+    memcpy(top, ranked, nr * sizeof(struct memdb_suggestion));
+
+__bail_out:
+    free(friends);
+    free(cands);
+    free(ranked);
+    return nr;
+}
+
+int
+gweb_memdb_handle_suggestions_query (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                                     j2c_resp_t **j2cresp)
+{
+    int err = GWEB_MYSQL_ERR_UNKNOWN, ret = MYSQL_STATUS_FAIL;
+    struct memdb_suggestion top[MYSQL_MAX_SUGGESTION_ROWS_PER_QUERY];
+    struct memdb_user *user;
+    int idx, nr_rows;
+    char buf[32];
+
+    J2C_MSG_TABLE(suggestions_query, *jrecord) = &j2cmsg->suggestions_query;
+    J2C_RESP_TABLE(suggestions_query, *resp) = NULL;
+    struct j2c_suggestions_query_resp_array1 *arr;
+
+    gweb_mysql_prepare_response(JSON_C_SUGGESTIONS_QUERY_RESP, GWEB_MYSQL_OK, j2cresp);
+    resp = &(*j2cresp)->suggestions_query;
+    resp->nr_array1_records = -1; /* No records */
+
+    pthread_rwlock_rdlock(&db->lock);
+
+    if ((user = memdb_user_lookup(db, jrecord->fields[FIELD_SUGGESTIONS_QUERY_UID])) == NULL) {
+        err = GWEB_MYSQL_ERR_NO_RECORD;
+        goto __unlock;
+    }
+
+    if ((nr_rows = memdb_suggestions(user, top, MYSQL_MAX_SUGGESTION_ROWS_PER_QUERY)) < 0 ||
+        (nr_rows && (resp->array1 = calloc(nr_rows, sizeof(*resp->array1))) == NULL)) {
+        err = GWEB_MYSQL_ERR_NO_MEMORY;
+        goto __unlock;
+    }
+
+    for (idx = 0; idx < nr_rows; idx++) {
+        arr = &resp->array1[idx];
+        resp->nr_array1_records = idx + 1;
+
+        arr->fields[SUGGEST_IDX(UID)] = strdup(MEMDB_UID(top[idx].user));
+        memdb_user_card(top[idx].user, &arr->fields[SUGGEST_IDX(FNAME)],
+                        &arr->fields[SUGGEST_IDX(LNAME)],
+                        &arr->fields[SUGGEST_IDX(AVATAR_URL)]);
+        snprintf(buf, sizeof(buf), "%d", top[idx].mutual);
+        arr->fields[SUGGEST_IDX(MUTUAL)] = strdup(buf);
+    }
+
+    sprintf(buf, "%d", nr_rows);
+    resp->fields[FIELD_SUGGESTIONS_QUERY_RESP_RECORD_COUNT] = strdup(buf);
+    resp->nr_array1_records = nr_rows;
+
+    err = GWEB_MYSQL_OK;
+    ret = MYSQL_STATUS_OK;
+
+__unlock:
+    pthread_rwlock_unlock(&db->lock);
+    gweb_mysql_update_response(JSON_C_SUGGESTIONS_QUERY_RESP, err, j2cresp);
+    return ret;
+}
+
+/* Member counts only, there are no caches, pools or queries */
+int
+gweb_memdb_handle_stats_query (struct gweb_memdb *db, j2c_msg_t *j2cmsg,
+                               j2c_resp_t **j2cresp)
+{
+    J2C_RESP_TABLE(stats_query, *resp) = NULL;
+    int nr_users, nr_emails;
+    char buf[32];
+
+    gweb_mysql_prepare_response(JSON_C_STATS_QUERY_RESP, GWEB_MYSQL_OK, j2cresp);
+    resp = &(*j2cresp)->stats_query;
+
+    pthread_rwlock_rdlock(&db->lock);
+    nr_users = db->nr_users;
+    nr_emails = db->nr_emails;
+    pthread_rwlock_unlock(&db->lock);
+
+    snprintf(buf, sizeof(buf), "%d", nr_users);
+    resp->fields[FIELD_STATS_QUERY_RESP_MEMBER_UIDS] = strdup(buf);
+    snprintf(buf, sizeof(buf), "%d", nr_emails);
+    resp->fields[FIELD_STATS_QUERY_RESP_MEMBER_EMAILS] = strdup(buf);
+
+    return MYSQL_STATUS_OK;
+}
+
+static void *
+gweb_memdb_session_get (const struct gweb_storage_handler *handler,
+                        int read_only, const char *key)
+{
+    return g_memdb.ready ? &g_memdb : NULL;
+}
+
+static void
+gweb_memdb_session_put (void *session, int read_only, const char *key)
+{
+}
+
+static int
+gweb_memdb_check_uid (const char *uid)
+{
+    struct gweb_memdb *db = &g_memdb;
+    int found;
+
+    pthread_rwlock_rdlock(&db->lock);
+    found = db->ready && memdb_user_lookup(db, uid) != NULL;
+    pthread_rwlock_unlock(&db->lock);
+
+    return found;
+}
+
+/* Called with write lock held */
+static void
+gweb_memdb_free_all (struct gweb_memdb *db)
+{
+    struct list *tables[] = { db->requests, db->channels, db->uids };
+    struct memdb_user *user;
+    struct list *head;
+    size_t tbl;
+    int idx;
+
+    for (tbl = 0; tbl < sizeof(tables) / sizeof(tables[0]); tbl++) {
+        for (idx = 0; idx < GWEB_MEMDB_HASH_SIZE; idx++) {
+            head = &tables[tbl][idx];
+            while (!list_empty(head)) {
+                if (tables[tbl] == db->uids) {
+                    user = list_entry(head->next, struct memdb_user, uid_node);
+                    list_remove(&user->uid_node);
+                    memdb_user_free(user);
+                } else {
+                    memdb_link_free(list_entry(head->next, struct memdb_link,
+                                               hash_node));
+                }
+            }
+        }
+    }
+
+    free(db->uids);
+    free(db->emails);
+    free(db->requests);
+    free(db->channels);
+    db->uids = db->emails = db->requests = db->channels = NULL;
+    db->nr_users = db->nr_emails = 0;
+}
+
+int
+gweb_memdb_init (void)
+{
+    struct gweb_memdb *db = &g_memdb;
+    int idx;
+
+    pthread_rwlock_wrlock(&db->lock);
+
+    db->uids = calloc(GWEB_MEMDB_HASH_SIZE, sizeof(struct list));
+    db->emails = calloc(GWEB_MEMDB_HASH_SIZE, sizeof(struct list));
+    db->requests = calloc(GWEB_MEMDB_HASH_SIZE, sizeof(struct list));
+    db->channels = calloc(GWEB_MEMDB_HASH_SIZE, sizeof(struct list));
+    if (!db->uids || !db->emails || !db->requests || !db->channels) {
+        log_error("%s: unable to allocate memory!\n", __func__);
+        free(db->uids);
+        free(db->emails);
+        free(db->requests);
+        free(db->channels);
+        db->uids = db->emails = db->requests = db->channels = NULL;
+        pthread_rwlock_unlock(&db->lock);
+        return MYSQL_STATUS_FAIL;
+    }
+
+    for (idx = 0; idx < GWEB_MEMDB_HASH_SIZE; idx++) {
+        list_init(&db->uids[idx]);
+        list_init(&db->emails[idx]);
+        list_init(&db->requests[idx]);
+        list_init(&db->channels[idx]);
+    }
+
+    /* No rows to load, the grid starts empty */
+    if (gweb_geo_grid_init(NULL) != MYSQL_STATUS_OK) {
+        goto __bail_out;
+    }
+
+    db->ready = 1;
+    pthread_rwlock_unlock(&db->lock);
+
+    log_debug("In-memory store ready, %d buckets\n", GWEB_MEMDB_HASH_SIZE);
+
+    return MYSQL_STATUS_OK;
+
+__bail_out:
+    gweb_memdb_free_all(db);
+    pthread_rwlock_unlock(&db->lock);
+    return MYSQL_STATUS_FAIL;
+}
+
+int
+gweb_memdb_shutdown (void)
+{
+    struct gweb_memdb *db = &g_memdb;
+
+    pthread_rwlock_wrlock(&db->lock);
+    if (db->ready) {
+        gweb_geo_grid_shutdown();
+        gweb_memdb_free_all(db);
+        db->ready = 0;
+    }
+    pthread_rwlock_unlock(&db->lock);
+
+    return MYSQL_STATUS_OK;
+}
+
+const struct gweb_storage_ops gweb_memdb_storage = {
+    .name        = "memdb",
+    .init        = gweb_memdb_init,
+    .shutdown    = gweb_memdb_shutdown,
+    .session_get = gweb_memdb_session_get,
+    .session_put = gweb_memdb_session_put,
+    .check_uid   = gweb_memdb_check_uid,
+    .handlers    = gweb_memdb_storage_handlers,
+};
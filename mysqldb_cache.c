@@ -0,0 +1,524 @@
+/*
+ * Read-through caches in front of MySQL
+ *
+ * User cards (first name, last name, avatar URL) are read for every
+ * row of neighbour lists and by avatar queries, and change only when
+ * the user updates the profile or avatar. They are kept in a sharded
+ * LRU (lru.c) and dropped by the write handlers once committed.
+ *
+ * Full profile records, as returned by login and profile queries, are
+ * cached the same way, packed in a single allocation each, under a
+ * byte bound and a TTL so that a write missed by the invalidation
+ * hooks is not served forever.
+ *
+ * Friend of friend suggestions are cached per UID under a TTL too,
+ * the ranking reads the whole neighbourhood of the user.
+ *
+ * Connect preferences are cached per UID as one array, under a TTL,
+ * so accepting a request builds its channel rows without reading
+ * them back.
+ *
+ * Registered UIDs and emails are held as sets of 64-bit hashes
+ * (hashset.c), loaded at startup and added to on registration, so
+ * that existence checks mostly do not reach MySQL. Emails are case
+ * folded, the Email column compares case-insensitively.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <mysql.h>
+
+#include <gweb/common.h>
+#include <gweb/hash.h>
+#include <gweb/hashset.h>
+#include <gweb/mysqldb_api.h>
+#include <gweb/mysqldb_pool.h>
+#include <gweb/mysqldb_stmt.h>
+#include <gweb/mysqldb_graph.h>
+#include <gweb/mysqldb_cache.h>
+#include <gweb/mysqldb_log.h>
+
+struct gweb_member_set {
+    pthread_rwlock_t lock;
+    int ready;
+    struct gweb_hashset uids;
+    struct gweb_hashset emails;
+};
+
+struct gweb_profile_record {
+    int nr_fields;
+    char *fields[];
+};
+
+struct gweb_suggest_record {
+    int nr;
+    struct gweb_graph_suggestion suggestions[];
+};
+
+/* Destination of a suggestion cache hit */
+struct gweb_suggest_copy {
+    struct gweb_graph_suggestion *suggestions;
+    int *nr;
+};
+
+static struct gweb_lru *g_card_cache;
+static struct gweb_lru *g_profile_cache;
+static struct gweb_lru *g_suggest_cache;
+static struct gweb_lru *g_pref_cache;
+
+static struct gweb_member_set g_members = {
+    .lock = PTHREAD_RWLOCK_INITIALIZER,
+};
+
+static char *
+gweb_cache_strdup (const char *str)
+{
+    return str ? strdup(str) : NULL;
+}
+
+void
+gweb_user_card_free (struct gweb_user_card *card)
+{
+    free(card->fname);
+    free(card->lname);
+    free(card->avatar_url);
+    memset(card, 0, sizeof(*card));
+}
+
+static void
+gweb_card_free (void *value)
+{
+    gweb_user_card_free(value);
+    free(value);
+}
+
+static void
+gweb_card_copy (const void *value, void *arg)
+{
+    const struct gweb_user_card *cached = value;
+    struct gweb_user_card *card = arg;
+
+    card->fname = gweb_cache_strdup(cached->fname);
+    card->lname = gweb_cache_strdup(cached->lname);
+    card->avatar_url = gweb_cache_strdup(cached->avatar_url);
+}
+
+/* Copies of the cached fields on a hit, free with gweb_user_card_free() */
+int
+gweb_card_cache_get (const char *uid, struct gweb_user_card *card,
+                     unsigned long *gen)
+{
+    memset(card, 0, sizeof(*card));
+    return gweb_lru_get(g_card_cache, uid, gweb_card_copy, card, gen);
+}
+
+void
+gweb_card_cache_put (const char *uid, const char *fname, const char *lname,
+                     const char *avatar_url, unsigned long gen)
+{
+    struct gweb_user_card *card;
+
+    if (g_card_cache == NULL) {
+        return;
+    }
+
+    if ((card = calloc(1, sizeof(struct gweb_user_card))) == NULL) {
+        return;
+    }
+    card->fname = gweb_cache_strdup(fname);
+    card->lname = gweb_cache_strdup(lname);
+    card->avatar_url = gweb_cache_strdup(avatar_url);
+
+    gweb_lru_put(g_card_cache, uid, card, sizeof(*card), gen);
+}
+
+void
+gweb_card_cache_invalidate (const char *uid)
+{
+    if (uid) {
+        gweb_lru_invalidate(g_card_cache, uid);
+    }
+}
+
+void
+gweb_card_cache_stats (struct gweb_lru_stats *stats, int reset)
+{
+    gweb_lru_stats(g_card_cache, stats, reset);
+}
+
+static void
+gweb_profile_copy (const void *value, void *arg)
+{
+    const struct gweb_profile_record *record = value;
+    char **fields = arg;
+    int fld;
+
+    for (fld = 0; fld < record->nr_fields; fld++) {
+        fields[fld] = gweb_cache_strdup(record->fields[fld]);
+    }
+}
+
+/* Copies of the cached fields on a hit, nr_fields must match the put */
+int
+gweb_profile_cache_get (const char *uid, char **fields, int nr_fields,
+                        unsigned long *gen)
+{
+    memset(fields, 0, nr_fields * sizeof(char *));
+    return gweb_lru_get(g_profile_cache, uid, gweb_profile_copy, fields, gen);
+}
+
+void
+gweb_profile_cache_put (const char *uid, char *const *fields, int nr_fields,
+                        unsigned long gen)
+{
+    struct gweb_profile_record *record;
+    size_t size = sizeof(struct gweb_profile_record) + nr_fields * sizeof(char *);
+    char *data;
+    int fld;
+
+    if (g_profile_cache == NULL) {
+        return;
+    }
+
+    for (fld = 0; fld < nr_fields; fld++) {
+        size += fields[fld] ? strlen(fields[fld]) + 1 : 0;
+    }
+
+    if ((record = malloc(size)) == NULL) {
+        return;
+    }
+    record->nr_fields = nr_fields;
+
+    data = (char *)&record->fields[nr_fields];
+    for (fld = 0; fld < nr_fields; fld++) {
+        record->fields[fld] = NULL;
+        if (fields[fld]) {
+            record->fields[fld] = strcpy(data, fields[fld]);
+            data += strlen(data) + 1;
+        }
+    }
+
+    gweb_lru_put(g_profile_cache, uid, record, size, gen);
+}
+
+void
+gweb_profile_cache_invalidate (const char *uid)
+{
+    if (uid) {
+        gweb_lru_invalidate(g_profile_cache, uid);
+    }
+}
+
+void
+gweb_profile_cache_stats (struct gweb_lru_stats *stats, int reset)
+{
+    gweb_lru_stats(g_profile_cache, stats, reset);
+}
+
+static void
+gweb_suggest_copy (const void *value, void *arg)
+{
+    const struct gweb_suggest_record *record = value;
+    struct gweb_suggest_copy *copy = arg;
+
+    memcpy(copy->suggestions, record->suggestions,
+           record->nr * sizeof(struct gweb_graph_suggestion));
+    *copy->nr = record->nr;
+}
+
+/* suggestions has room for MYSQL_MAX_SUGGESTION_ROWS_PER_QUERY */
+int
+gweb_suggest_cache_get (const char *uid, struct gweb_graph_suggestion *suggestions,
+                        int *nr, unsigned long *gen)
+{
+    struct gweb_suggest_copy copy = { suggestions, nr };
+
+    *nr = 0;
+    return gweb_lru_get(g_suggest_cache, uid, gweb_suggest_copy, &copy, gen);
+}
+
+void
+gweb_suggest_cache_put (const char *uid, const struct gweb_graph_suggestion *suggestions,
+                        int nr, unsigned long gen)
+{
+    struct gweb_suggest_record *record;
+    size_t size;
+
+    if (g_suggest_cache == NULL || nr > MYSQL_MAX_SUGGESTION_ROWS_PER_QUERY) {
+        return;
+    }
+
+    size = sizeof(struct gweb_suggest_record) + nr * sizeof(struct gweb_graph_suggestion);
+    if ((record = malloc(size)) == NULL) {
+        return;
+    }
+    record->nr = nr;
+    memcpy(record->suggestions, suggestions, nr * sizeof(struct gweb_graph_suggestion));
+
+    gweb_lru_put(g_suggest_cache, uid, record, size, gen);
+}
+
+void
+gweb_suggest_cache_invalidate (const char *uid)
+{
+    if (uid) {
+        gweb_lru_invalidate(g_suggest_cache, uid);
+    }
+}
+
+void
+gweb_suggest_cache_stats (struct gweb_lru_stats *stats, int reset)
+{
+    gweb_lru_stats(g_suggest_cache, stats, reset);
+}
+
+static size_t
+gweb_pref_size (int nr)
+{
+    return sizeof(struct gweb_cxn_prefs) + nr * sizeof(struct gweb_cxn_pref);
+}
+
+static void
+gweb_pref_copy (const void *value, void *arg)
+{
+    const struct gweb_cxn_prefs *record = value;
+    struct gweb_cxn_prefs **prefs = arg;
+
+    /* Left NULL on failure, the caller reads MySQL */
+    if ((*prefs = malloc(gweb_pref_size(record->nr))) != NULL) {
+        memcpy(*prefs, record, gweb_pref_size(record->nr));
+    }
+}
+
+int
+gweb_pref_cache_get (const char *uid, struct gweb_cxn_prefs **prefs,
+                     unsigned long *gen)
+{
+    *prefs = NULL;
+    return gweb_lru_get(g_pref_cache, uid, gweb_pref_copy, prefs, gen) && *prefs;
+}
+
+void
+gweb_pref_cache_put (const char *uid, const struct gweb_cxn_prefs *prefs,
+                     unsigned long gen)
+{
+    struct gweb_cxn_prefs *record;
+
+    if (g_pref_cache == NULL || prefs->nr > GWEB_PREF_CACHE_MAX_CHANNELS) {
+        return;
+    }
+
+    if ((record = malloc(gweb_pref_size(prefs->nr))) == NULL) {
+        return;
+    }
+    memcpy(record, prefs, gweb_pref_size(prefs->nr));
+
+    gweb_lru_put(g_pref_cache, uid, record, gweb_pref_size(prefs->nr), gen);
+}
+
+void
+gweb_pref_cache_invalidate (const char *uid)
+{
+    if (uid) {
+        gweb_lru_invalidate(g_pref_cache, uid);
+    }
+}
+
+void
+gweb_pref_cache_stats (struct gweb_lru_stats *stats, int reset)
+{
+    gweb_lru_stats(g_pref_cache, stats, reset);
+}
+
+int
+gweb_cache_init (struct mysql_config *cfg)
+{
+    int size = cfg->card_cache_size ? cfg->card_cache_size : GWEB_CARD_CACHE_SIZE;
+    int bytes = cfg->profile_cache_bytes ? cfg->profile_cache_bytes :
+        GWEB_PROFILE_CACHE_BYTES;
+    int ttl = cfg->profile_cache_ttl_secs ? cfg->profile_cache_ttl_secs :
+        GWEB_PROFILE_CACHE_TTL;
+    int suggest_size = cfg->suggest_cache_size ? cfg->suggest_cache_size :
+        GWEB_SUGGEST_CACHE_SIZE;
+    int suggest_ttl = cfg->suggest_cache_ttl_secs ? cfg->suggest_cache_ttl_secs :
+        GWEB_SUGGEST_CACHE_TTL;
+    int pref_size = cfg->pref_cache_size ? cfg->pref_cache_size : GWEB_PREF_CACHE_SIZE;
+    int pref_ttl = cfg->pref_cache_ttl_secs ? cfg->pref_cache_ttl_secs :
+        GWEB_PREF_CACHE_TTL;
+
+    if (size < 0) {
+        log_debug("User card cache disabled\n");
+    } else if ((g_card_cache = gweb_lru_create(size, 0, 0, gweb_card_free)) == NULL) {
+        goto __bail_out;
+    } else {
+        log_debug("User card cache ready, %d entries\n", size);
+    }
+
+    /*
+     * The byte bound is what limits the profile cache, entries are
+     * capped only to size the hash buckets, at one per 256 bytes.
+     */
+    if (bytes < 0) {
+        log_debug("Profile cache disabled\n");
+    } else if ((g_profile_cache = gweb_lru_create(bytes / 256 + 1, bytes,
+                                                  ttl < 0 ? 0 : ttl, free)) == NULL) {
+        goto __bail_out;
+    } else {
+        log_debug("Profile cache ready, %d bytes, TTL %d secs\n", bytes, ttl);
+    }
+
+    if (suggest_size < 0) {
+        log_debug("Suggestion cache disabled\n");
+    } else if ((g_suggest_cache = gweb_lru_create(suggest_size, 0,
+                                                  suggest_ttl < 0 ? 0 : suggest_ttl,
+                                                  free)) == NULL) {
+        goto __bail_out;
+    } else {
+        log_debug("Suggestion cache ready, %d entries, TTL %d secs\n",
+                  suggest_size, suggest_ttl);
+    }
+
+    if (pref_size < 0) {
+        log_debug("Connect preference cache disabled\n");
+    } else if ((g_pref_cache = gweb_lru_create(pref_size, 0,
+                                               pref_ttl < 0 ? 0 : pref_ttl,
+                                               free)) == NULL) {
+        goto __bail_out;
+    } else {
+        log_debug("Connect preference cache ready, %d entries, TTL %d secs\n",
+                  pref_size, pref_ttl);
+    }
+
+    return MYSQL_STATUS_OK;
+
+__bail_out:
+    log_error("%s: unable to allocate memory!\n", __func__);
+    gweb_lru_destroy(g_card_cache);
+    g_card_cache = NULL;
+    gweb_lru_destroy(g_profile_cache);
+    g_profile_cache = NULL;
+    gweb_lru_destroy(g_suggest_cache);
+    g_suggest_cache = NULL;
+    return MYSQL_STATUS_FAIL;
+}
+
+/* Called with write lock held */
+static void
+gweb_member_insert (struct gweb_member_set *members, const char *uid,
+                    const char *email)
+{
+    if ((uid && gweb_hashset_add(&members->uids, gweb_hash64_string(uid)) < 0) ||
+        (email && gweb_hashset_add(&members->emails,
+                                   gweb_hash64_string_nocase(email)) < 0)) {
+        /* A partial set would turn registered users away */
+        log_error("%s: unable to allocate memory, set dropped\n", __func__);
+        gweb_hashset_free(&members->uids);
+        gweb_hashset_free(&members->emails);
+        members->ready = 0;
+    }
+}
+
+void
+gweb_member_add (const char *uid, const char *email)
+{
+    struct gweb_member_set *members = &g_members;
+
+    pthread_rwlock_wrlock(&members->lock);
+    if (members->ready) {
+        gweb_member_insert(members, uid, email);
+    }
+    pthread_rwlock_unlock(&members->lock);
+}
+
+int
+gweb_member_check (const char *uid, const char *email)
+{
+    struct gweb_member_set *members = &g_members;
+    int found = -1;
+
+    pthread_rwlock_rdlock(&members->lock);
+    if (members->ready) {
+        found = (uid && gweb_hashset_contains(&members->uids,
+                                              gweb_hash64_string(uid))) ||
+            (email && gweb_hashset_contains(&members->emails,
+                                            gweb_hash64_string_nocase(email)));
+    }
+    pthread_rwlock_unlock(&members->lock);
+
+    return found;
+}
+
+void
+gweb_member_stats (int *nr_uids, int *nr_emails)
+{
+    struct gweb_member_set *members = &g_members;
+
+    pthread_rwlock_rdlock(&members->lock);
+    *nr_uids = members->uids.nr_members;
+    *nr_emails = members->emails.nr_members;
+    pthread_rwlock_unlock(&members->lock);
+}
+
+/* Load every registered UID and email, checks go to MySQL until then */
+int
+gweb_member_init (struct gweb_mysql_conn *conn)
+{
+    struct gweb_member_set *members = &g_members;
+    struct gweb_mysql_stmt *st;
+    MYSQL_ROW row;
+    int nr_rows;
+
+    if ((st = gweb_stmt_registered_users(conn)) == NULL) {
+        return MYSQL_STATUS_FAIL;
+    }
+    nr_rows = gweb_mysql_stmt_num_rows(st);
+
+    pthread_rwlock_wrlock(&members->lock);
+    if (gweb_hashset_init(&members->uids, nr_rows) < 0 ||
+        gweb_hashset_init(&members->emails, nr_rows) < 0) {
+        log_error("%s: unable to allocate memory!\n", __func__);
+        gweb_hashset_free(&members->uids);
+        pthread_rwlock_unlock(&members->lock);
+        gweb_mysql_stmt_done(st);
+        return MYSQL_STATUS_FAIL;
+    }
+
+    members->ready = 1;
+    while (members->ready && (row = gweb_mysql_stmt_fetch(st)) != NULL) {
+        gweb_member_insert(members, row[0], row[1]);
+    }
+    pthread_rwlock_unlock(&members->lock);
+
+    gweb_mysql_stmt_done(st);
+
+    if (!members->ready) {
+        return MYSQL_STATUS_FAIL;
+    }
+
+    log_debug("Member set ready, %d UID(s)\n", nr_rows);
+
+    return MYSQL_STATUS_OK;
+}
+
+void
+gweb_cache_shutdown (void)
+{
+    struct gweb_member_set *members = &g_members;
+
+    gweb_lru_destroy(g_card_cache);
+    g_card_cache = NULL;
+    gweb_lru_destroy(g_profile_cache);
+    g_profile_cache = NULL;
+    gweb_lru_destroy(g_suggest_cache);
+    g_suggest_cache = NULL;
+    gweb_lru_destroy(g_pref_cache);
+    g_pref_cache = NULL;
+
+    pthread_rwlock_wrlock(&members->lock);
+    members->ready = 0;
+    gweb_hashset_free(&members->uids);
+    gweb_hashset_free(&members->emails);
+    pthread_rwlock_unlock(&members->lock);
+}
@@ -0,0 +1,742 @@
+/*
+ * In-process spatial grid over the latest user locations
+ *
+ * Points are bucketed into fixed lat/long cells. A neighbour search
+ * scans only the cells covering the search circle instead of running
+ * the distance UDF over every row of UserGeoLocation. The grid is
+ * warmed from the live rows at startup and kept current from the
+ * location write path, so it also sees points still waiting in the
+ * write-behind buffer.
+ *
+ * Each point with an expiry holds a timer on a timing wheel
+ * (timer_wheel.c). The reaper thread advances the wheel every second,
+ * dropping the points that came due, and deletes expired rows from
+ * UserGeoLocation in batches, sooner when many points expired.
+ * Candidates are ranked in a batch of latitude/longitude arrays, which
+ * also serves the SQL bounding box path. Distances are great-circle on
+ * a spherical earth (geodist.c), within half a percent of the geodesic
+ * distance computed by libgeod_inverse.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <mysql.h>
+
+#include <gweb/common.h>
+#include <gweb/hash.h>
+#include <gweb/list.h>
+#include <gweb/mysqldb_api.h>
+#include <gweb/mysqldb_pool.h>
+#include <gweb/mysqldb_stmt.h>
+#include <gweb/mysqldb_geo.h>
+#include <gweb/mysqldb_log.h>
+#include <gweb/geodist.h>
+#include <gweb/sql_gen.h>
+#include <gweb/timer_wheel.h>
+
+#define GWEB_GEO_NR_ROWS    ((int)(180 / GWEB_GEO_CELL_DEG))
+#define GWEB_GEO_NR_COLS    ((int)(360 / GWEB_GEO_CELL_DEG))
+
+#define GWEB_GEO_DATETIME_FORMAT   "%Y-%m-%d %H:%M:%S"
+
+struct gweb_geo_cell {
+    struct list node;           /* cell hash bucket */
+    int row, col;
+    struct list points;
+};
+
+struct gweb_geo_point {
+    struct list node;           /* UID hash bucket */
+    struct list cell_node;      /* cell members */
+    struct gweb_geo_cell *cell;
+    struct gweb_timer timer;    /* armed unless expiry is -1 */
+
+    char uid[MAX_UID_STRSZ];
+    double latitude;
+    double longitude;
+    time_t seen;
+    int expiry;                 /* -1 never expires */
+    int radius;
+};
+
+struct gweb_geo_grid {
+    pthread_rwlock_t lock;
+    int ready;
+
+    struct list uids[GWEB_GEO_HASH_SIZE];
+    struct list cells[GWEB_GEO_HASH_SIZE];
+    int nr_points;
+
+    struct gweb_timer_wheel wheel;
+};
+
+struct gweb_geo_reaper {
+    pthread_mutex_t lock;
+    pthread_cond_t  wakeup;
+    pthread_t       thread;
+    int running;
+};
+
+static struct gweb_geo_grid g_geo_grid = {
+    .lock = PTHREAD_RWLOCK_INITIALIZER,
+};
+
+static struct gweb_geo_reaper g_geo_reaper = {
+    .lock   = PTHREAD_MUTEX_INITIALIZER,
+    .wakeup = PTHREAD_COND_INITIALIZER,
+};
+
+static int
+gweb_geo_row (double latitude)
+{
+    int row = (int)floor((latitude + 90) / GWEB_GEO_CELL_DEG);
+
+    if (row < 0) {
+        return 0;
+    }
+    return (row >= GWEB_GEO_NR_ROWS) ? GWEB_GEO_NR_ROWS - 1 : row;
+}
+
+/* Columns wrap around at the antimeridian */
+static int
+gweb_geo_wrap_col (int col)
+{
+    col %= GWEB_GEO_NR_COLS;
+    return (col < 0) ? col + GWEB_GEO_NR_COLS : col;
+}
+
+static int
+gweb_geo_col (double longitude)
+{
+    return gweb_geo_wrap_col((int)floor((longitude + 180) / GWEB_GEO_CELL_DEG));
+}
+
+static struct list *
+gweb_geo_cell_bucket (struct gweb_geo_grid *grid, int row, int col)
+{
+    uint32_t hash = (uint32_t)row * 2654435761u ^ (uint32_t)col;
+
+    return &grid->cells[hash & (GWEB_GEO_HASH_SIZE - 1)];
+}
+
+/* Called with lock held */
+static struct gweb_geo_cell *
+gweb_geo_cell_lookup (struct gweb_geo_grid *grid, int row, int col)
+{
+    struct list *head = gweb_geo_cell_bucket(grid, row, col), *pos;
+    struct gweb_geo_cell *cell;
+
+    for (pos = head->next; pos != head; pos = pos->next) {
+        cell = list_entry(pos, struct gweb_geo_cell, node);
+        if (cell->row == row && cell->col == col) {
+            return cell;
+        }
+    }
+    return NULL;
+}
+
+/* Called with lock held */
+static struct gweb_geo_point *
+gweb_geo_point_lookup (struct gweb_geo_grid *grid, const char *uid)
+{
+    struct list *head, *pos;
+    struct gweb_geo_point *point;
+
+    head = &grid->uids[gweb_hash_string(uid) & (GWEB_GEO_HASH_SIZE - 1)];
+    for (pos = head->next; pos != head; pos = pos->next) {
+        point = list_entry(pos, struct gweb_geo_point, node);
+        if (strcmp(point->uid, uid) == 0) {
+            return point;
+        }
+    }
+    return NULL;
+}
+
+/* Called with lock held, empty cells are released */
+static void
+gweb_geo_point_unlink (struct gweb_geo_point *point)
+{
+    struct gweb_geo_cell *cell = point->cell;
+
+    list_remove(&point->cell_node);
+    point->cell = NULL;
+
+    if (cell && list_empty(&cell->points)) {
+        list_remove(&cell->node);
+        free(cell);
+    }
+}
+
+/* Called with lock held */
+static int
+gweb_geo_point_link (struct gweb_geo_grid *grid, struct gweb_geo_point *point)
+{
+    struct gweb_geo_cell *cell;
+    int row = gweb_geo_row(point->latitude);
+    int col = gweb_geo_col(point->longitude);
+
+    if ((cell = gweb_geo_cell_lookup(grid, row, col)) == NULL) {
+        if ((cell = calloc(1, sizeof(struct gweb_geo_cell))) == NULL) {
+            return MYSQL_STATUS_FAIL;
+        }
+        cell->row = row;
+        cell->col = col;
+        list_init(&cell->points);
+        list_add(gweb_geo_cell_bucket(grid, row, col), &cell->node);
+    }
+
+    list_add(&cell->points, &point->cell_node);
+    point->cell = cell;
+
+    return MYSQL_STATUS_OK;
+}
+
+static void
+gweb_geo_point_free (struct gweb_geo_grid *grid, struct gweb_geo_point *point)
+{
+    gweb_geo_point_unlink(point);
+    gweb_timer_del(&grid->wheel, &point->timer);
+    list_remove(&point->node);
+    grid->nr_points--;
+    free(point);
+}
+
+static int
+gweb_geo_point_live (const struct gweb_geo_point *point, time_t now)
+{
+    return (point->expiry == -1 || point->seen + point->expiry >= now);
+}
+
+/* Called with write lock held, returns the number of points dropped */
+static int
+gweb_geo_expire (struct gweb_geo_grid *grid, time_t now)
+{
+    struct gweb_geo_point *point;
+    struct list expired;
+    int nr_expired;
+
+    list_init(&expired);
+    nr_expired = gweb_timer_wheel_advance(&grid->wheel, now, &expired);
+
+    while (!list_empty(&expired)) {
+        point = list_entry(expired.next, struct gweb_geo_point, timer.node);
+        /* No longer pending, not to be counted off the wheel again */
+        list_remove(&point->timer.node);
+        gweb_geo_point_free(grid, point);
+    }
+
+    if (nr_expired) {
+        log_debug("%s: %d expired location(s), %d left\n", __func__,
+                  nr_expired, grid->nr_points);
+    }
+
+    return nr_expired;
+}
+
+/* Called with write lock held */
+static void
+gweb_geo_grid_set (struct gweb_geo_grid *grid, const char *uid,
+                   double latitude, double longitude, time_t seen,
+                   int expiry, int radius)
+{
+    struct gweb_geo_point *point;
+
+    if ((point = gweb_geo_point_lookup(grid, uid)) == NULL) {
+        if ((point = calloc(1, sizeof(struct gweb_geo_point))) == NULL) {
+            log_error("%s: unable to allocate memory!\n", __func__);
+            return;
+        }
+        strcpy(point->uid, uid);
+        list_init(&point->cell_node);
+        gweb_timer_init(&point->timer);
+        list_add(&grid->uids[gweb_hash_string(uid) & (GWEB_GEO_HASH_SIZE - 1)],
+                 &point->node);
+        grid->nr_points++;
+    } else {
+        gweb_geo_point_unlink(point);
+    }
+
+    point->latitude = latitude;
+    point->longitude = longitude;
+    point->seen = seen;
+    point->expiry = expiry;
+    point->radius = radius;
+
+    if (expiry == -1) {
+        gweb_timer_del(&grid->wheel, &point->timer);
+    } else {
+        gweb_timer_add(&grid->wheel, &point->timer, seen + expiry);
+    }
+
+    if (gweb_geo_point_link(grid, point) != MYSQL_STATUS_OK) {
+        log_error("%s: unable to allocate memory!\n", __func__);
+        gweb_geo_point_free(grid, point);
+    }
+}
+
+static time_t
+gweb_geo_parse_time (const char *utc_dt_str)
+{
+    struct tm tm;
+
+    memset(&tm, 0, sizeof(tm));
+    if (strptime(utc_dt_str, GWEB_GEO_DATETIME_FORMAT, &tm) == NULL) {
+        return 0;
+    }
+    return timegm(&tm);
+}
+
+/* Latest point of a UID, seen is an UTC DATETIME string */
+void
+gweb_geo_grid_update (const char *uid, double latitude, double longitude,
+                      const char *seen, int expiry, int radius)
+{
+    struct gweb_geo_grid *grid = &g_geo_grid;
+
+    if (strlen(uid) >= MAX_UID_STRSZ) {
+        return;
+    }
+
+    pthread_rwlock_wrlock(&grid->lock);
+    if (grid->ready) {
+        gweb_geo_grid_set(grid, uid, latitude, longitude,
+                          gweb_geo_parse_time(seen), expiry, radius);
+    }
+    pthread_rwlock_unlock(&grid->lock);
+}
+
+/*
+ * Live point of a UID. Returns 1 if found, 0 if the UID has no live
+ * location and -1 if the grid can not tell.
+ */
+int
+gweb_geo_grid_lookup (const char *uid, struct gweb_geo_match *match)
+{
+    struct gweb_geo_grid *grid = &g_geo_grid;
+    struct gweb_geo_point *point;
+    int found = -1;
+
+    pthread_rwlock_rdlock(&grid->lock);
+    if (grid->ready) {
+        point = gweb_geo_point_lookup(grid, uid);
+        found = (point && gweb_geo_point_live(point, time(NULL)));
+        if (found) {
+            strcpy(match->uid, point->uid);
+            match->latitude = point->latitude;
+            match->longitude = point->longitude;
+            match->distance = 0;
+            match->radius = point->radius;
+        }
+    }
+    pthread_rwlock_unlock(&grid->lock);
+
+    return found;
+}
+
+static int
+gweb_geo_match_cmp (const void *a, const void *b)
+{
+    const struct gweb_geo_match *ma = a, *mb = b;
+
+    if (ma->distance != mb->distance) {
+        return (ma->distance < mb->distance) ? -1 : 1;
+    }
+    return strcmp(ma->uid, mb->uid);
+}
+
+int
+gweb_geo_batch_add (struct gweb_geo_batch *batch, const char *uid,
+                    double latitude, double longitude)
+{
+    int size;
+
+    if (strlen(uid) >= MAX_UID_STRSZ) {
+        return MYSQL_STATUS_OK;
+    }
+
+    if (batch->nr == batch->size) {
+        size = batch->size ? batch->size * 2 : 256;
+        if (!(batch->uid = realloc(batch->uid, size * sizeof(*batch->uid))) ||
+            !(batch->lat = realloc(batch->lat, size * sizeof(double))) ||
+            !(batch->lon = realloc(batch->lon, size * sizeof(double)))) {
+            log_error("%s: unable to allocate memory!\n", __func__);
+            return MYSQL_STATUS_FAIL;
+        }
+        batch->size = size;
+    }
+
+    strcpy(batch->uid[batch->nr], uid);
+    batch->lat[batch->nr] = latitude;
+    batch->lon[batch->nr] = longitude;
+    batch->nr++;
+
+    return MYSQL_STATUS_OK;
+}
+
+void
+gweb_geo_batch_free (struct gweb_geo_batch *batch)
+{
+    free(batch->uid);
+    free(batch->lat);
+    free(batch->lon);
+    memset(batch, 0, sizeof(*batch));
+}
+
+/*
+ * Candidates within radius meters of the given position, ordered by
+ * (distance, UID) and starting after the cursor pair. The haversine
+ * terms are computed in one pass over the batch, exact distances only
+ * for the points that pass. Returns up to limit matches, -1 on failure.
+ */
+int
+gweb_geo_batch_rank (struct gweb_geo_batch *batch, double latitude,
+                     double longitude, double radius, double after_distance,
+                     const char *after_uid, struct gweb_geo_match *matches,
+                     int limit)
+{
+    struct gweb_geo_match *found = NULL, *match;
+    double *hav, hav_max, distance;
+    int idx, nr_found = 0, ret = -1;
+
+    if (batch->nr == 0) {
+        return 0;
+    }
+
+    hav = malloc(batch->nr * sizeof(double));
+    found = malloc(batch->nr * sizeof(struct gweb_geo_match));
+    if (!hav || !found) {
+        log_error("%s: unable to allocate memory!\n", __func__);
+        goto __bail_out;
+    }
+
+    gweb_geodist_hav_batch(latitude, longitude, batch->lat, batch->lon, hav,
+                           batch->nr);
+
+    /* Slack for the vector kernel, the exact distance decides */
+    hav_max = gweb_geodist_hav(radius) * (1 + 1e-6);
+
+    for (idx = 0; idx < batch->nr; idx++) {
+        if (hav[idx] >= hav_max) {
+            continue;
+        }
+
+        distance = gweb_geodist(latitude, longitude, batch->lat[idx],
+                                batch->lon[idx]);
+        if (distance >= radius || distance < after_distance ||
+            (distance == after_distance && strcmp(batch->uid[idx], after_uid) <= 0)) {
+            continue;
+        }
+
+        match = &found[nr_found++];
+        strcpy(match->uid, batch->uid[idx]);
+        match->latitude = batch->lat[idx];
+        match->longitude = batch->lon[idx];
+        match->distance = distance;
+        match->radius = 0;
+    }
+
+    qsort(found, nr_found, sizeof(struct gweb_geo_match), gweb_geo_match_cmp);
+
+    ret = (nr_found < limit) ? nr_found : limit;
+    if (ret) {
+        memcpy(matches, found, ret * sizeof(struct gweb_geo_match));
+    }
+
+__bail_out:
+    free(found);
+    free(hav);
+    return ret;
+}
+
+/* Latitude and longitude in degrees, finite and on the globe */
+int
+gweb_geo_valid (double latitude, double longitude)
+{
+    return isfinite(latitude) && isfinite(longitude) &&
+        fabs(latitude) <= 90 && fabs(longitude) <= 180;
+}
+
+/*
+ * Bounding box of a search circle in degrees, longitudes may run past
+ * +/-180. Returns -1 if the circle reaches too close to a pole.
+ */
+int
+gweb_geo_bbox (double latitude, double longitude, double radius,
+               struct gweb_geo_bbox *box)
+{
+    double dlat, dlon, edge;
+
+    dlat = radius / (GWEB_GEO_EARTH_RADIUS * M_PI / 180);
+    edge = fmax(fabs(latitude - dlat), fabs(latitude + dlat));
+    if (edge >= 90 || cos(edge * M_PI / 180) < 0.01) {
+        return -1;
+    }
+
+    dlon = dlat / cos(edge * M_PI / 180);
+    if (dlon >= 180) {
+        return -1;
+    }
+
+    box->min_lat = latitude - dlat;
+    box->max_lat = latitude + dlat;
+    box->min_lon = longitude - dlon;
+    box->max_lon = longitude + dlon;
+
+    return 0;
+}
+
+/*
+ * Live points within radius meters of the given position, excluding
+ * uid, ordered by (distance, UID) and starting after the cursor pair.
+ * Returns up to limit matches, or -1 when the search is left to SQL.
+ */
+int
+gweb_geo_grid_neighbours (const char *uid, double latitude, double longitude,
+                          double radius, double after_distance,
+                          const char *after_uid, struct gweb_geo_match *matches,
+                          int limit)
+{
+    struct gweb_geo_grid *grid = &g_geo_grid;
+    struct gweb_geo_batch batch = { 0 };
+    struct gweb_geo_point *point;
+    struct gweb_geo_cell *cell;
+    struct gweb_geo_bbox box;
+    struct list *pos;
+    int row, row0, row1, col, col0, col1, ret = -1;
+    time_t now = time(NULL);
+
+    /* Rows and columns covering the bounding box of the circle */
+    if (gweb_geo_bbox(latitude, longitude, radius, &box) < 0) {
+        return -1;
+    }
+
+    row0 = gweb_geo_row(box.min_lat);
+    row1 = gweb_geo_row(box.max_lat);
+    col0 = (int)floor((box.min_lon + 180) / GWEB_GEO_CELL_DEG);
+    col1 = (int)floor((box.max_lon + 180) / GWEB_GEO_CELL_DEG);
+
+    if ((row1 - row0 + 1) * (col1 - col0 + 1) > GWEB_GEO_MAX_SCAN_CELLS) {
+        return -1;
+    }
+
+    pthread_rwlock_rdlock(&grid->lock);
+    if (!grid->ready) {
+        pthread_rwlock_unlock(&grid->lock);
+        return -1;
+    }
+
+    for (row = row0; row <= row1; row++) {
+        for (col = col0; col <= col1; col++) {
+            if ((cell = gweb_geo_cell_lookup(grid, row, gweb_geo_wrap_col(col))) == NULL) {
+                continue;
+            }
+            for (pos = cell->points.next; pos != &cell->points; pos = pos->next) {
+                point = list_entry(pos, struct gweb_geo_point, cell_node);
+                if (!gweb_geo_point_live(point, now) || strcmp(point->uid, uid) == 0) {
+                    continue;
+                }
+                if (gweb_geo_batch_add(&batch, point->uid, point->latitude,
+                                       point->longitude) != MYSQL_STATUS_OK) {
+                    pthread_rwlock_unlock(&grid->lock);
+                    goto __bail_out;
+                }
+            }
+        }
+    }
+    pthread_rwlock_unlock(&grid->lock);
+
+    ret = gweb_geo_batch_rank(&batch, latitude, longitude, radius, after_distance,
+                              after_uid, matches, limit);
+
+__bail_out:
+    gweb_geo_batch_free(&batch);
+    return ret;
+}
+
+/* Load the live locations, the grid serves lookups from then on */
+int
+gweb_geo_grid_init (struct gweb_mysql_conn *conn)
+{
+    struct gweb_geo_grid *grid = &g_geo_grid;
+    struct gweb_mysql_stmt *st;
+    MYSQL_ROW row;
+    int idx;
+
+    for (idx = 0; idx < GWEB_GEO_HASH_SIZE; idx++) {
+        list_init(&grid->uids[idx]);
+        list_init(&grid->cells[idx]);
+    }
+    gweb_timer_wheel_init(&grid->wheel, time(NULL));
+
+    /* Without a database (memdb.c) the grid starts empty */
+    if (conn == NULL) {
+        pthread_rwlock_wrlock(&grid->lock);
+        grid->ready = 1;
+        pthread_rwlock_unlock(&grid->lock);
+        return MYSQL_STATUS_OK;
+    }
+
+    if ((st = gweb_stmt_location_live(conn)) == NULL) {
+        return MYSQL_STATUS_FAIL;
+    }
+
+    pthread_rwlock_wrlock(&grid->lock);
+    while ((row = gweb_mysql_stmt_fetch(st)) != NULL) {
+        if (!row[0] || !row[1] || !row[2] || !row[3] ||
+            strlen(row[0]) >= MAX_UID_STRSZ) {
+            continue;
+        }
+        gweb_geo_grid_set(grid, row[0], atof(row[1]), atof(row[2]),
+                          gweb_geo_parse_time(row[3]),
+                          row[4] ? atoi(row[4]) : -1,
+                          row[5] ? atoi(row[5]) : 0);
+    }
+    grid->ready = 1;
+    pthread_rwlock_unlock(&grid->lock);
+
+    gweb_mysql_stmt_done(st);
+
+    log_debug("Location grid ready, %d live location(s)\n", grid->nr_points);
+
+    return MYSQL_STATUS_OK;
+}
+
+void
+gweb_geo_grid_shutdown (void)
+{
+    struct gweb_geo_grid *grid = &g_geo_grid;
+    int idx;
+
+    pthread_rwlock_wrlock(&grid->lock);
+    if (grid->ready) {
+        for (idx = 0; idx < GWEB_GEO_HASH_SIZE; idx++) {
+            while (!list_empty(&grid->uids[idx])) {
+                gweb_geo_point_free(grid, list_entry(grid->uids[idx].next,
+                                                     struct gweb_geo_point, node));
+            }
+        }
+        grid->ready = 0;
+    }
+    pthread_rwlock_unlock(&grid->lock);
+}
+
+/* Delete expired rows in batches, returns the number deleted */
+static int
+gweb_geo_reap_rows (void)
+{
+    struct gweb_mysql_conn *conn;
+    char qrybuf[MAX_MYSQL_QRYSZ];
+    my_ulonglong affected;
+    int nr_reaped = 0;
+
+    if ((conn = gweb_mysql_pool_get()) == NULL) {
+        return 0;
+    }
+    conn->caller = __func__;
+
+    sprintf(qrybuf, GWEB_SQL_LOCATION_REAP, GWEB_GEO_REAP_ROWS);
+    do {
+        if (gweb_mysql_query_template(conn, GWEB_SQL_LOCATION_REAP,
+                                      qrybuf) != MYSQL_STATUS_OK) {
+            break;
+        }
+        affected = mysql_affected_rows(conn->mysql);
+        nr_reaped += (int)affected;
+    } while (affected == GWEB_GEO_REAP_ROWS);
+
+    gweb_mysql_pool_put(conn);
+
+    if (nr_reaped) {
+        log_debug("%s: %d expired location row(s) deleted\n", __func__,
+                  nr_reaped);
+    }
+
+    return nr_reaped;
+}
+
+/*
+ * Advances the grid wheel once a second. Rows are deleted every
+ * GWEB_GEO_REAP_SECS, or as soon as a batch worth of points expired.
+ */
+static void *
+gweb_geo_reaper_thread (void *arg)
+{
+    struct gweb_geo_reaper *reaper = arg;
+    struct gweb_geo_grid *grid = &g_geo_grid;
+    struct timespec deadline;
+    time_t now, last_reap = 0;
+    int running = 1, nr_due = 0;
+
+    mysql_thread_init();
+
+    while (running) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec++;
+
+        pthread_mutex_lock(&reaper->lock);
+        if (reaper->running) {
+            pthread_cond_timedwait(&reaper->wakeup, &reaper->lock, &deadline);
+        }
+        running = reaper->running;
+        pthread_mutex_unlock(&reaper->lock);
+
+        if (!running) {
+            break;
+        }
+
+        now = time(NULL);
+
+        pthread_rwlock_wrlock(&grid->lock);
+        if (grid->ready) {
+            nr_due += gweb_geo_expire(grid, now);
+        }
+        pthread_rwlock_unlock(&grid->lock);
+
+        if (nr_due >= GWEB_GEO_REAP_ROWS || now - last_reap >= GWEB_GEO_REAP_SECS) {
+            gweb_geo_reap_rows();
+            last_reap = now;
+            nr_due = 0;
+        }
+    }
+
+    mysql_thread_end();
+
+    return NULL;
+}
+
+int
+gweb_geo_reaper_init (void)
+{
+    struct gweb_geo_reaper *reaper = &g_geo_reaper;
+
+    reaper->running = 1;
+    if (pthread_create(&reaper->thread, NULL, gweb_geo_reaper_thread, reaper)) {
+        log_error("%s: unable to start reaper thread\n", __func__);
+        reaper->running = 0;
+        return MYSQL_STATUS_FAIL;
+    }
+
+    return MYSQL_STATUS_OK;
+}
+
+void
+gweb_geo_reaper_shutdown (void)
+{
+    struct gweb_geo_reaper *reaper = &g_geo_reaper;
+    int was_running;
+
+    pthread_mutex_lock(&reaper->lock);
+    was_running = reaper->running;
+    reaper->running = 0;
+    pthread_cond_signal(&reaper->wakeup);
+    pthread_mutex_unlock(&reaper->lock);
+
+    if (was_running) {
+        pthread_join(reaper->thread, NULL);
+    }
+}
@@ -0,0 +1,1158 @@
+/*
+ * In-process connection graph
+ *
+ * Connection request and channel lists are read on every poll, each a
+ * range scan of UserConnectRequest or UserConnectChannel. Here the
+ * edges of both tables are held in compressed sparse row layout, one
+ * index per table and direction: UIDs are numbered, offsets[uid] gives
+ * the first edge of a UID and its edges follow contiguously, in list
+ * order (date, peer UID, flag/channel). A page is a binary search for
+ * the cursor and a scan of the rows that follow.
+ *
+ * The rows are loaded at startup. Writes do not touch the CSR arrays:
+ * the write handlers append to a delta log once committed, and lists
+ * of the UIDs the log mentions are rebuilt from their CSR slice and
+ * the log entries at read time. The merger thread folds the log into
+ * new CSR arrays every GWEB_GRAPH_MERGE_SECS, sooner once it holds
+ * GWEB_GRAPH_MERGE_OPS entries. The log is frozen and replaced by an
+ * empty one first, so the arrays are built without the lock while
+ * readers keep applying both logs, and swapped in once done.
+ *
+ * Labels (channels, request flags) are interned as written, and
+ * compared ignoring case like their columns: a channel differing from
+ * an existing one in case only is the same row.
+ *
+ * Channels are also indexed by UID id, both directions together and
+ * without repeats, for the friend of friend ranking of suggest.c. The
+ * index is rebuilt with the CSR arrays.
+ *
+ * Like the member set, the graph sees the writes of this process only.
+ * Should it fail to grow, it is dropped and lists go to SQL.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <mysql.h>
+
+#include <gweb/common.h>
+#include <gweb/hash.h>
+#include <gweb/mysqldb_api.h>
+#include <gweb/mysqldb_pool.h>
+#include <gweb/mysqldb_stmt.h>
+#include <gweb/mysqldb_graph.h>
+#include <gweb/mysqldb_log.h>
+#include <gweb/suggest.h>
+
+/* Names are stored in chunks that never move once allocated */
+#define GWEB_GRAPH_CHUNK_SHIFT      (16)
+#define GWEB_GRAPH_CHUNK_SIZE       (1 << GWEB_GRAPH_CHUNK_SHIFT)
+#define GWEB_GRAPH_NR_CHUNKS        (4096)
+
+#define GWEB_GRAPH_NAME(names, id)                                      \
+    ((names)->chunks[(id) >> GWEB_GRAPH_CHUNK_SHIFT][(id) & (GWEB_GRAPH_CHUNK_SIZE - 1)])
+
+enum {
+    GWEB_GRAPH_OP_SET,
+    GWEB_GRAPH_OP_DISCONNECT,
+};
+
+/* Interned strings, numbered in order of arrival */
+struct gweb_graph_names {
+    uint32_t *slots;            /* id + 1, 0 when free */
+    uint32_t mask;
+    uint32_t nr;
+    char (*chunks[GWEB_GRAPH_NR_CHUNKS])[GWEB_GRAPH_NAMESZ];
+};
+
+/* Dates are packed as YYYYMMDDhhmmss, which sorts as the text does */
+struct gweb_graph_edge {
+    uint32_t peer;
+    uint32_t label;
+    uint64_t date;
+};
+
+struct gweb_graph_csr {
+    uint32_t nr_owners;
+    uint32_t *offsets;          /* nr_owners + 1 */
+    struct gweb_graph_edge *edges;
+};
+
+/* Channel peers of a UID either way, ascending ids without repeats */
+struct gweb_graph_adj {
+    uint32_t nr_owners;
+    uint32_t *offsets;          /* nr_owners + 1 */
+    uint32_t *peers;
+};
+
+/* A write, or a row while loading */
+struct gweb_graph_op {
+    uint8_t kind;
+    uint8_t type;
+    uint32_t from;
+    uint32_t to;
+    uint32_t label;
+    uint64_t date;
+};
+
+struct gweb_graph_log {
+    struct gweb_graph_op *ops;
+    int nr, size;
+};
+
+struct gweb_graph {
+    pthread_rwlock_t lock;
+    int ready;
+    int merging;                /* frozen log and CSR arrays in use */
+
+    struct gweb_graph_names uids;
+    struct gweb_graph_names labels;
+    struct gweb_graph_csr csr[GWEB_GRAPH_NR_KINDS][GWEB_GRAPH_NR_DIRS];
+    struct gweb_graph_adj adj;
+
+    struct gweb_graph_log active;
+    struct gweb_graph_log frozen;
+};
+
+struct gweb_graph_merger {
+    pthread_mutex_t lock;
+    pthread_cond_t  wakeup;
+    pthread_t       thread;
+    int running;
+};
+
+static struct gweb_graph g_graph = {
+    .lock = PTHREAD_RWLOCK_INITIALIZER,
+};
+
+static struct gweb_graph_merger g_graph_merger = {
+    .lock   = PTHREAD_MUTEX_INITIALIZER,
+    .wakeup = PTHREAD_COND_INITIALIZER,
+};
+
+static int
+gweb_graph_names_find (const struct gweb_graph_names *names, const char *str)
+{
+    uint32_t idx, id;
+
+    if (names->slots == NULL) {
+        return -1;
+    }
+
+    for (idx = gweb_hash_string(str) & names->mask;
+         (id = names->slots[idx]) != 0; idx = (idx + 1) & names->mask) {
+        if (strcmp(GWEB_GRAPH_NAME(names, id - 1), str) == 0) {
+            return (int)(id - 1);
+        }
+    }
+    return -1;
+}
+
+/* Slots kept at most half full */
+static int
+gweb_graph_names_grow (struct gweb_graph_names *names)
+{
+    uint32_t size = names->slots ? 2 * (names->mask + 1) : 1024;
+    uint32_t *slots, idx, id;
+
+    if ((slots = calloc(size, sizeof(uint32_t))) == NULL) {
+        return -1;
+    }
+
+    for (id = 0; id < names->nr; id++) {
+        for (idx = gweb_hash_string(GWEB_GRAPH_NAME(names, id)) & (size - 1);
+             slots[idx] != 0; idx = (idx + 1) & (size - 1))
+            ;
+        slots[idx] = id + 1;
+    }
+
+    free(names->slots);
+    names->slots = slots;
+    names->mask = size - 1;
+
+    return 0;
+}
+
+/* Returns the id of str, added if new, or -1 */
+static int
+gweb_graph_names_add (struct gweb_graph_names *names, const char *str)
+{
+    uint32_t idx, id = names->nr;
+    int found;
+
+    if ((found = gweb_graph_names_find(names, str)) >= 0) {
+        return found;
+    }
+
+    if (strlen(str) >= GWEB_GRAPH_NAMESZ ||
+        id == GWEB_GRAPH_NR_CHUNKS * GWEB_GRAPH_CHUNK_SIZE) {
+        return -1;
+    }
+
+    if ((names->slots == NULL || 2 * (id + 1) > names->mask + 1) &&
+        gweb_graph_names_grow(names) < 0) {
+        return -1;
+    }
+
+    if (names->chunks[id >> GWEB_GRAPH_CHUNK_SHIFT] == NULL &&
+        (names->chunks[id >> GWEB_GRAPH_CHUNK_SHIFT] =
+         malloc(GWEB_GRAPH_CHUNK_SIZE * GWEB_GRAPH_NAMESZ)) == NULL) {
+        return -1;
+    }
+    strcpy(GWEB_GRAPH_NAME(names, id), str);
+
+    for (idx = gweb_hash_string(str) & names->mask; names->slots[idx] != 0;
+         idx = (idx + 1) & names->mask)
+        ;
+    names->slots[idx] = id + 1;
+    names->nr++;
+
+    return (int)id;
+}
+
+static void
+gweb_graph_names_free (struct gweb_graph_names *names)
+{
+    int idx;
+
+    for (idx = 0; idx < GWEB_GRAPH_NR_CHUNKS; idx++) {
+        free(names->chunks[idx]);
+    }
+    free(names->slots);
+    memset(names, 0, sizeof(*names));
+}
+
+/* "YYYY-MM-DD hh:mm:ss" packed, 0 if it does not parse */
+static uint64_t
+gweb_graph_date_pack (const char *date)
+{
+    int year, mon, day, hour, min, sec;
+
+    if (date == NULL ||
+        sscanf(date, "%4d-%2d-%2d %2d:%2d:%2d", &year, &mon, &day, &hour,
+               &min, &sec) != 6) {
+        return 0;
+    }
+
+    return ((((((uint64_t)year * 100 + mon) * 100 + day) * 100 + hour) * 100 +
+             min) * 100 + sec);
+}
+
+/* Empty for a NULL date */
+static void
+gweb_graph_date_unpack (uint64_t date, char *buf)
+{
+    if (date == 0) {
+        buf[0] = '\0';
+        return;
+    }
+    snprintf(buf, MAX_DATETIME_STRSZ, "%04d-%02d-%02d %02d:%02d:%02d",
+             (int)(date / 10000000000ull % 10000), (int)(date / 100000000 % 100),
+             (int)(date / 1000000 % 100), (int)(date / 10000 % 100),
+             (int)(date / 100 % 100), (int)(date % 100));
+}
+
+/*
+ * List order. Names of the ids compared are never written again, the
+ * merger sorts without the lock.
+ */
+static int
+gweb_graph_edge_cmp (const void *a, const void *b)
+{
+    const struct gweb_graph_edge *ea = a, *eb = b;
+    struct gweb_graph *graph = &g_graph;
+    int cmp;
+
+    if (ea->date != eb->date) {
+        return (ea->date < eb->date) ? -1 : 1;
+    }
+    if (ea->peer != eb->peer &&
+        (cmp = strcmp(GWEB_GRAPH_NAME(&graph->uids, ea->peer),
+                      GWEB_GRAPH_NAME(&graph->uids, eb->peer))) != 0) {
+        return cmp;
+    }
+    if (ea->label == eb->label) {
+        return 0;
+    }
+    return gweb_mysql_ci_cmp(GWEB_GRAPH_NAME(&graph->labels, ea->label),
+                             GWEB_GRAPH_NAME(&graph->labels, eb->label));
+}
+
+static inline uint32_t
+gweb_graph_op_owner (const struct gweb_graph_op *op, int dir)
+{
+    return (dir == GWEB_GRAPH_OUTBOUND) ? op->from : op->to;
+}
+
+/*
+ * Apply a write to the list of its owner, edges has room for one more.
+ * Same rules as the statements: CXN_REQUEST_UPSERT, CXN_CHANNEL_INSERT
+ * and CXN_CHANNEL_DELETE.
+ */
+static void
+gweb_graph_op_apply (const struct gweb_graph_op *op, int dir,
+                     struct gweb_graph_edge *edges, uint32_t *nr_edges)
+{
+    struct gweb_graph *graph = &g_graph;
+    uint32_t peer = (dir == GWEB_GRAPH_OUTBOUND) ? op->to : op->from;
+    uint32_t idx, nr = 0;
+
+    if (op->type == GWEB_GRAPH_OP_DISCONNECT) {
+        for (idx = 0; idx < *nr_edges; idx++) {
+            if (edges[idx].peer != peer) {
+                edges[nr++] = edges[idx];
+            }
+        }
+        *nr_edges = nr;
+        return;
+    }
+
+    for (idx = 0; idx < *nr_edges; idx++) {
+        if (edges[idx].peer != peer) {
+            continue;
+        }
+        if (op->kind == GWEB_GRAPH_REQUEST) {
+            edges[idx].label = op->label;
+            return;
+        }
+        if (edges[idx].label == op->label ||
+            gweb_mysql_ci_cmp(GWEB_GRAPH_NAME(&graph->labels, edges[idx].label),
+                              GWEB_GRAPH_NAME(&graph->labels, op->label)) == 0) {
+            return;
+        }
+    }
+
+    edges[*nr_edges].peer = peer;
+    edges[*nr_edges].label = op->label;
+    edges[*nr_edges].date = op->date;
+    (*nr_edges)++;
+}
+
+static void
+gweb_graph_csr_free (struct gweb_graph_csr *csr)
+{
+    free(csr->offsets);
+    free(csr->edges);
+    memset(csr, 0, sizeof(*csr));
+}
+
+/* Bucket rows by owner, then sort each list */
+static int
+gweb_graph_csr_load (struct gweb_graph_csr *csr, const struct gweb_graph_op *rows,
+                     int nr_rows, int kind, int dir, uint32_t nr_owners)
+{
+    uint32_t *fill, owner, idx;
+    int row, nr_edges = 0;
+
+    csr->nr_owners = nr_owners;
+    csr->offsets = calloc(nr_owners + 1, sizeof(uint32_t));
+    fill = calloc(nr_owners + 1, sizeof(uint32_t));
+
+    for (row = 0; row < nr_rows; row++) {
+        nr_edges += (rows[row].kind == kind);
+    }
+    csr->edges = malloc((nr_edges + 1) * sizeof(struct gweb_graph_edge));
+
+    if (!csr->offsets || !fill || !csr->edges) {
+        free(fill);
+        gweb_graph_csr_free(csr);
+        return -1;
+    }
+
+    for (row = 0; row < nr_rows; row++) {
+        if (rows[row].kind == kind) {
+            csr->offsets[gweb_graph_op_owner(&rows[row], dir) + 1]++;
+        }
+    }
+    for (idx = 0; idx < nr_owners; idx++) {
+        csr->offsets[idx + 1] += csr->offsets[idx];
+    }
+
+    for (row = 0; row < nr_rows; row++) {
+        if (rows[row].kind != kind) {
+            continue;
+        }
+        owner = gweb_graph_op_owner(&rows[row], dir);
+        idx = csr->offsets[owner] + fill[owner]++;
+        csr->edges[idx].peer = (dir == GWEB_GRAPH_OUTBOUND) ?
+            rows[row].to : rows[row].from;
+        csr->edges[idx].label = rows[row].label;
+        csr->edges[idx].date = rows[row].date;
+    }
+    free(fill);
+
+    for (idx = 0; idx < nr_owners; idx++) {
+        qsort(&csr->edges[csr->offsets[idx]],
+              csr->offsets[idx + 1] - csr->offsets[idx],
+              sizeof(struct gweb_graph_edge), gweb_graph_edge_cmp);
+    }
+
+    return 0;
+}
+
+/* Log entries of a kind, by owner then in log order */
+struct gweb_graph_pending {
+    uint32_t owner;
+    int idx;
+};
+
+static int
+gweb_graph_pending_cmp (const void *a, const void *b)
+{
+    const struct gweb_graph_pending *pa = a, *pb = b;
+
+    if (pa->owner != pb->owner) {
+        return (pa->owner < pb->owner) ? -1 : 1;
+    }
+    return pa->idx - pb->idx;
+}
+
+/*
+ * New arrays from the current ones and the frozen log. Lists the log
+ * does not mention are copied as they are.
+ */
+static int
+gweb_graph_csr_merge (struct gweb_graph_csr *csr, const struct gweb_graph_csr *old,
+                      const struct gweb_graph_log *log, int kind, int dir,
+                      uint32_t nr_owners)
+{
+    struct gweb_graph_pending *pending;
+    uint32_t owner, nr, nr_edges = 0;
+    int idx, nr_pending = 0, next = 0;
+    size_t size = old->nr_owners ? old->offsets[old->nr_owners] : 0;
+
+    if ((pending = malloc((log->nr + 1) * sizeof(struct gweb_graph_pending))) == NULL) {
+        return -1;
+    }
+    for (idx = 0; idx < log->nr; idx++) {
+        if (log->ops[idx].kind == kind) {
+            pending[nr_pending].owner = gweb_graph_op_owner(&log->ops[idx], dir);
+            pending[nr_pending++].idx = idx;
+        }
+    }
+    qsort(pending, nr_pending, sizeof(struct gweb_graph_pending),
+          gweb_graph_pending_cmp);
+
+    csr->nr_owners = nr_owners;
+    csr->offsets = malloc((nr_owners + 1) * sizeof(uint32_t));
+    csr->edges = malloc((size + nr_pending + 1) * sizeof(struct gweb_graph_edge));
+    if (!csr->offsets || !csr->edges) {
+        free(pending);
+        gweb_graph_csr_free(csr);
+        return -1;
+    }
+
+    for (owner = 0; owner < nr_owners; owner++) {
+        csr->offsets[owner] = nr_edges;
+
+        nr = 0;
+        if (owner < old->nr_owners) {
+            nr = old->offsets[owner + 1] - old->offsets[owner];
+            memcpy(&csr->edges[nr_edges], &old->edges[old->offsets[owner]],
+                   nr * sizeof(struct gweb_graph_edge));
+        }
+
+        if (next < nr_pending && pending[next].owner == owner) {
+            while (next < nr_pending && pending[next].owner == owner) {
+                gweb_graph_op_apply(&log->ops[pending[next++].idx], dir,
+                                    &csr->edges[nr_edges], &nr);
+            }
+            qsort(&csr->edges[nr_edges], nr, sizeof(struct gweb_graph_edge),
+                  gweb_graph_edge_cmp);
+        }
+        nr_edges += nr;
+    }
+    csr->offsets[nr_owners] = nr_edges;
+
+    free(pending);
+    return 0;
+}
+
+static void
+gweb_graph_adj_free (struct gweb_graph_adj *adj)
+{
+    free(adj->offsets);
+    free(adj->peers);
+    memset(adj, 0, sizeof(*adj));
+}
+
+static int
+gweb_graph_peer_cmp (const void *a, const void *b)
+{
+    uint32_t pa = *(const uint32_t *)a, pb = *(const uint32_t *)b;
+
+    return (pa > pb) - (pa < pb);
+}
+
+/* Sort peers and drop repeats, returns how many are left */
+static uint32_t
+gweb_graph_peers_unique (uint32_t *peers, uint32_t nr)
+{
+    uint32_t idx, nr_unique = 0;
+
+    qsort(peers, nr, sizeof(uint32_t), gweb_graph_peer_cmp);
+    for (idx = 0; idx < nr; idx++) {
+        if (nr_unique == 0 || peers[nr_unique - 1] != peers[idx]) {
+            peers[nr_unique++] = peers[idx];
+        }
+    }
+    return nr_unique;
+}
+
+/* From the channel arrays of both directions, compacted in place */
+static int
+gweb_graph_adj_build (struct gweb_graph_adj *adj,
+                      const struct gweb_graph_csr csrs[GWEB_GRAPH_NR_DIRS])
+{
+    uint32_t owner, idx, nr, nr_peers = 0;
+    size_t size = 0;
+    int dir;
+
+    for (dir = 0; dir < GWEB_GRAPH_NR_DIRS; dir++) {
+        size += csrs[dir].nr_owners ? csrs[dir].offsets[csrs[dir].nr_owners] : 0;
+    }
+
+    adj->nr_owners = csrs[GWEB_GRAPH_OUTBOUND].nr_owners;
+    adj->offsets = malloc((adj->nr_owners + 1) * sizeof(uint32_t));
+    adj->peers = malloc((size + 1) * sizeof(uint32_t));
+    if (!adj->offsets || !adj->peers) {
+        gweb_graph_adj_free(adj);
+        return -1;
+    }
+
+    for (owner = 0; owner < adj->nr_owners; owner++) {
+        adj->offsets[owner] = nr_peers;
+
+        nr = 0;
+        for (dir = 0; dir < GWEB_GRAPH_NR_DIRS; dir++) {
+            if (owner >= csrs[dir].nr_owners) {
+                continue;
+            }
+            for (idx = csrs[dir].offsets[owner]; idx < csrs[dir].offsets[owner + 1];
+                 idx++) {
+                adj->peers[nr_peers + nr++] = csrs[dir].edges[idx].peer;
+            }
+        }
+        nr_peers += gweb_graph_peers_unique(&adj->peers[nr_peers], nr);
+    }
+    adj->offsets[adj->nr_owners] = nr_peers;
+
+    return 0;
+}
+
+/* Called with write lock held, and no merge running */
+static void
+gweb_graph_free (struct gweb_graph *graph)
+{
+    int kind, dir;
+
+    for (kind = 0; kind < GWEB_GRAPH_NR_KINDS; kind++) {
+        for (dir = 0; dir < GWEB_GRAPH_NR_DIRS; dir++) {
+            gweb_graph_csr_free(&graph->csr[kind][dir]);
+        }
+    }
+    gweb_graph_adj_free(&graph->adj);
+    free(graph->active.ops);
+    free(graph->frozen.ops);
+    memset(&graph->active, 0, sizeof(graph->active));
+    memset(&graph->frozen, 0, sizeof(graph->frozen));
+
+    gweb_graph_names_free(&graph->uids);
+    gweb_graph_names_free(&graph->labels);
+}
+
+/* Called with write lock held, the merger frees what it is using */
+static void
+gweb_graph_drop (struct gweb_graph *graph, const char *reason)
+{
+    log_error("Connection graph dropped, %s, lists go to MySQL\n", reason);
+
+    graph->ready = 0;
+    if (!graph->merging) {
+        gweb_graph_free(graph);
+    }
+}
+
+static void
+gweb_graph_log_write (int kind, int type, const char *from_uid, const char *to_uid,
+                      const char *date, const char *label)
+{
+    struct gweb_graph *graph = &g_graph;
+    struct gweb_graph_merger *merger = &g_graph_merger;
+    struct gweb_graph_op *op;
+    int from, to, label_id = 0, size, full;
+
+    if (!from_uid || !to_uid) {
+        return;
+    }
+
+    pthread_rwlock_wrlock(&graph->lock);
+    if (!graph->ready) {
+        pthread_rwlock_unlock(&graph->lock);
+        return;
+    }
+
+    if ((from = gweb_graph_names_add(&graph->uids, from_uid)) < 0 ||
+        (to = gweb_graph_names_add(&graph->uids, to_uid)) < 0 ||
+        (label && (label_id = gweb_graph_names_add(&graph->labels, label)) < 0)) {
+        gweb_graph_drop(graph, "name not stored");
+        pthread_rwlock_unlock(&graph->lock);
+        return;
+    }
+
+    if (graph->active.nr == graph->active.size) {
+        size = graph->active.size ? 2 * graph->active.size : GWEB_GRAPH_MERGE_OPS;
+        if ((op = realloc(graph->active.ops, size * sizeof(struct gweb_graph_op))) == NULL) {
+            gweb_graph_drop(graph, "delta log full");
+            pthread_rwlock_unlock(&graph->lock);
+            return;
+        }
+        graph->active.ops = op;
+        graph->active.size = size;
+    }
+
+    op = &graph->active.ops[graph->active.nr++];
+    op->kind = kind;
+    op->type = type;
+    op->from = from;
+    op->to = to;
+    op->label = label_id;
+    op->date = gweb_graph_date_pack(date);
+
+    full = (graph->active.nr == GWEB_GRAPH_MERGE_OPS);
+    pthread_rwlock_unlock(&graph->lock);
+
+    if (full) {
+        pthread_mutex_lock(&merger->lock);
+        pthread_cond_signal(&merger->wakeup);
+        pthread_mutex_unlock(&merger->lock);
+    }
+}
+
+void
+gweb_graph_request_set (const char *from_uid, const char *to_uid,
+                        const char *sent, const char *flag)
+{
+    gweb_graph_log_write(GWEB_GRAPH_REQUEST, GWEB_GRAPH_OP_SET, from_uid, to_uid,
+                         sent, flag ? flag : "");
+}
+
+void
+gweb_graph_channel_set (const char *from_uid, const char *to_uid,
+                        const char *connected, const char *channel)
+{
+    gweb_graph_log_write(GWEB_GRAPH_CHANNEL, GWEB_GRAPH_OP_SET, from_uid, to_uid,
+                         connected, channel ? channel : "");
+}
+
+void
+gweb_graph_channel_disconnect (const char *from_uid, const char *to_uid)
+{
+    gweb_graph_log_write(GWEB_GRAPH_CHANNEL, GWEB_GRAPH_OP_DISCONNECT, from_uid,
+                         to_uid, NULL, NULL);
+}
+
+/* Log entries for the list of owner, frozen first */
+static int
+gweb_graph_count_pending (const struct gweb_graph *graph, int kind, int dir,
+                          uint32_t owner)
+{
+    const struct gweb_graph_log *logs[] = { &graph->frozen, &graph->active };
+    int nr = 0, log, idx;
+
+    for (log = 0; log < ARRAY_SIZE(logs); log++) {
+        for (idx = 0; idx < logs[log]->nr; idx++) {
+            nr += (logs[log]->ops[idx].kind == kind &&
+                   gweb_graph_op_owner(&logs[log]->ops[idx], dir) == owner);
+        }
+    }
+    return nr;
+}
+
+static void
+gweb_graph_apply_pending (const struct gweb_graph *graph, int kind, int dir,
+                          uint32_t owner, struct gweb_graph_edge *edges,
+                          uint32_t *nr_edges)
+{
+    const struct gweb_graph_log *logs[] = { &graph->frozen, &graph->active };
+    const struct gweb_graph_op *op;
+    int log, idx;
+
+    for (log = 0; log < ARRAY_SIZE(logs); log++) {
+        for (idx = 0; idx < logs[log]->nr; idx++) {
+            op = &logs[log]->ops[idx];
+            if (op->kind == kind && gweb_graph_op_owner(op, dir) == owner) {
+                gweb_graph_op_apply(op, dir, edges, nr_edges);
+            }
+        }
+    }
+}
+
+/* Positive if the edge sorts after the cursor */
+static int
+gweb_graph_after (const struct gweb_graph *graph, const struct gweb_graph_edge *edge,
+                  uint64_t date, const char *uid, const char *label)
+{
+    int cmp;
+
+    if (edge->date != date) {
+        return (edge->date > date) ? 1 : -1;
+    }
+    if ((cmp = strcmp(GWEB_GRAPH_NAME(&graph->uids, edge->peer), uid)) != 0) {
+        return cmp;
+    }
+    return label ? gweb_mysql_ci_cmp(GWEB_GRAPH_NAME(&graph->labels, edge->label),
+                                     label) : 0;
+}
+
+int
+gweb_graph_list (int kind, int dir, const char *uid, const char *label,
+                 const char *after_date, const char *after_uid,
+                 const char *after_label, struct gweb_graph_match *matches,
+                 int limit)
+{
+    struct gweb_graph *graph = &g_graph;
+    struct gweb_graph_edge *edges, *merged = NULL;
+    struct gweb_graph_csr *csr = &graph->csr[kind][dir];
+    uint32_t lo, hi, mid, nr_edges = 0;
+    uint64_t date;
+    int owner, nr_pending, nr = 0;
+
+    if ((date = gweb_graph_date_pack(after_date)) == 0) {
+        return -1;
+    }
+
+    pthread_rwlock_rdlock(&graph->lock);
+    if (!graph->ready) {
+        nr = -1;
+        goto __bail_out;
+    }
+
+    if ((owner = gweb_graph_names_find(&graph->uids, uid)) < 0) {
+        goto __bail_out;
+    }
+
+    edges = NULL;
+    if (owner < csr->nr_owners) {
+        edges = &csr->edges[csr->offsets[owner]];
+        nr_edges = csr->offsets[owner + 1] - csr->offsets[owner];
+    }
+
+    /* Rebuilt when written since the last merge */
+    if ((nr_pending = gweb_graph_count_pending(graph, kind, dir, owner)) > 0) {
+        if ((merged = malloc((nr_edges + nr_pending) *
+                             sizeof(struct gweb_graph_edge))) == NULL) {
+            nr = -1;
+            goto __bail_out;
+        }
+        if (nr_edges) {
+            memcpy(merged, edges, nr_edges * sizeof(struct gweb_graph_edge));
+        }
+        gweb_graph_apply_pending(graph, kind, dir, owner, merged, &nr_edges);
+        qsort(merged, nr_edges, sizeof(struct gweb_graph_edge), gweb_graph_edge_cmp);
+        edges = merged;
+    }
+
+    /* First edge after the cursor */
+    for (lo = 0, hi = nr_edges; lo < hi; ) {
+        mid = lo + (hi - lo) / 2;
+        if (gweb_graph_after(graph, &edges[mid], date, after_uid, after_label) > 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    for (; lo < nr_edges && nr < limit; lo++) {
+        if (label && gweb_mysql_ci_cmp(GWEB_GRAPH_NAME(&graph->labels, edges[lo].label),
+                                       label) != 0) {
+            continue;
+        }
+        strcpy(matches[nr].uid, GWEB_GRAPH_NAME(&graph->uids, edges[lo].peer));
+        strcpy(matches[nr].label, GWEB_GRAPH_NAME(&graph->labels, edges[lo].label));
+        gweb_graph_date_unpack(edges[lo].date, matches[nr].date);
+        nr++;
+    }
+
+__bail_out:
+    pthread_rwlock_unlock(&graph->lock);
+    free(merged);
+    return nr;
+}
+
+/*
+ * Channel peers of owner, with the writes not merged yet. Points into
+ * the index when the log does not mention owner, else into *built.
+ */
+static int
+gweb_graph_channel_peers (const struct gweb_graph *graph, uint32_t owner,
+                          const uint32_t **peers, uint32_t *nr_peers,
+                          uint32_t **built)
+{
+    const struct gweb_graph_csr *csr;
+    struct gweb_graph_edge *edges;
+    uint32_t idx, nr, size = 0, nr_built = 0;
+    int dir, nr_pending = 0;
+
+    *built = NULL;
+    for (dir = 0; dir < GWEB_GRAPH_NR_DIRS; dir++) {
+        nr_pending += gweb_graph_count_pending(graph, GWEB_GRAPH_CHANNEL, dir, owner);
+    }
+
+    if (nr_pending == 0) {
+        *peers = NULL;
+        *nr_peers = 0;
+        if (owner < graph->adj.nr_owners) {
+            *peers = &graph->adj.peers[graph->adj.offsets[owner]];
+            *nr_peers = graph->adj.offsets[owner + 1] - graph->adj.offsets[owner];
+        }
+        return 0;
+    }
+
+    for (dir = 0; dir < GWEB_GRAPH_NR_DIRS; dir++) {
+        csr = &graph->csr[GWEB_GRAPH_CHANNEL][dir];
+        size += (owner < csr->nr_owners) ?
+            csr->offsets[owner + 1] - csr->offsets[owner] : 0;
+    }
+    size += nr_pending;
+
+    edges = malloc(size * sizeof(struct gweb_graph_edge));
+    *built = malloc(size * sizeof(uint32_t));
+    if (!edges || !*built) {
+        free(edges);
+        return -1;
+    }
+
+    for (dir = 0; dir < GWEB_GRAPH_NR_DIRS; dir++) {
+        csr = &graph->csr[GWEB_GRAPH_CHANNEL][dir];
+        nr = 0;
+        if (owner < csr->nr_owners) {
+            nr = csr->offsets[owner + 1] - csr->offsets[owner];
+            memcpy(edges, &csr->edges[csr->offsets[owner]],
+                   nr * sizeof(struct gweb_graph_edge));
+        }
+        gweb_graph_apply_pending(graph, GWEB_GRAPH_CHANNEL, dir, owner, edges, &nr);
+
+        for (idx = 0; idx < nr; idx++) {
+            (*built)[nr_built++] = edges[idx].peer;
+        }
+    }
+    free(edges);
+
+    *peers = *built;
+    *nr_peers = gweb_graph_peers_unique(*built, nr_built);
+    return 0;
+}
+
+int
+gweb_graph_suggestions (const char *uid, struct gweb_graph_suggestion *suggestions,
+                        int limit)
+{
+    struct gweb_graph *graph = &g_graph;
+    struct gweb_suggest_graph view;
+    struct gweb_suggestion *top;
+    const uint32_t *friends;
+    uint32_t nr_friends, *built = NULL;
+    int owner, idx, nr = 0;
+
+    if ((top = malloc((limit + 1) * sizeof(struct gweb_suggestion))) == NULL) {
+        return -1;
+    }
+
+    pthread_rwlock_rdlock(&graph->lock);
+    if (!graph->ready) {
+        nr = -1;
+        goto __bail_out;
+    }
+
+    if ((owner = gweb_graph_names_find(&graph->uids, uid)) < 0) {
+        goto __bail_out;
+    }
+
+    if (gweb_graph_channel_peers(graph, owner, &friends, &nr_friends, &built) < 0) {
+        nr = -1;
+        goto __bail_out;
+    }
+
+    view.nr_vertices = graph->adj.nr_owners;
+    view.offsets = graph->adj.offsets;
+    view.peers = graph->adj.peers;
+
+    if ((nr = gweb_suggest_rank(&view, owner, friends, nr_friends, top, limit)) < 0) {
+        goto __bail_out;
+    }
+
+    for (idx = 0; idx < nr; idx++) {
+        strcpy(suggestions[idx].uid, GWEB_GRAPH_NAME(&graph->uids, top[idx].vid));
+        suggestions[idx].mutual = top[idx].mutual;
+    }
+
+__bail_out:
+    pthread_rwlock_unlock(&graph->lock);
+    free(built);
+    free(top);
+    return nr;
+}
+
+void
+gweb_graph_stats (int *nr_uids, long *nr_edges, int *nr_pending)
+{
+    struct gweb_graph *graph = &g_graph;
+    struct gweb_graph_csr *csr;
+    int kind;
+
+    *nr_uids = 0;
+    *nr_edges = 0;
+    *nr_pending = 0;
+
+    pthread_rwlock_rdlock(&graph->lock);
+    if (graph->ready) {
+        *nr_uids = graph->uids.nr;
+        for (kind = 0; kind < GWEB_GRAPH_NR_KINDS; kind++) {
+            csr = &graph->csr[kind][GWEB_GRAPH_OUTBOUND];
+            *nr_edges += csr->nr_owners ? csr->offsets[csr->nr_owners] : 0;
+        }
+        *nr_pending = graph->active.nr + graph->frozen.nr;
+    }
+    pthread_rwlock_unlock(&graph->lock);
+}
+
+/*
+ * Fold the log into new arrays. Readers and writers carry on while
+ * they are built: the frozen log and the old arrays are not written
+ * until the swap.
+ */
+static void
+gweb_graph_merge (void)
+{
+    struct gweb_graph *graph = &g_graph;
+    struct gweb_graph_csr csr[GWEB_GRAPH_NR_KINDS][GWEB_GRAPH_NR_DIRS];
+    struct gweb_graph_adj adj = { 0 };
+    int kind, dir, failed = 0;
+    uint32_t nr_owners;
+
+    pthread_rwlock_wrlock(&graph->lock);
+    if (!graph->ready || graph->active.nr == 0) {
+        pthread_rwlock_unlock(&graph->lock);
+        return;
+    }
+    graph->frozen = graph->active;
+    memset(&graph->active, 0, sizeof(graph->active));
+    nr_owners = graph->uids.nr;
+    graph->merging = 1;
+    pthread_rwlock_unlock(&graph->lock);
+
+    memset(csr, 0, sizeof(csr));
+    for (kind = 0; kind < GWEB_GRAPH_NR_KINDS && !failed; kind++) {
+        for (dir = 0; dir < GWEB_GRAPH_NR_DIRS && !failed; dir++) {
+            failed = gweb_graph_csr_merge(&csr[kind][dir], &graph->csr[kind][dir],
+                                          &graph->frozen, kind, dir, nr_owners);
+        }
+    }
+    if (!failed) {
+        failed = gweb_graph_adj_build(&adj, csr[GWEB_GRAPH_CHANNEL]);
+    }
+
+    pthread_rwlock_wrlock(&graph->lock);
+    graph->merging = 0;
+
+    if (failed && graph->ready) {
+        gweb_graph_drop(graph, "unable to merge");
+    }
+    if (!graph->ready) {
+        /* Dropped meanwhile or just now */
+        for (kind = 0; kind < GWEB_GRAPH_NR_KINDS; kind++) {
+            for (dir = 0; dir < GWEB_GRAPH_NR_DIRS; dir++) {
+                gweb_graph_csr_free(&csr[kind][dir]);
+            }
+        }
+        gweb_graph_adj_free(&adj);
+        gweb_graph_free(graph);
+        pthread_rwlock_unlock(&graph->lock);
+        return;
+    }
+
+    for (kind = 0; kind < GWEB_GRAPH_NR_KINDS; kind++) {
+        for (dir = 0; dir < GWEB_GRAPH_NR_DIRS; dir++) {
+            gweb_graph_csr_free(&graph->csr[kind][dir]);
+            graph->csr[kind][dir] = csr[kind][dir];
+        }
+    }
+    gweb_graph_adj_free(&graph->adj);
+    graph->adj = adj;
+
+    log_debug("%s: %d write(s) merged\n", __func__, graph->frozen.nr);
+    free(graph->frozen.ops);
+    memset(&graph->frozen, 0, sizeof(graph->frozen));
+    pthread_rwlock_unlock(&graph->lock);
+}
+
+/* Append a loaded row, returns -1 if it can not be stored */
+static int
+gweb_graph_load_row (struct gweb_graph *graph, struct gweb_graph_log *rows,
+                     int kind, MYSQL_ROW row)
+{
+    struct gweb_graph_op *op;
+    int from, to, label, size;
+
+    if (!row[0] || !row[1]) {
+        return 0;
+    }
+
+    if ((from = gweb_graph_names_add(&graph->uids, row[0])) < 0 ||
+        (to = gweb_graph_names_add(&graph->uids, row[1])) < 0 ||
+        (label = gweb_graph_names_add(&graph->labels, row[3] ? row[3] : "")) < 0) {
+        return -1;
+    }
+
+    if (rows->nr == rows->size) {
+        size = rows->size ? 2 * rows->size : 65536;
+        if ((op = realloc(rows->ops, size * sizeof(struct gweb_graph_op))) == NULL) {
+            return -1;
+        }
+        rows->ops = op;
+        rows->size = size;
+    }
+
+    op = &rows->ops[rows->nr++];
+    op->kind = kind;
+    op->type = GWEB_GRAPH_OP_SET;
+    op->from = from;
+    op->to = to;
+    op->label = label;
+    op->date = gweb_graph_date_pack(row[2]);
+
+    return 0;
+}
+
+/* Load both tables, lists go to MySQL until then */
+int
+gweb_graph_init (struct gweb_mysql_conn *conn)
+{
+    struct gweb_graph *graph = &g_graph;
+    struct gweb_graph_log rows = { 0 };
+    struct gweb_mysql_stmt *st;
+    MYSQL_ROW row;
+    int kind, dir, ret = MYSQL_STATUS_FAIL;
+
+    pthread_rwlock_wrlock(&graph->lock);
+
+    for (kind = 0; kind < GWEB_GRAPH_NR_KINDS; kind++) {
+        st = (kind == GWEB_GRAPH_REQUEST) ? gweb_stmt_cxn_request_edges(conn) :
+            gweb_stmt_cxn_channel_edges(conn);
+        if (st == NULL) {
+            goto __bail_out;
+        }
+        while ((row = gweb_mysql_stmt_fetch(st)) != NULL) {
+            if (gweb_graph_load_row(graph, &rows, kind, row) < 0) {
+                log_error("%s: unable to allocate memory!\n", __func__);
+                gweb_mysql_stmt_done(st);
+                goto __bail_out;
+            }
+        }
+        gweb_mysql_stmt_done(st);
+    }
+
+    for (kind = 0; kind < GWEB_GRAPH_NR_KINDS; kind++) {
+        for (dir = 0; dir < GWEB_GRAPH_NR_DIRS; dir++) {
+            if (gweb_graph_csr_load(&graph->csr[kind][dir], rows.ops, rows.nr,
+                                    kind, dir, graph->uids.nr) < 0) {
+                log_error("%s: unable to allocate memory!\n", __func__);
+                goto __bail_out;
+            }
+        }
+    }
+
+    if (gweb_graph_adj_build(&graph->adj, graph->csr[GWEB_GRAPH_CHANNEL]) < 0) {
+        log_error("%s: unable to allocate memory!\n", __func__);
+        goto __bail_out;
+    }
+
+    graph->ready = 1;
+    ret = MYSQL_STATUS_OK;
+
+    log_debug("Connection graph ready, %u UID(s), %d edge(s)\n",
+              graph->uids.nr, rows.nr);
+
+__bail_out:
+    if (ret != MYSQL_STATUS_OK) {
+        gweb_graph_free(graph);
+    }
+    pthread_rwlock_unlock(&graph->lock);
+    free(rows.ops);
+
+    return ret;
+}
+
+void
+gweb_graph_shutdown (void)
+{
+    struct gweb_graph *graph = &g_graph;
+
+    pthread_rwlock_wrlock(&graph->lock);
+    graph->ready = 0;
+    if (!graph->merging) {
+        gweb_graph_free(graph);
+    }
+    pthread_rwlock_unlock(&graph->lock);
+}
+
+static void *
+gweb_graph_merger_thread (void *arg)
+{
+    struct gweb_graph_merger *merger = arg;
+    struct timespec deadline;
+    int running = 1;
+
+    while (running) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += GWEB_GRAPH_MERGE_SECS;
+
+        pthread_mutex_lock(&merger->lock);
+        if (merger->running) {
+            pthread_cond_timedwait(&merger->wakeup, &merger->lock, &deadline);
+        }
+        running = merger->running;
+        pthread_mutex_unlock(&merger->lock);
+
+        if (running) {
+            gweb_graph_merge();
+        }
+    }
+
+    return NULL;
+}
+
+int
+gweb_graph_merger_init (void)
+{
+    struct gweb_graph_merger *merger = &g_graph_merger;
+
+    merger->running = 1;
+    if (pthread_create(&merger->thread, NULL, gweb_graph_merger_thread, merger)) {
+        log_error("%s: unable to start merger thread\n", __func__);
+        merger->running = 0;
+        return MYSQL_STATUS_FAIL;
+    }
+    return MYSQL_STATUS_OK;
+}
+
+void
+gweb_graph_merger_shutdown (void)
+{
+    struct gweb_graph_merger *merger = &g_graph_merger;
+    int was_running;
+
+    pthread_mutex_lock(&merger->lock);
+    was_running = merger->running;
+    merger->running = 0;
+    pthread_cond_signal(&merger->wakeup);
+    pthread_mutex_unlock(&merger->lock);
+
+    if (was_running) {
+        pthread_join(merger->thread, NULL);
+    }
+}
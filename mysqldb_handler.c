@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <malloc.h>
 #include <string.h>
+#include <strings.h>
 #include <errno.h>
 #include <signal.h>
 
@@ -18,59 +19,22 @@
 #include <gweb/common.h>
 #include <gweb/json_struct.h>
 #include <gweb/json_api.h>
+#include <gweb/sql_gen.h>
 #include <gweb/mysqldb_api.h>
+#include <gweb/mysqldb_pool.h>
+#include <gweb/mysqldb_stmt.h>
+#include <gweb/mysqldb_txn.h>
+#include <gweb/mysqldb_location.h>
+#include <gweb/mysqldb_geo.h>
+#include <gweb/mysqldb_graph.h>
+#include <gweb/mysqldb_cache.h>
+#include <gweb/mysqldb_slowlog.h>
 #include <gweb/mysqldb_log.h>
 #include <gweb/config.h>
 #include <gweb/uid.h>
 
-/* Misc macros */
-#define MAX_DATETIME_STRSZ   (20)
-
-/* MySQL transaction status */
-enum {
-    GWEB_MYSQL_ERR_NO_RECORD = 1,
-    GWEB_MYSQL_ERR_NO_MEMORY,
-    GWEB_MYSQL_ERR_UNKNOWN,
-    GWEB_MYSQL_ERR_DUPLICATE,
-    GWEB_MYSQL_OK,
-};
-
-static struct mysql_config *g_mysql_cfg;
-static MYSQL *g_mysql_ctx;
-
-/* Atomic transactions -- depends on the backend storage engine
- * (eg. InnoDB)
- */
-static inline void
-gweb_mysql_start_transaction (void)
-{
-    gweb_mysql_ping();
-
-    mysql_query(g_mysql_ctx, "START TRANSACTION");
-}
-
-/* Assume Abort/Commit is done before timeout and there is no need to
- * do ping again. Need to see how mysql behaves when ping is done
- * between the transaction block.
- */
-static inline void
-gweb_mysql_abort_transaction (void)
-{
-    /* gweb_mysql_ping(); */
-
-    mysql_query(g_mysql_ctx, "ROLLBACK");
-}
-
-static inline void
-gweb_mysql_commit_transaction (void)
-{
-    /* gweb_mysql_ping(); */
-
-    mysql_query(g_mysql_ctx, "COMMIT");
-}
-
 #define GWEB_MYSQL_DATETIME_FORMAT   "%Y-%m-%d %H:%M:%S"
-static void
+void
 gweb_get_utc_datetime (char *dtbuf)
 {
     time_t now;
@@ -82,31 +46,6 @@ gweb_get_utc_datetime (char *dtbuf)
     strftime(dtbuf, MAX_DATETIME_STRSZ, GWEB_MYSQL_DATETIME_FORMAT, tm_info);
 }
 
-/* Given an UTC timestamp and expiry in seconds, find if the time has
- * expired.
- */
-static int
-gweb_check_time_expired (const char *utc_dt_str, int expiry)
-{
-    time_t now, prev;
-    struct tm tm_prev;
-    double seconds;
-
-    time(&now);
-
-    memset(&tm_prev, 0, sizeof(struct tm));
-    strptime(utc_dt_str, GWEB_MYSQL_DATETIME_FORMAT, &tm_prev);
-
-    prev = mktime(&tm_prev);
-
-    seconds = difftime(now, prev);
-    if (seconds > (double)expiry) {
-        return 1;
-    }
-
-    return 0;
-}
-
 static j2c_resp_t *
 gweb_mysql_allocate_response (void)
 {
@@ -136,6 +75,11 @@ gweb_mysql_get_common_response (int mysql_code,
         *desc = "Duplicate Entry";
         break;
 
+    case GWEB_MYSQL_ERR_INVALID:
+        *code = "400";
+        *desc = "Invalid Request";
+        break;
+
     case GWEB_MYSQL_OK:
         *code = "200";
         *desc = "OK";
@@ -157,7 +101,7 @@ gweb_mysql_get_common_response (int mysql_code,
                        &table->fields[FIELD_##macro##_RESP_DESC]);      \
     }
 
-static void
+void
 gweb_mysql_update_response (int resp_type, int mysql_code,
                             j2c_resp_t **response)
 {
@@ -229,13 +173,21 @@ gweb_mysql_update_response (int resp_type, int mysql_code,
         generate_default_response(neighbour_query, NEIGHBOUR_QUERY, mysql_code);
         break;
 
+    case JSON_C_SUGGESTIONS_QUERY_RESP:
+        generate_default_response(suggestions_query, SUGGESTIONS_QUERY, mysql_code);
+        break;
+
+    case JSON_C_STATS_QUERY_RESP:
+        generate_default_response(stats_query, STATS_QUERY, mysql_code);
+        break;
+
     default:
         return;
     }
     return;
 }
 
-static void
+void
 gweb_mysql_prepare_response (int resp_type, int mysql_code,
                              j2c_resp_t **response)
 {
@@ -259,69 +211,68 @@ gweb_mysql_prepare_response (int resp_type, int mysql_code,
 #define PUSH_BUF(buf, len, fmt...)             \
     len += sprintf(buf+len, fmt)
 
-/* For APIs requiring just a peek of record to see if one or more rows
- * exists.
- */
-static int
-gweb_mysql_get_query_count (const char *query)
-{
-    MYSQL_RES *result;
-    int ret;
-
-    if (mysql_query(g_mysql_ctx, query)) {
-        report_mysql_error_noclose(g_mysql_ctx);
-        return -1;
-    }
-
-    if ((result = mysql_store_result(g_mysql_ctx)) == NULL) {
-        report_mysql_error_noclose(g_mysql_ctx);
-        return -1;
-    }
-
-    ret = mysql_num_rows(result);
-
-    mysql_free_result(result);
-
-    return ret;
-}
+/* Push a value escaped for a quoted SQL string */
+#define PUSH_ESCAPED(conn, buf, len, str)                               \
+    len += mysql_real_escape_string((conn)->mysql, (char *)(buf)+(len), \
+                                    (str), strlen(str))
 
 int
-gweb_mysql_check_uid_email (const char *uid_str, const char *email)
+gweb_mysql_check_uid_email (struct gweb_mysql_conn *conn, const char *uid_str,
+                            const char *email)
 {
-    uint8_t qrybuf[MAX_MYSQL_QRYSZ];
-    int len = 0;
+    struct gweb_mysql_stmt *st;
+    int count;
+
+    /*
+     * Registered members answer from the set. A registration missing
+     * both goes ahead, the unique keys catch a race with another
+     * server. A lone UID missing is confirmed and learnt, it may have
+     * registered through another server.
+     */
+    switch (gweb_member_check(uid_str, email)) {
+    case 1:
+        return 1;
+    case 0:
+        if (email) {
+            return 0;
+        }
+        break;
+    default:
+        break;
+    }
 
     if (email) {
         /* Check if UID/E-Mail is already registered */
-        PUSH_BUF(qrybuf, len, "SELECT * FROM UserRegInfo WHERE "
-                 "UID='%s' OR Email='%s'", uid_str, email);
+        st = gweb_stmt_check_uid_email(conn, uid_str, email);
     } else {
         /* Check if UID is already registered */
-        PUSH_BUF(qrybuf, len, "SELECT * FROM UserRegInfo WHERE UID='%s'",
-                 uid_str);
+        st = gweb_stmt_check_uid(conn, uid_str);
     }
-    qrybuf[len] = '\0';
 
-    gweb_mysql_ping();
+    count = gweb_mysql_stmt_count(st);
+    if (count > 0 && !email) {
+        gweb_member_add(uid_str, NULL);
+    }
 
-    return gweb_mysql_get_query_count(qrybuf);
+    return count;
 }
 
 int
-gweb_mysql_handle_registration (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
+gweb_mysql_handle_registration (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                                j2c_resp_t **j2cresp)
 {
     struct j2c_registration_msg *jrecord = &j2cmsg->registration;
 
-    uint8_t qrybuf[MAX_MYSQL_QRYSZ], *db_qry1, *db_qry2;
     uint8_t uid_str[MAX_UID_STRSZ], utc_dt_str[MAX_DATETIME_STRSZ];
-    int len = 0, ret;
+    struct gweb_mysql_txn txn;
+    int ret;
 
     /* Get UID for this registration */
     gweb_app_get_uid_str(jrecord->fields[FIELD_REGISTRATION_PHONE],
                          jrecord->fields[FIELD_REGISTRATION_EMAIL],
                          uid_str);
 
-    ret = gweb_mysql_check_uid_email((const char *)uid_str,
+    ret = gweb_mysql_check_uid_email(conn, (const char *)uid_str,
                                jrecord->fields[FIELD_REGISTRATION_EMAIL]);
     if (ret < 0) {
         gweb_mysql_prepare_response(JSON_C_REGISTRATION_RESP,
@@ -337,48 +288,40 @@ gweb_mysql_handle_registration (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
     }
 
     /* UID is not already registered, update database */
-    len = 0;
-    db_qry1 = &qrybuf[len];
-    PUSH_BUF(qrybuf, len, "INSERT INTO UserRegInfo ");
-    PUSH_BUF(qrybuf, len, "(UID, FirstName, LastName, Email, StartDate, ");
-    PUSH_BUF(qrybuf, len, "Password) VALUES ");
 
     /* NOTE: Should this datetime be sent from the application
      * layer?
      */
     gweb_get_utc_datetime(utc_dt_str);
 
-    PUSH_BUF(qrybuf, len, "('%s', '%s', '%s', '%s', '%s', '%s')",
-             uid_str,
-             jrecord->fields[FIELD_REGISTRATION_FNAME],
-             jrecord->fields[FIELD_REGISTRATION_LNAME],
-             jrecord->fields[FIELD_REGISTRATION_EMAIL],
-             utc_dt_str,
-             jrecord->fields[FIELD_REGISTRATION_PASSWORD]);
+    /* The inserts and the commit go out in one round trip */
+    gweb_mysql_txn_begin(&txn, conn);
 
-    qrybuf[len++] = '\0';
-
-    db_qry2 = &qrybuf[len];
-    PUSH_BUF(qrybuf, len, "INSERT INTO UserPhone ");
-    PUSH_BUF(qrybuf, len, "(UID, PhoneType, Phone) VALUES ");
+    gweb_txn_registration_insert_user(&txn, uid_str,
+                          jrecord->fields[FIELD_REGISTRATION_FNAME],
+                          jrecord->fields[FIELD_REGISTRATION_LNAME],
+                          jrecord->fields[FIELD_REGISTRATION_EMAIL],
+                          utc_dt_str,
+                          jrecord->fields[FIELD_REGISTRATION_PASSWORD]);
 
     /* NOTE: default phone type set to mobile */
-    PUSH_BUF(qrybuf, len, "('%s', 'mobile', '%s')",
-             uid_str,
-             jrecord->fields[FIELD_REGISTRATION_PHONE]);
-    qrybuf[len++] = '\0';
-
-    gweb_mysql_start_transaction();
+    gweb_txn_registration_insert_phone(&txn, uid_str,
+                          jrecord->fields[FIELD_REGISTRATION_PHONE]);
 
-    if (mysql_query(g_mysql_ctx, db_qry1)) {
-        goto __abort_transaction;
-    }
+    gweb_txn_profile_view_insert(&txn, uid_str,
+                          jrecord->fields[FIELD_REGISTRATION_FNAME],
+                          jrecord->fields[FIELD_REGISTRATION_LNAME],
+                          jrecord->fields[FIELD_REGISTRATION_EMAIL],
+                          jrecord->fields[FIELD_REGISTRATION_PHONE]);
 
-    if (mysql_query(g_mysql_ctx, db_qry2)) {
+    if (gweb_mysql_txn_commit(&txn) != MYSQL_STATUS_OK) {
         goto __abort_transaction;
     }
+    gweb_member_add((const char *)uid_str, jrecord->fields[FIELD_REGISTRATION_EMAIL]);
+    gweb_profile_cache_invalidate((const char *)uid_str);
 
-    gweb_mysql_commit_transaction();
+    /* The client reads its new UID back next, keep it on the primary */
+    gweb_mysql_pin((const char *)uid_str);
 
     gweb_mysql_prepare_response(JSON_C_REGISTRATION_RESP,
                                 GWEB_MYSQL_OK,
@@ -390,8 +333,6 @@ gweb_mysql_handle_registration (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
     return MYSQL_STATUS_OK;
 
 __abort_transaction:
-    report_mysql_error_noclose(g_mysql_ctx);
-    gweb_mysql_abort_transaction();
     gweb_mysql_prepare_response(JSON_C_REGISTRATION_RESP,
                                 GWEB_MYSQL_ERR_UNKNOWN,
                                 j2cresp);
@@ -411,39 +352,21 @@ gweb_mysql_free_registration (j2c_resp_t *j2cresp)
     return MYSQL_STATUS_OK;
 }
 
-static const char *profile_info_qry_fields[] = {
-    [FIELD_PROFILE_INFO_RESP_CODE] = NULL,
-    [FIELD_PROFILE_INFO_RESP_DESC] = NULL,
-    [FIELD_PROFILE_INFO_RESP_UID] = "UserRegInfo.UID",
-    [FIELD_PROFILE_INFO_RESP_FNAME] = "UserRegInfo.FirstName",
-    [FIELD_PROFILE_INFO_RESP_LNAME] = "UserRegInfo.LastName",
-    [FIELD_PROFILE_INFO_RESP_EMAIL] = "UserRegInfo.Email",
-    [FIELD_PROFILE_INFO_RESP_PHONE] = "UserPhone.Phone",
-    [FIELD_PROFILE_INFO_RESP_ADDRESS1] = "UserAddress.Address1",
-    [FIELD_PROFILE_INFO_RESP_ADDRESS2] = "UserAddress.Address2",
-    [FIELD_PROFILE_INFO_RESP_ADDRESS3] = "UserAddress.Address3",
-    [FIELD_PROFILE_INFO_RESP_COUNTRY] = "UserAddress.Country",
-    [FIELD_PROFILE_INFO_RESP_STATE] = "UserAddress.State",
-    [FIELD_PROFILE_INFO_RESP_PINCODE] = "UserAddress.Pincode",
-    /* NOTE: Multi-record, using below hack */
-    [FIELD_PROFILE_INFO_RESP_FACEBOOK_HANDLE] = "UserSocialNetwork.NetworkType",
-    [FIELD_PROFILE_INFO_RESP_TWITTER_HANDLE] = "UserSocialNetwork.NetworkHandle",
-    [FIELD_PROFILE_INFO_RESP_AVATAR_URL] = "UserRegInfo.AvatarURL",
-    [FIELD_PROFILE_INFO_RESP_FLAG] = "UserRegInfo.ProfileFlags",
-};
-
 /*
- * Populate complete profile information based on UID or e-mail
+ * Populate complete profile information based on UID or e-mail, a
+ * single UserProfileView row with columns in FIELD_PROFILE_INFO_RESP_*
+ * order, see PROFILE_INFO_BY_UID. Records looked up by UID go through
+ * the profile cache.
  */
 static int
-gweb_mysql_populate_profile_info (j2c_resp_t *j2cresp, const char *uid,
+gweb_mysql_populate_profile_info (struct gweb_mysql_conn *conn,
+                                  j2c_resp_t *j2cresp, const char *uid,
                                   const char *email)
 {
-    uint8_t qrybuf[MAX_MYSQL_QRYSZ];
-    int len = 0, fld;
-
-    MYSQL_RES *result;
+    struct gweb_mysql_stmt *st;
     MYSQL_ROW row;
+    unsigned long gen = 0;
+    int fld;
 
     J2C_RESP_TABLE(profile_info, *resp) = &j2cresp->profile_info;
 
@@ -451,83 +374,49 @@ gweb_mysql_populate_profile_info (j2c_resp_t *j2cresp, const char *uid,
         return GWEB_MYSQL_ERR_NO_RECORD;
     }
 
-    PUSH_BUF(qrybuf, len, "SELECT ");
-
-    for (fld = 0; fld < FIELD_PROFILE_INFO_RESP_MAX; fld++) {
-        if (profile_info_qry_fields[fld] == NULL) {
-            PUSH_BUF(qrybuf, len, "NULL,");
-        } else {
-            PUSH_BUF(qrybuf, len, "%s,", profile_info_qry_fields[fld]);
-        }
+    if (uid != NULL &&
+        gweb_profile_cache_get(uid, &resp->fields[FIELD_PROFILE_INFO_RESP_UID],
+                               FIELD_PROFILE_INFO_RESP_MAX - FIELD_PROFILE_INFO_RESP_UID,
+                               &gen)) {
+        return GWEB_MYSQL_OK;
     }
 
-    len--; /* Strip leading ',' */
-
-    PUSH_BUF(qrybuf, len, " FROM UserRegInfo "
-	     "LEFT JOIN UserPhone USING(UID) "
-	     "LEFT JOIN UserSocialNetwork USING(UID) "
-	     "LEFT JOIN UserAddress USING(UID) "
-	     "WHERE ");
-
     if (uid != NULL) {
-        PUSH_BUF(qrybuf, len, "UserRegInfo.UID='%s'", uid);
-    } else if (email != NULL) {
-        PUSH_BUF(qrybuf, len, "UserRegInfo.Email='%s'", email);
-    }
-
-    qrybuf[len] = '\0';
-
-    gweb_mysql_ping();
-
-    if (mysql_query(g_mysql_ctx, qrybuf)) {
-        report_mysql_error_noclose(g_mysql_ctx);
-        return GWEB_MYSQL_ERR_UNKNOWN;
+        st = gweb_stmt_profile_info_by_uid(conn, uid);
+    } else {
+        st = gweb_stmt_profile_info_by_email(conn, email);
     }
 
-    if ((result = mysql_store_result(g_mysql_ctx)) == NULL) {
-        report_mysql_error_noclose(g_mysql_ctx);
+    if (st == NULL) {
         return GWEB_MYSQL_ERR_UNKNOWN;
     }
 
-    if (mysql_num_rows(result) == 0) {
-        mysql_free_result(result);
+    if (gweb_mysql_stmt_num_rows(st) == 0) {
+        gweb_mysql_stmt_done(st);
         return GWEB_MYSQL_ERR_NO_RECORD;
     }
 
-    if ((row = mysql_fetch_row(result)) == NULL) {
-        mysql_free_result(result);
+    if ((row = gweb_mysql_stmt_fetch(st)) == NULL) {
+        gweb_mysql_stmt_done(st);
         return GWEB_MYSQL_ERR_UNKNOWN;
     }
 
     for (fld = FIELD_PROFILE_INFO_RESP_UID;
          fld < FIELD_PROFILE_INFO_RESP_MAX;
          fld++) {
-        if (fld == FIELD_PROFILE_INFO_RESP_FACEBOOK_HANDLE ||
-            fld == FIELD_PROFILE_INFO_RESP_TWITTER_HANDLE) {
-            continue;
-        }
         if (row[fld]) {
             resp->fields[fld] = strndup(row[fld], strlen(row[fld]));
         }
     }
 
-    do {
-        char *network_type = row[FIELD_PROFILE_INFO_RESP_FACEBOOK_HANDLE];
-        int handle_idx = FIELD_PROFILE_INFO_RESP_TWITTER_HANDLE;
-
-        if (network_type) {
-            if (strcasecmp(network_type, "facebook") == 0) {
-                resp->fields[FIELD_PROFILE_INFO_RESP_FACEBOOK_HANDLE] =
-                    strndup(row[handle_idx], strlen(row[handle_idx]));
-
-            } else if (strcasecmp(network_type, "twitter") == 0) {
-                resp->fields[FIELD_PROFILE_INFO_RESP_TWITTER_HANDLE] =
-                    strndup(row[handle_idx], strlen(row[handle_idx]));
-            }
-        }
-    } while ((row = mysql_fetch_row(result)));
+    gweb_mysql_stmt_done(st);
 
-    mysql_free_result(result);
+    /* Not from a replica that may not have the latest write yet */
+    if (uid != NULL && gweb_mysql_conn_fresh(conn, uid)) {
+        gweb_profile_cache_put(uid, &resp->fields[FIELD_PROFILE_INFO_RESP_UID],
+                               FIELD_PROFILE_INFO_RESP_MAX - FIELD_PROFILE_INFO_RESP_UID,
+                               gen);
+    }
 
     return GWEB_MYSQL_OK;
 }
@@ -547,11 +436,14 @@ gweb_mysql_free_profile_info (j2c_resp_t *j2cresp)
 }
 
 int
-gweb_mysql_handle_login (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
+gweb_mysql_handle_login (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                         j2c_resp_t **j2cresp)
 {
-    uint8_t qrybuf[MAX_MYSQL_QRYSZ];
-    int len = 0, err = GWEB_MYSQL_ERR_UNKNOWN, ret = MYSQL_STATUS_FAIL;
-    int count;
+    int err = GWEB_MYSQL_ERR_UNKNOWN, ret = MYSQL_STATUS_FAIL;
+    struct gweb_mysql_conn *primary;
+    struct gweb_mysql_stmt *st;
+    MYSQL_ROW row;
+    char uid[MAX_UID_STRSZ];
 
     J2C_MSG_TABLE(login, *jrecord) = &j2cmsg->login;
 
@@ -566,23 +458,31 @@ gweb_mysql_handle_login (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
         goto __bail_out;
     }
     
-    PUSH_BUF(qrybuf, len, "SELECT UID from UserRegInfo WHERE "
-             "UserRegInfo.Email='%s' AND UserRegInfo.Password='%s'",
-             jrecord->fields[FIELD_LOGIN_EMAIL],
-             jrecord->fields[FIELD_LOGIN_PASSWORD]);
-    qrybuf[len] = '\0';
-
-    if ((count = gweb_mysql_get_query_count(qrybuf)) < 0) {
+    if ((st = gweb_stmt_login_check(conn, jrecord->fields[FIELD_LOGIN_EMAIL],
+                                    jrecord->fields[FIELD_LOGIN_PASSWORD])) == NULL) {
         goto __bail_out;
     }
 
-    if (count == 0) {
+    if ((row = gweb_mysql_stmt_fetch(st)) == NULL || row[0] == NULL) {
+        gweb_mysql_stmt_done(st);
         err = GWEB_MYSQL_ERR_NO_RECORD;
         goto __bail_out;
     }
+    snprintf(uid, sizeof(uid), "%s", row[0]);
+    gweb_mysql_stmt_done(st);
 
-    err = gweb_mysql_populate_profile_info(*j2cresp, NULL,
-                              jrecord->fields[FIELD_LOGIN_EMAIL]);
+    /*
+     * By UID rather than email, so that logins hit the profile cache.
+     * A profile updated moments ago is read from the primary.
+     */
+    if (!gweb_mysql_conn_fresh(conn, uid) &&
+        (primary = gweb_mysql_pool_get()) != NULL) {
+        primary->caller = conn->caller;
+        err = gweb_mysql_populate_profile_info(primary, *j2cresp, uid, NULL);
+        gweb_mysql_pool_put(primary);
+    } else {
+        err = gweb_mysql_populate_profile_info(conn, *j2cresp, uid, NULL);
+    }
     if (err != GWEB_MYSQL_OK) {
         goto __bail_out;
     }
@@ -606,43 +506,36 @@ gweb_mysql_free_login (j2c_resp_t *j2cresp)
 }
 
 int
-gweb_mysql_handle_avatar (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
+gweb_mysql_handle_avatar (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                          j2c_resp_t **j2cresp)
 {
     struct j2c_avatar_msg *jrecord = &j2cmsg->avatar;
-
-    uint8_t qrybuf[MAX_MYSQL_QRYSZ];
-    int len = 0, ret;
+    struct gweb_mysql_txn txn;
+    int ret;
 
     /* Check if UID is registered */
-    ret = gweb_mysql_check_uid_email(jrecord->fields[FIELD_PROFILE_UID], NULL);
+    ret = gweb_mysql_check_uid_email(conn, jrecord->fields[FIELD_PROFILE_UID], NULL);
     if (ret <= 0) {
-        report_mysql_error_noclose(g_mysql_ctx);
         goto __bail_out;
     }
 
-    PUSH_BUF(qrybuf, len,
-             "UPDATE UserRegInfo SET AvatarURL='%s' WHERE UID='%s'",
-             jrecord->fields[FIELD_AVATAR_URL],
-             jrecord->fields[FIELD_AVATAR_UID]);
-    qrybuf[len] = '\0';
-
-    gweb_mysql_ping();
-
-    gweb_mysql_start_transaction();
+    gweb_mysql_txn_begin(&txn, conn);
+    gweb_txn_avatar_update(&txn, jrecord->fields[FIELD_AVATAR_URL],
+                           jrecord->fields[FIELD_AVATAR_UID]);
+    gweb_txn_profile_view_avatar_update(&txn, jrecord->fields[FIELD_AVATAR_URL],
+                                        jrecord->fields[FIELD_AVATAR_UID]);
 
-    if (mysql_query(g_mysql_ctx, qrybuf)) {
-        goto __abort_transaction;
+    if (gweb_mysql_txn_commit(&txn) != MYSQL_STATUS_OK) {
+        goto __bail_out;
     }
-
-    gweb_mysql_commit_transaction();
+    gweb_card_cache_invalidate(jrecord->fields[FIELD_AVATAR_UID]);
+    gweb_profile_cache_invalidate(jrecord->fields[FIELD_AVATAR_UID]);
 
     gweb_mysql_prepare_response(JSON_C_AVATAR_RESP,
                                 GWEB_MYSQL_OK,
                                 j2cresp);
     return MYSQL_STATUS_OK;
 
-__abort_transaction:
-    gweb_mysql_abort_transaction();
 __bail_out:
     gweb_mysql_prepare_response(JSON_C_AVATAR_RESP,
                                 GWEB_MYSQL_ERR_NO_RECORD,
@@ -659,217 +552,92 @@ gweb_mysql_free_avatar (j2c_resp_t *j2cresp)
     return MYSQL_STATUS_OK;
 }
 
+/* Empty handle removes the network, otherwise it is set */
 static int
-gweb_mysql_query_social_network (const char *uid, const char *sn_type)
-{
-    uint8_t qrybuf[MAX_MYSQL_QRYSZ];
-    int len = 0;
-
-    PUSH_BUF(qrybuf, len, "SELECT UID from UserSocialNetwork WHERE UID='%s' "
-             "AND NetworkType='%s'", uid, sn_type);
-    qrybuf[len] = '\0';
-
-    return gweb_mysql_get_query_count(qrybuf);
-}
-
-static int
-gweb_mysql_update_social_network (char *qrybuf, struct j2c_profile_msg *jrecord,
-                                  const char *sn_type, int field_idx, int found)
+gweb_mysql_update_social_network (struct gweb_mysql_txn *txn,
+                                  struct j2c_profile_msg *jrecord,
+                                  const char *sn_type, int field_idx)
 {
-    int len = 0;
+    const char *uid = jrecord->fields[FIELD_PROFILE_UID];
+    const char *handle = jrecord->fields[field_idx];
 
-    if (strlen(jrecord->fields[field_idx]) == 0) {
-        PUSH_BUF(qrybuf, len, "DELETE FROM UserSocialNetwork WHERE UID='%s' "
-                 "AND NetworkType='%s'",
-                 jrecord->fields[FIELD_PROFILE_UID],
-                 sn_type);
+    if (field_idx == FIELD_PROFILE_FACEBOOK_HANDLE) {
+        gweb_txn_profile_view_facebook_update(txn, handle, uid);
     } else {
-        if (found) {
-            PUSH_BUF(qrybuf, len,
-                     "UPDATE UserSocialNetwork SET NetworkHandle='%s' "
-                     "WHERE UID='%s' AND NetworkType='%s'",
-                     jrecord->fields[field_idx],
-                     jrecord->fields[FIELD_PROFILE_UID],
-                     sn_type);
-        } else {
-            PUSH_BUF(qrybuf, len,
-                     "INSERT INTO UserSocialNetwork (UID, NetworkType, "
-                     "NetworkHandle) VALUES ('%s', '%s', '%s')",
-                     jrecord->fields[FIELD_PROFILE_UID],
-                     sn_type,
-                     jrecord->fields[field_idx]);
-        }
+        gweb_txn_profile_view_twitter_update(txn, handle, uid);
     }
-    qrybuf[len] = '\0';
-
-    return len;
-}
 
-/* If the given string is "" then set the field to NULL, else update
- * the field
- */
-#define STR_OR_NULL_QRY(fld, fldname)				\
-    if (jrecord->fields[fld]) {					\
-	if (strlen(jrecord->fields[fld]) == 0) {		\
-	    PUSH_BUF(qrybuf, len, fldname "NULL,");		\
-	} else {						\
-	    PUSH_BUF(qrybuf, len, fldname "'%s',",		\
-		     jrecord->fields[fld]);			\
-	}							\
+    if (strlen(handle) == 0) {
+        return gweb_txn_social_network_delete(txn, uid, sn_type);
     }
 
-#define STR_OR_NULL_INSERT_QRY(fld, fldname)	\
-    STR_OR_NULL_QRY(fld, fldname)		\
-    else {					\
-	PUSH_BUF(qrybuf, len, "NULL,");		\
-    }
+    return gweb_txn_social_network_upsert(txn, uid, sn_type, handle);
+}
 
 int
-gweb_mysql_handle_profile (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
+gweb_mysql_handle_profile (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                           j2c_resp_t **j2cresp)
 {
     struct j2c_profile_msg *jrecord = &j2cmsg->profile;
+    struct gweb_mysql_txn txn;
 
-    uint8_t qrybuf[MAX_MYSQL_QRYSZ], *db_qry1, *db_qry2, *db_qry3;
-    int record_found = 0, sn_facebook_found = 0, sn_twitter_found = 0;
-    int update_fields = 0;
-    int len = 0, tmp_len, ret;
+    int ret;
     int bail_out_err = GWEB_MYSQL_ERR_UNKNOWN;
 
     /* Check if UID is registered */
-    ret = gweb_mysql_check_uid_email(jrecord->fields[FIELD_PROFILE_UID], NULL);
+    ret = gweb_mysql_check_uid_email(conn, jrecord->fields[FIELD_PROFILE_UID], NULL);
     if (ret <= 0) {
-        report_mysql_error_noclose(g_mysql_ctx);
         bail_out_err = GWEB_MYSQL_ERR_NO_RECORD;
         goto __bail_out;
     }
 
-    /*
-     * NOTE: address type hardcoded as permanent for now
-     */
-    PUSH_BUF(qrybuf, len,
-             "SELECT UID from UserAddress WHERE UID='%s' AND AddressType='%s'",
-             jrecord->fields[FIELD_PROFILE_UID],
-             "permanent");
-    qrybuf[len] = '\0';
-
-    gweb_mysql_ping();
-
-    /* Check if the record exists */
-    if ((ret = gweb_mysql_get_query_count(qrybuf)) < 0) {
-        report_mysql_error_noclose(g_mysql_ctx);
-        goto __bail_out;
-    }
-    record_found = ret;
+    /* Build the transaction, the updates go out in one round trip */
+    gweb_mysql_txn_begin(&txn, conn);
 
-    ret = gweb_mysql_query_social_network(jrecord->fields[FIELD_PROFILE_UID],
-                                          "facebook");
-    if (ret < 0) {
-        report_mysql_error_noclose(g_mysql_ctx);
-        goto __bail_out;
-    }
-    sn_facebook_found = ret;
-
-    ret = gweb_mysql_query_social_network(jrecord->fields[FIELD_PROFILE_UID],
-                                          "twitter");
-    if (ret < 0) {
-        report_mysql_error_noclose(g_mysql_ctx);
-        goto __bail_out;
-    }
-    sn_twitter_found = ret;
-
-    db_qry1 = db_qry2 = db_qry3 = NULL;
-
-    /* Update record if exists or else, insert. Note that, we have a
-     * case where there is no primary key in this table. Check for
-     * other social network handles.
+    /* Insert the address or update it in place, keyed on UID and
+     * address type. Absent fields are left as is, empty ones are set
+     * to NULL. NOTE: address type hardcoded as permanent for now
      */
-    len = 0;
-
-    /* Check if there is atleast one field to update */
-    if (jrecord->fields[FIELD_PROFILE_ADDRESS1] ||
-	jrecord->fields[FIELD_PROFILE_ADDRESS2] ||
-	jrecord->fields[FIELD_PROFILE_ADDRESS3] ||
-	jrecord->fields[FIELD_PROFILE_STATE] ||
-	jrecord->fields[FIELD_PROFILE_PINCODE] ||
-	jrecord->fields[FIELD_PROFILE_COUNTRY]) {
-	update_fields = 1;
-    }
-
-    if (record_found && update_fields) {
-	PUSH_BUF(qrybuf, len, "UPDATE UserAddress SET ");
-	STR_OR_NULL_QRY(FIELD_PROFILE_ADDRESS1, "Address1=");
-	STR_OR_NULL_QRY(FIELD_PROFILE_ADDRESS2, "Address2=");
-	STR_OR_NULL_QRY(FIELD_PROFILE_ADDRESS3, "Address3=");
-	STR_OR_NULL_QRY(FIELD_PROFILE_STATE, "State=");
-	STR_OR_NULL_QRY(FIELD_PROFILE_PINCODE, "Pincode=");
-	STR_OR_NULL_QRY(FIELD_PROFILE_COUNTRY, "Country=");
-	len--; /* Strip leading ',' */
-	PUSH_BUF(qrybuf, len, " WHERE UID='%s' AND AddressType='%s'",
-		 jrecord->fields[FIELD_PROFILE_UID], "permanent");
-
-	db_qry1 = &qrybuf[0];
-	qrybuf[len++] = '\0';
-
-    } else if (!record_found) {
-        PUSH_BUF(qrybuf, len, "INSERT INTO UserAddress "
-                 "(UID, AddressType, Address1, Address2, Address3, State, "
-                 "Pincode, Country) VALUES ('%s', '%s', ",
-		 jrecord->fields[FIELD_PROFILE_UID],
-		 "permanent");
-	STR_OR_NULL_INSERT_QRY(FIELD_PROFILE_ADDRESS1, "");
-	STR_OR_NULL_INSERT_QRY(FIELD_PROFILE_ADDRESS2, "");
-	STR_OR_NULL_INSERT_QRY(FIELD_PROFILE_ADDRESS3, "");
-	STR_OR_NULL_INSERT_QRY(FIELD_PROFILE_STATE, "");
-	STR_OR_NULL_INSERT_QRY(FIELD_PROFILE_PINCODE, "");
-	STR_OR_NULL_INSERT_QRY(FIELD_PROFILE_COUNTRY, "");
-	len--; /* Strip leading ',' */
-
-	PUSH_BUF(qrybuf, len, ")");
-
-	db_qry1 = &qrybuf[0];
-	qrybuf[len++] = '\0';
-    }
+    gweb_txn_address_upsert(&txn,
+                            jrecord->fields[FIELD_PROFILE_UID],
+                            "permanent",
+                            jrecord->fields[FIELD_PROFILE_ADDRESS1],
+                            jrecord->fields[FIELD_PROFILE_ADDRESS2],
+                            jrecord->fields[FIELD_PROFILE_ADDRESS3],
+                            jrecord->fields[FIELD_PROFILE_STATE],
+                            jrecord->fields[FIELD_PROFILE_PINCODE],
+                            jrecord->fields[FIELD_PROFILE_COUNTRY]);
+    gweb_txn_profile_view_address_update(&txn,
+                            jrecord->fields[FIELD_PROFILE_ADDRESS1],
+                            jrecord->fields[FIELD_PROFILE_ADDRESS2],
+                            jrecord->fields[FIELD_PROFILE_ADDRESS3],
+                            jrecord->fields[FIELD_PROFILE_STATE],
+                            jrecord->fields[FIELD_PROFILE_PINCODE],
+                            jrecord->fields[FIELD_PROFILE_COUNTRY],
+                            jrecord->fields[FIELD_PROFILE_UID]);
 
     if (jrecord->fields[FIELD_PROFILE_FACEBOOK_HANDLE]) {
-        db_qry2 = &qrybuf[len];
-        tmp_len = gweb_mysql_update_social_network(db_qry2, jrecord, "facebook",
-                             FIELD_PROFILE_FACEBOOK_HANDLE, sn_facebook_found);
-        len += tmp_len + 1;
+        gweb_mysql_update_social_network(&txn, jrecord, "facebook",
+                                         FIELD_PROFILE_FACEBOOK_HANDLE);
     }
 
     if (jrecord->fields[FIELD_PROFILE_TWITTER_HANDLE]) {
-        db_qry3 = &qrybuf[len];
-        tmp_len = gweb_mysql_update_social_network(db_qry3, jrecord, "twitter",
-                             FIELD_PROFILE_TWITTER_HANDLE, sn_twitter_found);
-        len += tmp_len + 1;
+        gweb_mysql_update_social_network(&txn, jrecord, "twitter",
+                                         FIELD_PROFILE_TWITTER_HANDLE);
     }
 
-    /* Start transaction and push the updates */
-    gweb_mysql_start_transaction();
-
-    if (db_qry1 && mysql_query(g_mysql_ctx, db_qry1)) {
-        goto __abort_transaction;
-    }
-
-    if (db_qry2 && mysql_query(g_mysql_ctx, db_qry2)) {
-        goto __abort_transaction;
-    }
-
-    if (db_qry3 && mysql_query(g_mysql_ctx, db_qry3)) {
-        goto __abort_transaction;
+    /* Fails if any statement could not be added */
+    if (gweb_mysql_txn_commit(&txn) != MYSQL_STATUS_OK) {
+        goto __bail_out;
     }
-
-    gweb_mysql_commit_transaction();
+    gweb_card_cache_invalidate(jrecord->fields[FIELD_PROFILE_UID]);
+    gweb_profile_cache_invalidate(jrecord->fields[FIELD_PROFILE_UID]);
 
     gweb_mysql_prepare_response(JSON_C_PROFILE_RESP,
                                 GWEB_MYSQL_OK,
                                 j2cresp);
     return MYSQL_STATUS_OK;
 
-__abort_transaction:
-    report_mysql_error_noclose(g_mysql_ctx);
-    gweb_mysql_abort_transaction();
-
 __bail_out:
     gweb_mysql_prepare_response(JSON_C_PROFILE_RESP,
                                 bail_out_err,
@@ -881,81 +649,138 @@ __bail_out:
 
 #define CXN_REQUEST_FLAG_CLOSED      "closed"
 #define CXN_CHANNEL_BASIC_CONNECT    "connect"
+#define CXN_PREFERENCE_FLAG_PUBLIC   "public"
 
-static int
-gweb_mysql_prepare_cxn_accept_query (const char *from_uid, const char *to_uid,
-                                     uint8_t *buf, int *qlen)
+/*
+ * Preference rows (ChannelId, ChannelFlags) of a statement, in the
+ * order read. NULL if they could not be read, free() otherwise.
+ */
+static struct gweb_cxn_prefs *
+gweb_mysql_cxn_prefs_read (struct gweb_mysql_stmt *st)
 {
-    uint8_t qrybuf[MAX_MYSQL_QRYSZ], utc_dt_str[MAX_DATETIME_STRSZ];
-    int len = 0, qcount = -1, row_count, idx;
-
-    MYSQL_RES *result = NULL;
+    struct gweb_cxn_prefs *prefs;
     MYSQL_ROW row;
+    int nr_rows;
 
-    PUSH_BUF(qrybuf, len, "SELECT ChannelId FROM UserConnectPreferences WHERE "
-             "UID='%s' AND ChannelFlags='public'", to_uid);
-    qrybuf[len++] = '\0';
+    if (st == NULL) {
+        return NULL;
+    }
 
-    if (mysql_query(g_mysql_ctx, qrybuf)) {
-        report_mysql_error_noclose(g_mysql_ctx);
-        goto __bail_out;
+    nr_rows = gweb_mysql_stmt_num_rows(st);
+    prefs = calloc(1, sizeof(struct gweb_cxn_prefs) +
+                   nr_rows * sizeof(struct gweb_cxn_pref));
+    if (prefs == NULL) {
+        log_error("%s: unable to allocate memory!\n", __func__);
+        gweb_mysql_stmt_done(st);
+        return NULL;
     }
 
-    if ((result = mysql_store_result(g_mysql_ctx)) == NULL) {
-        report_mysql_error_noclose(g_mysql_ctx);
-        goto __bail_out;
+    while (prefs->nr < nr_rows && (row = gweb_mysql_stmt_fetch(st)) != NULL) {
+        snprintf(prefs->prefs[prefs->nr].channel, GWEB_CXN_PREF_NAMESZ, "%s",
+                 row[0] ? row[0] : "");
+        snprintf(prefs->prefs[prefs->nr].flag, GWEB_CXN_PREF_NAMESZ, "%s",
+                 row[1] ? row[1] : "");
+        prefs->nr++;
     }
+    gweb_mysql_stmt_done(st);
 
-    gweb_get_utc_datetime(utc_dt_str);
+    return prefs;
+}
 
-    len = 0;
+/*
+ * Connect preferences of the UID, from the cache or read and cached.
+ * The read stops one row over GWEB_PREF_CACHE_MAX_CHANNELS, a longer
+ * list is incomplete and not cached. NULL if they could not be read,
+ * free() otherwise.
+ */
+static struct gweb_cxn_prefs *
+gweb_mysql_cxn_prefs (struct gweb_mysql_conn *conn, const char *uid)
+{
+    struct gweb_cxn_prefs *prefs = NULL;
+    unsigned long gen;
 
-    PUSH_BUF(buf, len, "DELETE FROM UserConnectChannel WHERE "
-             "FromUID='%s' AND ToUID='%s'", from_uid, to_uid);
-    buf[len++] = '\0';
-    qcount = 1;
+    if (gweb_pref_cache_get(uid, &prefs, &gen)) {
+        return prefs;
+    }
 
-    /* Insert ChannelId as 'connect' if no public preferences exists */
-    if ((row_count = mysql_num_rows(result)) == 0) {
-        PUSH_BUF(buf, len, "INSERT INTO UserConnectChannel (FromUID, ToUID, "
-                 "ConnectedOn, ChannelId) VALUES ('%s', '%s', '%s', '%s')",
-                 from_uid, to_uid, utc_dt_str,
-                 CXN_CHANNEL_BASIC_CONNECT);
-        buf[len++] = '\0';
-        *qlen = len;
-        qcount++;
-        goto __bail_out;
+    prefs = gweb_mysql_cxn_prefs_read(
+        gweb_stmt_cxn_preference_all(conn, uid,
+                                     GWEB_PREF_CACHE_MAX_CHANNELS + 1));
+
+    /* Not from a replica that may not have the latest write yet */
+    if (prefs && gweb_mysql_conn_fresh(conn, uid)) {
+        gweb_pref_cache_put(uid, prefs, gen);
     }
+    return prefs;
+}
+
+/*
+ * Connect the UIDs on every channel the accepting UID exposes as
+ * public, or on the basic channel if there are none. Added to the
+ * caller's transaction.
+ */
+static int
+gweb_mysql_cxn_accept (struct gweb_mysql_txn *txn, const char *from_uid,
+                       const char *to_uid, const char *utc_dt_str,
+                       char (*channels)[GWEB_GRAPH_NAMESZ], int nr_public)
+{
+    int idx;
 
-    PUSH_BUF(buf, len, "INSERT INTO UserConnectChannel (FromUID, ToUID, "
-             "ConnectedOn, ChannelId) VALUES ");
+    if (gweb_txn_cxn_channel_delete(txn, from_uid, to_uid) != MYSQL_STATUS_OK) {
+        return MYSQL_STATUS_FAIL;
+    }
 
-    for (idx = 0; idx < row_count; idx++) {
-        if ((row = mysql_fetch_row(result)) == NULL) {
-            qcount = -1;
-            goto __bail_out;
+    /* Insert ChannelId as 'connect' if no public preferences exists */
+    if (nr_public == 0) {
+        return gweb_txn_cxn_channel_insert(txn, from_uid, to_uid, utc_dt_str,
+                                           CXN_CHANNEL_BASIC_CONNECT);
+    }
+
+    for (idx = 0; idx < nr_public; idx++) {
+        if (gweb_txn_cxn_channel_insert(txn, from_uid, to_uid, utc_dt_str,
+                                        channels[idx]) != MYSQL_STATUS_OK) {
+            return MYSQL_STATUS_FAIL;
         }
-        PUSH_BUF(buf, len, "('%s', '%s', '%s', '%s'),",
-                 from_uid, to_uid, utc_dt_str, row[0]);
     }
-    buf[--len] = '\0';
-    *qlen = len;
-    qcount++;
+    return MYSQL_STATUS_OK;
+}
 
-__bail_out:
-    if (result) {
-        mysql_free_result(result);
+/*
+ * Same on the connection graph, once committed. Neither UID is to be
+ * suggested the other any longer.
+ */
+static void
+gweb_mysql_graph_accept (const char *from_uid, const char *to_uid,
+                         const char *utc_dt_str,
+                         char (*channels)[GWEB_GRAPH_NAMESZ], int nr_public)
+{
+    int idx;
+
+    gweb_graph_channel_disconnect(from_uid, to_uid);
+
+    if (nr_public == 0) {
+        gweb_graph_channel_set(from_uid, to_uid, utc_dt_str,
+                               CXN_CHANNEL_BASIC_CONNECT);
+    }
+    for (idx = 0; idx < nr_public; idx++) {
+        gweb_graph_channel_set(from_uid, to_uid, utc_dt_str, channels[idx]);
     }
-    return qcount;
+
+    gweb_suggest_cache_invalidate(from_uid);
+    gweb_suggest_cache_invalidate(to_uid);
 }
 
 int
-gweb_mysql_handle_cxn_request (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
+gweb_mysql_handle_cxn_request (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                               j2c_resp_t **j2cresp)
 {
-    uint8_t qrybuf[MAX_MYSQL_QRYSZ], *q_ptr;
     uint8_t utc_dt_str[MAX_DATETIME_STRSZ];
     int err = GWEB_MYSQL_ERR_UNKNOWN, ret = MYSQL_STATUS_FAIL;
-    int len = 0, count, is_update = 0, qry_idx, qcount = 0;
+    int count, is_closed, idx, nr_public = 0;
+    const char *from_uid, *to_uid, *flag;
+    char (*channels)[GWEB_GRAPH_NAMESZ] = NULL;
+    struct gweb_cxn_prefs *prefs = NULL;
+    struct gweb_mysql_txn txn;
 
     J2C_MSG_TABLE(cxn_request, *jrecord) = &j2cmsg->cxn_request;
 
@@ -968,15 +793,13 @@ gweb_mysql_handle_cxn_request (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
         goto __bail_out;
     }
 
-    /* Check if UIDs are valid */
-    PUSH_BUF(qrybuf, len, "SELECT UID FROM UserRegInfo WHERE UID='%s' or UID='%s'",
-             jrecord->fields[FIELD_CXN_REQUEST_UID],
-             jrecord->fields[FIELD_CXN_REQUEST_TO_UID]);
-    qrybuf[len++] = '\0';
-
-    gweb_mysql_ping();
+    from_uid = jrecord->fields[FIELD_CXN_REQUEST_UID];
+    to_uid = jrecord->fields[FIELD_CXN_REQUEST_TO_UID];
+    flag = jrecord->fields[FIELD_CXN_REQUEST_FLAG];
 
-    if ((count = gweb_mysql_get_query_count(qrybuf)) < 0) {
+    /* Check if UIDs are valid */
+    if ((count = gweb_mysql_stmt_count(gweb_stmt_cxn_check_uids(conn, from_uid,
+                                                                to_uid))) < 0) {
         goto __bail_out;
     }
 
@@ -988,82 +811,85 @@ gweb_mysql_handle_cxn_request (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
         goto __bail_out;
     }
 
-    /* Check if the record exists, if so, update the flags alone */
-    len = 0;
-    PUSH_BUF(qrybuf, len, "SELECT FromUID, ToUID FROM UserConnectRequest WHERE "
-             "FromUID='%s' AND ToUID='%s'",
-             jrecord->fields[FIELD_CXN_REQUEST_UID],
-             jrecord->fields[FIELD_CXN_REQUEST_TO_UID]);
-    qrybuf[len++] = '\0';
+    /* If the request flag is 'closed' connect the UIDs in the channel
+     * table based on the preferences that are exposed as public
+     */
+    is_closed = !strcmp(flag, CXN_REQUEST_FLAG_CLOSED);
+    if (is_closed) {
+        if ((prefs = gweb_mysql_cxn_prefs(conn, to_uid)) == NULL) {
+            goto __bail_out;
+        }
 
-    if ((is_update = gweb_mysql_get_query_count(qrybuf)) < 0) {
-        goto __bail_out;
-    }
+        /* Too many to cache, only the public ones are read */
+        if (prefs->nr > GWEB_PREF_CACHE_MAX_CHANNELS) {
+            free(prefs);
+            prefs = gweb_mysql_cxn_prefs_read(
+                gweb_stmt_cxn_preference_public(conn, to_uid));
+            if (prefs == NULL) {
+                goto __bail_out;
+            }
+        }
 
-    len = 0;
-    if (is_update) {
-        PUSH_BUF(qrybuf, len, "UPDATE UserConnectRequest SET Flags='%s' WHERE "
-                 "FromUID='%s' AND ToUID='%s'",
-                 jrecord->fields[FIELD_CXN_REQUEST_FLAG],
-                 jrecord->fields[FIELD_CXN_REQUEST_UID],
-                 jrecord->fields[FIELD_CXN_REQUEST_TO_UID]);
-        qrybuf[len++] = '\0';
-    } else {
-        gweb_get_utc_datetime(utc_dt_str);
-        PUSH_BUF(qrybuf, len, "INSERT INTO UserConnectRequest (FromUID, ToUID, "
-                 "SentOn, Flags) VALUES ('%s', '%s', '%s', '%s')",
-                 jrecord->fields[FIELD_CXN_REQUEST_UID],
-                 jrecord->fields[FIELD_CXN_REQUEST_TO_UID],
-                 utc_dt_str,
-                 jrecord->fields[FIELD_CXN_REQUEST_FLAG]);
-        qrybuf[len++] = '\0';
+        /* Written to the channel table and kept for the graph */
+        if (prefs->nr &&
+            (channels = calloc(prefs->nr, GWEB_GRAPH_NAMESZ)) == NULL) {
+            err = GWEB_MYSQL_ERR_NO_MEMORY;
+            goto __bail_out;
+        }
+        for (idx = 0; idx < prefs->nr; idx++) {
+            /* ChannelFlags compares ignoring case in MySQL too */
+            if (!strcasecmp(prefs->prefs[idx].flag, CXN_PREFERENCE_FLAG_PUBLIC)) {
+                snprintf(channels[nr_public++], GWEB_GRAPH_NAMESZ, "%s",
+                         prefs->prefs[idx].channel);
+            }
+        }
     }
 
-    /* If the request flag is 'accept' connect the UIDs in the channel
-     * table based on the preferences that are exposed as public
-     */
-    if (!strcmp(jrecord->fields[FIELD_CXN_REQUEST_FLAG], CXN_REQUEST_FLAG_CLOSED)) {
-        int q_len = 0;
+    gweb_get_utc_datetime(utc_dt_str);
 
-        qcount = gweb_mysql_prepare_cxn_accept_query(jrecord->fields[FIELD_CXN_REQUEST_UID],
-                                                     jrecord->fields[FIELD_CXN_REQUEST_TO_UID],
-                                                     &qrybuf[len], &q_len);
-        if (qcount == -1) {
+    /* Insert the request, or update the flags alone if it exists. Only
+     * accepting it touches more than one row.
+     */
+    if (!is_closed) {
+        if (!gweb_stmt_cxn_request_upsert(conn, from_uid, to_uid, utc_dt_str,
+                                          flag)) {
             goto __bail_out;
         }
-        len += q_len;
-    }
+    } else {
+        gweb_mysql_txn_begin(&txn, conn);
 
-    gweb_mysql_start_transaction();
+        gweb_txn_cxn_request_upsert(&txn, from_uid, to_uid, utc_dt_str, flag);
+        gweb_mysql_cxn_accept(&txn, from_uid, to_uid, utc_dt_str,
+                              channels, nr_public);
 
-    q_ptr = qrybuf;
-    for (len = qry_idx = 0; qry_idx < qcount + 1; qry_idx++) {
-        /* log_debug("**# [Q%d] EXEC MYSQL [%s]\n", qry_idx, q_ptr+len); */
-        if (mysql_query(g_mysql_ctx, q_ptr + len)) {
-            report_mysql_error_noclose(g_mysql_ctx);
-            gweb_mysql_abort_transaction();
+        if (gweb_mysql_txn_commit(&txn) != MYSQL_STATUS_OK) {
             goto __bail_out;
         }
-        len += strlen(q_ptr + len) + 1;
     }
 
-    gweb_mysql_commit_transaction();
+    gweb_graph_request_set(from_uid, to_uid, utc_dt_str, flag);
+    if (is_closed) {
+        gweb_mysql_graph_accept(from_uid, to_uid, utc_dt_str, channels, nr_public);
+    }
 
     err = GWEB_MYSQL_OK;
     ret = MYSQL_STATUS_OK;
 
 __bail_out:
+    free(channels);
+    free(prefs);
     gweb_mysql_update_response(JSON_C_CXN_REQUEST_RESP, err, j2cresp);
     return ret;
 }
 
 int
-gweb_mysql_handle_cxn_channel (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
+gweb_mysql_handle_cxn_channel (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                               j2c_resp_t **j2cresp)
 {
-    uint8_t qrybuf[MAX_MYSQL_QRYSZ];
     uint8_t utc_dt_str[MAX_DATETIME_STRSZ];
     int err = GWEB_MYSQL_ERR_UNKNOWN, ret = MYSQL_STATUS_FAIL;
-    int len = 0, count, is_update = 0;
+    int count;
+    const char *from_uid, *to_uid, *type;
 
     J2C_MSG_TABLE(cxn_channel, *jrecord) = &j2cmsg->cxn_channel;
 
@@ -1077,15 +903,13 @@ gweb_mysql_handle_cxn_channel (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
         goto __bail_out;
     }
 
-    /* Check if UIDs are valid */
-    PUSH_BUF(qrybuf, len, "SELECT UID FROM UserRegInfo WHERE UID='%s' or UID='%s'",
-             jrecord->fields[FIELD_CXN_CHANNEL_UID],
-             jrecord->fields[FIELD_CXN_CHANNEL_TO_UID]);
-    qrybuf[len++] = '\0';
-
-    gweb_mysql_ping();
+    from_uid = jrecord->fields[FIELD_CXN_CHANNEL_UID];
+    to_uid = jrecord->fields[FIELD_CXN_CHANNEL_TO_UID];
+    type = jrecord->fields[FIELD_CXN_CHANNEL_TYPE];
 
-    if ((count = gweb_mysql_get_query_count(qrybuf)) < 0) {
+    /* Check if UIDs are valid */
+    if ((count = gweb_mysql_stmt_count(gweb_stmt_cxn_check_uids(conn, from_uid,
+                                                                to_uid))) < 0) {
         goto __bail_out;
     }
 
@@ -1097,139 +921,359 @@ gweb_mysql_handle_cxn_channel (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
         goto __bail_out;
     }
 
-    /* Check if the record exists, if so, update the flags alone */
-    len = 0;
-    PUSH_BUF(qrybuf, len, "SELECT FromUID, ToUID FROM UserConnectChannel WHERE "
-             "FromUID='%s' AND ToUID='%s' AND ChannelId='%s'",
-             jrecord->fields[FIELD_CXN_CHANNEL_UID],
-             jrecord->fields[FIELD_CXN_CHANNEL_TO_UID],
-             jrecord->fields[FIELD_CXN_CHANNEL_TYPE]);
-    qrybuf[len++] = '\0';
+    /* An existing channel is left as is */
+    gweb_get_utc_datetime(utc_dt_str);
 
-    if ((is_update = gweb_mysql_get_query_count(qrybuf)) < 0) {
+    if (!gweb_stmt_cxn_channel_insert(conn, from_uid, to_uid, utc_dt_str, type)) {
         goto __bail_out;
     }
+    gweb_graph_channel_set(from_uid, to_uid, utc_dt_str, type);
+    gweb_suggest_cache_invalidate(from_uid);
+    gweb_suggest_cache_invalidate(to_uid);
 
-    len = 0;
-    if (!is_update) {
-        gweb_get_utc_datetime(utc_dt_str);
-        PUSH_BUF(qrybuf, len, "INSERT INTO UserConnectChannel (FromUID, ToUID, "
-                 "ConnectedOn, ChannelId) VALUES ('%s', '%s', '%s', '%s')",
-                 jrecord->fields[FIELD_CXN_CHANNEL_UID],
-                 jrecord->fields[FIELD_CXN_CHANNEL_TO_UID],
-                 utc_dt_str,
-                 jrecord->fields[FIELD_CXN_CHANNEL_TYPE]);
-        qrybuf[len++] = '\0';
+    err = GWEB_MYSQL_OK;
+    ret = MYSQL_STATUS_OK;
 
-        gweb_mysql_start_transaction();
+__bail_out:
+    gweb_mysql_update_response(JSON_C_CXN_CHANNEL_RESP, err, j2cresp);
+    return ret;
+}
 
-        if (mysql_query(g_mysql_ctx, qrybuf)) {
-            report_mysql_error_noclose(g_mysql_ctx);
-            gweb_mysql_abort_transaction();
-            goto __bail_out;
+#define CXN_OUTBOUND   (1)
+#define CXN_INBOUND    (2)
+
+#define CXN_REQ_IDX(x)   \
+   ((FIELD_CXN_REQUEST_QUERY_RESP_##x) - FIELD_CXN_REQUEST_QUERY_RESP_ARRAY_START - 1)
+
+#define CXN_CHNL_IDX(x)                                                 \
+    ((FIELD_CXN_CHANNEL_QUERY_RESP_##x) - FIELD_CXN_CHANNEL_QUERY_RESP_ARRAY_START - 1)
+
+#define CXN_PREF_IDX(x)                         \
+    ((FIELD_CXN_PREFERENCE_QUERY_RESP_##x) - FIELD_CXN_PREFERENCE_QUERY_RESP_ARRAY_START - 1)
+
+#define NEIGHBOUR_IDX(x)                        \
+    ((FIELD_NEIGHBOUR_QUERY_RESP_##x) - FIELD_NEIGHBOUR_QUERY_RESP_ARRAY_START - 1)
+
+#define SUGGEST_IDX(x)                          \
+    ((FIELD_SUGGESTIONS_QUERY_RESP_##x) - FIELD_SUGGESTIONS_QUERY_RESP_ARRAY_START - 1)
+
+#define STATS_IDX(x)                            \
+    ((FIELD_STATS_QUERY_RESP_##x) - FIELD_STATS_QUERY_RESP_ARRAY_START - 1)
+
+/*
+ * Page cursors. A cursor holds the sort key of the last row of a page,
+ * the next page is fetched with a keyset predicate on it. Key values
+ * are joined with GWEB_CURSOR_SEP and hex encoded so the token passes
+ * through URLs as is, clients treat it as opaque.
+ */
+#define GWEB_CURSOR_SEP          (0x1f)
+
+char *
+gweb_cursor_encode (int nr_keys, const char *keys[])
+{
+    static const char hex[] = "0123456789abcdef";
+    const unsigned char *key;
+    char *token, *out;
+    size_t len = 0;
+    int idx;
+
+    for (idx = 0; idx < nr_keys; idx++) {
+        if (keys[idx] == NULL) {
+            return NULL;
         }
+        len += strlen(keys[idx]) + 1;
+    }
 
-        gweb_mysql_commit_transaction();
+    if ((token = malloc(2 * len + 1)) == NULL) {
+        return NULL;
     }
 
-    err = GWEB_MYSQL_OK;
-    ret = MYSQL_STATUS_OK;
+    for (out = token, idx = 0; idx < nr_keys; idx++) {
+        if (idx) {
+            *out++ = hex[GWEB_CURSOR_SEP >> 4];
+            *out++ = hex[GWEB_CURSOR_SEP & 0xf];
+        }
+        for (key = (const unsigned char *)keys[idx]; *key; key++) {
+            *out++ = hex[*key >> 4];
+            *out++ = hex[*key & 0xf];
+        }
+    }
+    *out = '\0';
 
-__bail_out:
-    gweb_mysql_update_response(JSON_C_CXN_CHANNEL_RESP, err, j2cresp);
-    return ret;
+    return token;
+}
+
+static inline int
+gweb_cursor_hexval (char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
 }
 
 /*
- * Given UID, fetch name and avatar for minimal profile display. Note
- * that the e-mail/phone or other details have not been fetched.
+ * Split a cursor into nr_keys values stored in buf. Keys are left
+ * untouched when there is no cursor (first page). Returns -1 if the
+ * cursor is malformed.
  */
-static int
-gweb_mysql_get_name_avatar_from_uid (const char *uid, char **fname,
-                                     char **lname, char **avatar)
+int
+gweb_cursor_decode (const char *token, char *buf, size_t bufsz,
+                    int nr_keys, const char *keys[])
 {
-    MYSQL_RES *result;
-    MYSQL_ROW row;
+    size_t len, idx;
+    int nr = 0, hi, lo, c;
 
-    uint8_t qrybuf[MAX_MYSQL_QRYSZ];
-    int len = 0;
+    if (token == NULL) {
+        return 0;
+    }
 
-    /* TBD: LOG error */
-    if (!uid || !fname || !lname || !avatar)
-        return MYSQL_STATUS_FAIL;
+    len = strlen(token);
+    if (len % 2 || len / 2 >= bufsz) {
+        return -1;
+    }
 
-    PUSH_BUF(qrybuf, len, "SELECT FirstName, LastName, AvatarURL FROM UserRegInfo "
-             "WHERE UID='%s'", uid);
-    qrybuf[len] = '\0';
+    keys[nr++] = buf;
+    for (idx = 0; idx < len; idx += 2) {
+        hi = gweb_cursor_hexval(token[idx]);
+        lo = gweb_cursor_hexval(token[idx + 1]);
+        if (hi < 0 || lo < 0) {
+            return -1;
+        }
 
-    *fname = *lname = *avatar = NULL;
+        c = (hi << 4) | lo;
+        if (c == 0) {
+            return -1;
+        }
 
-    if (mysql_query(g_mysql_ctx, qrybuf)) {
-        report_mysql_error_noclose(g_mysql_ctx);
-        return MYSQL_STATUS_FAIL;
+        if (c == GWEB_CURSOR_SEP) {
+            if (nr == nr_keys) {
+                return -1;
+            }
+            *buf++ = '\0';
+            keys[nr++] = buf;
+            continue;
+        }
+        *buf++ = c;
     }
+    *buf = '\0';
+
+    return (nr == nr_keys) ? 0 : -1;
+}
+
+/* Cards looked up at once, lists hold fewer rows per page */
+#define MAX_USER_CARDS    (32)
 
-    if ((result = mysql_store_result(g_mysql_ctx)) == NULL) {
-        report_mysql_error_noclose(g_mysql_ctx);
+/*
+ * Name and avatar of users listed in process, from the card cache and
+ * one query for the rest. A UID may be listed more than once. Fields
+ * are left NULL for UIDs not found, free with gweb_user_card_free().
+ */
+static int
+gweb_mysql_user_cards (struct gweb_mysql_conn *conn, const char *uids[],
+                       struct gweb_user_card *cards, int nr)
+{
+    uint8_t qrybuf[MAX_MYSQL_QRYSZ];
+    unsigned long gen[MAX_USER_CARDS];
+    char cached[MAX_USER_CARDS];
+    MYSQL_RES *result;
+    MYSQL_ROW row;
+    int idx, len = 0, nr_missed = 0;
+
+    if (nr > MAX_USER_CARDS) {
         return MYSQL_STATUS_FAIL;
     }
 
-    /* *TBD* There should be only one row if there is a match. */
-    if (mysql_num_rows(result) != 1) {
-        mysql_free_result(result);
-        return MYSQL_STATUS_FAIL;
+    PUSH_BUF(qrybuf, len, GWEB_SQL_NEIGHBOUR_NAMES);
+    for (idx = 0; idx < nr; idx++) {
+        cached[idx] = gweb_card_cache_get(uids[idx], &cards[idx], &gen[idx]);
+        if (cached[idx]) {
+            continue;
+        }
+        PUSH_BUF(qrybuf, len, "%s'", nr_missed++ ? ", " : "");
+        PUSH_ESCAPED(conn, qrybuf, len, uids[idx]);
+        PUSH_BUF(qrybuf, len, "'");
     }
+    PUSH_BUF(qrybuf, len, ")");
 
-    if ((row = mysql_fetch_row(result)) == NULL) {
-        report_mysql_error_noclose(g_mysql_ctx);
-        mysql_free_result(result);
-        return MYSQL_STATUS_FAIL;
+    if (nr_missed == 0) {
+        return MYSQL_STATUS_OK;
     }
 
-    if (row[0])
-        *fname = strndup(row[0], strlen(row[0])); /* FirstName */
-    if (row[1])
-        *lname = strndup(row[1], strlen(row[1])); /* LastName */
-    if (row[2])
-        *avatar = strndup(row[2], strlen(row[2])); /* AvatarURL */
+    if (gweb_mysql_query_template(conn, GWEB_SQL_NEIGHBOUR_NAMES,
+                                  (char *)qrybuf) != MYSQL_STATUS_OK) {
+        goto __bail_out;
+    }
 
+    if ((result = mysql_store_result(conn->mysql)) == NULL) {
+        report_mysql_error_noaction(conn->mysql);
+        goto __bail_out;
+    }
+
+    while ((row = mysql_fetch_row(result)) != NULL) {
+        for (idx = 0; idx < nr; idx++) {
+            if (cached[idx] || strcmp(uids[idx], row[0]) != 0) {
+                continue;
+            }
+            if (gweb_mysql_conn_fresh(conn, row[0])) {
+                gweb_card_cache_put(row[0], row[1], row[2], row[3], gen[idx]);
+            }
+            /* FirstName, LastName, AvatarURL */
+            cards[idx].fname = row[1] ? strdup(row[1]) : NULL;
+            cards[idx].lname = row[2] ? strdup(row[2]) : NULL;
+            cards[idx].avatar_url = row[3] ? strdup(row[3]) : NULL;
+            cached[idx] = 1;
+        }
+    }
     mysql_free_result(result);
 
     return MYSQL_STATUS_OK;
+
+__bail_out:
+    for (idx = 0; idx < nr; idx++) {
+        gweb_user_card_free(&cards[idx]);
+    }
+    return MYSQL_STATUS_FAIL;
 }
 
-#define CXN_OUTBOUND   (1)
-#define CXN_INBOUND    (2)
+static inline int
+gweb_graph_dir (int direction)
+{
+    return (direction == CXN_INBOUND) ? GWEB_GRAPH_INBOUND : GWEB_GRAPH_OUTBOUND;
+}
 
-#define MYSQL_MAX_CXN_REQUEST_ROWS_PER_QUERY      (20)
-#define MYSQL_MAX_CXN_CHANNEL_ROWS_PER_QUERY      (20)
-#define MYSQL_MAX_CXN_PREFERENCE_ROWS_PER_QUERY   (20)
-#define MYSQL_MAX_NEIGHBOUR_ROWS_PER_QUERY        (20)
+/*
+ * One page of requests listed from the connection graph. Holds
+ * max_rows + 1 matches when there is a next page.
+ */
+static int
+gweb_mysql_cxn_request_page (struct gweb_mysql_conn *conn,
+                             struct j2c_cxn_request_query_resp *resp,
+                             struct gweb_graph_match *matches, int match_count,
+                             int *nr_rows)
+{
+    struct j2c_cxn_request_query_resp_array1 *arr;
+    struct gweb_user_card cards[MYSQL_MAX_CXN_REQUEST_ROWS_PER_QUERY];
+    const char *uids[MYSQL_MAX_CXN_REQUEST_ROWS_PER_QUERY];
+    const char *after[2];
+    int idx, max_rows;
 
-#define CXN_REQ_IDX(x)   \
-   ((FIELD_CXN_REQUEST_QUERY_RESP_##x) - FIELD_CXN_REQUEST_QUERY_RESP_ARRAY_START - 1)
+    max_rows = (match_count >= MYSQL_MAX_CXN_REQUEST_ROWS_PER_QUERY) ?
+        MYSQL_MAX_CXN_REQUEST_ROWS_PER_QUERY: match_count;
+    if (max_rows == 0) {
+        return GWEB_MYSQL_OK;
+    }
 
-#define CXN_CHNL_IDX(x)                                                 \
-    ((FIELD_CXN_CHANNEL_QUERY_RESP_##x) - FIELD_CXN_CHANNEL_QUERY_RESP_ARRAY_START - 1)
+    resp->array1 = calloc(max_rows, sizeof(struct j2c_cxn_request_query_resp_array1));
+    if (!resp->array1) {
+        return GWEB_MYSQL_ERR_NO_MEMORY;
+    }
 
-#define CXN_PREF_IDX(x)                         \
-    ((FIELD_CXN_PREFERENCE_QUERY_RESP_##x) - FIELD_CXN_PREFERENCE_QUERY_RESP_ARRAY_START - 1)
+    for (idx = 0; idx < max_rows; idx++) {
+        uids[idx] = matches[idx].uid;
+    }
+    if (gweb_mysql_user_cards(conn, uids, cards, max_rows) != MYSQL_STATUS_OK) {
+        return GWEB_MYSQL_ERR_UNKNOWN;
+    }
 
-#define NEIGHBOUR_IDX(x)                        \
-    ((FIELD_NEIGHBOUR_QUERY_RESP_##x) - FIELD_NEIGHBOUR_QUERY_RESP_ARRAY_START - 1)
+    for (idx = 0; idx < max_rows; idx++) {
+        arr = &resp->array1[idx];
+        arr->fields[CXN_REQ_IDX(UID)] = strdup(matches[idx].uid);
+        if (matches[idx].date[0]) {
+            arr->fields[CXN_REQ_IDX(DATE)] = strdup(matches[idx].date);
+        }
+        if (matches[idx].label[0]) {
+            arr->fields[CXN_REQ_IDX(FLAG)] = strdup(matches[idx].label);
+        }
+        arr->fields[CXN_REQ_IDX(FNAME)] = cards[idx].fname;
+        arr->fields[CXN_REQ_IDX(LNAME)] = cards[idx].lname;
+        arr->fields[CXN_REQ_IDX(AVATAR_URL)] = cards[idx].avatar_url;
+        *nr_rows = idx + 1;
+
+        /* One match over the page, the next page starts after this row */
+        if (idx == max_rows - 1 && match_count > max_rows) {
+            after[0] = matches[idx].date;
+            after[1] = matches[idx].uid;
+            resp->fields[FIELD_CXN_REQUEST_QUERY_RESP_NEXT_CURSOR] =
+                gweb_cursor_encode(2, after);
+        }
+    }
+
+    return GWEB_MYSQL_OK;
+}
+
+/* Same for channels */
+static int
+gweb_mysql_cxn_channel_page (struct gweb_mysql_conn *conn,
+                             struct j2c_cxn_channel_query_resp *resp,
+                             struct gweb_graph_match *matches, int match_count,
+                             int *nr_rows)
+{
+    struct j2c_cxn_channel_query_resp_array1 *arr;
+    struct gweb_user_card cards[MYSQL_MAX_CXN_CHANNEL_ROWS_PER_QUERY];
+    const char *uids[MYSQL_MAX_CXN_CHANNEL_ROWS_PER_QUERY];
+    const char *after[3];
+    int idx, max_rows;
+
+    max_rows = (match_count >= MYSQL_MAX_CXN_CHANNEL_ROWS_PER_QUERY) ?
+        MYSQL_MAX_CXN_CHANNEL_ROWS_PER_QUERY: match_count;
+    if (max_rows == 0) {
+        return GWEB_MYSQL_OK;
+    }
+
+    resp->array1 = calloc(max_rows, sizeof(struct j2c_cxn_channel_query_resp_array1));
+    if (!resp->array1) {
+        return GWEB_MYSQL_ERR_NO_MEMORY;
+    }
+
+    for (idx = 0; idx < max_rows; idx++) {
+        uids[idx] = matches[idx].uid;
+    }
+    if (gweb_mysql_user_cards(conn, uids, cards, max_rows) != MYSQL_STATUS_OK) {
+        return GWEB_MYSQL_ERR_UNKNOWN;
+    }
+
+    for (idx = 0; idx < max_rows; idx++) {
+        arr = &resp->array1[idx];
+        arr->fields[CXN_CHNL_IDX(UID)] = strdup(matches[idx].uid);
+        if (matches[idx].date[0]) {
+            arr->fields[CXN_CHNL_IDX(DATE)] = strdup(matches[idx].date);
+        }
+        arr->fields[CXN_CHNL_IDX(CHANNEL_TYPE)] = strdup(matches[idx].label);
+        arr->fields[CXN_CHNL_IDX(FNAME)] = cards[idx].fname;
+        arr->fields[CXN_CHNL_IDX(LNAME)] = cards[idx].lname;
+        arr->fields[CXN_CHNL_IDX(AVATAR_URL)] = cards[idx].avatar_url;
+        *nr_rows = idx + 1;
+
+        if (idx == max_rows - 1 && match_count > max_rows) {
+            after[0] = matches[idx].date;
+            after[1] = matches[idx].uid;
+            after[2] = matches[idx].label;
+            resp->fields[FIELD_CXN_CHANNEL_QUERY_RESP_NEXT_CURSOR] =
+                gweb_cursor_encode(3, after);
+        }
+    }
+
+    return GWEB_MYSQL_OK;
+}
 
 int
-gweb_mysql_handle_cxn_request_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
+gweb_mysql_handle_cxn_request_query (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                                     j2c_resp_t **j2cresp)
 {
     int match_count, direction = 0;
-    int max_rows, idx, rowid = 0, len = 0;
+    int max_rows, idx, rowid = 0;
+    int limit = MYSQL_MAX_CXN_REQUEST_ROWS_PER_QUERY + 1;
     int err = GWEB_MYSQL_ERR_UNKNOWN, ret = MYSQL_STATUS_FAIL;
-    uint8_t qrybuf[MAX_MYSQL_QRYSZ], buf[32];
+    uint8_t buf[32];
 
-    char *fname = NULL, *lname = NULL, *avatar = NULL;
-    const char *uid = NULL;
+    const char *uid = NULL, *flag;
+    const char *after[2] = { GWEB_CURSOR_MIN_DATE, "" };
+    char curbuf[MAX_CURSOR_STRSZ];
+    struct gweb_graph_match matches[MYSQL_MAX_CXN_REQUEST_ROWS_PER_QUERY + 1];
 
-    MYSQL_RES *result = NULL;
+    struct gweb_mysql_stmt *st = NULL;
     MYSQL_ROW row;
 
     J2C_MSG_TABLE(cxn_request_query, *jrecord) = &j2cmsg->cxn_request_query;
@@ -1243,45 +1287,59 @@ gweb_mysql_handle_cxn_request_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
     resp = &((*j2cresp)->cxn_request_query);
     resp->nr_array1_records = -1; /* No records */
 
-    PUSH_BUF(qrybuf, len, "SELECT FromUID, ToUID, SentOn, Flags FROM UserConnectRequest "
-             "WHERE TRUE ");
-
     if (jrecord->fields[FIELD_CXN_REQUEST_QUERY_FROM_UID]) {
         uid = jrecord->fields[FIELD_CXN_REQUEST_QUERY_FROM_UID];
         direction = CXN_OUTBOUND;
-        PUSH_BUF(qrybuf, len, "AND FromUID='%s' ", uid);
 
     } else if (jrecord->fields[FIELD_CXN_REQUEST_QUERY_TO_UID]) {
         uid = jrecord->fields[FIELD_CXN_REQUEST_QUERY_TO_UID];
         direction = CXN_INBOUND;
-        PUSH_BUF(qrybuf, len, "AND ToUID='%s' ", uid);
     }
 
-    if (!direction || !gweb_mysql_check_uid_email(uid, NULL)) {
+    if (!direction || !gweb_mysql_check_uid_email(conn, uid, NULL)) {
         err = GWEB_MYSQL_ERR_NO_RECORD;
         goto __bail_out;
     }
 
-    if (jrecord->fields[FIELD_CXN_REQUEST_QUERY_FLAG]) {
-        PUSH_BUF(qrybuf, len, "AND Flags='%s' ",
-                 jrecord->fields[FIELD_CXN_REQUEST_QUERY_FLAG]);
-    }
+    flag = jrecord->fields[FIELD_CXN_REQUEST_QUERY_FLAG];
 
-    qrybuf[len] = '\0';
+    if (gweb_cursor_decode(jrecord->fields[FIELD_CXN_REQUEST_QUERY_CURSOR],
+                           curbuf, sizeof(curbuf), 2, after) < 0) {
+        err = GWEB_MYSQL_ERR_INVALID;
+        goto __bail_out;
+    }
 
-    gweb_mysql_ping();
+    /* From the connection graph, SQL when it is not loaded */
+    match_count = gweb_graph_list(GWEB_GRAPH_REQUEST, gweb_graph_dir(direction),
+                                  uid, flag, after[0], after[1], NULL, matches,
+                                  limit);
+    if (match_count >= 0) {
+        err = gweb_mysql_cxn_request_page(conn, resp, matches, match_count,
+                                          &rowid);
+        if (err != GWEB_MYSQL_OK) {
+            goto __bail_out;
+        }
+        goto __send_record;
+    }
 
-    if (mysql_query(g_mysql_ctx, qrybuf)) {
-        report_mysql_error_noclose(g_mysql_ctx);
-        goto __bail_out;
+    if (direction == CXN_OUTBOUND) {
+        st = (flag) ?
+            gweb_stmt_cxn_request_list_from_flag(conn, uid, flag, after[0],
+                                                 after[1], limit) :
+            gweb_stmt_cxn_request_list_from(conn, uid, after[0], after[1],
+                                            limit);
+    } else {
+        st = (flag) ?
+            gweb_stmt_cxn_request_list_to_flag(conn, uid, flag, after[0],
+                                               after[1], limit) :
+            gweb_stmt_cxn_request_list_to(conn, uid, after[0], after[1], limit);
     }
 
-    if ((result = mysql_store_result(g_mysql_ctx)) == NULL) {
-        report_mysql_error_noclose(g_mysql_ctx);
+    if (st == NULL) {
         goto __bail_out;
     }
 
-    match_count = mysql_num_rows(result);
+    match_count = gweb_mysql_stmt_num_rows(st);
     if (match_count == 0) {
         goto __send_record;
     }
@@ -1298,11 +1356,19 @@ gweb_mysql_handle_cxn_request_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
         goto __bail_out;
     }
 
-    for (rowid = idx = 0; idx < match_count && rowid < max_rows; idx++) {
-        if ((row = mysql_fetch_row(result)) == NULL) {
+    for (rowid = idx = 0; idx < max_rows; idx++) {
+        if ((row = gweb_mysql_stmt_fetch(st)) == NULL) {
             goto __bail_out;
         }
 
+        /* One row over the page, the next page starts after this row */
+        if (idx == max_rows - 1 && match_count > max_rows) {
+            after[0] = row[2];
+            after[1] = (direction == CXN_INBOUND) ? row[0] : row[1];
+            resp->fields[FIELD_CXN_REQUEST_QUERY_RESP_NEXT_CURSOR] =
+                gweb_cursor_encode(2, after);
+        }
+
         if (!row[0] || !row[1]) { /* FromUID || ToUID */
             /* Skip if there is no FromUID or ToUID */
             continue;
@@ -1323,22 +1389,15 @@ gweb_mysql_handle_cxn_request_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
             arr->fields[CXN_REQ_IDX(FLAG)] = strndup(row[3], strlen(row[3]));
         }
 
-        if (gweb_mysql_get_name_avatar_from_uid(arr->fields[CXN_REQ_IDX(UID)],
-                           &fname, &lname, &avatar) != MYSQL_STATUS_OK) {
-            free(arr->fields[CXN_REQ_IDX(UID)]);
-            free(arr->fields[CXN_REQ_IDX(DATE)]);
-            rowid--;
-            continue;
-        }
-
-        if (fname) {
-            arr->fields[CXN_REQ_IDX(FNAME)] = fname;
+        /* Peer name and avatar, joined from UserRegInfo */
+        if (row[4]) {
+            arr->fields[CXN_REQ_IDX(FNAME)] = strndup(row[4], strlen(row[4]));
         }
-        if (lname) {
-            arr->fields[CXN_REQ_IDX(LNAME)] = lname;
+        if (row[5]) {
+            arr->fields[CXN_REQ_IDX(LNAME)] = strndup(row[5], strlen(row[5]));
         }
-        if (avatar) {
-            arr->fields[CXN_REQ_IDX(AVATAR_URL)] = avatar;
+        if (row[6]) {
+            arr->fields[CXN_REQ_IDX(AVATAR_URL)] = strndup(row[6], strlen(row[6]));
         }
     }
 
@@ -1351,25 +1410,27 @@ __send_record:
     ret = MYSQL_STATUS_OK;
 
 __bail_out:
-    if (result) {
-        mysql_free_result(result);
-    }
+    gweb_mysql_stmt_done(st);
     gweb_mysql_update_response(JSON_C_CXN_REQUEST_QUERY_RESP, err, j2cresp);
     return ret;
 }
 
 int
-gweb_mysql_handle_cxn_channel_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
+gweb_mysql_handle_cxn_channel_query (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                                     j2c_resp_t **j2cresp)
 {
     int match_count, direction = 0;
-    int max_rows, idx, rowid = 0, len = 0;
+    int max_rows, idx, rowid = 0;
+    int limit = MYSQL_MAX_CXN_CHANNEL_ROWS_PER_QUERY + 1;
     int err = GWEB_MYSQL_ERR_UNKNOWN, ret = MYSQL_STATUS_FAIL;
-    uint8_t qrybuf[MAX_MYSQL_QRYSZ], buf[32];
+    uint8_t buf[32];
 
-    char *fname = NULL, *lname = NULL, *avatar = NULL;
-    const char *uid = NULL;
+    const char *uid = NULL, *type;
+    const char *after[3] = { GWEB_CURSOR_MIN_DATE, "", "" };
+    char curbuf[MAX_CURSOR_STRSZ];
+    struct gweb_graph_match matches[MYSQL_MAX_CXN_CHANNEL_ROWS_PER_QUERY + 1];
 
-    MYSQL_RES *result = NULL;
+    struct gweb_mysql_stmt *st = NULL;
     MYSQL_ROW row;
 
     struct j2c_cxn_channel_query_msg *jrecord = &j2cmsg->cxn_channel_query;
@@ -1382,45 +1443,59 @@ gweb_mysql_handle_cxn_channel_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
     resp = &(*j2cresp)->cxn_channel_query;
     resp->nr_array1_records = -1; /* No records */
 
-    PUSH_BUF(qrybuf, len, "SELECT FromUID, ToUID, ConnectedOn, ChannelId "
-             "FROM UserConnectChannel WHERE TRUE ");
-
     if (jrecord->fields[FIELD_CXN_CHANNEL_QUERY_FROM_UID]) {
         uid = jrecord->fields[FIELD_CXN_CHANNEL_QUERY_FROM_UID];
         direction = CXN_OUTBOUND;
-        PUSH_BUF(qrybuf, len, "AND FromUID='%s' ", uid);
 
     } else if (jrecord->fields[FIELD_CXN_CHANNEL_QUERY_TO_UID]) {
         uid = jrecord->fields[FIELD_CXN_CHANNEL_QUERY_TO_UID];
         direction = CXN_INBOUND;
-        PUSH_BUF(qrybuf, len, "AND ToUID='%s' ", uid);
     }
 
-    if (!direction || !gweb_mysql_check_uid_email(uid, NULL)) {
+    if (!direction || !gweb_mysql_check_uid_email(conn, uid, NULL)) {
         err = GWEB_MYSQL_ERR_NO_RECORD;
         goto __bail_out;
     }
 
-    if (jrecord->fields[FIELD_CXN_CHANNEL_QUERY_TYPE]) {
-        PUSH_BUF(qrybuf, len, "AND ChannelId='%s' ",
-                 jrecord->fields[FIELD_CXN_CHANNEL_QUERY_TYPE]);
-    }
+    type = jrecord->fields[FIELD_CXN_CHANNEL_QUERY_TYPE];
 
-    qrybuf[len] = '\0';
+    if (gweb_cursor_decode(jrecord->fields[FIELD_CXN_CHANNEL_QUERY_CURSOR],
+                           curbuf, sizeof(curbuf), 3, after) < 0) {
+        err = GWEB_MYSQL_ERR_INVALID;
+        goto __bail_out;
+    }
 
-    gweb_mysql_ping();
+    match_count = gweb_graph_list(GWEB_GRAPH_CHANNEL, gweb_graph_dir(direction),
+                                  uid, type, after[0], after[1], after[2],
+                                  matches, limit);
+    if (match_count >= 0) {
+        err = gweb_mysql_cxn_channel_page(conn, resp, matches, match_count,
+                                          &rowid);
+        if (err != GWEB_MYSQL_OK) {
+            goto __bail_out;
+        }
+        goto __send_record;
+    }
 
-    if (mysql_query(g_mysql_ctx, qrybuf)) {
-        report_mysql_error_noclose(g_mysql_ctx);
-        goto __bail_out;
+    if (direction == CXN_OUTBOUND) {
+        st = (type) ?
+            gweb_stmt_cxn_channel_list_from_type(conn, uid, type, after[0],
+                                                 after[1], after[2], limit) :
+            gweb_stmt_cxn_channel_list_from(conn, uid, after[0], after[1],
+                                            after[2], limit);
+    } else {
+        st = (type) ?
+            gweb_stmt_cxn_channel_list_to_type(conn, uid, type, after[0],
+                                               after[1], after[2], limit) :
+            gweb_stmt_cxn_channel_list_to(conn, uid, after[0], after[1],
+                                          after[2], limit);
     }
 
-    if ((result = mysql_store_result(g_mysql_ctx)) == NULL) {
-        report_mysql_error_noclose(g_mysql_ctx);
+    if (st == NULL) {
         goto __bail_out;
     }
 
-    match_count = mysql_num_rows(result);
+    match_count = gweb_mysql_stmt_num_rows(st);
     if (match_count == 0) {
         goto __send_record;
     }
@@ -1438,11 +1513,20 @@ gweb_mysql_handle_cxn_channel_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
         goto __bail_out;
     }
 
-    for (rowid = idx = 0; idx < match_count && rowid < max_rows; idx++) {
-        if ((row = mysql_fetch_row(result)) == NULL) {
+    for (rowid = idx = 0; idx < max_rows; idx++) {
+        if ((row = gweb_mysql_stmt_fetch(st)) == NULL) {
             err = GWEB_MYSQL_ERR_UNKNOWN;
             goto __bail_out;
         }
+
+        /* One row over the page, the next page starts after this row */
+        if (idx == max_rows - 1 && match_count > max_rows) {
+            after[0] = row[2];
+            after[1] = (direction == CXN_INBOUND) ? row[0] : row[1];
+            after[2] = row[3];
+            resp->fields[FIELD_CXN_CHANNEL_QUERY_RESP_NEXT_CURSOR] =
+                gweb_cursor_encode(3, after);
+        }
         if (!row[0] || !row[1]) { /* ToUID */
             /* Skip if there is no ToUID */
             continue;
@@ -1465,21 +1549,15 @@ gweb_mysql_handle_cxn_channel_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
             arr->fields[CXN_CHNL_IDX(CHANNEL_TYPE)] = strndup(row[3], strlen(row[3]));
         }
 
-        if (gweb_mysql_get_name_avatar_from_uid(arr->fields[CXN_CHNL_IDX(UID)],
-                           &fname, &lname, &avatar) != MYSQL_STATUS_OK) {
-            free(arr->fields[CXN_CHNL_IDX(UID)]);
-            free(arr->fields[CXN_CHNL_IDX(DATE)]);
-            rowid--;
-            continue;
-        }
-        if (fname) {
-            arr->fields[CXN_CHNL_IDX(FNAME)] = fname;
+        /* Peer name and avatar, joined from UserRegInfo */
+        if (row[4]) {
+            arr->fields[CXN_CHNL_IDX(FNAME)] = strndup(row[4], strlen(row[4]));
         }
-        if (lname) {
-            arr->fields[CXN_CHNL_IDX(LNAME)] = lname;
+        if (row[5]) {
+            arr->fields[CXN_CHNL_IDX(LNAME)] = strndup(row[5], strlen(row[5]));
         }
-        if (avatar) {
-            arr->fields[CXN_CHNL_IDX(AVATAR_URL)] = avatar;
+        if (row[6]) {
+            arr->fields[CXN_CHNL_IDX(AVATAR_URL)] = strndup(row[6], strlen(row[6]));
         }
     }
 
@@ -1492,21 +1570,18 @@ __send_record:
     ret = MYSQL_STATUS_OK;
 
 __bail_out:
-    if (result) {
-        mysql_free_result(result);
-    }
+    gweb_mysql_stmt_done(st);
     gweb_mysql_update_response(JSON_C_CXN_CHANNEL_QUERY_RESP, err, j2cresp);
     return ret;
 }
 
 int
-gweb_mysql_handle_uid_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
+gweb_mysql_handle_uid_query (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                             j2c_resp_t **j2cresp)
 {
-    uint8_t qrybuf[MAX_MYSQL_QRYSZ];
     int err = GWEB_MYSQL_ERR_UNKNOWN, ret = MYSQL_STATUS_FAIL;
-    int len = 0;
 
-    MYSQL_RES *result = NULL;
+    struct gweb_mysql_stmt *st = NULL;
     MYSQL_ROW row;
 
     J2C_MSG_TABLE(uid_query, *jrecord) = &j2cmsg->uid_query;
@@ -1520,30 +1595,18 @@ gweb_mysql_handle_uid_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
         goto __bail_out;
     }
 
-    PUSH_BUF(qrybuf, len, "SELECT UID FROM UserRegInfo WHERE Email='%s'",
-             jrecord->fields[FIELD_UID_QUERY_EMAIL]);
-    qrybuf[len] = '\0';
-
-    gweb_mysql_ping();
-
-    if (mysql_query(g_mysql_ctx, qrybuf)) {
-        report_mysql_error_noclose(g_mysql_ctx);
-        goto __bail_out;
-    }
-
-    if ((result = mysql_store_result(g_mysql_ctx)) == NULL) {
-        report_mysql_error_noclose(g_mysql_ctx);
+    if ((st = gweb_stmt_uid_from_email(conn,
+                                       jrecord->fields[FIELD_UID_QUERY_EMAIL])) == NULL) {
         goto __bail_out;
     }
 
-    if (mysql_num_rows(result) == 0) {
+    if (gweb_mysql_stmt_num_rows(st) == 0) {
         err = GWEB_MYSQL_ERR_NO_RECORD;
         goto __bail_out;
     }
 
     /* Pick the first matching record */
-    if ((row = mysql_fetch_row(result)) == NULL) {
-        report_mysql_error_noclose(g_mysql_ctx);
+    if ((row = gweb_mysql_stmt_fetch(st)) == NULL) {
         goto __bail_out;
     }
 
@@ -1553,15 +1616,14 @@ gweb_mysql_handle_uid_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
     ret = MYSQL_STATUS_OK;
 
 __bail_out:
-    if (result) {
-        mysql_free_result(result);
-    }
+    gweb_mysql_stmt_done(st);
     gweb_mysql_update_response(JSON_C_UID_QUERY_RESP, err, j2cresp);
     return ret;
 }
 
 int
-gweb_mysql_handle_profile_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
+gweb_mysql_handle_profile_query (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                                 j2c_resp_t **j2cresp)
 {
     int err = GWEB_MYSQL_ERR_UNKNOWN, ret = MYSQL_STATUS_FAIL;
     int count;
@@ -1577,7 +1639,7 @@ gweb_mysql_handle_profile_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
         goto __bail_out;
     }
 
-    count = gweb_mysql_check_uid_email(jrecord->fields[FIELD_PROFILE_QUERY_UID],
+    count = gweb_mysql_check_uid_email(conn, jrecord->fields[FIELD_PROFILE_QUERY_UID],
                                        NULL);
     if (count < 0) {
         goto __bail_out;
@@ -1588,7 +1650,7 @@ gweb_mysql_handle_profile_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
         goto __bail_out;
     }
 
-    err = gweb_mysql_populate_profile_info(*j2cresp,
+    err = gweb_mysql_populate_profile_info(conn, *j2cresp,
                      jrecord->fields[FIELD_PROFILE_QUERY_UID], NULL);
     if (err != GWEB_MYSQL_OK) {
         goto __bail_out;
@@ -1603,13 +1665,15 @@ __bail_out:
 }
 
 int
-gweb_mysql_handle_avatar_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
+gweb_mysql_handle_avatar_query (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                                j2c_resp_t **j2cresp)
 {
-    uint8_t qrybuf[MAX_MYSQL_QRYSZ];
     int err = GWEB_MYSQL_ERR_UNKNOWN, ret = MYSQL_STATUS_FAIL;
-    int len = 0;
 
-    MYSQL_RES *result = NULL;
+    struct gweb_mysql_stmt *st = NULL;
+    struct gweb_user_card card;
+    unsigned long gen;
+    const char *uid;
     MYSQL_ROW row;
 
     J2C_MSG_TABLE(avatar_query, *jrecord) = &j2cmsg->avatar_query;
@@ -1618,41 +1682,43 @@ gweb_mysql_handle_avatar_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
     gweb_mysql_prepare_response(JSON_C_AVATAR_QUERY_RESP, GWEB_MYSQL_OK, j2cresp);
     resp = &(*j2cresp)->avatar_query;
 
-    if (!jrecord->fields[FIELD_AVATAR_QUERY_UID]) {
+    if ((uid = jrecord->fields[FIELD_AVATAR_QUERY_UID]) == NULL) {
         err = GWEB_MYSQL_ERR_NO_RECORD;
         goto __bail_out;
     }
 
-    PUSH_BUF(qrybuf, len, "SELECT AvatarURL FROM UserRegInfo WHERE UID='%s'",
-             jrecord->fields[FIELD_AVATAR_QUERY_UID]);
-    qrybuf[len] = '\0';
+    if (gweb_card_cache_get(uid, &card, &gen)) {
+        resp->fields[FIELD_AVATAR_QUERY_RESP_URL] =
+            card.avatar_url ? card.avatar_url : strdup("");
+        card.avatar_url = NULL;
+        gweb_user_card_free(&card);
 
-    gweb_mysql_ping();
-
-    if (mysql_query(g_mysql_ctx, qrybuf)) {
-        report_mysql_error_noclose(g_mysql_ctx);
+        err = GWEB_MYSQL_OK;
+        ret = MYSQL_STATUS_OK;
         goto __bail_out;
     }
 
-    if ((result = mysql_store_result(g_mysql_ctx)) == NULL) {
-        report_mysql_error_noclose(g_mysql_ctx);
+    if ((st = gweb_stmt_user_card(conn, uid)) == NULL) {
         goto __bail_out;
     }
 
-    if (mysql_num_rows(result) == 0) {
+    if (gweb_mysql_stmt_num_rows(st) == 0) {
         err = GWEB_MYSQL_ERR_NO_RECORD;
         goto __bail_out;
     }
 
     /* Pick the first matching record */
-    if ((row = mysql_fetch_row(result)) == NULL) {
+    if ((row = gweb_mysql_stmt_fetch(st)) == NULL) {
         err = GWEB_MYSQL_ERR_NO_RECORD;
-        report_mysql_error_noclose(g_mysql_ctx);
         goto __bail_out;
     }
 
-    if (row[0]) {
-        resp->fields[FIELD_AVATAR_QUERY_RESP_URL] = strndup(row[0], strlen(row[0]));
+    if (gweb_mysql_conn_fresh(conn, uid)) {
+        gweb_card_cache_put(uid, row[0], row[1], row[2], gen);
+    }
+
+    if (row[2]) {
+        resp->fields[FIELD_AVATAR_QUERY_RESP_URL] = strndup(row[2], strlen(row[2]));
     } else {
         resp->fields[FIELD_AVATAR_QUERY_RESP_URL] = strndup("", strlen(""));
     }
@@ -1661,9 +1727,7 @@ gweb_mysql_handle_avatar_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
     ret = MYSQL_STATUS_OK;
 
 __bail_out:
-    if (result) {
-        mysql_free_result(result);
-    }
+    gweb_mysql_stmt_done(st);
     gweb_mysql_update_response(JSON_C_AVATAR_QUERY_RESP, err, j2cresp);
     return ret;
 }
@@ -1675,10 +1739,12 @@ __bail_out:
     ((FIELD_CXN_PREFERENCE_##x) - FIELD_CXN_PREFERENCE_ARRAY_START - 1)
 
 int
-gweb_mysql_handle_cxn_preference (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
+gweb_mysql_handle_cxn_preference (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                                  j2c_resp_t **j2cresp)
 {
-    uint8_t qrybuf[MAX_MYSQL_QRYSZ], *qry_delete, *qry_insert;
-    int idx, len = 0, err = GWEB_MYSQL_ERR_UNKNOWN, ret = MYSQL_STATUS_FAIL;
+    uint8_t qrybuf[MAX_MYSQL_QRYSZ];
+    char uid_esc[MAX_MYSQL_QRYSZ / 4];
+    int idx, nr_rows = 0, len = 0, err = GWEB_MYSQL_ERR_UNKNOWN, ret = MYSQL_STATUS_FAIL;
 
     const char *uid = NULL;
 
@@ -1691,59 +1757,43 @@ gweb_mysql_handle_cxn_preference (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
 
     uid = jrecord->fields[FIELD_CXN_PREFERENCE_UID];
 
-    if (!uid || !gweb_mysql_check_uid_email(uid, NULL) || !jrecord->nr_array1_records) {
+    if (!uid || !gweb_mysql_check_uid_email(conn, uid, NULL) || !jrecord->nr_array1_records) {
         err = GWEB_MYSQL_ERR_NO_RECORD;
         goto __bail_out;
     }
 
-    /* Delete records that already exists from the given set */
-    qry_delete = &qrybuf[0];
-
-    PUSH_BUF(qrybuf, len,
-             "DELETE FROM CxnPrefTable USING UserConnectPreferences AS CxnPrefTable "
-             "WHERE CxnPrefTable.UID='%s' AND FIND_IN_SET(CxnPrefTable.ChannelId, '",
-             uid);
-
-    for (idx = 0; idx < jrecord->nr_array1_records; idx++) {
-        arr = &jrecord->array1[idx];
-        if (arr->fields[CXN_PREF_INS_IDX(CHANNEL_TYPE)]) {
-            PUSH_BUF(qrybuf, len, "%s,", arr->fields[CXN_PREF_INS_IDX(CHANNEL_TYPE)]);
-        }
-    }
-    if (idx) {
-        len--;
-        PUSH_BUF(qrybuf, len, "')");
-    }
-    qrybuf[len++] = '\0';
+    /* The row count varies, so this stays a text query. UID is known
+     * to exist and hence fits the column.
+     */
+    mysql_real_escape_string(conn->mysql, uid_esc, uid, strlen(uid));
 
-    /* Insert records */
-    qry_insert = &qrybuf[len];
-    PUSH_BUF(qrybuf, len, "INSERT INTO UserConnectPreferences "
-             "(UID, ChannelId, ChannelFlags) VALUES ");
+    /* Insert the given set, existing channels take the new flags */
+    PUSH_BUF(qrybuf, len, GWEB_SQL_CXN_PREFERENCE_INSERT_ROWS);
 
     for (idx = 0; idx < jrecord->nr_array1_records; idx++) {
         arr = &jrecord->array1[idx];
         if (arr->fields[CXN_PREF_INS_IDX(CHANNEL_TYPE)]) {
-            PUSH_BUF(qrybuf, len, "('%s', '%s', '%s'),",
-                     uid, arr->fields[CXN_PREF_INS_IDX(CHANNEL_TYPE)],
-                     arr->fields[CXN_PREF_INS_IDX(FLAG)]);
+            PUSH_BUF(qrybuf, len, "%s('%s', '", nr_rows++ ? ", " : "", uid_esc);
+            PUSH_ESCAPED(conn, qrybuf, len, arr->fields[CXN_PREF_INS_IDX(CHANNEL_TYPE)]);
+            PUSH_BUF(qrybuf, len, "', '");
+            if (arr->fields[CXN_PREF_INS_IDX(FLAG)]) {
+                PUSH_ESCAPED(conn, qrybuf, len, arr->fields[CXN_PREF_INS_IDX(FLAG)]);
+            }
+            PUSH_BUF(qrybuf, len, "')");
         }
     }
-    if (idx) {
-        qrybuf[--len] = '\0';
-    }
 
-    gweb_mysql_start_transaction();
-
-    if (mysql_query(g_mysql_ctx, qry_delete)) {
-        goto __abort_transaction;
+    if (nr_rows == 0) {
+        err = GWEB_MYSQL_ERR_NO_RECORD;
+        goto __bail_out;
     }
+    PUSH_BUF(qrybuf, len, GWEB_SQL_CXN_PREFERENCE_UPSERT_TAIL);
 
-    if (mysql_query(g_mysql_ctx, qry_insert)) {
-        goto __abort_transaction;
+    if (gweb_mysql_query_template(conn, GWEB_SQL_CXN_PREFERENCE_INSERT_ROWS,
+                                  (char *)qrybuf) != MYSQL_STATUS_OK) {
+        goto __bail_out;
     }
-
-    gweb_mysql_commit_transaction();
+    gweb_pref_cache_invalidate(uid);
 
     err = GWEB_MYSQL_OK;
     ret = MYSQL_STATUS_OK;
@@ -1751,24 +1801,23 @@ gweb_mysql_handle_cxn_preference (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
 __bail_out:
     gweb_mysql_update_response(JSON_C_CXN_PREFERENCE_RESP, err, j2cresp);
     return ret;
-
-__abort_transaction:
-    report_mysql_error_noclose(g_mysql_ctx);
-    gweb_mysql_abort_transaction();
-    gweb_mysql_update_response(JSON_C_CXN_PREFERENCE_RESP, err, j2cresp);
-    return ret;
 }
 
 int
-gweb_mysql_handle_cxn_preference_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
+gweb_mysql_handle_cxn_preference_query (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                                        j2c_resp_t **j2cresp)
 {
-    int match_count, max_rows, idx, rowid = 0, len = 0;
+    int start, max_rows, idx, rowid = 0;
     int err = GWEB_MYSQL_ERR_UNKNOWN, ret = MYSQL_STATUS_FAIL;
-    uint8_t qrybuf[MAX_MYSQL_QRYSZ], buf[32];
+    uint8_t buf[32];
     const char *uid = NULL;
+    const char *after[1] = { "" };
+    char curbuf[MAX_CURSOR_STRSZ];
+    int limit = MYSQL_MAX_CXN_PREFERENCE_ROWS_PER_QUERY + 1;
+    unsigned long gen;
 
-    MYSQL_RES *result = NULL;
-    MYSQL_ROW row;
+    struct gweb_cxn_prefs *prefs = NULL;
+    struct gweb_cxn_pref *pref;
 
     J2C_MSG_TABLE(cxn_preference_query, *jrecord) = &j2cmsg->cxn_preference_query;
     J2C_RESP_TABLE(cxn_preference_query, *resp) = NULL;
@@ -1783,39 +1832,49 @@ gweb_mysql_handle_cxn_preference_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
 
     uid = jrecord->fields[FIELD_CXN_PREFERENCE_QUERY_UID];
 
-    if (!uid || !gweb_mysql_check_uid_email(uid, NULL)) {
+    if (!uid || !gweb_mysql_check_uid_email(conn, uid, NULL)) {
         err = GWEB_MYSQL_ERR_NO_RECORD;
         goto __bail_out;
     }
 
-    PUSH_BUF(qrybuf, len,
-             "SELECT UID, ChannelId, ChannelFlags FROM UserConnectPreferences "
-             "WHERE UID='%s'", uid);
-    qrybuf[len] = '\0';
-
-    gweb_mysql_ping();
-
-    if (mysql_query(g_mysql_ctx, qrybuf)) {
-        report_mysql_error_noclose(g_mysql_ctx);
+    if (gweb_cursor_decode(jrecord->fields[FIELD_CXN_PREFERENCE_QUERY_CURSOR],
+                           curbuf, sizeof(curbuf), 1, after) < 0) {
+        err = GWEB_MYSQL_ERR_INVALID;
         goto __bail_out;
     }
 
-    if ((result = mysql_store_result(g_mysql_ctx)) == NULL) {
-        report_mysql_error_noclose(g_mysql_ctx);
-        goto __bail_out;
+    /* A cached list is paged in place, otherwise MySQL reads the page
+     * and one row over it. Only accepting a request fills the cache.
+     */
+    if (!gweb_pref_cache_get(uid, &prefs, &gen)) {
+        prefs = gweb_mysql_cxn_prefs_read(
+            gweb_stmt_cxn_preference_list(conn, uid, after[0], limit));
+        if (prefs == NULL) {
+            goto __bail_out;
+        }
     }
 
-    match_count = mysql_num_rows(result);
-    if (match_count == 0) {
+    /* Preferences are few, the page is found by a scan */
+    for (start = 0; start < prefs->nr; start++) {
+        if (gweb_mysql_ci_cmp(prefs->prefs[start].channel, after[0]) > 0) {
+            break;
+        }
+    }
+
+    if (start >= prefs->nr) {
         err = GWEB_MYSQL_ERR_NO_RECORD;
         goto __bail_out;
     }
 
-    /* *TBD* For easier access, dump all requested data to a file in
-     * JSON format and upload.
-     */
-    max_rows = (match_count >= MYSQL_MAX_CXN_PREFERENCE_ROWS_PER_QUERY) ?
-        MYSQL_MAX_CXN_PREFERENCE_ROWS_PER_QUERY: match_count;
+    max_rows = prefs->nr - start;
+    if (max_rows > MYSQL_MAX_CXN_PREFERENCE_ROWS_PER_QUERY) {
+        max_rows = MYSQL_MAX_CXN_PREFERENCE_ROWS_PER_QUERY;
+
+        /* The next page starts after the last row of this one */
+        after[0] = prefs->prefs[start + max_rows - 1].channel;
+        resp->fields[FIELD_CXN_PREFERENCE_QUERY_RESP_NEXT_CURSOR] =
+            gweb_cursor_encode(1, after);
+    }
 
     resp->array1 = calloc(sizeof(struct j2c_cxn_preference_query_resp_array1),
                           max_rows);
@@ -1824,20 +1883,15 @@ gweb_mysql_handle_cxn_preference_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
         goto __bail_out;
     }
 
-    for (rowid = idx = 0; idx < match_count && rowid < max_rows; idx++) {
-        if ((row = mysql_fetch_row(result)) == NULL) {
-            err = GWEB_MYSQL_ERR_UNKNOWN;
-            goto __bail_out;
-        }
-
-        /* NOTE: Number of rows in response could be lesser than max_rows */
+    for (idx = 0; idx < max_rows; idx++) {
+        pref = &prefs->prefs[start + idx];
         arr = &resp->array1[rowid++];
 
-        arr->fields[CXN_PREF_IDX(CHANNEL_TYPE)] = strndup(row[1], strlen(row[1]));
-        arr->fields[CXN_PREF_IDX(FLAG)] = strndup(row[2], strlen(row[2]));
+        arr->fields[CXN_PREF_IDX(CHANNEL_TYPE)] = strdup(pref->channel);
+        arr->fields[CXN_PREF_IDX(FLAG)] = strdup(pref->flag);
     }
 
-    sprintf(buf, "%d", match_count);
+    sprintf(buf, "%d", rowid);
     resp->fields[FIELD_CXN_PREFERENCE_QUERY_RESP_RECORD_COUNT] = strndup(buf, strlen(buf));
     resp->nr_array1_records = rowid;
 
@@ -1845,9 +1899,7 @@ gweb_mysql_handle_cxn_preference_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
     ret = MYSQL_STATUS_OK;
 
 __bail_out:
-    if (result) {
-        mysql_free_result(result);
-    }
+    free(prefs);
     gweb_mysql_update_response(JSON_C_CXN_PREFERENCE_QUERY_RESP, err, j2cresp);
     return ret;
 }
@@ -1855,15 +1907,13 @@ __bail_out:
 /*
  * Store given location information for the UID
  */
-#define GWEB_DEFAULT_GEO_LOCATION_EXPIRY   (3600) /* 1 hour */
-#define GWEB_DEFAULT_GEO_LOCATION_RADIUS   (500)  /* 500 meter radius */
 int
-gweb_mysql_handle_location (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
+gweb_mysql_handle_location (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                            j2c_resp_t **j2cresp)
 {
-    uint8_t qrybuf[MAX_MYSQL_QRYSZ];
     uint8_t utc_dt_str[MAX_DATETIME_STRSZ];
     int err = GWEB_MYSQL_ERR_UNKNOWN, ret = MYSQL_STATUS_FAIL;
-    int len = 0, record_found;
+    double latitude, longitude;
     int expiry_secs, neighbour_radius;
 
     J2C_MSG_TABLE(location, *jrecord) = &j2cmsg->location;
@@ -1878,18 +1928,11 @@ gweb_mysql_handle_location (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
         goto __bail_out;
     }
 
-    gweb_mysql_ping();
-
-    if (!gweb_mysql_check_uid_email(jrecord->fields[FIELD_LOCATION_UID], NULL)) {
+    if (!gweb_mysql_check_uid_email(conn, jrecord->fields[FIELD_LOCATION_UID], NULL)) {
         err = GWEB_MYSQL_ERR_NO_RECORD;
         goto __bail_out;
     }
 
-    PUSH_BUF(qrybuf, len,
-             "SELECT UID FROM UserGeoLocation WHERE UID='%s'",
-             jrecord->fields[FIELD_LOCATION_UID]);
-    qrybuf[len] = '\0';
-
     if (!jrecord->fields[FIELD_LOCATION_EXPIRY]) {
         expiry_secs = GWEB_DEFAULT_GEO_LOCATION_EXPIRY;
     } else {
@@ -1902,45 +1945,31 @@ gweb_mysql_handle_location (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
         neighbour_radius = atoi(jrecord->fields[FIELD_LOCATION_RADIUS]);
     }
 
-    if ((ret = gweb_mysql_get_query_count(qrybuf)) < 0) {
-        report_mysql_error_noclose(g_mysql_ctx);
-        ret = MYSQL_STATUS_FAIL;
+    latitude = atof(jrecord->fields[FIELD_LOCATION_LATITUDE]);
+    longitude = atof(jrecord->fields[FIELD_LOCATION_LONGITUDE]);
+
+    /* Could not be written, and would fail the buffered batch with it */
+    if (!gweb_geo_valid(latitude, longitude)) {
+        err = GWEB_MYSQL_ERR_INVALID;
         goto __bail_out;
     }
-    record_found = ret;
 
     gweb_get_utc_datetime(utc_dt_str);
 
-    len = 0;
-    if (record_found) {
-        PUSH_BUF(qrybuf, len,
-                 "UPDATE UserGeoLocation SET Location=Point(%lf, %lf), "
-                 "SeenAt='%s', Expiry=%d, Radius=%d WHERE UID='%s'",
-                 atof(jrecord->fields[FIELD_LOCATION_LATITUDE]),
-                 atof(jrecord->fields[FIELD_LOCATION_LONGITUDE]),
-                 utc_dt_str, expiry_secs, neighbour_radius,
-                 jrecord->fields[FIELD_LOCATION_UID]);
-        qrybuf[len] = '\0';
-    } else {
-        PUSH_BUF(qrybuf, len,
-                 "INSERT INTO UserGeoLocation (UID, Location, SeenAt, Expiry, "
-                 "Radius) VALUES ('%s', Point(%lf, %lf), '%s', %d, %d)",
-                 jrecord->fields[FIELD_LOCATION_UID],
-                 atof(jrecord->fields[FIELD_LOCATION_LATITUDE]),
-                 atof(jrecord->fields[FIELD_LOCATION_LONGITUDE]),
-                 utc_dt_str, expiry_secs, neighbour_radius);
-        qrybuf[len] = '\0';
-    }
-
-    gweb_mysql_start_transaction();
-    if (mysql_query(g_mysql_ctx, qrybuf)) {
-        report_mysql_error_noclose(g_mysql_ctx);
-        ret = MYSQL_STATUS_FAIL;
-        gweb_mysql_abort_transaction();
+    /* Buffered and written behind, unless the buffer can not take it.
+     * Single row keyed on UID, replaced in place.
+     */
+    if (gweb_location_buffer_put(jrecord->fields[FIELD_LOCATION_UID],
+                                 latitude, longitude, utc_dt_str,
+                                 expiry_secs, neighbour_radius) != MYSQL_STATUS_OK &&
+        !gweb_stmt_location_upsert(conn, jrecord->fields[FIELD_LOCATION_UID],
+                                   latitude, longitude, utc_dt_str,
+                                   expiry_secs, neighbour_radius)) {
         goto __bail_out;
     }
 
-    gweb_mysql_commit_transaction();
+    gweb_geo_grid_update(jrecord->fields[FIELD_LOCATION_UID], latitude,
+                         longitude, utc_dt_str, expiry_secs, neighbour_radius);
 
     err = GWEB_MYSQL_OK;
     ret = MYSQL_STATUS_OK;
@@ -1951,14 +1980,15 @@ __bail_out:
 }
 
 int
-gweb_mysql_handle_location_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
+gweb_mysql_handle_location_query (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                                  j2c_resp_t **j2cresp)
 {
-    uint8_t qrybuf[MAX_MYSQL_QRYSZ];
     int err = GWEB_MYSQL_ERR_UNKNOWN, ret = MYSQL_STATUS_FAIL;
-    int len = 0;
     const char *uid = NULL;
+    char numbuf[32];
 
-    MYSQL_RES *result = NULL;
+    struct gweb_mysql_stmt *st = NULL;
+    struct gweb_location loc;
     MYSQL_ROW row;
 
     J2C_MSG_TABLE(location_query, *jrecord) = &j2cmsg->location_query;
@@ -1971,34 +2001,38 @@ gweb_mysql_handle_location_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
     resp = &(*j2cresp)->location_query;
 
     uid = jrecord->fields[FIELD_LOCATION_QUERY_UID];
-    if (!uid || !gweb_mysql_check_uid_email(uid, NULL)) {
+    if (!uid || !gweb_mysql_check_uid_email(conn, uid, NULL)) {
         err = GWEB_MYSQL_ERR_NO_RECORD;
         goto __bail_out;
     }
 
-    PUSH_BUF(qrybuf, len,
-             "SELECT UID, ST_X(Location), ST_Y(Location), SeenAt, Expiry, "
-             "Radius FROM UserGeoLocation WHERE UID='%s'", uid);
-    qrybuf[len] = '\0';
-
-    gweb_mysql_ping();
+    /* Not yet written out, serve from the buffer */
+    if (gweb_location_buffer_get(uid, &loc)) {
+        snprintf(numbuf, sizeof(numbuf), "%.17g", loc.latitude);
+        resp->fields[FIELD_LOCATION_QUERY_RESP_LATITUDE] = strdup(numbuf);
+        snprintf(numbuf, sizeof(numbuf), "%.17g", loc.longitude);
+        resp->fields[FIELD_LOCATION_QUERY_RESP_LONGITUDE] = strdup(numbuf);
+        resp->fields[FIELD_LOCATION_QUERY_RESP_LOCATION_TIME] = strdup(loc.seen);
+        snprintf(numbuf, sizeof(numbuf), "%d", loc.expiry);
+        resp->fields[FIELD_LOCATION_QUERY_RESP_EXPIRY] = strdup(numbuf);
+        snprintf(numbuf, sizeof(numbuf), "%d", loc.radius);
+        resp->fields[FIELD_LOCATION_QUERY_RESP_RADIUS] = strdup(numbuf);
 
-    if (mysql_query(g_mysql_ctx, qrybuf)) {
-        report_mysql_error_noclose(g_mysql_ctx);
+        err = GWEB_MYSQL_OK;
+        ret = MYSQL_STATUS_OK;
         goto __bail_out;
     }
 
-    if ((result = mysql_store_result(g_mysql_ctx)) == NULL) {
-        report_mysql_error_noclose(g_mysql_ctx);
+    if ((st = gweb_stmt_location(conn, uid)) == NULL) {
         goto __bail_out;
     }
 
-    if (mysql_num_rows(result) == 0) {
+    if (gweb_mysql_stmt_num_rows(st) == 0) {
         err = GWEB_MYSQL_ERR_NO_RECORD;
         goto __bail_out;
     }
 
-    if ((row = mysql_fetch_row(result)) == NULL) {
+    if ((row = gweb_mysql_stmt_fetch(st)) == NULL) {
         goto __bail_out;
     }
 
@@ -2017,25 +2051,198 @@ gweb_mysql_handle_location_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
     ret = MYSQL_STATUS_OK;
 
 __bail_out:
-    if (result) {
-        mysql_free_result(result);
-    }
+    gweb_mysql_stmt_done(st);
     gweb_mysql_update_response(JSON_C_LOCATION_QUERY_RESP, err, j2cresp);
     return ret;
 }
 
+/*
+ * Position and search radius of the querying UID, from the grid when
+ * it can tell. Returns GWEB_MYSQL_OK or the error to report.
+ */
+static int
+gweb_mysql_neighbour_origin (struct gweb_mysql_conn *conn, const char *uid,
+                             const char *radius, double *latitude,
+                             double *longitude, double *distance)
+{
+    struct gweb_geo_match self;
+    struct gweb_mysql_stmt *st;
+    MYSQL_ROW row;
+    int err = GWEB_MYSQL_ERR_NO_RECORD;
+
+    switch (gweb_geo_grid_lookup(uid, &self)) {
+    case 0:
+        return GWEB_MYSQL_ERR_NO_RECORD;
+    case 1:
+        *latitude = self.latitude;
+        *longitude = self.longitude;
+        *distance = radius ? atof(radius) : self.radius;
+        return GWEB_MYSQL_OK;
+    default:
+        break;
+    }
+
+    if ((st = gweb_stmt_location(conn, uid)) == NULL) {
+        return GWEB_MYSQL_ERR_UNKNOWN;
+    }
+
+    if (!gweb_mysql_stmt_num_rows(st) || (row = gweb_mysql_stmt_fetch(st)) == NULL) {
+        goto __bail_out;
+    }
+
+    /* Expired records are reported as no records, NULL never expires */
+    if (row[6] && atoi(row[6])) {
+        goto __bail_out;
+    }
+
+    *latitude = atof(row[1]);
+    *longitude = atof(row[2]);
+    *distance = atof(radius ? radius : row[5]);
+    err = GWEB_MYSQL_OK;
+
+__bail_out:
+    gweb_mysql_stmt_done(st);
+    return err;
+}
+
+/* Name and avatar of the neighbours ranked in process */
+static int
+gweb_mysql_neighbour_names (struct gweb_mysql_conn *conn,
+                            struct j2c_neighbour_query_resp *resp, int nr_rows)
+{
+    struct j2c_neighbour_query_resp_array1 *arr;
+    struct gweb_user_card cards[MYSQL_MAX_NEIGHBOUR_ROWS_PER_QUERY];
+    const char *uids[MYSQL_MAX_NEIGHBOUR_ROWS_PER_QUERY];
+    int idx;
+
+    for (idx = 0; idx < nr_rows; idx++) {
+        uids[idx] = resp->array1[idx].fields[NEIGHBOUR_IDX(UID)];
+    }
+
+    if (gweb_mysql_user_cards(conn, uids, cards, nr_rows) != MYSQL_STATUS_OK) {
+        return MYSQL_STATUS_FAIL;
+    }
+
+    for (idx = 0; idx < nr_rows; idx++) {
+        arr = &resp->array1[idx];
+        arr->fields[NEIGHBOUR_IDX(FNAME)] = cards[idx].fname;
+        arr->fields[NEIGHBOUR_IDX(LNAME)] = cards[idx].lname;
+        arr->fields[NEIGHBOUR_IDX(AVATAR_URL)] = cards[idx].avatar_url;
+    }
+
+    return MYSQL_STATUS_OK;
+}
+
+/*
+ * Candidates from the spatial index within the bounding box of the
+ * search circle, ranked in process. Returns -1 when the box wraps the
+ * antimeridian or reaches a pole, those are left to the geodesic UDF.
+ */
+static int
+gweb_mysql_neighbour_bbox (struct gweb_mysql_conn *conn, const char *uid,
+                           double latitude, double longitude, double distance,
+                           double after_distance, const char *after_uid,
+                           struct gweb_geo_match *matches, int limit)
+{
+    struct gweb_geo_batch batch = { 0 };
+    struct gweb_geo_bbox box;
+    struct gweb_mysql_stmt *st;
+    MYSQL_ROW row;
+    int ret = -1;
+
+    if (gweb_geo_bbox(latitude, longitude, distance, &box) < 0 ||
+        box.min_lon < -180 || box.max_lon > 180) {
+        return -1;
+    }
+
+    st = gweb_stmt_neighbours_bbox(conn, box.min_lat, box.min_lon,
+                                   box.max_lat, box.max_lon, uid);
+    if (st == NULL) {
+        return -1;
+    }
+
+    while ((row = gweb_mysql_stmt_fetch(st)) != NULL) {
+        if (gweb_geo_batch_add(&batch, row[0], atof(row[1]),
+                               atof(row[2])) != MYSQL_STATUS_OK) {
+            goto __bail_out;
+        }
+    }
+
+    ret = gweb_geo_batch_rank(&batch, latitude, longitude, distance,
+                              after_distance, after_uid, matches, limit);
+
+__bail_out:
+    gweb_mysql_stmt_done(st);
+    gweb_geo_batch_free(&batch);
+    return ret;
+}
+
+/*
+ * One page of neighbours ranked in process. Holds max_rows + 1
+ * matches when there is a next page.
+ */
+static int
+gweb_mysql_neighbour_page (struct gweb_mysql_conn *conn,
+                           struct j2c_neighbour_query_resp *resp,
+                           struct gweb_geo_match *matches, int match_count,
+                           int *nr_rows)
+{
+    struct j2c_neighbour_query_resp_array1 *arr;
+    const char *after[2];
+    char buf[32];
+    int idx, max_rows;
+
+    max_rows = (match_count >= MYSQL_MAX_NEIGHBOUR_ROWS_PER_QUERY) ?
+        MYSQL_MAX_NEIGHBOUR_ROWS_PER_QUERY: match_count;
+
+    resp->array1 = calloc(max_rows, sizeof(struct j2c_neighbour_query_resp_array1));
+    if (!resp->array1) {
+        return GWEB_MYSQL_ERR_NO_MEMORY;
+    }
+
+    for (idx = 0; idx < max_rows; idx++) {
+        arr = &resp->array1[idx];
+        arr->fields[NEIGHBOUR_IDX(UID)] = strdup(matches[idx].uid);
+        snprintf(buf, sizeof(buf), "%.17g", matches[idx].latitude);
+        arr->fields[NEIGHBOUR_IDX(LATITUDE)] = strdup(buf);
+        snprintf(buf, sizeof(buf), "%.17g", matches[idx].longitude);
+        arr->fields[NEIGHBOUR_IDX(LONGITUDE)] = strdup(buf);
+        snprintf(buf, sizeof(buf), "%.17g", matches[idx].distance);
+        arr->fields[NEIGHBOUR_IDX(DISTANCE)] = strdup(buf);
+        *nr_rows = idx + 1;
+
+        /* One match over the page, the next page starts after this row */
+        if (idx == max_rows - 1 && match_count > max_rows) {
+            after[0] = arr->fields[NEIGHBOUR_IDX(DISTANCE)];
+            after[1] = arr->fields[NEIGHBOUR_IDX(UID)];
+            resp->fields[FIELD_NEIGHBOUR_QUERY_RESP_NEXT_CURSOR] =
+                gweb_cursor_encode(2, after);
+        }
+    }
+
+    if (max_rows && gweb_mysql_neighbour_names(conn, resp, max_rows) != MYSQL_STATUS_OK) {
+        return GWEB_MYSQL_ERR_UNKNOWN;
+    }
+
+    return GWEB_MYSQL_OK;
+}
+
 int
-gweb_mysql_handle_neighbour_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
+gweb_mysql_handle_neighbour_query (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                                   j2c_resp_t **j2cresp)
 {
-    uint8_t qrybuf[MAX_MYSQL_QRYSZ], buf[32];
+    uint8_t buf[32];
     int err = GWEB_MYSQL_ERR_UNKNOWN, ret = MYSQL_STATUS_FAIL;
-    int len = 0, expiry_secs;
+    double latitude, longitude, distance;
     int match_count, max_rows, idx, rowid = 0;
 
-    const char *radius, *uid = NULL;
-    char *fname, *lname, *avatar;
+    const char *uid = NULL;
+    const char *after[2] = { GWEB_CURSOR_MIN_DISTANCE, "" };
+    char curbuf[MAX_CURSOR_STRSZ];
+    int limit = MYSQL_MAX_NEIGHBOUR_ROWS_PER_QUERY + 1;
+    struct gweb_geo_match matches[MYSQL_MAX_NEIGHBOUR_ROWS_PER_QUERY + 1];
 
-    MYSQL_RES *result = NULL;
+    struct gweb_mysql_stmt *st = NULL;
     MYSQL_ROW row;
 
     J2C_MSG_TABLE(neighbour_query, *jrecord) = &j2cmsg->neighbour_query;
@@ -2049,75 +2256,54 @@ gweb_mysql_handle_neighbour_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
     resp = &(*j2cresp)->neighbour_query;
     resp->nr_array1_records = -1; /* No records */
 
-    gweb_mysql_ping();
-
     uid = jrecord->fields[FIELD_NEIGHBOUR_QUERY_UID];
-    if (!uid || !gweb_mysql_check_uid_email(uid, NULL)) {
-        err = GWEB_MYSQL_ERR_NO_RECORD;
-        goto __bail_out;
-    }
-
-    PUSH_BUF(qrybuf, len,
-             "SELECT UID, ST_X(Location), ST_Y(Location), SeenAt, Expiry, "
-             "Radius FROM UserGeoLocation WHERE UID='%s'", uid);
-    qrybuf[len] = '\0';
-
-    if (mysql_query(g_mysql_ctx, qrybuf)) {
-        report_mysql_error_noclose(g_mysql_ctx);
-        goto __bail_out;
-    }
-
-    if ((result = mysql_store_result(g_mysql_ctx)) == NULL) {
-        report_mysql_error_noclose(g_mysql_ctx);
-        goto __bail_out;
-    }
-
-    if (!mysql_num_rows(result)) {
+    if (!uid || !gweb_mysql_check_uid_email(conn, uid, NULL)) {
         err = GWEB_MYSQL_ERR_NO_RECORD;
         goto __bail_out;
     }
 
-    if ((row = mysql_fetch_row(result)) == NULL) {
-        err = GWEB_MYSQL_ERR_NO_RECORD;
+    if (gweb_cursor_decode(jrecord->fields[FIELD_NEIGHBOUR_QUERY_CURSOR],
+                           curbuf, sizeof(curbuf), 2, after) < 0) {
+        err = GWEB_MYSQL_ERR_INVALID;
         goto __bail_out;
     }
 
-    if (jrecord->fields[FIELD_NEIGHBOUR_QUERY_RADIUS]) {
-        radius = jrecord->fields[FIELD_NEIGHBOUR_QUERY_RADIUS];
-    } else {
-        radius = row[5];
-    }
-
-    /* Check if the record has expired, if so, return no records */
-    expiry_secs = atoi(row[4]);
-    if (expiry_secs != -1 && gweb_check_time_expired(row[3], expiry_secs)) {
-        err = GWEB_MYSQL_ERR_NO_RECORD;
+    err = gweb_mysql_neighbour_origin(conn, uid,
+                                      jrecord->fields[FIELD_NEIGHBOUR_QUERY_RADIUS],
+                                      &latitude, &longitude, &distance);
+    if (err != GWEB_MYSQL_OK) {
         goto __bail_out;
     }
+    err = GWEB_MYSQL_ERR_UNKNOWN;
 
-    len = 0;
-    PUSH_BUF(qrybuf, len,
-             "SELECT UID, ST_X(Location), ST_Y(Location), SeenAt, Expiry, "
-             "Radius, libgeod_inverse(ST_X(Location), ST_Y(Location), %s, %s) "
-             "Distance from UserGeoLocation WHERE UID != '%s' HAVING "
-             "Distance < %s ORDER BY Distance",
-             row[1], row[2], uid, radius);
-    qrybuf[len] = '\0';
-
-    gweb_mysql_ping();
-
-    if (mysql_query(g_mysql_ctx, qrybuf)) {
-        report_mysql_error_noclose(g_mysql_ctx);
-        goto __bail_out;
+    /*
+     * Scan the covering grid cells, SQL takes what the grid can not:
+     * the spatial index when the bounding box allows, else the UDF.
+     */
+    match_count = gweb_geo_grid_neighbours(uid, latitude, longitude, distance,
+                                           atof(after[0]), after[1], matches,
+                                           limit);
+    if (match_count < 0) {
+        match_count = gweb_mysql_neighbour_bbox(conn, uid, latitude, longitude,
+                                                distance, atof(after[0]),
+                                                after[1], matches, limit);
+    }
+    if (match_count >= 0) {
+        err = gweb_mysql_neighbour_page(conn, resp, matches, match_count,
+                                        &rowid);
+        if (err != GWEB_MYSQL_OK) {
+            goto __bail_out;
+        }
+        goto __send_record;
     }
 
-    mysql_free_result(result);
-    if ((result = mysql_store_result(g_mysql_ctx)) == NULL) {
-        report_mysql_error_noclose(g_mysql_ctx);
+    st = gweb_stmt_neighbours(conn, latitude, longitude, uid, distance,
+                              atof(after[0]), after[1], limit);
+    if (st == NULL) {
         goto __bail_out;
     }
 
-    match_count = mysql_num_rows(result);
+    match_count = gweb_mysql_stmt_num_rows(st);
     if (match_count == 0) {
         goto __send_record;
     }
@@ -2134,24 +2320,17 @@ gweb_mysql_handle_neighbour_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
         goto __bail_out;
     }
 
-    for (rowid = idx = 0; idx < match_count && rowid < max_rows; idx++) {
-        if ((row = mysql_fetch_row(result)) == NULL) {
+    for (rowid = idx = 0; idx < max_rows; idx++) {
+        if ((row = gweb_mysql_stmt_fetch(st)) == NULL) {
             goto __bail_out;
         }
 
-        /* Check if the matched record meets the expiry time, if not
-         * skip the record.
-         */
-        expiry_secs = atoi(row[4]);
-        if (expiry_secs != -1 && gweb_check_time_expired(row[3], expiry_secs)) {
-            continue;
-        }
-
-        if (gweb_mysql_get_name_avatar_from_uid (row[0], &fname, &lname,
-                                                 &avatar) != MYSQL_STATUS_OK) {
-            log_debug("%s: fetch fname/lname/avatar for uid=[%s] failed",
-                      __func__, row[0]);
-            continue;
+        /* One row over the page, the next page starts after this row */
+        if (idx == max_rows - 1 && match_count > max_rows) {
+            after[0] = row[6];
+            after[1] = row[0];
+            resp->fields[FIELD_NEIGHBOUR_QUERY_RESP_NEXT_CURSOR] =
+                gweb_cursor_encode(2, after);
         }
 
         /* NOTE: number of rows in response could be lesser than max_rows */
@@ -2160,9 +2339,15 @@ gweb_mysql_handle_neighbour_query (j2c_msg_t *j2cmsg, j2c_resp_t **j2cresp)
         arr->fields[NEIGHBOUR_IDX(LATITUDE)] = strndup(row[1], strlen(row[1]));
         arr->fields[NEIGHBOUR_IDX(LONGITUDE)] = strndup(row[2], strlen(row[2]));
         arr->fields[NEIGHBOUR_IDX(DISTANCE)] = strndup(row[6], strlen(row[6]));
-        arr->fields[NEIGHBOUR_IDX(FNAME)] = fname;
-        arr->fields[NEIGHBOUR_IDX(LNAME)] = lname;
-        arr->fields[NEIGHBOUR_IDX(AVATAR_URL)] = avatar;
+        if (row[7]) { /* FirstName */
+            arr->fields[NEIGHBOUR_IDX(FNAME)] = strndup(row[7], strlen(row[7]));
+        }
+        if (row[8]) { /* LastName */
+            arr->fields[NEIGHBOUR_IDX(LNAME)] = strndup(row[8], strlen(row[8]));
+        }
+        if (row[9]) { /* AvatarURL */
+            arr->fields[NEIGHBOUR_IDX(AVATAR_URL)] = strndup(row[9], strlen(row[9]));
+        }
     }
 
 __send_record:
@@ -2174,13 +2359,92 @@ __send_record:
     ret = MYSQL_STATUS_OK;
 
 __bail_out:
-    if (result) {
-        mysql_free_result(result);
-    }
+    gweb_mysql_stmt_done(st);
     gweb_mysql_update_response(JSON_C_NEIGHBOUR_QUERY_RESP, err, j2cresp);
     return ret;
 }
 
+/*
+ * People you may know, ranked from the connection graph and cached
+ * per UID. There is no SQL fallback, the same ranking is a self-join
+ * of UserConnectChannel over the whole neighbourhood of the UID.
+ */
+int
+gweb_mysql_handle_suggestions_query (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                                     j2c_resp_t **j2cresp)
+{
+    struct gweb_graph_suggestion suggestions[MYSQL_MAX_SUGGESTION_ROWS_PER_QUERY];
+    struct gweb_user_card cards[MYSQL_MAX_SUGGESTION_ROWS_PER_QUERY];
+    const char *uids[MYSQL_MAX_SUGGESTION_ROWS_PER_QUERY];
+    int err = GWEB_MYSQL_ERR_UNKNOWN, ret = MYSQL_STATUS_FAIL;
+    int idx, nr_rows = 0;
+    unsigned long gen;
+    const char *uid;
+    char buf[32];
+
+    J2C_MSG_TABLE(suggestions_query, *jrecord) = &j2cmsg->suggestions_query;
+    J2C_RESP_TABLE(suggestions_query, *resp) = NULL;
+    struct j2c_suggestions_query_resp_array1 *arr;
+
+    gweb_mysql_prepare_response(JSON_C_SUGGESTIONS_QUERY_RESP, GWEB_MYSQL_OK,
+                                j2cresp);
+    resp = &(*j2cresp)->suggestions_query;
+    resp->nr_array1_records = -1; /* No records */
+
+    uid = jrecord->fields[FIELD_SUGGESTIONS_QUERY_UID];
+    if (!uid || !gweb_mysql_check_uid_email(conn, uid, NULL)) {
+        err = GWEB_MYSQL_ERR_NO_RECORD;
+        goto __bail_out;
+    }
+
+    if (!gweb_suggest_cache_get(uid, suggestions, &nr_rows, &gen)) {
+        nr_rows = gweb_graph_suggestions(uid, suggestions,
+                                         MYSQL_MAX_SUGGESTION_ROWS_PER_QUERY);
+        if (nr_rows < 0) {
+            log_error("%s: connection graph not available\n", __func__);
+            goto __bail_out;
+        }
+        gweb_suggest_cache_put(uid, suggestions, nr_rows, gen);
+    }
+
+    if (nr_rows) {
+        resp->array1 = calloc(nr_rows, sizeof(struct j2c_suggestions_query_resp_array1));
+        if (!resp->array1) {
+            err = GWEB_MYSQL_ERR_NO_MEMORY;
+            goto __bail_out;
+        }
+
+        for (idx = 0; idx < nr_rows; idx++) {
+            uids[idx] = suggestions[idx].uid;
+        }
+        if (gweb_mysql_user_cards(conn, uids, cards, nr_rows) != MYSQL_STATUS_OK) {
+            goto __bail_out;
+        }
+    }
+
+    for (idx = 0; idx < nr_rows; idx++) {
+        arr = &resp->array1[idx];
+        arr->fields[SUGGEST_IDX(UID)] = strdup(suggestions[idx].uid);
+        arr->fields[SUGGEST_IDX(FNAME)] = cards[idx].fname;
+        arr->fields[SUGGEST_IDX(LNAME)] = cards[idx].lname;
+        arr->fields[SUGGEST_IDX(AVATAR_URL)] = cards[idx].avatar_url;
+        snprintf(buf, sizeof(buf), "%d", suggestions[idx].mutual);
+        arr->fields[SUGGEST_IDX(MUTUAL)] = strdup(buf);
+        resp->nr_array1_records = idx + 1;
+    }
+
+    sprintf(buf, "%d", nr_rows);
+    resp->fields[FIELD_SUGGESTIONS_QUERY_RESP_RECORD_COUNT] = strdup(buf);
+    resp->nr_array1_records = nr_rows;
+
+    err = GWEB_MYSQL_OK;
+    ret = MYSQL_STATUS_OK;
+
+__bail_out:
+    gweb_mysql_update_response(JSON_C_SUGGESTIONS_QUERY_RESP, err, j2cresp);
+    return ret;
+}
+
 int
 gweb_mysql_free_profile_query (j2c_resp_t *j2cresp)
 {
@@ -2272,6 +2536,7 @@ gweb_mysql_free_cxn_request_query (j2c_resp_t *j2cresp)
         J2CRESP_FREE_ARRAY(resp->array1, resp->nr_array1_records,
                            CXN_REQ_IDX(ARRAY_END));
         free(resp->fields[FIELD_CXN_REQUEST_QUERY_RESP_RECORD_COUNT]);
+        free(resp->fields[FIELD_CXN_REQUEST_QUERY_RESP_NEXT_CURSOR]);
         free(j2cresp);
     }
     return MYSQL_STATUS_OK;
@@ -2287,6 +2552,7 @@ gweb_mysql_free_cxn_channel_query (j2c_resp_t *j2cresp)
         J2CRESP_FREE_ARRAY(resp->array1, resp->nr_array1_records,
                            CXN_CHNL_IDX(ARRAY_END));
         free(resp->fields[FIELD_CXN_CHANNEL_QUERY_RESP_RECORD_COUNT]);
+        free(resp->fields[FIELD_CXN_CHANNEL_QUERY_RESP_NEXT_CURSOR]);
         free(j2cresp);
     }
     return MYSQL_STATUS_OK;
@@ -2302,6 +2568,7 @@ gweb_mysql_free_cxn_preference_query (j2c_resp_t *j2cresp)
         J2CRESP_FREE_ARRAY(resp->array1, resp->nr_array1_records,
                            CXN_PREF_IDX(ARRAY_END));
         free(resp->fields[FIELD_CXN_PREFERENCE_QUERY_RESP_RECORD_COUNT]);
+        free(resp->fields[FIELD_CXN_PREFERENCE_QUERY_RESP_NEXT_CURSOR]);
         free(j2cresp);
     }
     return MYSQL_STATUS_OK;
@@ -2344,95 +2611,177 @@ gweb_mysql_free_neighbour_query (j2c_resp_t *j2cresp)
         J2CRESP_FREE_ARRAY(resp->array1, resp->nr_array1_records,
                            NEIGHBOUR_IDX(ARRAY_END));
         free(resp->fields[FIELD_NEIGHBOUR_QUERY_RESP_RECORD_COUNT]);
+        free(resp->fields[FIELD_NEIGHBOUR_QUERY_RESP_NEXT_CURSOR]);
         free(j2cresp);
     }
     return MYSQL_STATUS_OK;
 }
 
 int
-gweb_mysql_free_profile (j2c_resp_t *j2cresp)
+gweb_mysql_free_suggestions_query (j2c_resp_t *j2cresp)
 {
+    struct j2c_suggestions_query_resp *resp = NULL;
+
     if (j2cresp) {
+        resp = &j2cresp->suggestions_query;
+        J2CRESP_FREE_ARRAY(resp->array1, resp->nr_array1_records,
+                           SUGGEST_IDX(ARRAY_END));
+        free(resp->fields[FIELD_SUGGESTIONS_QUERY_RESP_RECORD_COUNT]);
         free(j2cresp);
     }
     return MYSQL_STATUS_OK;
 }
 
 int
-gweb_mysql_shutdown (void)
-{
-    log_debug("Closing MySQL connection!\n");
-
-    if (g_mysql_ctx)
-	mysql_close(g_mysql_ctx);
-
-    return MYSQL_STATUS_OK;
-}
-
-static int
-gweb_mysql_connect (MYSQL *ctx)
+gweb_mysql_free_profile (j2c_resp_t *j2cresp)
 {
-    if (!ctx) {
-        return MYSQL_STATUS_FAIL;
-    }
-
-    if (mysql_real_connect(ctx,
-                           g_mysql_cfg->host,
-                           g_mysql_cfg->username,
-                           g_mysql_cfg->password,
-                           g_mysql_cfg->database,
-                           0,
-                           NULL,
-                           CLIENT_MULTI_STATEMENTS) == NULL) {
-        return MYSQL_STATUS_FAIL;
+    if (j2cresp) {
+        free(j2cresp);
     }
-
     return MYSQL_STATUS_OK;
 }
 
-/*
- * Check / reconnect MySQL connection
- */
+/* Process counters, no database access */
 int
-gweb_mysql_ping (void)
+gweb_mysql_handle_stats_query (struct gweb_mysql_conn *conn, j2c_msg_t *j2cmsg,
+                               j2c_resp_t **j2cresp)
 {
-    unsigned long thid_before_ping, thid_after_ping;
-
-    thid_before_ping = mysql_thread_id(g_mysql_ctx);
-    mysql_ping(g_mysql_ctx);
-    thid_after_ping = mysql_thread_id(g_mysql_ctx);
+    struct gweb_lru_stats card, profile, suggest, pref;
+    struct gweb_mysql_pool_stats pool;
+    struct gweb_slowlog_stats *queries, *query;
+    struct j2c_stats_query_resp_array1 *arr;
+    const char *reset;
+    char buf[32], hist[GWEB_SLOWLOG_BUCKETS * 21];
+    unsigned long lookups, nr_slow;
+    int nr_uids, nr_emails, nr_queries, idx, bucket, len;
+    int nr_graph_uids, nr_graph_pending;
+    long nr_graph_edges;
+
+    J2C_MSG_TABLE(stats_query, *jrecord) = &j2cmsg->stats_query;
+    J2C_RESP_TABLE(stats_query, *resp) = NULL;
+
+    gweb_mysql_prepare_response(JSON_C_STATS_QUERY_RESP, GWEB_MYSQL_OK, j2cresp);
+    resp = &(*j2cresp)->stats_query;
+
+    reset = jrecord->fields[FIELD_STATS_QUERY_RESET];
+    gweb_card_cache_stats(&card, reset && atoi(reset));
+    gweb_profile_cache_stats(&profile, reset && atoi(reset));
+    gweb_suggest_cache_stats(&suggest, reset && atoi(reset));
+    gweb_pref_cache_stats(&pref, reset && atoi(reset));
+    gweb_member_stats(&nr_uids, &nr_emails);
+    gweb_graph_stats(&nr_graph_uids, &nr_graph_edges, &nr_graph_pending);
+    gweb_mysql_pool_stats(&pool);
+    nr_slow = gweb_slowlog_stats(&queries, &nr_queries, reset && atoi(reset));
+
+#define STATS_FIELD(field, fmt, val)                                    \
+    do {                                                                \
+        snprintf(buf, sizeof(buf), fmt, val);                           \
+        resp->fields[FIELD_STATS_QUERY_RESP_##field] = strdup(buf);     \
+    } while (0)
+
+#define QUERY_FIELD(field, fmt, val)                                    \
+    do {                                                                \
+        snprintf(buf, sizeof(buf), fmt, val);                           \
+        arr->fields[STATS_IDX(QUERY_##field)] = strdup(buf);            \
+    } while (0)
+
+    lookups = card.hits + card.misses;
+    STATS_FIELD(CARD_ENTRIES, "%d", card.entries);
+    STATS_FIELD(CARD_CAPACITY, "%d", card.capacity);
+    STATS_FIELD(CARD_HITS, "%lu", card.hits);
+    STATS_FIELD(CARD_MISSES, "%lu", card.misses);
+    STATS_FIELD(CARD_HIT_RATE, "%.4f", lookups ? (double)card.hits / lookups : 0.0);
+    STATS_FIELD(CARD_EVICTIONS, "%lu", card.evictions);
+    STATS_FIELD(CARD_INVALIDATIONS, "%lu", card.invalidations);
+
+    lookups = profile.hits + profile.misses;
+    STATS_FIELD(PROFILE_ENTRIES, "%d", profile.entries);
+    STATS_FIELD(PROFILE_BYTES, "%zu", profile.bytes);
+    STATS_FIELD(PROFILE_MAX_BYTES, "%zu", profile.max_bytes);
+    STATS_FIELD(PROFILE_HITS, "%lu", profile.hits);
+    STATS_FIELD(PROFILE_MISSES, "%lu", profile.misses);
+    STATS_FIELD(PROFILE_HIT_RATE, "%.4f",
+                lookups ? (double)profile.hits / lookups : 0.0);
+    STATS_FIELD(PROFILE_EVICTIONS, "%lu", profile.evictions);
+    STATS_FIELD(PROFILE_EXPIRATIONS, "%lu", profile.expirations);
+    STATS_FIELD(PROFILE_INVALIDATIONS, "%lu", profile.invalidations);
+
+    lookups = suggest.hits + suggest.misses;
+    STATS_FIELD(SUGGEST_ENTRIES, "%d", suggest.entries);
+    STATS_FIELD(SUGGEST_HITS, "%lu", suggest.hits);
+    STATS_FIELD(SUGGEST_MISSES, "%lu", suggest.misses);
+    STATS_FIELD(SUGGEST_HIT_RATE, "%.4f",
+                lookups ? (double)suggest.hits / lookups : 0.0);
+    STATS_FIELD(SUGGEST_EXPIRATIONS, "%lu", suggest.expirations);
+
+    lookups = pref.hits + pref.misses;
+    STATS_FIELD(PREF_ENTRIES, "%d", pref.entries);
+    STATS_FIELD(PREF_HITS, "%lu", pref.hits);
+    STATS_FIELD(PREF_MISSES, "%lu", pref.misses);
+    STATS_FIELD(PREF_HIT_RATE, "%.4f", lookups ? (double)pref.hits / lookups : 0.0);
+    STATS_FIELD(PREF_INVALIDATIONS, "%lu", pref.invalidations);
+    STATS_FIELD(PREF_EXPIRATIONS, "%lu", pref.expirations);
+
+    STATS_FIELD(MEMBER_UIDS, "%d", nr_uids);
+    STATS_FIELD(MEMBER_EMAILS, "%d", nr_emails);
+    STATS_FIELD(GRAPH_UIDS, "%d", nr_graph_uids);
+    STATS_FIELD(GRAPH_EDGES, "%ld", nr_graph_edges);
+    STATS_FIELD(GRAPH_PENDING, "%d", nr_graph_pending);
+    STATS_FIELD(REPLICAS, "%d", pool.nr_replicas);
+    STATS_FIELD(REPLICAS_HEALTHY, "%d", pool.nr_healthy);
+    STATS_FIELD(READS_REPLICA, "%lu", pool.reads_replica);
+    STATS_FIELD(READS_PINNED, "%lu", pool.reads_pinned);
+    STATS_FIELD(READS_FALLBACK, "%lu", pool.reads_fallback);
+    STATS_FIELD(SLOW_THRESHOLD_MS, "%d", gweb_slowlog_threshold_ms());
+    STATS_FIELD(SLOW_QUERIES, "%lu", nr_slow);
+
+    if (nr_queries) {
+        resp->array1 = calloc(nr_queries, sizeof(struct j2c_stats_query_resp_array1));
+    }
+    for (idx = 0; resp->array1 && idx < nr_queries; idx++) {
+        arr = &resp->array1[idx];
+        query = &queries[idx];
+
+        for (len = 0, bucket = 0; bucket < GWEB_SLOWLOG_BUCKETS; bucket++) {
+            len += sprintf(&hist[len], "%s%lu", bucket ? " " : "", query->hist[bucket]);
+        }
 
-    if (thid_before_ping != thid_after_ping) {
-        log_debug("%s: MySQL reconnected!\n", __func__);
+        arr->fields[STATS_IDX(QUERY_NAME)] = strdup(query->name);
+        QUERY_FIELD(COUNT, "%lu", query->count);
+        QUERY_FIELD(ROWS, "%lu", query->rows);
+        QUERY_FIELD(SLOW, "%lu", query->slow);
+        QUERY_FIELD(AVG_US, "%llu", query->total_us / query->count);
+        QUERY_FIELD(P50_US, "%lu", gweb_slowlog_percentile(query, 50));
+        QUERY_FIELD(P99_US, "%lu", gweb_slowlog_percentile(query, 99));
+        QUERY_FIELD(MAX_US, "%lu", query->max_us);
+        arr->fields[STATS_IDX(QUERY_HISTOGRAM)] = strdup(hist);
+        resp->nr_array1_records++;
     }
+    free(queries);
+
+#undef QUERY_FIELD
+#undef STATS_FIELD
 
+    gweb_mysql_update_response(JSON_C_STATS_QUERY_RESP, GWEB_MYSQL_OK, j2cresp);
     return MYSQL_STATUS_OK;
 }
 
 int
-gweb_mysql_init (void)
+gweb_mysql_free_stats_query (j2c_resp_t *j2cresp)
 {
-    my_bool reconnect = 1;
-
-    if ((g_mysql_cfg = config_load_mysqldb()) == NULL) {
-        log_error("Invalid MYSQL configuration, bailing out\n");
-        return MYSQL_STATUS_FAIL;
-    }
-
-    log_debug("Initializing schema, MySQL version = %s\n",
-	      mysql_get_client_info());
-
-    if ((g_mysql_ctx = mysql_init(NULL)) == NULL) {
-	report_mysql_error(g_mysql_ctx);
-    }
-
-    mysql_options(g_mysql_ctx, MYSQL_OPT_RECONNECT, &reconnect);
+    struct j2c_stats_query_resp *resp = NULL;
+    int fidx;
 
-    if (gweb_mysql_connect(g_mysql_ctx) != MYSQL_STATUS_OK) {
-        report_mysql_error(g_mysql_ctx);
+    if (j2cresp) {
+        resp = &j2cresp->stats_query;
+        for (fidx = FIELD_STATS_QUERY_RESP_CARD_ENTRIES;
+             fidx < FIELD_STATS_QUERY_RESP_ARRAY_START;
+             fidx++) {
+            J2CRESP_CHECK_FREE(resp->fields[fidx]);
+        }
+        J2CRESP_FREE_ARRAY(resp->array1, resp->nr_array1_records,
+                           STATS_IDX(ARRAY_END));
+        free(j2cresp);
     }
-
-    log_debug("MySQL connected!\n");
-
     return MYSQL_STATUS_OK;
 }
@@ -0,0 +1,406 @@
+/*
+ * Location write-behind buffer
+ *
+ * Clients report their location every few seconds. Updates are kept
+ * in memory, one entry per UID holding the latest point, and a flusher
+ * thread writes them out as multi-row upserts within one transaction,
+ * on an interval or as soon as enough UIDs are pending. The request is
+ * acknowledged once the point is buffered.
+ *
+ * Pending points are served to location queries from here, so a client
+ * reads its own writes; neighbour searches see them through the grid
+ * (mysqldb_geo.c). A failed flush leaves the entries in place for the
+ * next round; when the buffer is full or not running, new UIDs are
+ * written through. A chunk MySQL rejects is retried row by row, and
+ * rows rejected on their own are dropped so they do not hold back the
+ * rest of the buffer.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <mysql.h>
+#include <mysqld_error.h>
+
+#include <gweb/common.h>
+#include <gweb/config.h>
+#include <gweb/hash.h>
+#include <gweb/list.h>
+#include <gweb/sql_gen.h>
+#include <gweb/mysqldb_api.h>
+#include <gweb/mysqldb_pool.h>
+#include <gweb/mysqldb_location.h>
+#include <gweb/mysqldb_log.h>
+
+/* Upper bound of one formatted LOCATION_ROW, escaped UID included */
+#define GWEB_LOCATION_ROWSZ     (256)
+
+struct gweb_location_entry {
+    struct list node;           /* hash bucket */
+    unsigned long seq;          /* bumped on every update */
+    struct gweb_location loc;
+};
+
+struct gweb_location_buffer {
+    pthread_mutex_t lock;
+    pthread_cond_t  wakeup;
+    pthread_t       flusher;
+    int running;
+
+    struct list buckets[GWEB_LOCATION_HASH_SIZE];
+    int nr_pending;
+    unsigned long seq;
+
+    int flush_ms;
+    int flush_rows;
+};
+
+static struct gweb_location_buffer g_location_buf = {
+    .lock   = PTHREAD_MUTEX_INITIALIZER,
+    .wakeup = PTHREAD_COND_INITIALIZER,
+};
+
+static struct list *
+gweb_location_bucket (struct gweb_location_buffer *buf, const char *uid)
+{
+    return &buf->buckets[gweb_hash_string(uid) & (GWEB_LOCATION_HASH_SIZE - 1)];
+}
+
+/* Called with lock held */
+static struct gweb_location_entry *
+gweb_location_lookup (struct gweb_location_buffer *buf, const char *uid)
+{
+    struct list *head = gweb_location_bucket(buf, uid), *pos;
+    struct gweb_location_entry *entry;
+
+    for (pos = head->next; pos != head; pos = pos->next) {
+        entry = list_entry(pos, struct gweb_location_entry, node);
+        if (strcmp(entry->loc.uid, uid) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Buffer the latest point of a UID. Returns MYSQL_STATUS_FAIL when the
+ * caller has to write it through.
+ */
+int
+gweb_location_buffer_put (const char *uid, double latitude, double longitude,
+                          const char *seen, int expiry, int radius)
+{
+    struct gweb_location_buffer *buf = &g_location_buf;
+    struct gweb_location_entry *entry;
+    int ret = MYSQL_STATUS_FAIL;
+
+    if (strlen(uid) >= MAX_UID_STRSZ || strlen(seen) >= GWEB_LOCATION_SEEN_STRSZ) {
+        return MYSQL_STATUS_FAIL;
+    }
+
+    pthread_mutex_lock(&buf->lock);
+
+    if (!buf->running) {
+        goto __bail_out;
+    }
+
+    if ((entry = gweb_location_lookup(buf, uid)) == NULL) {
+        if (buf->nr_pending >= GWEB_LOCATION_MAX_PENDING) {
+            log_debug("%s: buffer full, writing through\n", __func__);
+            goto __bail_out;
+        }
+        if ((entry = calloc(1, sizeof(struct gweb_location_entry))) == NULL) {
+            goto __bail_out;
+        }
+        strcpy(entry->loc.uid, uid);
+        list_add(gweb_location_bucket(buf, uid), &entry->node);
+        buf->nr_pending++;
+    }
+
+    entry->seq = ++buf->seq;
+    entry->loc.latitude = latitude;
+    entry->loc.longitude = longitude;
+    strcpy(entry->loc.seen, seen);
+    entry->loc.expiry = expiry;
+    entry->loc.radius = radius;
+
+    if (buf->nr_pending >= buf->flush_rows) {
+        pthread_cond_signal(&buf->wakeup);
+    }
+    ret = MYSQL_STATUS_OK;
+
+__bail_out:
+    pthread_mutex_unlock(&buf->lock);
+    return ret;
+}
+
+/* Pending point of a UID, returns 0 if there is none */
+int
+gweb_location_buffer_get (const char *uid, struct gweb_location *loc)
+{
+    struct gweb_location_buffer *buf = &g_location_buf;
+    struct gweb_location_entry *entry;
+    int found = 0;
+
+    pthread_mutex_lock(&buf->lock);
+    if ((entry = gweb_location_lookup(buf, uid)) != NULL) {
+        *loc = entry->loc;
+        found = 1;
+    }
+    pthread_mutex_unlock(&buf->lock);
+
+    return found;
+}
+
+/* Write out one chunk of rows as a single multi-row upsert */
+static int
+gweb_location_write (struct gweb_mysql_conn *conn, char *qrybuf,
+                     struct gweb_location_entry *rows, int nr_rows)
+{
+    char uid_esc[2 * MAX_UID_STRSZ + 1];
+    int idx, len = 0;
+
+    len += sprintf(qrybuf + len, GWEB_SQL_LOCATION_INSERT_ROWS);
+    for (idx = 0; idx < nr_rows; idx++) {
+        mysql_real_escape_string(conn->mysql, uid_esc, rows[idx].loc.uid,
+                                 strlen(rows[idx].loc.uid));
+        if (idx) {
+            qrybuf[len++] = ',';
+        }
+        len += sprintf(qrybuf + len, GWEB_SQL_LOCATION_ROW, uid_esc,
+                       rows[idx].loc.latitude, rows[idx].loc.longitude,
+                       rows[idx].loc.seen, rows[idx].loc.expiry,
+                       rows[idx].loc.radius, rows[idx].loc.expiry,
+                       rows[idx].loc.seen, rows[idx].loc.expiry);
+    }
+    sprintf(qrybuf + len, GWEB_SQL_LOCATION_UPSERT_TAIL);
+
+    return gweb_mysql_query_template(conn, GWEB_SQL_LOCATION_INSERT_ROWS, qrybuf);
+}
+
+/* Errors that leave no transaction to carry on with */
+static int
+gweb_location_txn_lost (struct gweb_mysql_conn *conn)
+{
+    unsigned int err = mysql_errno(conn->mysql);
+
+    return gweb_mysql_conn_lost(err) || err == ER_LOCK_DEADLOCK;
+}
+
+/*
+ * Rows of a rejected chunk one at a time. A failed statement is rolled
+ * back on its own, so rows still rejected are dropped and the rest
+ * stay in the transaction.
+ */
+static int
+gweb_location_write_rows (struct gweb_mysql_conn *conn, char *qrybuf,
+                          struct gweb_location_entry *rows, int nr_rows)
+{
+    int idx;
+
+    for (idx = 0; idx < nr_rows; idx++) {
+        if (gweb_location_write(conn, qrybuf, &rows[idx], 1) == MYSQL_STATUS_OK) {
+            continue;
+        }
+        if (gweb_location_txn_lost(conn)) {
+            return MYSQL_STATUS_FAIL;
+        }
+        log_error("%s: location of %s (%g, %g) dropped\n", __func__,
+                  rows[idx].loc.uid, rows[idx].loc.latitude,
+                  rows[idx].loc.longitude);
+    }
+    return MYSQL_STATUS_OK;
+}
+
+/*
+ * Flush everything pending at the time of the call. Entries are copied
+ * out so updates keep flowing in while the rows are written, and only
+ * dropped afterwards if they were not updated meanwhile.
+ */
+static int
+gweb_location_flush (struct gweb_location_buffer *buf)
+{
+    struct gweb_location_entry *batch, *entry;
+    struct gweb_mysql_conn *conn;
+    struct list *pos;
+    char *qrybuf = NULL;
+    int idx, nr_batch = 0, chunk, ret = MYSQL_STATUS_FAIL;
+
+    pthread_mutex_lock(&buf->lock);
+    if (buf->nr_pending == 0) {
+        pthread_mutex_unlock(&buf->lock);
+        return MYSQL_STATUS_OK;
+    }
+
+    batch = malloc(buf->nr_pending * sizeof(struct gweb_location_entry));
+    if (batch == NULL) {
+        pthread_mutex_unlock(&buf->lock);
+        log_error("%s: unable to allocate memory!\n", __func__);
+        return MYSQL_STATUS_FAIL;
+    }
+
+    for (idx = 0; idx < GWEB_LOCATION_HASH_SIZE; idx++) {
+        for (pos = buf->buckets[idx].next; pos != &buf->buckets[idx]; pos = pos->next) {
+            batch[nr_batch++] = *list_entry(pos, struct gweb_location_entry, node);
+        }
+    }
+    pthread_mutex_unlock(&buf->lock);
+
+    qrybuf = malloc(MAX_MYSQL_QRYSZ + buf->flush_rows * GWEB_LOCATION_ROWSZ);
+    if (qrybuf == NULL) {
+        log_error("%s: unable to allocate memory!\n", __func__);
+        goto __bail_out;
+    }
+
+    if ((conn = gweb_mysql_pool_get()) == NULL) {
+        goto __bail_out;
+    }
+    conn->caller = __func__;
+
+    gweb_mysql_start_transaction(conn);
+
+    for (idx = 0; idx < nr_batch; idx += chunk) {
+        chunk = nr_batch - idx;
+        if (chunk > buf->flush_rows) {
+            chunk = buf->flush_rows;
+        }
+        if (gweb_location_write(conn, qrybuf, &batch[idx], chunk) != MYSQL_STATUS_OK &&
+            (gweb_location_txn_lost(conn) ||
+             gweb_location_write_rows(conn, qrybuf, &batch[idx], chunk) != MYSQL_STATUS_OK)) {
+            gweb_mysql_abort_transaction(conn);
+            gweb_mysql_pool_put(conn);
+            goto __bail_out;
+        }
+    }
+
+    ret = gweb_mysql_commit_transaction(conn);
+    gweb_mysql_pool_put(conn);
+
+    if (ret != MYSQL_STATUS_OK) {
+        goto __bail_out;
+    }
+
+    pthread_mutex_lock(&buf->lock);
+    for (idx = 0; idx < nr_batch; idx++) {
+        entry = gweb_location_lookup(buf, batch[idx].loc.uid);
+        if (entry && entry->seq == batch[idx].seq) {
+            list_remove(&entry->node);
+            buf->nr_pending--;
+            free(entry);
+        }
+    }
+    pthread_mutex_unlock(&buf->lock);
+
+    log_debug("%s: %d location(s) written\n", __func__, nr_batch);
+
+__bail_out:
+    if (ret != MYSQL_STATUS_OK) {
+        log_error("%s: %d location(s) kept for retry\n", __func__, nr_batch);
+    }
+    free(qrybuf);
+    free(batch);
+    return ret;
+}
+
+static void *
+gweb_location_flusher (void *arg)
+{
+    struct gweb_location_buffer *buf = arg;
+    struct timespec deadline;
+    int running = 1, failed = 0;
+
+    mysql_thread_init();
+
+    while (running) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += buf->flush_ms / 1000;
+        deadline.tv_nsec += (buf->flush_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+        /* After a failed flush wait out the interval, not the size */
+        pthread_mutex_lock(&buf->lock);
+        while (buf->running && (failed || buf->nr_pending < buf->flush_rows)) {
+            if (pthread_cond_timedwait(&buf->wakeup, &buf->lock, &deadline)) {
+                break;
+            }
+        }
+        running = buf->running;
+        pthread_mutex_unlock(&buf->lock);
+
+        failed = (gweb_location_flush(buf) != MYSQL_STATUS_OK);
+    }
+
+    mysql_thread_end();
+
+    return NULL;
+}
+
+int
+gweb_location_buffer_init (struct mysql_config *cfg)
+{
+    struct gweb_location_buffer *buf = &g_location_buf;
+    int idx;
+
+    buf->flush_ms = (cfg->location_flush_ms > 0) ?
+        cfg->location_flush_ms : GWEB_LOCATION_FLUSH_MS;
+    buf->flush_rows = (cfg->location_flush_rows > 0) ?
+        cfg->location_flush_rows : GWEB_LOCATION_FLUSH_ROWS;
+
+    for (idx = 0; idx < GWEB_LOCATION_HASH_SIZE; idx++) {
+        list_init(&buf->buckets[idx]);
+    }
+
+    buf->running = 1;
+    if (pthread_create(&buf->flusher, NULL, gweb_location_flusher, buf)) {
+        log_error("%s: unable to start flusher thread\n", __func__);
+        buf->running = 0;
+        return MYSQL_STATUS_FAIL;
+    }
+
+    log_debug("Location buffer ready, flush every %d ms or %d UID(s)\n",
+              buf->flush_ms, buf->flush_rows);
+
+    return MYSQL_STATUS_OK;
+}
+
+/* Stops buffering and writes out what is pending, pool must be up */
+void
+gweb_location_buffer_shutdown (void)
+{
+    struct gweb_location_buffer *buf = &g_location_buf;
+    struct gweb_location_entry *entry;
+    int idx, was_running;
+
+    pthread_mutex_lock(&buf->lock);
+    was_running = buf->running;
+    buf->running = 0;
+    pthread_cond_signal(&buf->wakeup);
+    pthread_mutex_unlock(&buf->lock);
+
+    if (!was_running) {
+        return;
+    }
+
+    /* Flusher does a last round on its way out */
+    pthread_join(buf->flusher, NULL);
+
+    pthread_mutex_lock(&buf->lock);
+    if (buf->nr_pending) {
+        log_error("%s: dropping %d unwritten location(s)\n", __func__,
+                  buf->nr_pending);
+    }
+    for (idx = 0; idx < GWEB_LOCATION_HASH_SIZE; idx++) {
+        while (!list_empty(&buf->buckets[idx])) {
+            entry = list_entry(buf->buckets[idx].next,
+                               struct gweb_location_entry, node);
+            list_remove(&entry->node);
+            free(entry);
+        }
+    }
+    buf->nr_pending = 0;
+    pthread_mutex_unlock(&buf->lock);
+}
@@ -0,0 +1,852 @@
+/*
+ * MySQL connection pool
+ *
+ * Each request checks out a connection, runs its queries and returns
+ * it. Checkout waits a bounded time for an idle connection when the
+ * pool is at its maximum size. A background thread pings connections
+ * that sat idle for a validation interval, drops the dead ones and
+ * refills the pool to its minimum size. Failed connects back off
+ * exponentially so an unreachable server is not hammered.
+ *
+ * Requests never ping. A query failing with a lost connection is
+ * reconnected and replayed once when that is safe, otherwise the
+ * connection is marked broken and dropped on return.
+ *
+ * Read replicas get a pool each. Read-only APIs are spread over them
+ * round robin, skipping replicas whose last connect failed, and fall
+ * back to the primary. Writes pin their key (UID or email) to the
+ * primary for a few seconds, reads by a pinned key stay on the primary
+ * so users see their own updates despite replication lag.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <mysql.h>
+
+#include <gweb/common.h>
+#include <gweb/config.h>
+#include <gweb/list.h>
+#include <gweb/mysqldb_api.h>
+#include <gweb/mysqldb_pool.h>
+#include <gweb/mysqldb_stmt.h>
+#include <gweb/mysqldb_location.h>
+#include <gweb/mysqldb_geo.h>
+#include <gweb/mysqldb_graph.h>
+#include <gweb/mysqldb_cache.h>
+#include <gweb/mysqldb_slowlog.h>
+#include <gweb/mysqldb_log.h>
+#include <gweb/hash.h>
+#include <gweb/lru.h>
+
+struct gweb_mysql_pool {
+    const char *name;
+    struct mysql_config *cfg;   /* server and credentials */
+
+    pthread_mutex_t lock;
+    pthread_cond_t  conn_avail;
+    pthread_cond_t  validator_wakeup;
+    pthread_t       validator;
+
+    struct list idle;           /* most recently used at tail */
+    int nr_conns;               /* open, including checked out */
+    int nr_idle;
+    int running;
+
+    int min_conns;
+    int max_conns;
+    int wait_ms;
+    int validate_secs;
+
+    int backoff_secs;
+    time_t next_connect;
+    int healthy;                /* last connect attempt succeeded */
+};
+
+/* Primary, replicas and the read routing between them */
+struct gweb_mysql_router {
+    int nr_replicas;
+    struct gweb_mysql_pool *replicas;
+    unsigned int next_replica;
+
+    struct gweb_lru *pins;      /* keys written in the last pin_secs */
+
+    unsigned long reads_replica;
+    unsigned long reads_pinned;
+    unsigned long reads_fallback;
+};
+
+static struct gweb_mysql_pool g_mysql_pool = {
+    .name             = "primary",
+    .lock             = PTHREAD_MUTEX_INITIALIZER,
+    .conn_avail       = PTHREAD_COND_INITIALIZER,
+    .validator_wakeup = PTHREAD_COND_INITIALIZER,
+};
+
+static struct gweb_mysql_router g_mysql_router;
+
+static int
+gweb_mysql_connect (struct gweb_mysql_pool *pool, MYSQL *ctx)
+{
+    if (!ctx) {
+        return MYSQL_STATUS_FAIL;
+    }
+
+    if (mysql_real_connect(ctx,
+                           pool->cfg->host,
+                           pool->cfg->username,
+                           pool->cfg->password,
+                           pool->cfg->database,
+                           0,
+                           NULL,
+                           CLIENT_MULTI_STATEMENTS) == NULL) {
+        return MYSQL_STATUS_FAIL;
+    }
+
+    return MYSQL_STATUS_OK;
+}
+
+static struct gweb_mysql_conn *
+gweb_mysql_conn_open (struct gweb_mysql_pool *pool)
+{
+    struct gweb_mysql_conn *conn;
+
+    if ((conn = calloc(1, sizeof(struct gweb_mysql_conn))) == NULL) {
+        log_error("%s: unable to allocate memory!\n", __func__);
+        return NULL;
+    }
+    list_init(&conn->node);
+    conn->pool = pool;
+    conn->replica = (pool != &g_mysql_pool);
+
+    if ((conn->mysql = mysql_init(NULL)) == NULL) {
+        log_error("%s: mysql_init failed!\n", __func__);
+        free(conn);
+        return NULL;
+    }
+
+    if (gweb_mysql_connect(pool, conn->mysql) != MYSQL_STATUS_OK) {
+        report_mysql_error_noaction(conn->mysql);
+        mysql_close(conn->mysql);
+        free(conn);
+        return NULL;
+    }
+
+    conn->last_used = time(NULL);
+
+    return conn;
+}
+
+static void
+gweb_mysql_conn_close (struct gweb_mysql_conn *conn)
+{
+    gweb_mysql_stmt_cache_free(conn);
+    if (conn->mysql) {
+        mysql_close(conn->mysql);
+    }
+    free(conn->explain);
+    free(conn);
+}
+
+/* Called with pool lock held after each connect attempt */
+static void
+gweb_mysql_pool_backoff (struct gweb_mysql_pool *pool, int connected)
+{
+    pool->healthy = connected;
+
+    if (connected) {
+        if (pool->backoff_secs) {
+            log_notice("MySQL %s connect recovered after backoff\n", pool->name);
+        }
+        pool->backoff_secs = 0;
+        pool->next_connect = 0;
+        return;
+    }
+
+    if (pool->backoff_secs == 0) {
+        pool->backoff_secs = 1;
+    } else if (pool->backoff_secs < GWEB_MYSQL_POOL_MAX_BACKOFF) {
+        pool->backoff_secs *= 2;
+        if (pool->backoff_secs > GWEB_MYSQL_POOL_MAX_BACKOFF) {
+            pool->backoff_secs = GWEB_MYSQL_POOL_MAX_BACKOFF;
+        }
+    }
+    pool->next_connect = time(NULL) + pool->backoff_secs;
+
+    log_error("MySQL %s connect failed, retrying in %d secs\n", pool->name,
+              pool->backoff_secs);
+}
+
+/* Called with pool lock held, drops the lock while connecting */
+static struct gweb_mysql_conn *
+gweb_mysql_pool_grow (struct gweb_mysql_pool *pool)
+{
+    struct gweb_mysql_conn *conn;
+
+    pool->nr_conns++;
+    pthread_mutex_unlock(&pool->lock);
+
+    conn = gweb_mysql_conn_open(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    gweb_mysql_pool_backoff(pool, conn != NULL);
+    if (conn == NULL) {
+        pool->nr_conns--;
+    }
+
+    return conn;
+}
+
+static void
+gweb_mysql_deadline (struct timespec *ts, int msecs)
+{
+    clock_gettime(CLOCK_REALTIME, ts);
+
+    ts->tv_sec += msecs / 1000;
+    ts->tv_nsec += (msecs % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+/*
+ * Checkout a connection, waits up to the configured time when the
+ * pool is exhausted. Returns NULL on timeout.
+ */
+static struct gweb_mysql_conn *
+gweb_mysql_pool_checkout (struct gweb_mysql_pool *pool)
+{
+    struct gweb_mysql_conn *conn = NULL;
+    struct timespec deadline;
+    int rc = 0;
+
+    /* Per-thread client state, no-op once initialized */
+    mysql_thread_init();
+
+    gweb_mysql_deadline(&deadline, pool->wait_ms);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->running) {
+        if (!list_empty(&pool->idle)) {
+            conn = list_entry(pool->idle.prev, struct gweb_mysql_conn, node);
+            list_remove(&conn->node);
+            pool->nr_idle--;
+            break;
+        }
+
+        if (pool->nr_conns < pool->max_conns && time(NULL) >= pool->next_connect) {
+            if ((conn = gweb_mysql_pool_grow(pool)) != NULL) {
+                break;
+            }
+            continue;
+        }
+
+        if (rc == ETIMEDOUT) {
+            break;
+        }
+        rc = pthread_cond_timedwait(&pool->conn_avail, &pool->lock, &deadline);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (conn == NULL) {
+        log_error("%s: no MySQL %s connection available\n", __func__, pool->name);
+    }
+
+    return conn;
+}
+
+/* Primary connection, for writes and anything that must be current */
+struct gweb_mysql_conn *
+gweb_mysql_pool_get (void)
+{
+    return gweb_mysql_pool_checkout(&g_mysql_pool);
+}
+
+/* Pin map key, hashed so long emails fit and case does not matter */
+static void
+gweb_mysql_pin_key (const char *key, char *buf, size_t size)
+{
+    snprintf(buf, size, "%016llx",
+             (unsigned long long)gweb_hash64_string_nocase(key));
+}
+
+static void
+gweb_mysql_pin_copy (const void *value, void *arg)
+{
+}
+
+static void
+gweb_mysql_pin_free (void *value)
+{
+}
+
+/* Keep reads by key on the primary for the pin window */
+void
+gweb_mysql_pin (const char *key)
+{
+    struct gweb_mysql_router *router = &g_mysql_router;
+    char buf[GWEB_LRU_KEYSZ];
+
+    if (key && router->pins) {
+        gweb_mysql_pin_key(key, buf, sizeof(buf));
+        gweb_lru_put(router->pins, buf, NULL, 0, 0);
+    }
+}
+
+int
+gweb_mysql_pinned (const char *key)
+{
+    struct gweb_mysql_router *router = &g_mysql_router;
+    char buf[GWEB_LRU_KEYSZ];
+    unsigned long gen;
+
+    if (key == NULL || router->pins == NULL) {
+        return 0;
+    }
+
+    gweb_mysql_pin_key(key, buf, sizeof(buf));
+    return gweb_lru_get(router->pins, buf, gweb_mysql_pin_copy, NULL, &gen);
+}
+
+/*
+ * Whether rows for key read on conn are current, i.e. fit to fill a
+ * cache with. Replicas may lag behind a write for the pin window.
+ */
+int
+gweb_mysql_conn_fresh (struct gweb_mysql_conn *conn, const char *key)
+{
+    return !conn->replica || !gweb_mysql_pinned(key);
+}
+
+/*
+ * Connection for a read-only request on key (may be NULL). Replicas in
+ * turn, the primary if key is pinned or no replica can serve.
+ */
+struct gweb_mysql_conn *
+gweb_mysql_pool_get_read (const char *key)
+{
+    struct gweb_mysql_router *router = &g_mysql_router;
+    struct gweb_mysql_pool *pool;
+    struct gweb_mysql_conn *conn;
+    unsigned int start;
+    int idx;
+
+    if (router->nr_replicas == 0) {
+        return gweb_mysql_pool_get();
+    }
+
+    if (gweb_mysql_pinned(key)) {
+        __sync_fetch_and_add(&router->reads_pinned, 1);
+        return gweb_mysql_pool_get();
+    }
+
+    start = __sync_fetch_and_add(&router->next_replica, 1);
+    for (idx = 0; idx < router->nr_replicas; idx++) {
+        pool = &router->replicas[(start + idx) % router->nr_replicas];
+        if (!pool->running || !pool->healthy) {
+            continue;
+        }
+        if ((conn = gweb_mysql_pool_checkout(pool)) != NULL) {
+            __sync_fetch_and_add(&router->reads_replica, 1);
+            return conn;
+        }
+    }
+
+    __sync_fetch_and_add(&router->reads_fallback, 1);
+    return gweb_mysql_pool_get();
+}
+
+void
+gweb_mysql_pool_stats (struct gweb_mysql_pool_stats *stats)
+{
+    struct gweb_mysql_router *router = &g_mysql_router;
+    int idx;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->nr_replicas = router->nr_replicas;
+    for (idx = 0; idx < router->nr_replicas; idx++) {
+        stats->nr_healthy += router->replicas[idx].healthy;
+    }
+    stats->reads_replica = router->reads_replica;
+    stats->reads_pinned = router->reads_pinned;
+    stats->reads_fallback = router->reads_fallback;
+}
+
+void
+gweb_mysql_pool_put (struct gweb_mysql_conn *conn)
+{
+    struct gweb_mysql_pool *pool;
+
+    if (conn == NULL) {
+        return;
+    }
+    pool = conn->pool;
+
+    gweb_slowlog_explain(conn);
+    conn->caller = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    if (!pool->running || conn->broken) {
+        pool->nr_conns--;
+        /* Room to open a fresh one */
+        pthread_cond_signal(&pool->conn_avail);
+        pthread_mutex_unlock(&pool->lock);
+        gweb_mysql_conn_close(conn);
+        return;
+    }
+
+    conn->last_used = time(NULL);
+    list_add(&pool->idle, &conn->node);
+    pool->nr_idle++;
+
+    pthread_cond_signal(&pool->conn_avail);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* Liveness check for idle connections, validator thread only */
+static int
+gweb_mysql_ping (struct gweb_mysql_conn *conn)
+{
+    if (mysql_ping(conn->mysql)) {
+        report_mysql_error_noaction(conn->mysql);
+        return MYSQL_STATUS_FAIL;
+    }
+
+    return MYSQL_STATUS_OK;
+}
+
+/*
+ * Replace a lost server connection in place. Prepared statements and
+ * session state do not survive, the statement cache is flushed. Honours
+ * the pool backoff so a dead server costs one connect per interval, not
+ * one per request. On failure the connection is marked broken.
+ */
+int
+gweb_mysql_reconnect (struct gweb_mysql_conn *conn)
+{
+    struct gweb_mysql_pool *pool = conn->pool;
+    int ret = MYSQL_STATUS_FAIL;
+
+    gweb_mysql_stmt_cache_free(conn);
+    mysql_close(conn->mysql);
+    conn->in_txn = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    if (time(NULL) < pool->next_connect) {
+        pthread_mutex_unlock(&pool->lock);
+        conn->mysql = NULL;
+        goto __bail_out;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if ((conn->mysql = mysql_init(NULL)) == NULL) {
+        log_error("%s: mysql_init failed!\n", __func__);
+        goto __bail_out;
+    }
+
+    ret = gweb_mysql_connect(pool, conn->mysql);
+    if (ret != MYSQL_STATUS_OK) {
+        report_mysql_error_noaction(conn->mysql);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    gweb_mysql_pool_backoff(pool, ret == MYSQL_STATUS_OK);
+    pthread_mutex_unlock(&pool->lock);
+
+    if (ret == MYSQL_STATUS_OK) {
+        log_notice("MySQL %s connection re-established\n", pool->name);
+        return ret;
+    }
+
+__bail_out:
+    conn->broken = 1;
+    return MYSQL_STATUS_FAIL;
+}
+
+/*
+ * Text query with reconnect on a lost connection. Only replayed when
+ * the server never saw it and no transaction is open. Timed under
+ * tmpl, the format qry was printed from.
+ */
+int
+gweb_mysql_query_template (struct gweb_mysql_conn *conn, const char *tmpl,
+                           const char *qry)
+{
+    struct timespec start;
+    unsigned int err;
+    int retries = 1;
+
+    gweb_slowlog_start(&start);
+    while (mysql_query(conn->mysql, qry)) {
+        err = mysql_errno(conn->mysql);
+        report_mysql_error_noaction(conn->mysql);
+
+        if (!gweb_mysql_conn_lost(err)) {
+            return MYSQL_STATUS_FAIL;
+        }
+
+        if (conn->in_txn || err != CR_SERVER_GONE_ERROR || !retries--) {
+            conn->broken = 1;
+            return MYSQL_STATUS_FAIL;
+        }
+
+        if (gweb_mysql_reconnect(conn) != MYSQL_STATUS_OK) {
+            return MYSQL_STATUS_FAIL;
+        }
+    }
+
+    /* Rows of a result set are only known once the caller stores it */
+    gweb_slowlog_text(conn, tmpl, qry, &start, mysql_field_count(conn->mysql) ? 0 :
+                      (unsigned long)mysql_affected_rows(conn->mysql));
+
+    return MYSQL_STATUS_OK;
+}
+
+int
+gweb_mysql_query (struct gweb_mysql_conn *conn, const char *qry)
+{
+    return gweb_mysql_query_template(conn, NULL, qry);
+}
+
+/*
+ * Ping connections that were idle for a validation interval, oldest
+ * first. Called with pool lock held.
+ */
+static void
+gweb_mysql_pool_validate (struct gweb_mysql_pool *pool)
+{
+    struct gweb_mysql_conn *conn;
+    struct list stale, *node;
+    time_t now = time(NULL);
+    int alive;
+
+    list_init(&stale);
+    while (!list_empty(&pool->idle)) {
+        conn = list_entry(pool->idle.next, struct gweb_mysql_conn, node);
+        if (now - conn->last_used < pool->validate_secs) {
+            break;
+        }
+        list_remove(&conn->node);
+        list_add(&stale, &conn->node);
+        pool->nr_idle--;
+    }
+
+    while (!list_empty(&stale)) {
+        node = stale.next;
+        list_remove(node);
+        conn = list_entry(node, struct gweb_mysql_conn, node);
+
+        pthread_mutex_unlock(&pool->lock);
+        alive = (gweb_mysql_ping(conn) == MYSQL_STATUS_OK);
+        if (!alive) {
+            gweb_mysql_conn_close(conn);
+        }
+        pthread_mutex_lock(&pool->lock);
+
+        if (!alive) {
+            pool->nr_conns--;
+            continue;
+        }
+        conn->last_used = time(NULL);
+        list_add(&pool->idle, &conn->node);
+        pool->nr_idle++;
+        pthread_cond_signal(&pool->conn_avail);
+    }
+
+    /* Refill to minimum size */
+    while (pool->running && pool->nr_conns < pool->min_conns &&
+           time(NULL) >= pool->next_connect) {
+        if ((conn = gweb_mysql_pool_grow(pool)) == NULL) {
+            break;
+        }
+        list_add(&pool->idle, &conn->node);
+        pool->nr_idle++;
+        pthread_cond_signal(&pool->conn_avail);
+    }
+}
+
+static void *
+gweb_mysql_pool_validator (void *arg)
+{
+    struct gweb_mysql_pool *pool = arg;
+    struct timespec deadline;
+    int wait_secs;
+
+    mysql_thread_init();
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->running) {
+        wait_secs = pool->validate_secs;
+        if (pool->backoff_secs && pool->backoff_secs < wait_secs) {
+            wait_secs = pool->backoff_secs;
+        }
+        gweb_mysql_deadline(&deadline, wait_secs * 1000);
+        pthread_cond_timedwait(&pool->validator_wakeup, &pool->lock, &deadline);
+
+        if (pool->running) {
+            gweb_mysql_pool_validate(pool);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    mysql_thread_end();
+
+    return NULL;
+}
+
+static void
+gweb_mysql_pool_stop (struct gweb_mysql_pool *pool)
+{
+    struct gweb_mysql_conn *conn;
+    int validator_running;
+
+    pthread_mutex_lock(&pool->lock);
+    validator_running = pool->running;
+    pool->running = 0;
+    pthread_cond_broadcast(&pool->conn_avail);
+    pthread_cond_signal(&pool->validator_wakeup);
+    pthread_mutex_unlock(&pool->lock);
+
+    if (validator_running) {
+        pthread_join(pool->validator, NULL);
+    }
+
+    /* Checked out connections are closed on return */
+    pthread_mutex_lock(&pool->lock);
+    while (!list_empty(&pool->idle)) {
+        conn = list_entry(pool->idle.next, struct gweb_mysql_conn, node);
+        list_remove(&conn->node);
+        pool->nr_idle--;
+        pool->nr_conns--;
+        gweb_mysql_conn_close(conn);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * Open the minimum connections and start the validator. The primary
+ * fails without a connection, a replica keeps retrying in the
+ * background and serves no reads until it connects.
+ */
+static int
+gweb_mysql_pool_start (struct gweb_mysql_pool *pool, struct mysql_config *cfg)
+{
+    struct gweb_mysql_conn *conn;
+    int idx;
+
+    pool->cfg = cfg;
+
+    pool->min_conns = (cfg->pool_min > 0) ? cfg->pool_min : GWEB_MYSQL_POOL_MIN;
+    pool->max_conns = (cfg->pool_max > 0) ? cfg->pool_max : GWEB_MYSQL_POOL_MAX;
+    if (pool->max_conns < pool->min_conns) {
+        pool->max_conns = pool->min_conns;
+    }
+    pool->wait_ms = (cfg->pool_wait_ms > 0) ?
+        cfg->pool_wait_ms : GWEB_MYSQL_POOL_WAIT_MS;
+    pool->validate_secs = (cfg->pool_validate_secs > 0) ?
+        cfg->pool_validate_secs : GWEB_MYSQL_POOL_VALIDATE_SECS;
+
+    list_init(&pool->idle);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->running = 1;
+    for (idx = 0; idx < pool->min_conns; idx++) {
+        if ((conn = gweb_mysql_pool_grow(pool)) == NULL) {
+            break;
+        }
+        list_add(&pool->idle, &conn->node);
+        pool->nr_idle++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    /* Not even one connection, bail out */
+    if (pool->nr_conns == 0 && pool == &g_mysql_pool) {
+        pool->running = 0;
+        return MYSQL_STATUS_FAIL;
+    }
+
+    if (pthread_create(&pool->validator, NULL, gweb_mysql_pool_validator, pool)) {
+        log_error("%s: unable to start validator thread\n", __func__);
+        pthread_mutex_lock(&pool->lock);
+        pool->running = 0;
+        pthread_mutex_unlock(&pool->lock);
+        gweb_mysql_pool_stop(pool);
+        return MYSQL_STATUS_FAIL;
+    }
+
+    log_debug("MySQL %s pool ready, %d connection(s) [min %d, max %d]\n",
+              pool->name, pool->nr_conns, pool->min_conns, pool->max_conns);
+
+    return MYSQL_STATUS_OK;
+}
+
+int
+gweb_mysql_pool_init (struct mysql_config *cfg)
+{
+    struct gweb_mysql_router *router = &g_mysql_router;
+    struct gweb_mysql_pool *pool;
+    int idx, pin_secs;
+
+    if (gweb_mysql_pool_start(&g_mysql_pool, cfg) != MYSQL_STATUS_OK) {
+        return MYSQL_STATUS_FAIL;
+    }
+
+    if (cfg->nr_replicas == 0) {
+        return MYSQL_STATUS_OK;
+    }
+
+    /* Replicas are optional, reads stay on the primary without them */
+    router->replicas = calloc(cfg->nr_replicas, sizeof(struct gweb_mysql_pool));
+    if (router->replicas == NULL) {
+        log_error("%s: unable to allocate memory, no replicas\n", __func__);
+        return MYSQL_STATUS_OK;
+    }
+
+    pin_secs = cfg->pin_secs ? cfg->pin_secs : GWEB_MYSQL_PIN_SECS;
+    if (pin_secs > 0 &&
+        (router->pins = gweb_lru_create(GWEB_MYSQL_PIN_SIZE, 0, pin_secs,
+                                        gweb_mysql_pin_free)) == NULL) {
+        log_error("%s: unable to allocate memory, no replicas\n", __func__);
+        free(router->replicas);
+        router->replicas = NULL;
+        return MYSQL_STATUS_OK;
+    }
+
+    for (idx = 0; idx < cfg->nr_replicas; idx++) {
+        pool = &router->replicas[idx];
+        pool->name = cfg->replicas[idx].host ? cfg->replicas[idx].host : "replica";
+        pthread_mutex_init(&pool->lock, NULL);
+        pthread_cond_init(&pool->conn_avail, NULL);
+        pthread_cond_init(&pool->validator_wakeup, NULL);
+
+        if (gweb_mysql_pool_start(pool, &cfg->replicas[idx]) != MYSQL_STATUS_OK) {
+            log_error("MySQL replica %s not started\n", cfg->replicas[idx].host);
+            continue;
+        }
+        router->nr_replicas = idx + 1;
+    }
+
+    log_debug("MySQL read routing over %d replica(s), pin %d secs\n",
+              router->nr_replicas, pin_secs);
+
+    return MYSQL_STATUS_OK;
+}
+
+/*
+ * The replica array outlives shutdown, requests still holding a
+ * replica connection return it to a stopped pool.
+ */
+void
+gweb_mysql_pool_shutdown (void)
+{
+    struct gweb_mysql_router *router = &g_mysql_router;
+    int idx, nr_replicas = router->nr_replicas;
+
+    /* No new reads on replicas */
+    router->nr_replicas = 0;
+    __sync_synchronize();
+
+    for (idx = 0; idx < nr_replicas; idx++) {
+        gweb_mysql_pool_stop(&router->replicas[idx]);
+    }
+    gweb_mysql_pool_stop(&g_mysql_pool);
+
+    gweb_lru_destroy(router->pins);
+    router->pins = NULL;
+}
+
+int
+gweb_mysql_shutdown (void)
+{
+    log_debug("Closing MySQL connections!\n");
+
+    /* Pending locations need the pool */
+    gweb_location_buffer_shutdown();
+    gweb_geo_reaper_shutdown();
+    gweb_geo_grid_shutdown();
+    gweb_graph_merger_shutdown();
+    gweb_graph_shutdown();
+    gweb_mysql_pool_shutdown();
+    gweb_cache_shutdown();
+    gweb_slowlog_shutdown();
+
+    return MYSQL_STATUS_OK;
+}
+
+int
+gweb_mysql_init (void)
+{
+    struct mysql_config *cfg;
+    struct gweb_mysql_conn *conn;
+
+    if ((cfg = config_load_mysqldb()) == NULL) {
+        log_error("Invalid MYSQL configuration, bailing out\n");
+        return MYSQL_STATUS_FAIL;
+    }
+
+    log_debug("Initializing schema, MySQL version = %s\n",
+	      mysql_get_client_info());
+
+    /* Must precede any thread using the client library */
+    if (mysql_library_init(0, NULL, NULL)) {
+        log_error("MySQL client library init failed\n");
+        return MYSQL_STATUS_FAIL;
+    }
+
+    gweb_slowlog_init(cfg);
+
+    if (gweb_cache_init(cfg) != MYSQL_STATUS_OK) {
+        log_error("Cache init failed\n");
+        return MYSQL_STATUS_FAIL;
+    }
+
+    if (gweb_mysql_pool_init(cfg) != MYSQL_STATUS_OK) {
+        log_error("MySQL connection pool init failed\n");
+        gweb_cache_shutdown();
+        return MYSQL_STATUS_FAIL;
+    }
+
+    /*
+     * Neighbour searches, member checks and connection lists fall back
+     * to SQL on failure
+     */
+    if ((conn = gweb_mysql_pool_get()) != NULL) {
+        if (gweb_geo_grid_init(conn) != MYSQL_STATUS_OK) {
+            log_error("Location grid warm up failed\n");
+        }
+        if (gweb_member_init(conn) != MYSQL_STATUS_OK) {
+            log_error("Member set load failed, checks go to MySQL\n");
+        }
+        if (gweb_graph_init(conn) != MYSQL_STATUS_OK) {
+            log_error("Connection graph load failed, lists go to MySQL\n");
+        }
+        gweb_mysql_pool_put(conn);
+    }
+
+    /* Expired rows pile up but searches skip them, keep going */
+    if (gweb_geo_reaper_init() != MYSQL_STATUS_OK) {
+        log_error("Location reaper init failed\n");
+    }
+
+    /* Unmerged writes only make lists slower to rebuild */
+    if (gweb_graph_merger_init() != MYSQL_STATUS_OK) {
+        log_error("Connection graph merger init failed\n");
+    }
+
+    if (gweb_location_buffer_init(cfg) != MYSQL_STATUS_OK) {
+        log_error("Location buffer init failed\n");
+        gweb_geo_reaper_shutdown();
+        gweb_graph_merger_shutdown();
+        gweb_graph_shutdown();
+        gweb_mysql_pool_shutdown();
+        gweb_cache_shutdown();
+        return MYSQL_STATUS_FAIL;
+    }
+
+    log_debug("MySQL connected!\n");
+
+    return MYSQL_STATUS_OK;
+}
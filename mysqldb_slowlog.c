@@ -0,0 +1,415 @@
+/*
+ * In-process slow query log
+ *
+ * Every prepared statement execute and text query is timed and added
+ * to the totals of its template: the statement for prepared ones, the
+ * format string from sql_gen.h (before values are printed in) for text
+ * queries. Templates keep an execution count, rows and a log2 latency
+ * histogram, reported by /query/stats.
+ *
+ * Executions over the threshold are logged with the API handler the
+ * connection was checked out for. The first slow execution of each
+ * template also has its plan logged: the query, values filled in, is
+ * run through EXPLAIN once the connection is returned to the pool and
+ * no result set of the handler is pending on it.
+ *
+ * Updates are a handful of adds under one lock, far shorter than the
+ * round trip being timed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+
+#include <mysql.h>
+
+#include <gweb/common.h>
+#include <gweb/config.h>
+#include <gweb/mysqldb_api.h>
+#include <gweb/mysqldb_pool.h>
+#include <gweb/mysqldb_stmt.h>
+#include <gweb/mysqldb_slowlog.h>
+
+/* Longest EXPLAIN built from a prepared statement and its values */
+#define GWEB_SLOWLOG_QRYSZ          (8192)
+#define GWEB_SLOWLOG_LINESZ         (512)
+
+struct gweb_slowlog_entry {
+    struct gweb_slowlog_stats stats;
+    char *tmpl;                 /* text templates, the lookup key */
+    int explained;
+};
+
+struct gweb_slowlog {
+    pthread_mutex_t lock;
+    long threshold_us;          /* -1, nothing logged */
+
+    struct gweb_slowlog_entry stmts[GWEB_STMT_MAX];
+    struct gweb_slowlog_entry text[GWEB_SLOWLOG_MAX_TEXT];
+    int nr_text;
+};
+
+static struct gweb_slowlog g_slowlog = {
+    .lock         = PTHREAD_MUTEX_INITIALIZER,
+    .threshold_us = GWEB_SLOWLOG_THRESHOLD_MS * 1000L,
+};
+
+void
+gweb_slowlog_init (struct mysql_config *cfg)
+{
+    struct gweb_slowlog *slowlog = &g_slowlog;
+    int ms = cfg->slow_query_ms ? cfg->slow_query_ms : GWEB_SLOWLOG_THRESHOLD_MS;
+    int id;
+
+    pthread_mutex_lock(&slowlog->lock);
+    slowlog->threshold_us = ms < 0 ? -1 : ms * 1000L;
+    for (id = 0; id < GWEB_STMT_MAX; id++) {
+        snprintf(slowlog->stmts[id].stats.name, GWEB_SLOWLOG_NAMESZ, "%s",
+                 gweb_stmt_name[id]);
+    }
+    pthread_mutex_unlock(&slowlog->lock);
+
+    if (ms < 0) {
+        log_debug("Slow query log disabled, timing only\n");
+    } else {
+        log_debug("Slow query log ready, threshold %d ms\n", ms);
+    }
+}
+
+void
+gweb_slowlog_shutdown (void)
+{
+    struct gweb_slowlog *slowlog = &g_slowlog;
+    int idx;
+
+    pthread_mutex_lock(&slowlog->lock);
+    for (idx = 0; idx < slowlog->nr_text; idx++) {
+        free(slowlog->text[idx].tmpl);
+    }
+    memset(slowlog->text, 0, sizeof(slowlog->text));
+    slowlog->nr_text = 0;
+    pthread_mutex_unlock(&slowlog->lock);
+}
+
+int
+gweb_slowlog_threshold_ms (void)
+{
+    return g_slowlog.threshold_us < 0 ? -1 : (int)(g_slowlog.threshold_us / 1000);
+}
+
+static unsigned long
+gweb_slowlog_elapsed_us (const struct timespec *start)
+{
+    struct timespec now;
+    long usecs;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    usecs = (now.tv_sec - start->tv_sec) * 1000000L +
+        (now.tv_nsec - start->tv_nsec) / 1000;
+
+    return usecs < 0 ? 0 : usecs;
+}
+
+static int
+gweb_slowlog_bucket (unsigned long usecs)
+{
+    int bucket = 0;
+
+    while (usecs >>= 1) {
+        bucket++;
+    }
+    return bucket < GWEB_SLOWLOG_BUCKETS ? bucket : GWEB_SLOWLOG_BUCKETS - 1;
+}
+
+/*
+ * Called with lock held. Returns 1 for a slow execution, 2 when it is
+ * the first of its template and wants a plan.
+ */
+static int
+gweb_slowlog_add (struct gweb_slowlog *slowlog, struct gweb_slowlog_entry *entry,
+                  unsigned long usecs, unsigned long rows)
+{
+    struct gweb_slowlog_stats *stats = &entry->stats;
+
+    stats->count++;
+    stats->rows += rows;
+    stats->total_us += usecs;
+    if (usecs > stats->max_us) {
+        stats->max_us = usecs;
+    }
+    stats->hist[gweb_slowlog_bucket(usecs)]++;
+
+    if (slowlog->threshold_us < 0 || usecs < slowlog->threshold_us) {
+        return 0;
+    }
+
+    stats->slow++;
+    if (entry->explained) {
+        return 1;
+    }
+    entry->explained = 1;
+    return 2;
+}
+
+static void
+gweb_slowlog_report (struct gweb_mysql_conn *conn, const char *name,
+                     unsigned long usecs, unsigned long rows)
+{
+    log_notice("Slow query %s: %lu.%03lu ms, %lu row(s), from %s\n", name,
+               usecs / 1000, usecs % 1000, rows,
+               conn->caller ? conn->caller : "(internal)");
+}
+
+/* Only statements EXPLAIN accepts, not transaction control */
+static int
+gweb_slowlog_explainable (const char *sql)
+{
+    static const char *verbs[] = { "SELECT", "INSERT", "UPDATE", "DELETE", "REPLACE" };
+    int idx;
+
+    for (idx = 0; idx < ARRAY_SIZE(verbs); idx++) {
+        if (strncasecmp(sql, verbs[idx], strlen(verbs[idx])) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Hand the plan query to the connection, run from gweb_slowlog_explain() */
+static void
+gweb_slowlog_defer (struct gweb_mysql_conn *conn, const char *name, char *explain)
+{
+    free(conn->explain);
+    conn->explain = explain;
+    conn->explain_name = name;
+}
+
+/* "EXPLAIN <sql>" with the bound values printed in, NULL if too long */
+static char *
+gweb_slowlog_stmt_query (struct gweb_mysql_conn *conn, const char *sql,
+                         MYSQL_BIND *params)
+{
+    char *qry;
+    int len;
+
+    if ((qry = malloc(GWEB_SLOWLOG_QRYSZ)) == NULL) {
+        return NULL;
+    }
+    len = sprintf(qry, "EXPLAIN ");
+
+    if (gweb_mysql_stmt_print(conn, &qry[len], GWEB_SLOWLOG_QRYSZ - len, sql,
+                              params) < 0) {
+        free(qry);
+        return NULL;
+    }
+    return qry;
+}
+
+void
+gweb_slowlog_stmt (struct gweb_mysql_conn *conn, int id, MYSQL_BIND *params,
+                   const struct timespec *start, unsigned long rows)
+{
+    struct gweb_slowlog *slowlog = &g_slowlog;
+    unsigned long usecs = gweb_slowlog_elapsed_us(start);
+    char *explain;
+    int slow;
+
+    pthread_mutex_lock(&slowlog->lock);
+    slow = gweb_slowlog_add(slowlog, &slowlog->stmts[id], usecs, rows);
+    pthread_mutex_unlock(&slowlog->lock);
+
+    if (slow) {
+        gweb_slowlog_report(conn, gweb_stmt_name[id], usecs, rows);
+    }
+
+    if (slow == 2 && gweb_slowlog_explainable(gweb_stmt_sql[id])) {
+        if ((explain = gweb_slowlog_stmt_query(conn, gweb_stmt_sql[id], params))) {
+            gweb_slowlog_defer(conn, gweb_stmt_name[id], explain);
+        }
+    }
+}
+
+/* Called with lock held, NULL once the table is full */
+static struct gweb_slowlog_entry *
+gweb_slowlog_text_entry (struct gweb_slowlog *slowlog, const char *tmpl)
+{
+    struct gweb_slowlog_entry *entry;
+    int idx;
+
+    for (idx = 0; idx < slowlog->nr_text; idx++) {
+        if (strcmp(slowlog->text[idx].tmpl, tmpl) == 0) {
+            return &slowlog->text[idx];
+        }
+    }
+
+    if (slowlog->nr_text == GWEB_SLOWLOG_MAX_TEXT) {
+        return NULL;
+    }
+
+    entry = &slowlog->text[slowlog->nr_text];
+    if ((entry->tmpl = strdup(tmpl)) == NULL) {
+        return NULL;
+    }
+    /* Reported as a JSON string, which is not escaped */
+    snprintf(entry->stats.name, GWEB_SLOWLOG_NAMESZ, "%s", tmpl);
+    for (idx = 0; entry->stats.name[idx]; idx++) {
+        if (entry->stats.name[idx] == '"' || entry->stats.name[idx] == '\\') {
+            entry->stats.name[idx] = ' ';
+        }
+    }
+    slowlog->nr_text++;
+
+    return entry;
+}
+
+/* tmpl is the format string qry was printed from, NULL if qry is fixed */
+void
+gweb_slowlog_text (struct gweb_mysql_conn *conn, const char *tmpl,
+                   const char *qry, const struct timespec *start,
+                   unsigned long rows)
+{
+    struct gweb_slowlog *slowlog = &g_slowlog;
+    struct gweb_slowlog_entry *entry;
+    unsigned long usecs = gweb_slowlog_elapsed_us(start);
+    const char *name = NULL;
+    char *explain;
+    int slow = 0;
+
+    if (tmpl == NULL) {
+        tmpl = qry;
+    }
+
+    pthread_mutex_lock(&slowlog->lock);
+    if ((entry = gweb_slowlog_text_entry(slowlog, tmpl)) != NULL) {
+        slow = gweb_slowlog_add(slowlog, entry, usecs, rows);
+        /* Stays put until shutdown */
+        name = entry->stats.name;
+    }
+    pthread_mutex_unlock(&slowlog->lock);
+
+    if (slow) {
+        gweb_slowlog_report(conn, name, usecs, rows);
+    }
+
+    if (slow == 2 && gweb_slowlog_explainable(qry)) {
+        if ((explain = malloc(strlen(qry) + sizeof("EXPLAIN ")))) {
+            gweb_slowlog_defer(conn, name, strcat(strcpy(explain, "EXPLAIN "), qry));
+        }
+    }
+}
+
+/*
+ * Run a pending plan query, one line per plan row. Called as the
+ * connection is returned to the pool.
+ */
+void
+gweb_slowlog_explain (struct gweb_mysql_conn *conn)
+{
+    MYSQL_RES *res;
+    MYSQL_FIELD *fields;
+    MYSQL_ROW row;
+    char line[GWEB_SLOWLOG_LINESZ];
+    int col, nr_fields, len;
+
+    if (conn->explain == NULL) {
+        return;
+    }
+
+    if (conn->broken) {
+        goto __done;
+    }
+
+    if (mysql_query(conn->mysql, conn->explain) ||
+        (res = mysql_store_result(conn->mysql)) == NULL) {
+        log_error("%s: EXPLAIN %s failed: %s\n", __func__, conn->explain_name,
+                  mysql_error(conn->mysql));
+        goto __done;
+    }
+
+    log_notice("Slow query %s plan:\n", conn->explain_name);
+
+    fields = mysql_fetch_fields(res);
+    nr_fields = mysql_num_fields(res);
+    while ((row = mysql_fetch_row(res)) != NULL) {
+        line[0] = '\0';
+        for (len = 0, col = 0; col < nr_fields && len < sizeof(line); col++) {
+            if (row[col]) {
+                len += snprintf(&line[len], sizeof(line) - len, " %s=%s",
+                                fields[col].name, row[col]);
+            }
+        }
+        log_notice("   %s\n", line);
+    }
+    mysql_free_result(res);
+
+__done:
+    free(conn->explain);
+    conn->explain = NULL;
+    conn->explain_name = NULL;
+}
+
+/*
+ * Copies of the templates executed so far, free *stats after use.
+ * Returns the slow executions over all templates.
+ */
+unsigned long
+gweb_slowlog_stats (struct gweb_slowlog_stats **stats, int *nr_stats, int reset)
+{
+    struct gweb_slowlog *slowlog = &g_slowlog;
+    struct gweb_slowlog_entry *entry;
+    char name[GWEB_SLOWLOG_NAMESZ];
+    unsigned long nr_slow = 0;
+    int idx, nr = 0;
+
+    *nr_stats = 0;
+    *stats = NULL;
+
+    pthread_mutex_lock(&slowlog->lock);
+    *stats = calloc(GWEB_STMT_MAX + slowlog->nr_text,
+                    sizeof(struct gweb_slowlog_stats));
+
+    for (idx = 0; idx < GWEB_STMT_MAX + slowlog->nr_text; idx++) {
+        entry = idx < GWEB_STMT_MAX ? &slowlog->stmts[idx] :
+            &slowlog->text[idx - GWEB_STMT_MAX];
+        nr_slow += entry->stats.slow;
+        if (*stats && entry->stats.count) {
+            (*stats)[nr++] = entry->stats;
+        }
+        if (reset) {
+            strcpy(name, entry->stats.name);
+            memset(&entry->stats, 0, sizeof(entry->stats));
+            strcpy(entry->stats.name, name);
+        }
+    }
+    pthread_mutex_unlock(&slowlog->lock);
+
+    *nr_stats = nr;
+
+    return nr_slow;
+}
+
+/* Upper bound of the bucket holding the percentile, at most the max */
+unsigned long
+gweb_slowlog_percentile (const struct gweb_slowlog_stats *stats, int percent)
+{
+    unsigned long target, seen = 0;
+    int bucket;
+
+    if (stats->count == 0) {
+        return 0;
+    }
+
+    target = (stats->count * percent + 99) / 100;
+    for (bucket = 0; bucket < GWEB_SLOWLOG_BUCKETS - 1; bucket++) {
+        seen += stats->hist[bucket];
+        if (seen >= target) {
+            break;
+        }
+    }
+
+    if (bucket == GWEB_SLOWLOG_BUCKETS - 1 || (2UL << bucket) > stats->max_us) {
+        return stats->max_us;
+    }
+    return 2UL << bucket;
+}
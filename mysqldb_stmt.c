@@ -0,0 +1,354 @@
+/*
+ * Prepared statement cache
+ *
+ * Statements are listed in the API schema and prepared once per pooled
+ * connection, on first use. Parameters go over the binary protocol,
+ * results are fetched into per-statement string buffers so that the
+ * handlers keep working on MYSQL_ROW style rows.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <mysql.h>
+
+#include <gweb/common.h>
+#include <gweb/mysqldb_api.h>
+#include <gweb/mysqldb_pool.h>
+#include <gweb/mysqldb_stmt.h>
+#include <gweb/mysqldb_slowlog.h>
+
+#define report_mysql_stmt_error(st)                                     \
+    log_error("%s: %s\n", gweb_stmt_name[(st)->id], mysql_stmt_error((st)->stmt))
+
+static void
+gweb_mysql_stmt_close (struct gweb_mysql_stmt *st)
+{
+    if (st->stmt) {
+        mysql_stmt_close(st->stmt);
+    }
+    free(st->result);
+    free(st->length);
+    free(st->is_null);
+    free(st->error);
+    free(st->row);
+    free(st->colbuf);
+    free(st);
+}
+
+/* Bind every result column as a string buffer */
+static int
+gweb_mysql_stmt_bind_result (struct gweb_mysql_stmt *st)
+{
+    MYSQL_RES *meta;
+    MYSQL_FIELD *fields;
+    unsigned long size, total = 0;
+    unsigned int col;
+    char *buf;
+
+    /* DML, nothing to fetch */
+    if ((meta = mysql_stmt_result_metadata(st->stmt)) == NULL) {
+        return MYSQL_STATUS_OK;
+    }
+
+    st->nr_cols = mysql_num_fields(meta);
+    fields = mysql_fetch_fields(meta);
+
+    st->result = calloc(st->nr_cols, sizeof(MYSQL_BIND));
+    st->length = calloc(st->nr_cols, sizeof(unsigned long));
+    st->is_null = calloc(st->nr_cols, sizeof(my_bool));
+    st->error = calloc(st->nr_cols, sizeof(my_bool));
+    st->row = calloc(st->nr_cols, sizeof(char *));
+    if (!st->result || !st->length || !st->is_null || !st->error || !st->row) {
+        goto __bail_out;
+    }
+
+    for (col = 0; col < st->nr_cols; col++) {
+        size = fields[col].length + 1;
+        if (size < GWEB_MYSQL_STMT_MIN_COLSZ) {
+            size = GWEB_MYSQL_STMT_MIN_COLSZ;
+        } else if (size > GWEB_MYSQL_STMT_MAX_COLSZ) {
+            size = GWEB_MYSQL_STMT_MAX_COLSZ;
+        }
+        st->result[col].buffer_length = size;
+        total += size;
+    }
+
+    if ((st->colbuf = calloc(1, total)) == NULL) {
+        goto __bail_out;
+    }
+
+    /* Keep room for the terminating NUL */
+    for (buf = st->colbuf, col = 0; col < st->nr_cols; col++) {
+        st->result[col].buffer_type = MYSQL_TYPE_STRING;
+        st->result[col].buffer = buf;
+        st->result[col].length = &st->length[col];
+        st->result[col].is_null = &st->is_null[col];
+        st->result[col].error = &st->error[col];
+        st->row[col] = buf;
+        buf += st->result[col].buffer_length--;
+    }
+
+    mysql_free_result(meta);
+
+    if (mysql_stmt_bind_result(st->stmt, st->result)) {
+        report_mysql_stmt_error(st);
+        return MYSQL_STATUS_FAIL;
+    }
+
+    return MYSQL_STATUS_OK;
+
+__bail_out:
+    log_error("%s: unable to allocate memory!\n", __func__);
+    mysql_free_result(meta);
+    return MYSQL_STATUS_FAIL;
+}
+
+static struct gweb_mysql_stmt *
+gweb_mysql_stmt_prepare (struct gweb_mysql_conn *conn, int id)
+{
+    struct gweb_mysql_stmt *st;
+    const char *sql = gweb_stmt_sql[id];
+
+    if ((st = calloc(1, sizeof(struct gweb_mysql_stmt))) == NULL) {
+        log_error("%s: unable to allocate memory!\n", __func__);
+        return NULL;
+    }
+    st->id = id;
+
+    if ((st->stmt = mysql_stmt_init(conn->mysql)) == NULL) {
+        log_error("%s: %s\n", gweb_stmt_name[id], mysql_error(conn->mysql));
+        free(st);
+        return NULL;
+    }
+
+    if (mysql_stmt_prepare(st->stmt, sql, strlen(sql))) {
+        report_mysql_stmt_error(st);
+        gweb_mysql_stmt_close(st);
+        return NULL;
+    }
+
+    if (gweb_mysql_stmt_bind_result(st) != MYSQL_STATUS_OK) {
+        gweb_mysql_stmt_close(st);
+        return NULL;
+    }
+
+    log_debug("%s: prepared %s\n", __func__, gweb_stmt_name[id]);
+
+    return st;
+}
+
+/*
+ * Returns the error number, 0 on success. Sets replay_safe when a lost
+ * connection can not have applied anything: nothing was sent, or the
+ * statement only reads.
+ */
+static unsigned int
+gweb_mysql_stmt_run (struct gweb_mysql_conn *conn, int id, MYSQL_BIND *params,
+                     int *replay_safe)
+{
+    struct gweb_mysql_stmt *st = conn->stmts[id];
+    struct timespec start;
+    unsigned int err;
+
+    if (st == NULL) {
+        if ((st = gweb_mysql_stmt_prepare(conn, id)) == NULL) {
+            *replay_safe = 1;
+            err = mysql_errno(conn->mysql);
+            return err ? err : CR_UNKNOWN_ERROR;
+        }
+        conn->stmts[id] = st;
+    }
+    *replay_safe = (st->nr_cols != 0);
+
+    if (params && mysql_stmt_bind_param(st->stmt, params)) {
+        goto __bail_out;
+    }
+
+    gweb_slowlog_start(&start);
+    if (mysql_stmt_execute(st->stmt)) {
+        goto __bail_out;
+    }
+
+    if (st->nr_cols && mysql_stmt_store_result(st->stmt)) {
+        goto __bail_out;
+    }
+
+    gweb_slowlog_stmt(conn, id, params, &start, st->nr_cols ?
+                      (unsigned long)mysql_stmt_num_rows(st->stmt) :
+                      (unsigned long)mysql_stmt_affected_rows(st->stmt));
+
+    return 0;
+
+__bail_out:
+    report_mysql_stmt_error(st);
+    err = mysql_stmt_errno(st->stmt);
+
+    /* Re-prepare on next use, the handle may not survive the error */
+    conn->stmts[id] = NULL;
+    gweb_mysql_stmt_close(st);
+
+    return err;
+}
+
+/*
+ * Execute a cached statement with the given parameters. Result sets
+ * are buffered on the client so other statements may run while rows
+ * are being fetched. Returns NULL on failure.
+ *
+ * A lost connection is re-established and the statement replayed
+ * once, unless a transaction is open or a write may have been applied
+ * before the connection dropped.
+ */
+struct gweb_mysql_stmt *
+gweb_mysql_stmt_execute (struct gweb_mysql_conn *conn, int id,
+                         MYSQL_BIND *params)
+{
+    unsigned int err;
+    int replay_safe, retries = 1;
+
+    while ((err = gweb_mysql_stmt_run(conn, id, params, &replay_safe)) != 0) {
+        if (!gweb_mysql_conn_lost(err)) {
+            return NULL;
+        }
+
+        if (conn->in_txn || (err == CR_SERVER_LOST && !replay_safe) || !retries--) {
+            conn->broken = 1;
+            return NULL;
+        }
+
+        if (gweb_mysql_reconnect(conn) != MYSQL_STATUS_OK) {
+            return NULL;
+        }
+    }
+
+    return conn->stmts[id];
+}
+
+MYSQL_ROW
+gweb_mysql_stmt_fetch (struct gweb_mysql_stmt *st)
+{
+    unsigned int col;
+    int ret;
+
+    ret = mysql_stmt_fetch(st->stmt);
+    if (ret == MYSQL_NO_DATA) {
+        return NULL;
+    }
+
+    if (ret == 1) {
+        report_mysql_stmt_error(st);
+        return NULL;
+    }
+
+    for (col = 0; col < st->nr_cols; col++) {
+        if (st->is_null[col]) {
+            st->row[col] = NULL;
+            continue;
+        }
+        st->row[col] = st->result[col].buffer;
+        if (st->length[col] > st->result[col].buffer_length) {
+            log_debug("%s: column %u truncated\n", gweb_stmt_name[st->id], col);
+            st->length[col] = st->result[col].buffer_length;
+        }
+        st->row[col][st->length[col]] = '\0';
+    }
+
+    return st->row;
+}
+
+int
+gweb_mysql_stmt_num_rows (struct gweb_mysql_stmt *st)
+{
+    return mysql_stmt_num_rows(st->stmt);
+}
+
+/* Release the buffered result, statement stays prepared */
+void
+gweb_mysql_stmt_done (struct gweb_mysql_stmt *st)
+{
+    if (st && st->nr_cols) {
+        mysql_stmt_free_result(st->stmt);
+    }
+}
+
+/*
+ * Statement text with the bound values printed in place of the
+ * placeholders, as a text query would carry them. Returns the length,
+ * -1 if it does not fit in size.
+ */
+int
+gweb_mysql_stmt_print (struct gweb_mysql_conn *conn, char *qry, size_t size,
+                       const char *sql, MYSQL_BIND *params)
+{
+    MYSQL_BIND *bind = params;
+    size_t len = 0, need;
+
+    for (; *sql; sql++) {
+        if (len + 2 >= size) {
+            return -1;
+        }
+        if (*sql != '?' || bind == NULL) {
+            qry[len++] = *sql;
+            continue;
+        }
+
+        switch (bind->buffer_type) {
+        case MYSQL_TYPE_STRING:
+            need = 2 * bind->buffer_length + 3;
+            if (len + need >= size) {
+                return -1;
+            }
+            qry[len++] = '\'';
+            len += mysql_real_escape_string(conn->mysql, &qry[len], bind->buffer,
+                                            bind->buffer_length);
+            qry[len++] = '\'';
+            break;
+        case MYSQL_TYPE_DOUBLE:
+            len += snprintf(&qry[len], size - len, "%.17g", *(double *)bind->buffer);
+            break;
+        case MYSQL_TYPE_LONG:
+            len += snprintf(&qry[len], size - len, "%d", *(int *)bind->buffer);
+            break;
+        default:
+            len += snprintf(&qry[len], size - len, "NULL");
+            break;
+        }
+        if (len >= size) {
+            return -1;
+        }
+        bind++;
+    }
+    qry[len] = '\0';
+
+    return len;
+}
+
+/* For queries requiring just a peek of records, -1 on failure */
+int
+gweb_mysql_stmt_count (struct gweb_mysql_stmt *st)
+{
+    int count;
+
+    if (st == NULL) {
+        return -1;
+    }
+
+    count = gweb_mysql_stmt_num_rows(st);
+    gweb_mysql_stmt_done(st);
+
+    return count;
+}
+
+void
+gweb_mysql_stmt_cache_free (struct gweb_mysql_conn *conn)
+{
+    int id;
+
+    for (id = 0; id < GWEB_STMT_MAX; id++) {
+        if (conn->stmts[id]) {
+            gweb_mysql_stmt_close(conn->stmts[id]);
+            conn->stmts[id] = NULL;
+        }
+    }
+}
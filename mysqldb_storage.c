@@ -0,0 +1,73 @@
+/*
+ * MySQL storage backend
+ *
+ * Sessions are pooled connections. Reads may go to a replica, writes
+ * always to the primary, and the key of a write is pinned so that its
+ * own reads right after stay on the primary.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <mysql.h>
+
+#include <gweb/common.h>
+#include <gweb/mysqldb_api.h>
+#include <gweb/mysqldb_pool.h>
+#include <gweb/storage.h>
+
+static void *
+gweb_mysql_session_get (const struct gweb_storage_handler *handler,
+                        int read_only, const char *key)
+{
+    struct gweb_mysql_conn *conn;
+
+    if (read_only) {
+        conn = gweb_mysql_pool_get_read(key);
+    } else {
+        conn = gweb_mysql_pool_get();
+    }
+
+    /* Pool exhausted or DB down */
+    if (conn == NULL) {
+        return NULL;
+    }
+
+    conn->caller = handler->name;
+    return conn;
+}
+
+static void
+gweb_mysql_session_put (void *session, int read_only, const char *key)
+{
+    gweb_mysql_pool_put(session);
+
+    if (!read_only) {
+        gweb_mysql_pin(key);
+    }
+}
+
+static int
+gweb_mysql_check_uid (const char *uid)
+{
+    struct gweb_mysql_conn *conn;
+    int count;
+
+    if ((conn = gweb_mysql_pool_get()) == NULL) {
+        return -1;
+    }
+    conn->caller = __func__;
+    count = gweb_mysql_check_uid_email(conn, uid, NULL);
+    gweb_mysql_pool_put(conn);
+
+    return (count < 0) ? -1 : (count > 0);
+}
+
+const struct gweb_storage_ops gweb_mysql_storage = {
+    .name        = "mysql",
+    .init        = gweb_mysql_init,
+    .shutdown    = gweb_mysql_shutdown,
+    .session_get = gweb_mysql_session_get,
+    .session_put = gweb_mysql_session_put,
+    .check_uid   = gweb_mysql_check_uid,
+    .handlers    = gweb_mysql_storage_handlers,
+};
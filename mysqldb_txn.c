@@ -0,0 +1,193 @@
+/*
+ * Pipelined write transactions
+ *
+ * A write path used to cost a round trip per statement, plus two for
+ * START TRANSACTION and COMMIT. Here the statements are printed into a
+ * single multi-statement text query (connections are opened with
+ * CLIENT_MULTI_STATEMENTS) and their results walked with
+ * mysql_next_result(). The server stops at the first failing
+ * statement, COMMIT is never reached and the transaction is rolled
+ * back.
+ *
+ * Values are printed and escaped as the slow query log does for
+ * EXPLAIN (gweb_mysql_stmt_print()), so the text carries exactly what
+ * the prepared statement would have bound.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <mysql.h>
+
+#include <gweb/common.h>
+#include <gweb/mysqldb_api.h>
+#include <gweb/mysqldb_pool.h>
+#include <gweb/mysqldb_stmt.h>
+#include <gweb/mysqldb_slowlog.h>
+#include <gweb/mysqldb_log.h>
+#include <gweb/mysqldb_txn.h>
+
+#define GWEB_MYSQL_TXN_START    "START TRANSACTION"
+#define GWEB_MYSQL_TXN_COMMIT   ";COMMIT"
+
+void
+gweb_mysql_txn_begin (struct gweb_mysql_txn *txn, struct gweb_mysql_conn *conn)
+{
+    memset(txn, 0, sizeof(struct gweb_mysql_txn));
+    txn->conn = conn;
+
+    if ((txn->qry = malloc(GWEB_MYSQL_TXN_QRYSZ)) == NULL) {
+        txn->failed = 1;
+        return;
+    }
+    txn->size = GWEB_MYSQL_TXN_QRYSZ;
+    txn->len = sprintf(txn->qry, GWEB_MYSQL_TXN_START);
+}
+
+/* Append ";<stmt>" with the values of params, growing the buffer */
+int
+gweb_mysql_txn_add (struct gweb_mysql_txn *txn, int id, MYSQL_BIND *params)
+{
+    size_t size;
+    char *grown;
+    int len;
+
+    if (txn->failed) {
+        return MYSQL_STATUS_FAIL;
+    }
+
+    if (txn->nr_stmts == GWEB_MYSQL_TXN_MAX_STMTS) {
+        log_error("%s: %s, too many statements\n", __func__, gweb_stmt_name[id]);
+        goto __bail_out;
+    }
+
+    while ((len = gweb_mysql_stmt_print(txn->conn, &txn->qry[txn->len + 1],
+                                        txn->size - txn->len - 1,
+                                        gweb_stmt_sql[id], params)) < 0) {
+        size = 2 * txn->size;
+        if (size > GWEB_MYSQL_TXN_MAX_QRYSZ ||
+            (grown = realloc(txn->qry, size)) == NULL) {
+            log_error("%s: %s, query too long\n", __func__, gweb_stmt_name[id]);
+            goto __bail_out;
+        }
+        txn->qry = grown;
+        txn->size = size;
+    }
+
+    txn->qry[txn->len] = ';';
+    txn->len += len + 1;
+    txn->ids[txn->nr_stmts++] = id;
+
+    return MYSQL_STATUS_OK;
+
+__bail_out:
+    txn->failed = 1;
+    return MYSQL_STATUS_FAIL;
+}
+
+void
+gweb_mysql_txn_abort (struct gweb_mysql_txn *txn)
+{
+    free(txn->qry);
+    txn->qry = NULL;
+}
+
+/* Timed as "TXN <stmt>+<stmt>..." in the slow query log */
+static void
+gweb_mysql_txn_name (struct gweb_mysql_txn *txn, char *name, size_t size)
+{
+    int idx, len;
+
+    len = snprintf(name, size, "TXN ");
+    for (idx = 0; idx < txn->nr_stmts && len < size; idx++) {
+        len += snprintf(&name[len], size - len, "%s%s", idx ? "+" : "",
+                        gweb_stmt_name[txn->ids[idx]]);
+    }
+}
+
+/*
+ * Send the transaction and walk the results. Result 0 is START
+ * TRANSACTION, 1..nr_stmts the statements added, the last one COMMIT.
+ * Replayed once on a connection that was gone before the query went
+ * out, nothing ran then.
+ */
+int
+gweb_mysql_txn_commit (struct gweb_mysql_txn *txn)
+{
+    struct gweb_mysql_conn *conn = txn->conn;
+    char name[GWEB_SLOWLOG_NAMESZ], *qry;
+    struct timespec start;
+    unsigned long rows = 0;
+    unsigned int err;
+    MYSQL_RES *res;
+    int idx, status, retries = 1, ret = MYSQL_STATUS_FAIL;
+
+    if (txn->failed || txn->nr_stmts == 0) {
+        goto __bail_out;
+    }
+
+    if (txn->len + sizeof(GWEB_MYSQL_TXN_COMMIT) > txn->size) {
+        if ((qry = realloc(txn->qry, txn->len + sizeof(GWEB_MYSQL_TXN_COMMIT))) == NULL) {
+            goto __bail_out;
+        }
+        txn->qry = qry;
+        txn->size = txn->len + sizeof(GWEB_MYSQL_TXN_COMMIT);
+    }
+    txn->len += sprintf(&txn->qry[txn->len], GWEB_MYSQL_TXN_COMMIT);
+
+    gweb_slowlog_start(&start);
+    while (mysql_real_query(conn->mysql, txn->qry, txn->len)) {
+        err = mysql_errno(conn->mysql);
+        report_mysql_error_noaction(conn->mysql);
+
+        if (!gweb_mysql_conn_lost(err)) {
+            goto __bail_out;
+        }
+        if (err != CR_SERVER_GONE_ERROR || !retries--) {
+            conn->broken = 1;
+            goto __bail_out;
+        }
+        if (gweb_mysql_reconnect(conn) != MYSQL_STATUS_OK) {
+            goto __bail_out;
+        }
+    }
+
+    conn->in_txn = 1;
+    for (idx = 0; ; idx++) {
+        /* Statements of a write path return no rows, drained anyway */
+        if ((res = mysql_store_result(conn->mysql)) != NULL) {
+            mysql_free_result(res);
+        } else if (idx > 0 && idx <= txn->nr_stmts) {
+            rows += (unsigned long)mysql_affected_rows(conn->mysql);
+        }
+
+        if ((status = mysql_next_result(conn->mysql)) != 0) {
+            break;
+        }
+    }
+    conn->in_txn = 0;
+
+    /* Positive on the first failing statement, the rest never ran */
+    if (status > 0) {
+        err = mysql_errno(conn->mysql);
+        idx++;
+        log_error("%s: %s\n", (idx > 0 && idx <= txn->nr_stmts) ?
+                  gweb_stmt_name[txn->ids[idx - 1]] : "COMMIT",
+                  mysql_error(conn->mysql));
+
+        if (gweb_mysql_conn_lost(err)) {
+            conn->broken = 1;
+        } else {
+            gweb_mysql_query(conn, "ROLLBACK");
+        }
+        goto __bail_out;
+    }
+
+    gweb_mysql_txn_name(txn, name, sizeof(name));
+    gweb_slowlog_text(conn, name, txn->qry, &start, rows);
+    ret = MYSQL_STATUS_OK;
+
+__bail_out:
+    gweb_mysql_txn_abort(txn);
+    return ret;
+}
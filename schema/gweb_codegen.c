@@ -0,0 +1,1357 @@
+/*
+ * API code generator
+ *
+ * Reads the API schema (schema/gweb_api.schema) and generates:
+ *
+ *   <outdir>/gweb/json_struct.h  message/response enums and structures
+ *   <outdir>/gweb/sql_gen.h      SQL templates
+ *   <outdir>/gweb/stmt_gen.h     prepared statement ids, typed
+ *                                execute wrappers and transaction
+ *                                wrappers of write statements
+ *   <outdir>/stmt_sql.c          statement text, names and parameter
+ *                                lists, also linked by the schema
+ *                                self-check
+ *   <outdir>/stmt_gen.c          statement and transaction wrappers
+ *   <outdir>/gweb/storage_gen.h  storage operation ids, one per API
+ *   <outdir>/json_gen.c          straight-line JSON parse, GET argument
+ *                                binders, response serializers and the
+ *                                API dispatch table
+ *   <outdir>/storage_gen.c       handler table of each storage backend
+ *
+ * Runs on the build host as part of the build, hence only depends on
+ * libc. Usage: gweb_codegen <schema-file> <outdir>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define CG_MAX_LINE       (1024)
+#define CG_MAX_TOKENS     (24)
+#define CG_MAX_NAME       (64)
+#define CG_MAX_FIELDS     (48)
+#define CG_MAX_TABLES     (64)
+#define CG_MAX_APIS       (64)
+#define CG_MAX_SQL        (128)
+#define CG_MAX_SQL_TEXT   (2048)
+#define CG_MAX_PATH       (512)
+#define CG_MAX_PARAMS     (CG_MAX_TOKENS - 2)
+
+enum {
+    CG_TABLE_MSG,
+    CG_TABLE_RESP,
+};
+
+struct cg_field {
+    char name[CG_MAX_NAME];     /* enum suffix, FIELD_<TBL>_<name> */
+    char key[CG_MAX_NAME];      /* JSON key */
+};
+
+struct cg_table {
+    int  type;
+    char name[CG_MAX_NAME];
+    int  lineno;
+
+    int  nr_fields;
+    struct cg_field fields[CG_MAX_FIELDS];
+
+    /* One array set per table, always trailing the fields */
+    int  has_array;
+    int  array_field;           /* MSG: field index carrying the array */
+    int  nr_afields;
+    struct cg_field afields[CG_MAX_FIELDS];
+};
+
+struct cg_api {
+    char name[CG_MAX_NAME];
+    char msg[CG_MAX_NAME];
+    char resp[CG_MAX_NAME];
+    char db[CG_MAX_NAME];
+    char url[CG_MAX_NAME];
+    char key[CG_MAX_NAME];      /* msg field routing/pinning the request */
+    int  read_only;
+    int  lineno;
+
+    struct cg_table *msg_tbl;
+    struct cg_table *resp_tbl;
+};
+
+/*
+ * Prepared statement parameter, 's' string, 'd' double, 'i' int. A
+ * name listed again binds the same wrapper argument to another '?'.
+ */
+struct cg_param {
+    char type;
+    char name[CG_MAX_NAME];
+    int  repeat;
+};
+
+struct cg_sql {
+    char name[CG_MAX_NAME];
+    char text[CG_MAX_SQL_TEXT]; /* fragments separated by '\n' */
+    int  nr_args;
+    int  lineno;
+
+    int  is_stmt;
+    struct cg_param params[CG_MAX_PARAMS];
+};
+
+struct cg_schema {
+    const char *file;
+
+    int nr_tables;
+    struct cg_table tables[CG_MAX_TABLES];
+
+    int nr_apis;
+    struct cg_api apis[CG_MAX_APIS];
+
+    int nr_sql;
+    struct cg_sql sql[CG_MAX_SQL];
+};
+
+static struct cg_schema g_schema;
+
+static void
+cg_die (int lineno, const char *fmt, ...)
+{
+    va_list ap;
+
+    if (lineno > 0) {
+        fprintf(stderr, "%s:%d: ", g_schema.file, lineno);
+    } else {
+        fprintf(stderr, "gweb_codegen: ");
+    }
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+
+    exit(1);
+}
+
+static void
+cg_copy_name (int lineno, char *dst, const char *src)
+{
+    if (strlen(src) >= CG_MAX_NAME) {
+        cg_die(lineno, "name '%s' too long", src);
+    }
+    strcpy(dst, src);
+}
+
+static void
+cg_upper (char *dst, const char *src)
+{
+    while (*src) {
+        *dst++ = toupper((unsigned char)*src++);
+    }
+    *dst = '\0';
+}
+
+/*
+ * Split a line into tokens, a token within double quotes is kept as
+ * is (without the quotes). Returns number of tokens.
+ */
+static int
+cg_tokenize (int lineno, char *line, char *tokens[])
+{
+    int count = 0;
+    char *p = line;
+
+    while (*p) {
+        while (isspace((unsigned char)*p))
+            p++;
+        if (*p == '\0' || *p == '#')
+            break;
+
+        if (count == CG_MAX_TOKENS) {
+            cg_die(lineno, "too many tokens");
+        }
+
+        if (*p == '"') {
+            tokens[count++] = ++p;
+            while (*p && *p != '"')
+                p++;
+            if (*p != '"') {
+                cg_die(lineno, "unterminated string");
+            }
+            *p++ = '\0';
+            continue;
+        }
+
+        tokens[count++] = p;
+        while (*p && !isspace((unsigned char)*p))
+            p++;
+        if (*p) {
+            *p++ = '\0';
+        }
+    }
+
+    return count;
+}
+
+static struct cg_table *
+cg_find_table (int type, const char *name)
+{
+    int idx;
+
+    for (idx = 0; idx < g_schema.nr_tables; idx++) {
+        if (g_schema.tables[idx].type == type &&
+            strcmp(g_schema.tables[idx].name, name) == 0) {
+            return &g_schema.tables[idx];
+        }
+    }
+
+    return NULL;
+}
+
+static int
+cg_find_field (struct cg_table *tbl, const char *name)
+{
+    int idx;
+
+    for (idx = 0; idx < tbl->nr_fields; idx++) {
+        if (strcmp(tbl->fields[idx].name, name) == 0)
+            return idx;
+    }
+
+    return -1;
+}
+
+/* Count printf conversions in a SQL template */
+static int
+cg_sql_count_args (const char *text)
+{
+    int count = 0;
+
+    for (; *text; text++) {
+        if (*text != '%')
+            continue;
+        if (text[1] == '%') {
+            text++;
+            continue;
+        }
+        count++;
+    }
+
+    return count;
+}
+
+/* Count '?' placeholders outside of quoted literals */
+static int
+cg_stmt_count_args (const char *text)
+{
+    int count = 0;
+    char quote = 0;
+
+    for (; *text; text++) {
+        if (quote) {
+            if (*text == quote)
+                quote = 0;
+        } else if (*text == '\'' || *text == '"') {
+            quote = *text;
+        } else if (*text == '?') {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+static void
+cg_parse_stmt_params (int lineno, struct cg_sql *sql, char *tok[], int ntok)
+{
+    struct cg_param *param;
+    int idx, prev;
+
+    for (idx = 0; idx < ntok; idx++) {
+        param = &sql->params[sql->nr_args];
+        if (strchr("sdi", tok[idx][0]) == NULL || tok[idx][0] == '\0' ||
+            tok[idx][1] != ':' || tok[idx][2] == '\0') {
+            cg_die(lineno, "bad parameter '%s', expected <s|d|i>:<name>",
+                   tok[idx]);
+        }
+        param->type = tok[idx][0];
+        cg_copy_name(lineno, param->name, &tok[idx][2]);
+
+        for (prev = 0; prev < sql->nr_args; prev++) {
+            if (strcmp(sql->params[prev].name, param->name) == 0) {
+                if (sql->params[prev].type != param->type) {
+                    cg_die(lineno, "parameter '%s' repeated with another type",
+                           param->name);
+                }
+                param->repeat = 1;
+                break;
+            }
+        }
+        sql->nr_args++;
+    }
+}
+
+enum {
+    CG_STATE_TOP,
+    CG_STATE_TABLE,
+    CG_STATE_ARRAY,
+    CG_STATE_SQL,
+};
+
+static void
+cg_parse_schema (const char *file)
+{
+    FILE *fp;
+    char line[CG_MAX_LINE], *tok[CG_MAX_TOKENS];
+    int lineno = 0, ntok, state = CG_STATE_TOP, type, idx;
+    struct cg_table *tbl = NULL;
+    struct cg_field *fld;
+    struct cg_api *api;
+    struct cg_sql *sql = NULL;
+
+    g_schema.file = file;
+
+    if ((fp = fopen(file, "r")) == NULL) {
+        cg_die(0, "cannot open %s (%s)", file, strerror(errno));
+    }
+
+    while (fgets(line, sizeof(line), fp)) {
+        lineno++;
+        if ((ntok = cg_tokenize(lineno, line, tok)) == 0)
+            continue;
+
+        switch (state) {
+        case CG_STATE_TOP:
+            if (strcmp(tok[0], "msg") == 0 || strcmp(tok[0], "resp") == 0) {
+                if (ntok != 2) {
+                    cg_die(lineno, "usage: %s <name>", tok[0]);
+                }
+                type = (tok[0][0] == 'm') ? CG_TABLE_MSG : CG_TABLE_RESP;
+                if (cg_find_table(type, tok[1])) {
+                    cg_die(lineno, "duplicate %s '%s'", tok[0], tok[1]);
+                }
+                if (g_schema.nr_tables == CG_MAX_TABLES) {
+                    cg_die(lineno, "too many tables");
+                }
+                tbl = &g_schema.tables[g_schema.nr_tables++];
+                tbl->type = type;
+                tbl->lineno = lineno;
+                tbl->array_field = -1;
+                cg_copy_name(lineno, tbl->name, tok[1]);
+                state = CG_STATE_TABLE;
+
+            } else if (strcmp(tok[0], "api") == 0) {
+                if (ntok < 5) {
+                    cg_die(lineno, "usage: api <name> <msg> <resp> <db> "
+                           "[get <url>] [read] [key <FIELD>]");
+                }
+                if (g_schema.nr_apis == CG_MAX_APIS) {
+                    cg_die(lineno, "too many APIs");
+                }
+                api = &g_schema.apis[g_schema.nr_apis++];
+                api->lineno = lineno;
+                cg_copy_name(lineno, api->name, tok[1]);
+                cg_copy_name(lineno, api->msg, tok[2]);
+                cg_copy_name(lineno, api->resp, tok[3]);
+                cg_copy_name(lineno, api->db, tok[4]);
+                for (idx = 5; idx < ntok; idx++) {
+                    if (strcmp(tok[idx], "get") == 0 && idx + 1 < ntok &&
+                        !api->url[0]) {
+                        cg_copy_name(lineno, api->url, tok[++idx]);
+                    } else if (strcmp(tok[idx], "key") == 0 && idx + 1 < ntok &&
+                               !api->key[0]) {
+                        cg_copy_name(lineno, api->key, tok[++idx]);
+                    } else if (strcmp(tok[idx], "read") == 0 && !api->read_only) {
+                        api->read_only = 1;
+                    } else {
+                        cg_die(lineno, "unexpected '%s' in api", tok[idx]);
+                    }
+                }
+
+            } else if (strcmp(tok[0], "sql") == 0 || strcmp(tok[0], "stmt") == 0) {
+                if (tok[0][1] == 'q' && ntok != 2) {
+                    cg_die(lineno, "usage: sql <NAME>");
+                }
+                if (ntok < 2) {
+                    cg_die(lineno, "usage: stmt <NAME> [<type>:<param> ...]");
+                }
+                if (g_schema.nr_sql == CG_MAX_SQL) {
+                    cg_die(lineno, "too many SQL templates");
+                }
+                sql = &g_schema.sql[g_schema.nr_sql++];
+                sql->lineno = lineno;
+                cg_copy_name(lineno, sql->name, tok[1]);
+                if (tok[0][1] == 't') {
+                    sql->is_stmt = 1;
+                    cg_parse_stmt_params(lineno, sql, &tok[2], ntok - 2);
+                }
+                state = CG_STATE_SQL;
+
+            } else {
+                cg_die(lineno, "unknown statement '%s'", tok[0]);
+            }
+            break;
+
+        case CG_STATE_TABLE:
+        case CG_STATE_ARRAY:
+            if (strcmp(tok[0], "end") == 0) {
+                if (state == CG_STATE_TABLE && tbl->nr_fields == 0) {
+                    cg_die(lineno, "'%s' has no fields", tbl->name);
+                }
+                if (state == CG_STATE_ARRAY && tbl->nr_afields == 0) {
+                    cg_die(lineno, "empty array in '%s'", tbl->name);
+                }
+                state = (state == CG_STATE_ARRAY) ? CG_STATE_TABLE : CG_STATE_TOP;
+                break;
+            }
+
+            if (strcmp(tok[0], "array") == 0 && state == CG_STATE_TABLE) {
+                if (tbl->has_array) {
+                    cg_die(lineno, "only one array per table supported");
+                }
+                if (tbl->type == CG_TABLE_MSG) {
+                    if (ntok != 2) {
+                        cg_die(lineno, "usage: array <FIELD>");
+                    }
+                    if ((tbl->array_field = cg_find_field(tbl, tok[1])) < 0) {
+                        cg_die(lineno, "unknown array field '%s'", tok[1]);
+                    }
+                } else if (ntok != 1) {
+                    cg_die(lineno, "usage: array");
+                }
+                tbl->has_array = 1;
+                state = CG_STATE_ARRAY;
+                break;
+            }
+
+            if (strcmp(tok[0], "field") != 0 || ntok != 3) {
+                cg_die(lineno, "usage: field <NAME> <json-key>");
+            }
+
+            if (state == CG_STATE_TABLE) {
+                if (tbl->has_array) {
+                    cg_die(lineno, "fields must precede the array");
+                }
+                if (cg_find_field(tbl, tok[1]) >= 0) {
+                    cg_die(lineno, "duplicate field '%s'", tok[1]);
+                }
+                if (tbl->nr_fields == CG_MAX_FIELDS) {
+                    cg_die(lineno, "too many fields");
+                }
+                fld = &tbl->fields[tbl->nr_fields++];
+            } else {
+                if (tbl->nr_afields == CG_MAX_FIELDS) {
+                    cg_die(lineno, "too many array fields");
+                }
+                fld = &tbl->afields[tbl->nr_afields++];
+            }
+            cg_copy_name(lineno, fld->name, tok[1]);
+            cg_copy_name(lineno, fld->key, tok[2]);
+            break;
+
+        case CG_STATE_SQL:
+            if (strcmp(tok[0], "end") == 0 && ntok == 1) {
+                if (sql->text[0] == '\0') {
+                    cg_die(lineno, "empty SQL template '%s'", sql->name);
+                }
+                if (!sql->is_stmt) {
+                    sql->nr_args = cg_sql_count_args(sql->text);
+                } else if (cg_stmt_count_args(sql->text) != sql->nr_args) {
+                    cg_die(sql->lineno, "'%s' has %d placeholders, %d parameters",
+                           sql->name, cg_stmt_count_args(sql->text), sql->nr_args);
+                }
+                state = CG_STATE_TOP;
+                break;
+            }
+            if (ntok != 1 || strchr(tok[0], '\\')) {
+                cg_die(lineno, "expected one quoted SQL fragment");
+            }
+            if (strlen(sql->text) + strlen(tok[0]) + 2 >= CG_MAX_SQL_TEXT) {
+                cg_die(lineno, "SQL template too long");
+            }
+            strcat(sql->text, tok[0]);
+            strcat(sql->text, "\n");
+            break;
+        }
+    }
+
+    fclose(fp);
+
+    if (state != CG_STATE_TOP) {
+        cg_die(lineno, "unexpected end of file");
+    }
+}
+
+static void
+cg_validate_schema (void)
+{
+    struct cg_api *api;
+    int idx, jdx;
+
+    for (idx = 0; idx < g_schema.nr_sql; idx++) {
+        for (jdx = 0; jdx < idx; jdx++) {
+            if (g_schema.sql[jdx].is_stmt == g_schema.sql[idx].is_stmt &&
+                strcmp(g_schema.sql[jdx].name, g_schema.sql[idx].name) == 0) {
+                cg_die(g_schema.sql[idx].lineno, "duplicate SQL '%s'",
+                       g_schema.sql[idx].name);
+            }
+        }
+    }
+
+    for (idx = 0; idx < g_schema.nr_apis; idx++) {
+        api = &g_schema.apis[idx];
+
+        if ((api->msg_tbl = cg_find_table(CG_TABLE_MSG, api->msg)) == NULL) {
+            cg_die(api->lineno, "unknown msg '%s'", api->msg);
+        }
+        if ((api->resp_tbl = cg_find_table(CG_TABLE_RESP, api->resp)) == NULL) {
+            cg_die(api->lineno, "unknown resp '%s'", api->resp);
+        }
+        if (api->url[0] && api->msg_tbl->has_array) {
+            cg_die(api->lineno, "GET API cannot carry an array message");
+        }
+        if (api->key[0] && cg_find_field(api->msg_tbl, api->key) < 0) {
+            cg_die(api->lineno, "unknown key field '%s' in msg '%s'",
+                   api->key, api->msg);
+        }
+        for (jdx = 0; jdx < idx; jdx++) {
+            if (strcmp(g_schema.apis[jdx].name, api->name) == 0) {
+                cg_die(api->lineno, "duplicate API '%s'", api->name);
+            }
+            if (g_schema.apis[jdx].msg_tbl == api->msg_tbl) {
+                cg_die(api->lineno, "msg '%s' bound to more than one API",
+                       api->msg);
+            }
+            if (api->url[0] && strcmp(g_schema.apis[jdx].url, api->url) == 0) {
+                cg_die(api->lineno, "duplicate GET url '%s'", api->url);
+            }
+            if (strcmp(g_schema.apis[jdx].db, api->db) == 0) {
+                cg_die(api->lineno, "db handler '%s' bound to more than one API",
+                       api->db);
+            }
+        }
+    }
+}
+
+static FILE *
+cg_open_output (const char *outdir, const char *name)
+{
+    char path[CG_MAX_PATH];
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "%s/%s", outdir, name);
+    if ((fp = fopen(path, "w")) == NULL) {
+        cg_die(0, "cannot create %s (%s)", path, strerror(errno));
+    }
+
+    fprintf(fp, "/*\n * Generated by gweb_codegen from %s -- DO NOT EDIT.\n */\n",
+            g_schema.file);
+
+    return fp;
+}
+
+/*
+ * gweb/json_struct.h
+ */
+static void
+cg_emit_table_enum (FILE *fp, struct cg_table *tbl)
+{
+    char uname[CG_MAX_NAME], prefix[CG_MAX_NAME * 2];
+    int idx;
+
+    cg_upper(uname, tbl->name);
+    snprintf(prefix, sizeof(prefix), "FIELD_%s%s", uname,
+             (tbl->type == CG_TABLE_RESP) ? "_RESP" : "");
+
+    fprintf(fp, "enum _JSON_C_%s_%s_FIELDS {\n", uname,
+            (tbl->type == CG_TABLE_RESP) ? "RESP" : "MSG");
+    for (idx = 0; idx < tbl->nr_fields; idx++) {
+        fprintf(fp, "    %s_%s,\n", prefix, tbl->fields[idx].name);
+    }
+    if (tbl->has_array) {
+        fprintf(fp, "    %s_ARRAY_START,\n", prefix);
+        for (idx = 0; idx < tbl->nr_afields; idx++) {
+            fprintf(fp, "    %s_%s,\n", prefix, tbl->afields[idx].name);
+        }
+        fprintf(fp, "    %s_ARRAY_END,\n", prefix);
+    }
+    fprintf(fp, "    %s_MAX,\n};\n\n", prefix);
+}
+
+static void
+cg_emit_table_struct (FILE *fp, struct cg_table *tbl)
+{
+    const char *sfx = (tbl->type == CG_TABLE_RESP) ? "resp" : "msg";
+    const char *ctype = (tbl->type == CG_TABLE_RESP) ? "char" : "const char";
+    char uname[CG_MAX_NAME], prefix[CG_MAX_NAME * 2];
+
+    cg_upper(uname, tbl->name);
+    snprintf(prefix, sizeof(prefix), "FIELD_%s%s", uname,
+             (tbl->type == CG_TABLE_RESP) ? "_RESP" : "");
+
+    if (!tbl->has_array) {
+        fprintf(fp, "struct j2c_%s_%s {\n    %s *fields[%s_MAX];\n};\n\n",
+                tbl->name, sfx, ctype, prefix);
+        return;
+    }
+
+    fprintf(fp, "struct j2c_%s_%s_array1 {\n"
+            "    %s *fields[%s_ARRAY_END - %s_ARRAY_START];\n};\n\n",
+            tbl->name, sfx, ctype, prefix, prefix);
+    fprintf(fp, "struct j2c_%s_%s {\n"
+            "    %s *fields[%s_ARRAY_START];\n"
+            "    int nr_array1_records;\n"
+            "    struct j2c_%s_%s_array1 *array1;\n};\n\n",
+            tbl->name, sfx, ctype, prefix, tbl->name, sfx);
+}
+
+static void
+cg_emit_struct_header (const char *outdir)
+{
+    FILE *fp = cg_open_output(outdir, "gweb/json_struct.h");
+    struct cg_table *tbl;
+    char uname[CG_MAX_NAME];
+    int idx, type;
+
+    fprintf(fp, "#ifndef JSON_STRUCT_H\n#define JSON_STRUCT_H\n\n");
+
+    fprintf(fp, "/*\n * JSON to C structure map used by MySQL and other "
+            "dump routines. Each\n * message below has a corresponding "
+            "response structure.\n */\n");
+
+    for (type = CG_TABLE_MSG; type <= CG_TABLE_RESP; type++) {
+        const char *sfx = (type == CG_TABLE_MSG) ? "MSG" : "RESP";
+
+        fprintf(fp, "enum {\n    /* %s-START */ JSON_C_%s_MIN,\n", sfx, sfx);
+        for (idx = 0; idx < g_schema.nr_tables; idx++) {
+            tbl = &g_schema.tables[idx];
+            if (tbl->type != type)
+                continue;
+            cg_upper(uname, tbl->name);
+            fprintf(fp, "    JSON_C_%s_%s,\n", uname, sfx);
+        }
+        fprintf(fp, "    /* %s-END */ JSON_C_%s_MAX,\n};\n\n", sfx, sfx);
+    }
+
+    for (idx = 0; idx < g_schema.nr_tables; idx++) {
+        cg_emit_table_enum(fp, &g_schema.tables[idx]);
+    }
+
+    fprintf(fp, "#define J2C_MSG_TABLE(name, ...)  "
+            "struct j2c_##name##_msg __VA_ARGS__\n");
+    fprintf(fp, "#define J2C_RESP_TABLE(name, ...) "
+            "struct j2c_##name##_resp __VA_ARGS__\n\n");
+
+    for (idx = 0; idx < g_schema.nr_tables; idx++) {
+        cg_emit_table_struct(fp, &g_schema.tables[idx]);
+    }
+
+    for (type = CG_TABLE_MSG; type <= CG_TABLE_RESP; type++) {
+        const char *sfx = (type == CG_TABLE_MSG) ? "msg" : "resp";
+
+        fprintf(fp, "typedef union {\n");
+        for (idx = 0; idx < g_schema.nr_tables; idx++) {
+            tbl = &g_schema.tables[idx];
+            if (tbl->type != type)
+                continue;
+            fprintf(fp, "    struct j2c_%s_%s %s;\n", tbl->name, sfx, tbl->name);
+        }
+        fprintf(fp, "} j2c_%s_t;\n\n", sfx);
+    }
+
+    fprintf(fp, "#endif // JSON_STRUCT_H\n");
+    fclose(fp);
+}
+
+/*
+ * gweb/sql_gen.h
+ */
+static void
+cg_emit_sql_header (const char *outdir)
+{
+    FILE *fp = cg_open_output(outdir, "gweb/sql_gen.h");
+    struct cg_sql *sql;
+    char *frag, *next;
+    int idx;
+
+    fprintf(fp, "#ifndef SQL_GEN_H\n#define SQL_GEN_H\n\n");
+
+    for (idx = 0; idx < g_schema.nr_sql; idx++) {
+        sql = &g_schema.sql[idx];
+        if (sql->is_stmt)
+            continue;
+
+        fprintf(fp, "#define GWEB_SQL_%s_NR_ARGS  (%d)\n", sql->name,
+                sql->nr_args);
+        fprintf(fp, "#define GWEB_SQL_%s", sql->name);
+        for (frag = sql->text; *frag; frag = next + 1) {
+            next = strchr(frag, '\n');
+            fprintf(fp, " \\\n    \"%.*s\"", (int)(next - frag), frag);
+        }
+        fprintf(fp, "\n\n");
+    }
+
+    fprintf(fp, "#endif // SQL_GEN_H\n");
+    fclose(fp);
+}
+
+/*
+ * gweb/stmt_gen.h, stmt_sql.c and stmt_gen.c
+ */
+/*
+ * Write statements also get a gweb_txn_<stmt>() wrapper adding them
+ * to a pipelined transaction (mysqldb_txn.c)
+ */
+static int
+cg_stmt_is_write (struct cg_sql *sql)
+{
+    static const char *verbs[] = { "INSERT", "UPDATE", "DELETE", "REPLACE" };
+    int idx;
+
+    for (idx = 0; idx < sizeof(verbs) / sizeof(verbs[0]); idx++) {
+        if (strncasecmp(sql->text, verbs[idx], strlen(verbs[idx])) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void
+cg_emit_stmt_prototype (FILE *fp, struct cg_sql *sql, int txn)
+{
+    static const char *ctype[] = {
+        ['s'] = "const char *",
+        ['d'] = "double ",
+        ['i'] = "int ",
+    };
+    char lname[CG_MAX_NAME];
+    int idx, col;
+
+    for (idx = 0; sql->name[idx]; idx++) {
+        lname[idx] = tolower((unsigned char)sql->name[idx]);
+    }
+    lname[idx] = '\0';
+
+    if (txn) {
+        col = fprintf(fp, "gweb_txn_%s (", lname);
+        fprintf(fp, "struct gweb_mysql_txn *txn");
+    } else {
+        col = fprintf(fp, "gweb_stmt_%s (", lname);
+        fprintf(fp, "struct gweb_mysql_conn *conn");
+    }
+    for (idx = 0; idx < sql->nr_args; idx++) {
+        if (sql->params[idx].repeat)
+            continue;
+        fprintf(fp, ",\n%*s%s%s", col, "", ctype[(int)sql->params[idx].type],
+                sql->params[idx].name);
+    }
+    fprintf(fp, ")");
+}
+
+static void
+cg_emit_stmt_header (const char *outdir)
+{
+    FILE *fp = cg_open_output(outdir, "gweb/stmt_gen.h");
+    struct cg_sql *sql;
+    int idx;
+
+    fprintf(fp, "#ifndef STMT_GEN_H\n#define STMT_GEN_H\n\n");
+    fprintf(fp, "struct gweb_mysql_conn;\nstruct gweb_mysql_stmt;\n"
+            "struct gweb_mysql_txn;\n\n");
+
+    fprintf(fp, "enum gweb_stmt_id {\n");
+    for (idx = 0; idx < g_schema.nr_sql; idx++) {
+        if (g_schema.sql[idx].is_stmt) {
+            fprintf(fp, "    GWEB_STMT_%s,\n", g_schema.sql[idx].name);
+        }
+    }
+    fprintf(fp, "    GWEB_STMT_MAX,\n};\n\n");
+
+    fprintf(fp, "extern const char *const gweb_stmt_sql[GWEB_STMT_MAX];\n"
+            "extern const char *const gweb_stmt_name[GWEB_STMT_MAX];\n");
+    fprintf(fp, "/* Parameters as listed in the schema, \"s:uid s:email\" */\n"
+            "extern const char *const gweb_stmt_params[GWEB_STMT_MAX];\n\n");
+
+    /* Typed wrappers, bind parameters and execute */
+    for (idx = 0; idx < g_schema.nr_sql; idx++) {
+        sql = &g_schema.sql[idx];
+        if (!sql->is_stmt)
+            continue;
+        fprintf(fp, "extern struct gweb_mysql_stmt *\n");
+        cg_emit_stmt_prototype(fp, sql, 0);
+        fprintf(fp, ";\n\n");
+    }
+
+    /* Same arguments, added to a transaction */
+    for (idx = 0; idx < g_schema.nr_sql; idx++) {
+        sql = &g_schema.sql[idx];
+        if (!sql->is_stmt || !cg_stmt_is_write(sql))
+            continue;
+        fprintf(fp, "extern int\n");
+        cg_emit_stmt_prototype(fp, sql, 1);
+        fprintf(fp, ";\n\n");
+    }
+
+    fprintf(fp, "#endif // STMT_GEN_H\n");
+    fclose(fp);
+}
+
+static void
+cg_emit_stmt_text (const char *outdir)
+{
+    FILE *fp = cg_open_output(outdir, "stmt_sql.c");
+    struct cg_sql *sql;
+    char *frag, *next;
+    int idx, jdx;
+
+    fprintf(fp, "#include <gweb/stmt_gen.h>\n\n");
+
+    fprintf(fp, "const char *const gweb_stmt_sql[GWEB_STMT_MAX] = {\n");
+    for (idx = 0; idx < g_schema.nr_sql; idx++) {
+        sql = &g_schema.sql[idx];
+        if (!sql->is_stmt)
+            continue;
+        fprintf(fp, "    [GWEB_STMT_%s] =", sql->name);
+        for (frag = sql->text; *frag; frag = next + 1) {
+            next = strchr(frag, '\n');
+            fprintf(fp, "\n        \"%.*s\"", (int)(next - frag), frag);
+        }
+        fprintf(fp, ",\n");
+    }
+    fprintf(fp, "};\n\n");
+
+    fprintf(fp, "const char *const gweb_stmt_name[GWEB_STMT_MAX] = {\n");
+    for (idx = 0; idx < g_schema.nr_sql; idx++) {
+        sql = &g_schema.sql[idx];
+        if (sql->is_stmt) {
+            fprintf(fp, "    [GWEB_STMT_%s] = \"%s\",\n", sql->name, sql->name);
+        }
+    }
+    fprintf(fp, "};\n\n");
+
+    fprintf(fp, "const char *const gweb_stmt_params[GWEB_STMT_MAX] = {\n");
+    for (idx = 0; idx < g_schema.nr_sql; idx++) {
+        sql = &g_schema.sql[idx];
+        if (!sql->is_stmt)
+            continue;
+        fprintf(fp, "    [GWEB_STMT_%s] = \"", sql->name);
+        for (jdx = 0; jdx < sql->nr_args; jdx++) {
+            fprintf(fp, "%s%c:%s", jdx ? " " : "", sql->params[jdx].type,
+                    sql->params[jdx].name);
+        }
+        fprintf(fp, "\",\n");
+    }
+    fprintf(fp, "};\n");
+
+    fclose(fp);
+}
+
+static void
+cg_emit_stmt_source (const char *outdir)
+{
+    FILE *fp = cg_open_output(outdir, "stmt_gen.c");
+    static const char *binder[] = {
+        ['s'] = "gweb_mysql_bind_string(&bind[%d], %s);\n",
+        ['d'] = "gweb_mysql_bind_double(&bind[%d], &%s);\n",
+        ['i'] = "gweb_mysql_bind_int(&bind[%d], &%s);\n",
+    };
+    static const char *call[] = {
+        "gweb_mysql_stmt_execute(conn",
+        "gweb_mysql_txn_add(txn",
+    };
+    struct cg_sql *sql;
+    int idx, jdx, txn;
+
+    fprintf(fp,
+            "#include <string.h>\n\n"
+            "#include <mysql.h>\n\n"
+            "#include <gweb/stmt_gen.h>\n"
+            "#include <gweb/mysqldb_stmt.h>\n"
+            "#include <gweb/mysqldb_txn.h>\n");
+
+    for (idx = 0; idx < g_schema.nr_sql; idx++) {
+        sql = &g_schema.sql[idx];
+        if (!sql->is_stmt)
+            continue;
+
+        for (txn = 0; txn <= cg_stmt_is_write(sql); txn++) {
+            fprintf(fp, txn ? "\nint\n" : "\nstruct gweb_mysql_stmt *\n");
+            cg_emit_stmt_prototype(fp, sql, txn);
+            fprintf(fp, "\n{\n");
+            if (sql->nr_args == 0) {
+                fprintf(fp, "    return %s, GWEB_STMT_%s, NULL);\n}\n",
+                        call[txn], sql->name);
+                continue;
+            }
+            fprintf(fp, "    MYSQL_BIND bind[%d];\n\n", sql->nr_args);
+            fprintf(fp, "    memset(bind, 0, sizeof(bind));\n");
+            for (jdx = 0; jdx < sql->nr_args; jdx++) {
+                fprintf(fp, "    ");
+                fprintf(fp, binder[(int)sql->params[jdx].type], jdx,
+                        sql->params[jdx].name);
+            }
+            fprintf(fp, "\n    return %s, GWEB_STMT_%s, bind);\n}\n",
+                    call[txn], sql->name);
+        }
+    }
+
+    fclose(fp);
+}
+
+/*
+ * json_gen.c
+ */
+static void
+cg_emit_parser (FILE *fp, struct cg_table *tbl)
+{
+    char uname[CG_MAX_NAME];
+    int idx;
+
+    cg_upper(uname, tbl->name);
+
+    if (tbl->has_array) {
+        fprintf(fp,
+                "static void\n"
+                "gweb_json_parse_array_record_%s (struct json_object *jarr,\n"
+                "                                 struct j2c_%s_msg *j2ctbl)\n"
+                "{\n"
+                "    struct j2c_%s_msg_array1 *arr;\n"
+                "    struct json_object *jelem;\n"
+                "    int rcount, idx;\n\n"
+                "    j2ctbl->nr_array1_records = 0;\n"
+                "    j2ctbl->array1 = NULL;\n\n"
+                "    rcount = json_object_array_length(jarr);\n"
+                "    if (rcount == 0) {\n"
+                "        return;\n"
+                "    }\n"
+                "    if ((j2ctbl->array1 = calloc(sizeof(*arr), rcount)) == NULL) {\n"
+                "        return;\n"
+                "    }\n"
+                "    for (idx = 0; idx < rcount; idx++) {\n"
+                "        if (!(jelem = json_object_array_get_idx(jarr, idx))) {\n"
+                "            continue;\n"
+                "        }\n"
+                "        arr = &j2ctbl->array1[idx];\n",
+                tbl->name, tbl->name, tbl->name);
+        for (idx = 0; idx < tbl->nr_afields; idx++) {
+            fprintf(fp, "        arr->fields[FIELD_%s_%s - FIELD_%s_ARRAY_START - 1] =\n"
+                    "            json_gen_get_string(jelem, \"%s\");\n",
+                    uname, tbl->afields[idx].name, uname, tbl->afields[idx].key);
+        }
+        fprintf(fp, "    }\n    j2ctbl->nr_array1_records = rcount;\n}\n\n");
+
+        fprintf(fp,
+                "static void\n"
+                "gweb_json_free_array_handler_%s (j2c_msg_t *j2cmsg)\n"
+                "{\n"
+                "    struct j2c_%s_msg *j2ctbl = &j2cmsg->%s;\n\n"
+                "    if (j2ctbl->array1) {\n"
+                "        free(j2ctbl->array1);\n"
+                "        j2ctbl->nr_array1_records = 0;\n"
+                "        j2ctbl->array1 = NULL;\n"
+                "    }\n"
+                "}\n\n",
+                tbl->name, tbl->name, tbl->name);
+    }
+
+    fprintf(fp,
+            "static int\n"
+            "gweb_json_parse_record_%s (struct json_object *jobj, j2c_msg_t *j2cmsg)\n"
+            "{\n"
+            "    struct j2c_%s_msg *j2ctbl = &j2cmsg->%s;\n",
+            tbl->name, tbl->name, tbl->name);
+    if (tbl->has_array) {
+        fprintf(fp, "    struct json_object *jfield;\n");
+    }
+    fprintf(fp, "\n");
+    for (idx = 0; idx < tbl->nr_fields; idx++) {
+        fprintf(fp, "    j2ctbl->fields[FIELD_%s_%s] = "
+                "json_gen_get_string(jobj, \"%s\");\n",
+                uname, tbl->fields[idx].name, tbl->fields[idx].key);
+    }
+    if (tbl->has_array) {
+        fprintf(fp, "\n"
+                "    j2ctbl->nr_array1_records = 0;\n"
+                "    j2ctbl->array1 = NULL;\n"
+                "    if (json_object_object_get_ex(jobj, \"%s\", &jfield) &&\n"
+                "        json_object_get_array(jfield) != NULL) {\n"
+                "        gweb_json_parse_array_record_%s(jfield, j2ctbl);\n"
+                "    }\n",
+                tbl->fields[tbl->array_field].key, tbl->name);
+    }
+    fprintf(fp, "\n    return 0;\n}\n\n");
+
+    fprintf(fp,
+            "static void\n"
+            "gweb_json_dump_%s (j2c_msg_t *j2cmsg)\n"
+            "{\n",
+            tbl->name);
+    for (idx = 0; idx < tbl->nr_fields; idx++) {
+        fprintf(fp, "    log_debug(\"<JSON-PARSE: (%s)> %%s => %%s\\n\", \"%s\",\n"
+                "              j2cmsg->%s.fields[FIELD_%s_%s]);\n",
+                tbl->name, tbl->fields[idx].key, tbl->name, uname,
+                tbl->fields[idx].name);
+    }
+    fprintf(fp, "}\n\n");
+}
+
+static void
+cg_emit_get_binder (FILE *fp, struct cg_table *tbl)
+{
+    char uname[CG_MAX_NAME];
+    int idx;
+
+    cg_upper(uname, tbl->name);
+
+    fprintf(fp,
+            "static int\n"
+            "gweb_json_get_record_%s (void *connection, j2c_msg_t *j2cmsg)\n"
+            "{\n"
+            "    struct j2c_%s_msg *j2ctbl = &j2cmsg->%s;\n\n",
+            tbl->name, tbl->name, tbl->name);
+    for (idx = 0; idx < tbl->nr_fields; idx++) {
+        fprintf(fp, "    j2ctbl->fields[FIELD_%s_%s] =\n"
+                "        MHD_lookup_connection_value(connection, "
+                "MHD_GET_ARGUMENT_KIND, \"%s\");\n",
+                uname, tbl->fields[idx].name, tbl->fields[idx].key);
+    }
+    fprintf(fp, "\n    return 0;\n}\n\n");
+}
+
+static void
+cg_emit_push_field (FILE *fp, const char *indent, const char *key,
+                    const char *var, const char *index)
+{
+    /* "key":" is pushed as a literal with precomputed length */
+    fprintf(fp, "%sjson_gen_push_field(&jbuf, \"\\\"%s\\\":\\\"\", %d,\n"
+            "%s                    %s->fields[%s]);\n",
+            indent, key, (int)strlen(key) + 4, indent, var, index);
+}
+
+static void
+cg_emit_serializer (FILE *fp, struct cg_table *tbl)
+{
+    char uname[CG_MAX_NAME], index[CG_MAX_NAME * 4];
+    int idx;
+
+    cg_upper(uname, tbl->name);
+
+    fprintf(fp,
+            "static int\n"
+            "gweb_json_gen_response_%s (j2c_resp_t *j2cresp, char **response)\n"
+            "{\n"
+            "    struct j2c_%s_resp *j2ctbl = &j2cresp->%s;\n",
+            tbl->name, tbl->name, tbl->name);
+    if (tbl->has_array) {
+        fprintf(fp, "    struct j2c_%s_resp_array1 *j2carr;\n    int idx;\n",
+                tbl->name);
+    }
+    fprintf(fp,
+            "    struct json_gen_buf jbuf;\n\n"
+            "    if (!response || json_gen_buf_init(&jbuf, MAX_RESPONSE_BYTES)) {\n"
+            "        return 1;\n"
+            "    }\n\n"
+            "    json_gen_push(&jbuf, \"{\\\"status\\\":{\", 11);\n");
+
+    for (idx = 0; idx < tbl->nr_fields; idx++) {
+        snprintf(index, sizeof(index), "FIELD_%s_RESP_%s", uname,
+                 tbl->fields[idx].name);
+        cg_emit_push_field(fp, "    ", tbl->fields[idx].key, "j2ctbl", index);
+    }
+
+    if (tbl->has_array) {
+        fprintf(fp,
+                "\n"
+                "    if (j2ctbl->nr_array1_records >= 0) {\n"
+                "        json_gen_push(&jbuf, \"\\\"array1\\\":[\", 10);\n"
+                "        for (idx = 0; idx < j2ctbl->nr_array1_records; idx++) {\n"
+                "            j2carr = &j2ctbl->array1[idx];\n"
+                "            json_gen_push(&jbuf, \"{\", 1);\n");
+        for (idx = 0; idx < tbl->nr_afields; idx++) {
+            snprintf(index, sizeof(index),
+                     "FIELD_%s_RESP_%s - FIELD_%s_RESP_ARRAY_START - 1",
+                     uname, tbl->afields[idx].name, uname);
+            cg_emit_push_field(fp, "            ", tbl->afields[idx].key,
+                               "j2carr", index);
+        }
+        fprintf(fp,
+                "            json_gen_trim_comma(&jbuf);\n"
+                "            json_gen_push(&jbuf, \"},\", 2);\n"
+                "        }\n"
+                "        json_gen_trim_comma(&jbuf);\n"
+                "        json_gen_push(&jbuf, \"],\", 2);\n"
+                "    }\n");
+    }
+
+    fprintf(fp,
+            "\n"
+            "    /* Remove trailing ',' */\n"
+            "    json_gen_trim_comma(&jbuf);\n"
+            "    json_gen_push(&jbuf, \"}}\", 2);\n\n"
+            "    return json_gen_buf_finish(&jbuf, response);\n"
+            "}\n\n");
+}
+
+/* Lookup by length first, then a single memcmp per candidate */
+static void
+cg_emit_lookup (FILE *fp, const char *fn, const char *arg, int by_url)
+{
+    struct cg_api *api;
+    const char *key;
+    char uname[CG_MAX_NAME];
+    int idx, len, max_len = 0, found;
+
+    for (idx = 0; idx < g_schema.nr_apis; idx++) {
+        key = by_url ? g_schema.apis[idx].url : g_schema.apis[idx].name;
+        if ((len = strlen(key)) > max_len)
+            max_len = len;
+    }
+
+    fprintf(fp,
+            "const struct json_map_info *\n"
+            "%s (const char *%s)\n"
+            "{\n"
+            "    switch (strlen(%s)) {\n",
+            fn, arg, arg);
+    for (len = 1; len <= max_len; len++) {
+        found = 0;
+        for (idx = 0; idx < g_schema.nr_apis; idx++) {
+            api = &g_schema.apis[idx];
+            key = by_url ? api->url : api->name;
+            if (strlen(key) != len)
+                continue;
+            if (!found) {
+                fprintf(fp, "    case %d:\n", len);
+                found = 1;
+            }
+            cg_upper(uname, api->msg);
+            fprintf(fp, "        if (memcmp(%s, \"%s\", %d) == 0)\n"
+                    "            return &_j2c_map_info[JSON_C_%s_MSG];\n",
+                    arg, key, len, uname);
+        }
+        if (found) {
+            fprintf(fp, "        break;\n");
+        }
+    }
+    fprintf(fp, "    }\n\n    return NULL;\n}\n\n");
+}
+
+static int
+cg_table_in_use (struct cg_table *tbl)
+{
+    int idx;
+
+    for (idx = 0; idx < g_schema.nr_apis; idx++) {
+        if (g_schema.apis[idx].msg_tbl == tbl || g_schema.apis[idx].resp_tbl == tbl)
+            return 1;
+    }
+
+    return 0;
+}
+
+static void
+cg_emit_json_source (const char *outdir)
+{
+    FILE *fp = cg_open_output(outdir, "json_gen.c");
+    struct cg_table *tbl;
+    struct cg_api *api;
+    char uname[CG_MAX_NAME];
+    int idx, jdx, is_get;
+
+    fprintf(fp,
+            "#include <stdio.h>\n"
+            "#include <stdlib.h>\n"
+            "#include <string.h>\n\n"
+            "#include <microhttpd.h>\n\n"
+            "#include <gweb/common.h>\n"
+            "#include <gweb/json_api.h>\n"
+            "#include <gweb/json_map.h>\n"
+            "#include <gweb/mysqldb_api.h>\n"
+            "#include <gweb/storage_gen.h>\n\n");
+
+    for (idx = 0; idx < g_schema.nr_tables; idx++) {
+        tbl = &g_schema.tables[idx];
+        if (!cg_table_in_use(tbl))
+            continue;
+        if (tbl->type == CG_TABLE_MSG) {
+            cg_emit_parser(fp, tbl);
+
+            for (jdx = 0, is_get = 0; jdx < g_schema.nr_apis; jdx++) {
+                if (g_schema.apis[jdx].msg_tbl == tbl && g_schema.apis[jdx].url[0])
+                    is_get = 1;
+            }
+            if (is_get) {
+                cg_emit_get_binder(fp, tbl);
+            }
+        } else {
+            cg_emit_serializer(fp, tbl);
+        }
+    }
+
+    for (idx = 0; idx < g_schema.nr_apis; idx++) {
+        api = &g_schema.apis[idx];
+        if (!api->key[0])
+            continue;
+        cg_upper(uname, api->msg);
+        fprintf(fp,
+                "static const char *\n"
+                "gweb_json_key_%s (const j2c_msg_t *j2cmsg)\n"
+                "{\n"
+                "    return j2cmsg->%s.fields[FIELD_%s_%s];\n"
+                "}\n\n",
+                api->msg, api->msg, uname, api->key);
+    }
+
+    fprintf(fp, "static const struct json_map_info _j2c_map_info[JSON_C_MSG_MAX] = {\n");
+    for (idx = 0; idx < g_schema.nr_apis; idx++) {
+        api = &g_schema.apis[idx];
+        cg_upper(uname, api->msg);
+        fprintf(fp, "    [JSON_C_%s_MSG] = {\n", uname);
+        fprintf(fp, "        .api_name          = \"%s\",\n", api->name);
+        if (api->url[0]) {
+            fprintf(fp, "        .get_url           = \"%s\",\n", api->url);
+        }
+        fprintf(fp, "        .api_handler       = gweb_json_parse_record_%s,\n",
+                api->msg);
+        if (api->url[0]) {
+            fprintf(fp, "        .api_get_handler   = gweb_json_get_record_%s,\n",
+                    api->msg);
+        }
+        fprintf(fp, "        .api_dump_handler  = gweb_json_dump_%s,\n", api->msg);
+        fprintf(fp, "        .api_resp_handler  = gweb_json_gen_response_%s,\n",
+                api->resp);
+        if (api->msg_tbl->has_array) {
+            fprintf(fp, "        .api_free_handler  = "
+                    "gweb_json_free_array_handler_%s,\n", api->msg);
+        }
+        if (api->read_only) {
+            fprintf(fp, "        .api_read_only     = 1,\n");
+        }
+        if (api->key[0]) {
+            fprintf(fp, "        .api_key           = gweb_json_key_%s,\n", api->msg);
+        }
+        cg_upper(uname, api->db);
+        fprintf(fp, "        .api_db_op         = GWEB_STORAGE_OP_%s,\n", uname);
+        fprintf(fp, "        .api_db_resp_free  = gweb_mysql_free_%s,\n", api->db);
+        fprintf(fp, "    },\n");
+    }
+    fprintf(fp, "};\n\n");
+
+    cg_emit_lookup(fp, "gweb_json_lookup_api", "api_name", 0);
+    cg_emit_lookup(fp, "gweb_json_lookup_get_url", "url", 1);
+
+    fclose(fp);
+}
+
+/*
+ * Storage backends (gweb/storage.h). Each implements
+ * gweb_<backend>_handle_<db>() for every API, taking its own session
+ * type, called through a void * adapter.
+ */
+static const char *const cg_backends[] = { "mysql", "memdb" };
+
+#define CG_NR_BACKENDS  (sizeof(cg_backends) / sizeof(cg_backends[0]))
+
+static void
+cg_emit_storage_header (const char *outdir)
+{
+    FILE *fp = cg_open_output(outdir, "gweb/storage_gen.h");
+    char uname[CG_MAX_NAME];
+    int idx;
+
+    fprintf(fp, "#ifndef STORAGE_GEN_H\n#define STORAGE_GEN_H\n\n");
+
+    fprintf(fp, "enum gweb_storage_op {\n");
+    for (idx = 0; idx < g_schema.nr_apis; idx++) {
+        cg_upper(uname, g_schema.apis[idx].db);
+        fprintf(fp, "    GWEB_STORAGE_OP_%s,\n", uname);
+    }
+    fprintf(fp, "    GWEB_STORAGE_OP_MAX,\n};\n\n");
+
+    fprintf(fp, "#endif // STORAGE_GEN_H\n");
+    fclose(fp);
+}
+
+static void
+cg_emit_storage_source (const char *outdir)
+{
+    FILE *fp = cg_open_output(outdir, "storage_gen.c");
+    const char *backend, *db;
+    char uname[CG_MAX_NAME];
+    size_t bidx;
+    int idx;
+
+    fprintf(fp,
+            "#include <gweb/json_struct.h>\n"
+            "#include <gweb/mysqldb_api.h>\n"
+            "#include <gweb/memdb_api.h>\n"
+            "#include <gweb/storage.h>\n\n");
+
+    for (bidx = 0; bidx < CG_NR_BACKENDS; bidx++) {
+        backend = cg_backends[bidx];
+
+        for (idx = 0; idx < g_schema.nr_apis; idx++) {
+            db = g_schema.apis[idx].db;
+            fprintf(fp,
+                    "static int\n"
+                    "gweb_storage_%s_%s (void *session, j2c_msg_t *j2cmsg,\n"
+                    "                    j2c_resp_t **j2cresp)\n"
+                    "{\n"
+                    "    return gweb_%s_handle_%s(session, j2cmsg, j2cresp);\n"
+                    "}\n\n",
+                    backend, db, backend, db);
+        }
+
+        fprintf(fp, "const struct gweb_storage_handler "
+                "gweb_%s_storage_handlers[GWEB_STORAGE_OP_MAX] = {\n", backend);
+        for (idx = 0; idx < g_schema.nr_apis; idx++) {
+            db = g_schema.apis[idx].db;
+            cg_upper(uname, db);
+            fprintf(fp, "    [GWEB_STORAGE_OP_%s] = {\n", uname);
+            fprintf(fp, "        .name   = \"gweb_%s_handle_%s\",\n", backend, db);
+            fprintf(fp, "        .handle = gweb_storage_%s_%s,\n", backend, db);
+            fprintf(fp, "    },\n");
+        }
+        fprintf(fp, "};\n\n");
+    }
+
+    fclose(fp);
+}
+
+static void
+cg_make_dir (const char *path)
+{
+    if (mkdir(path, 0755) && errno != EEXIST) {
+        cg_die(0, "cannot create %s (%s)", path, strerror(errno));
+    }
+}
+
+int main (int argc, char *argv[])
+{
+    char path[CG_MAX_PATH];
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <schema-file> <outdir>\n", argv[0]);
+        return 1;
+    }
+
+    cg_parse_schema(argv[1]);
+    cg_validate_schema();
+
+    snprintf(path, sizeof(path), "%s/gweb", argv[2]);
+    cg_make_dir(argv[2]);
+    cg_make_dir(path);
+
+    cg_emit_struct_header(argv[2]);
+    cg_emit_sql_header(argv[2]);
+    cg_emit_stmt_header(argv[2]);
+    cg_emit_stmt_text(argv[2]);
+    cg_emit_stmt_source(argv[2]);
+    cg_emit_storage_header(argv[2]);
+    cg_emit_json_source(argv[2]);
+    cg_emit_storage_source(argv[2]);
+
+    return 0;
+}
@@ -0,0 +1,743 @@
+/*
+ * Bulk user import
+ *
+ * Loads users from a partner export without replaying registration
+ * POSTs. Input is CSV with a header line or JSON Lines, with the field
+ * names of the registration API (fname, lname, email, phone,
+ * password); rows without email or phone are rejected.
+ *
+ * UIDs are computed across threads with the same gweb_app_get_uid_str()
+ * as the server. Rows are then deduplicated in memory against each
+ * other and the users already registered: by UID, and by email case
+ * insensitively, first row wins. A UID shared by two different emails
+ * is a UID collision, the later user is not imported.
+ *
+ * UserRegInfo, UserPhone and the UserProfileView projection (schema
+ * v8) are filled with multi-row INSERTs in UID order (appends to the
+ * primary key), one transaction per batch. Unique checks are off for
+ * the session since rows were checked up front, and the UserPhone UID
+ * index is dropped and rebuilt once at the end. Run it with the server
+ * stopped, or registrations racing the import may fail the batch
+ * holding the same user.
+ *
+ *   bulk_import [-csv | -jsonl] [-t threads] [-b batch-rows] [-n] <file>
+ *
+ * -n stops after deduplication, nothing is written.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <mysql.h>
+#include <json-c/json.h>
+
+#ifndef DEBUG
+#  define DEBUG
+#endif
+
+#include <gweb/common.h>
+#include <gweb/config.h>
+#include <gweb/uid.h>
+#include <gweb/sql_gen.h>
+#include <gweb/stmt_gen.h>
+
+#define IMPORT_LINESZ           (4096)
+#define IMPORT_QUERYSZ          (1 << 20)   /* below max_allowed_packet */
+#define IMPORT_BATCH_ROWS       (1000)
+#define IMPORT_MAX_THREADS      (64)
+
+#define DROP_INDEX_UserPhone                                    \
+    "ALTER TABLE UserPhone DROP INDEX PhoneUIDIndex"
+
+#define ADD_INDEX_UserPhone                                     \
+    "ALTER TABLE UserPhone ADD INDEX PhoneUIDIndex (UID)"
+
+enum {
+    IMPORT_FNAME,
+    IMPORT_LNAME,
+    IMPORT_EMAIL,
+    IMPORT_PHONE,
+    IMPORT_PASSWORD,
+    IMPORT_NR_FIELDS,
+};
+
+/* Registration API names */
+static const char *import_field_name[IMPORT_NR_FIELDS] = {
+    [IMPORT_FNAME]    = "fname",
+    [IMPORT_LNAME]    = "lname",
+    [IMPORT_EMAIL]    = "email",
+    [IMPORT_PHONE]    = "phone",
+    [IMPORT_PASSWORD] = "password",
+};
+
+enum {
+    IMPORT_KEEP,
+    IMPORT_REGISTERED,          /* already in UserRegInfo */
+    IMPORT_DUPLICATE,           /* same user earlier in the input */
+    IMPORT_COLLISION,           /* UID taken by another email */
+};
+
+struct import_user {
+    char *fields[IMPORT_NR_FIELDS];
+    char uid[MAX_UID_STRSZ];
+    int existing;
+    int state;
+};
+
+struct import_set {
+    struct import_user *users;
+    int nr, size;
+
+    int nr_existing;            /* leading entries, loaded from the DB */
+    int nr_rejected;
+    int nr_state[IMPORT_COLLISION + 1];
+};
+
+struct import_uid_work {
+    pthread_t thread;
+    struct import_user *users;
+    int nr;
+};
+
+static double
+import_now (void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static struct import_user *
+import_user_new (struct import_set *set)
+{
+    struct import_user *grown;
+    int size;
+
+    if (set->nr == set->size) {
+        size = set->size ? 2 * set->size : 4096;
+        if ((grown = realloc(set->users, size * sizeof(*grown))) == NULL) {
+            return NULL;
+        }
+        set->users = grown;
+        set->size = size;
+    }
+
+    memset(&set->users[set->nr], 0, sizeof(struct import_user));
+    return &set->users[set->nr++];
+}
+
+/* Keep the row if it can register, else drop it as rejected */
+static int
+import_user_commit (struct import_set *set, struct import_user *user)
+{
+    int fld;
+
+    if (user->fields[IMPORT_EMAIL] && *user->fields[IMPORT_EMAIL] &&
+        user->fields[IMPORT_PHONE] && *user->fields[IMPORT_PHONE]) {
+        return 0;
+    }
+
+    for (fld = 0; fld < IMPORT_NR_FIELDS; fld++) {
+        free(user->fields[fld]);
+    }
+    set->nr--;
+    set->nr_rejected++;
+
+    return -1;
+}
+
+static int
+import_field_index (const char *name)
+{
+    int fld;
+
+    for (fld = 0; fld < IMPORT_NR_FIELDS; fld++) {
+        if (strcasecmp(name, import_field_name[fld]) == 0) {
+            return fld;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Split a CSV line in place, fields may be quoted with "" for a quote.
+ * Quoted newlines are not supported. Returns the number of fields.
+ */
+static int
+import_csv_split (char *line, char **cols, int max_cols)
+{
+    char *src = line, *dst;
+    int nr = 0;
+
+    line[strcspn(line, "\r\n")] = '\0';
+
+    while (nr < max_cols) {
+        cols[nr++] = dst = src;
+        if (*src == '"') {
+            src++;
+            while (*src) {
+                if (*src == '"' && src[1] == '"') {
+                    *dst++ = '"';
+                    src += 2;
+                } else if (*src == '"') {
+                    src++;
+                    break;
+                } else {
+                    *dst++ = *src++;
+                }
+            }
+            src += strcspn(src, ",");
+        } else {
+            while (*src && *src != ',') {
+                *dst++ = *src++;
+            }
+        }
+
+        if (*src != ',') {
+            *dst = '\0';
+            break;
+        }
+        src++;
+        *dst = '\0';
+    }
+    return nr;
+}
+
+static int
+import_read_csv (FILE *fp, struct import_set *set)
+{
+    char line[IMPORT_LINESZ], *cols[32];
+    int map[32], nr_cols, col, fld, lineno = 1;
+    struct import_user *user;
+
+    if (fgets(line, sizeof(line), fp) == NULL) {
+        fprintf(stderr, "empty input\n");
+        return -1;
+    }
+
+    nr_cols = import_csv_split(line, cols, ARRAY_SIZE(cols));
+    for (col = 0; col < nr_cols; col++) {
+        map[col] = import_field_index(cols[col]);
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        lineno++;
+        if (line[strcspn(line, "\r\n")] == '\0' && strlen(line) == sizeof(line) - 1) {
+            fprintf(stderr, "line %d: too long\n", lineno);
+            return -1;
+        }
+
+        if ((user = import_user_new(set)) == NULL) {
+            return -1;
+        }
+
+        nr_cols = import_csv_split(line, cols, ARRAY_SIZE(cols));
+        for (col = 0; col < nr_cols; col++) {
+            if ((fld = map[col]) < 0 || *cols[col] == '\0') {
+                continue;
+            }
+            if ((user->fields[fld] = strdup(cols[col])) == NULL) {
+                return -1;
+            }
+        }
+        import_user_commit(set, user);
+    }
+    return 0;
+}
+
+static int
+import_read_jsonl (FILE *fp, struct import_set *set)
+{
+    char line[IMPORT_LINESZ];
+    struct json_object *jobj, *jval;
+    struct import_user *user;
+    int fld, lineno = 0;
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        lineno++;
+        if (line[strspn(line, " \t\r\n")] == '\0') {
+            continue;
+        }
+
+        if ((jobj = json_tokener_parse(line)) == NULL ||
+            !json_object_is_type(jobj, json_type_object)) {
+            if (jobj) {
+                json_object_put(jobj);
+            }
+            set->nr_rejected++;
+            continue;
+        }
+
+        if ((user = import_user_new(set)) == NULL) {
+            json_object_put(jobj);
+            return -1;
+        }
+
+        for (fld = 0; fld < IMPORT_NR_FIELDS; fld++) {
+            if (!json_object_object_get_ex(jobj, import_field_name[fld], &jval) ||
+                !json_object_is_type(jval, json_type_string)) {
+                continue;
+            }
+            if ((user->fields[fld] = strdup(json_object_get_string(jval))) == NULL) {
+                json_object_put(jobj);
+                return -1;
+            }
+        }
+        json_object_put(jobj);
+        import_user_commit(set, user);
+    }
+    return 0;
+}
+
+/* Registered users take part in deduplication ahead of the input */
+static int
+import_load_existing (MYSQL *con, struct import_set *set)
+{
+    struct import_user *user;
+    MYSQL_RES *res;
+    MYSQL_ROW row;
+
+    if (mysql_query(con, gweb_stmt_sql[GWEB_STMT_REGISTERED_USERS]) ||
+        (res = mysql_use_result(con)) == NULL) {
+        fprintf(stderr, "%s\n", mysql_error(con));
+        return -1;
+    }
+
+    while ((row = mysql_fetch_row(res)) != NULL) {
+        if (!row[0] || strlen(row[0]) >= MAX_UID_STRSZ) {
+            continue;
+        }
+        if ((user = import_user_new(set)) == NULL ||
+            (row[1] && (user->fields[IMPORT_EMAIL] = strdup(row[1])) == NULL)) {
+            mysql_free_result(res);
+            return -1;
+        }
+        strcpy(user->uid, row[0]);
+        user->existing = 1;
+        set->nr_existing++;
+    }
+    mysql_free_result(res);
+
+    return 0;
+}
+
+static void *
+import_uid_thread (void *arg)
+{
+    struct import_uid_work *work = arg;
+    int idx;
+
+    for (idx = 0; idx < work->nr; idx++) {
+        gweb_app_get_uid_str(work->users[idx].fields[IMPORT_PHONE],
+                             work->users[idx].fields[IMPORT_EMAIL],
+                             work->users[idx].uid);
+    }
+    return NULL;
+}
+
+static int
+import_compute_uids (struct import_user *users, int nr, int nr_threads)
+{
+    struct import_uid_work work[IMPORT_MAX_THREADS];
+    int idx, chunk, start = 0, ret = 0;
+
+    chunk = (nr + nr_threads - 1) / nr_threads;
+    for (idx = 0; idx < nr_threads; idx++) {
+        work[idx].users = &users[start];
+        work[idx].nr = (nr - start < chunk) ? nr - start : chunk;
+        start += work[idx].nr;
+
+        if (pthread_create(&work[idx].thread, NULL, import_uid_thread, &work[idx])) {
+            /* Finish the slice here */
+            import_uid_thread(&work[idx]);
+            work[idx].nr = -1;
+        }
+    }
+
+    for (idx = 0; idx < nr_threads; idx++) {
+        if (work[idx].nr >= 0) {
+            ret |= pthread_join(work[idx].thread, NULL);
+        }
+    }
+    return ret ? -1 : 0;
+}
+
+static struct import_user *g_sort_users;
+
+/* Input order breaks ties, registered users first */
+static int
+import_cmp_uid (const void *a, const void *b)
+{
+    int ia = *(const int *)a, ib = *(const int *)b;
+    int cmp = strcmp(g_sort_users[ia].uid, g_sort_users[ib].uid);
+
+    return cmp ? cmp : ia - ib;
+}
+
+static int
+import_cmp_email (const void *a, const void *b)
+{
+    int ia = *(const int *)a, ib = *(const int *)b;
+    const char *ea = g_sort_users[ia].fields[IMPORT_EMAIL];
+    const char *eb = g_sort_users[ib].fields[IMPORT_EMAIL];
+    int cmp = strcasecmp(ea ? ea : "", eb ? eb : "");
+
+    return cmp ? cmp : ia - ib;
+}
+
+static void
+import_drop (struct import_set *set, struct import_user *kept,
+             struct import_user *user, int state)
+{
+    if (user->existing || user->state != IMPORT_KEEP) {
+        return;
+    }
+    user->state = kept->existing ? IMPORT_REGISTERED : state;
+    set->nr_state[user->state]++;
+}
+
+/*
+ * Mark duplicates and UID collisions. On return order[] lists the
+ * users to import in UID order, the count is returned.
+ */
+static int
+import_dedupe (struct import_set *set, int *order)
+{
+    struct import_user *users = set->users, *kept, *user;
+    const char *email;
+    int idx, first, nr = 0;
+
+    g_sort_users = users;
+    for (idx = 0; idx < set->nr; idx++) {
+        order[idx] = idx;
+    }
+
+    /* Emails first, an email registers once whatever the phone */
+    qsort(order, set->nr, sizeof(int), import_cmp_email);
+    for (first = 0, idx = 1; idx < set->nr; idx++) {
+        kept = &users[order[first]];
+        user = &users[order[idx]];
+        email = kept->fields[IMPORT_EMAIL];
+        if (email && user->fields[IMPORT_EMAIL] &&
+            strcasecmp(email, user->fields[IMPORT_EMAIL]) == 0) {
+            import_drop(set, kept, user, IMPORT_DUPLICATE);
+        } else {
+            first = idx;
+        }
+    }
+
+    qsort(order, set->nr, sizeof(int), import_cmp_uid);
+    for (first = -1, idx = 0; idx < set->nr; idx++) {
+        user = &users[order[idx]];
+        if (!user->existing && user->state != IMPORT_KEEP) {
+            continue;
+        }
+        if (first >= 0 && strcmp(users[order[first]].uid, user->uid) == 0) {
+            import_drop(set, &users[order[first]], user, IMPORT_COLLISION);
+        } else {
+            first = idx;
+        }
+    }
+
+    for (idx = 0; idx < set->nr; idx++) {
+        user = &users[order[idx]];
+        if (!user->existing && user->state == IMPORT_KEEP) {
+            order[nr++] = order[idx];
+        }
+    }
+    return nr;
+}
+
+/* Quoted and escaped into buf, or NULL */
+static int
+import_quote (MYSQL *con, char *buf, const char *value)
+{
+    int len;
+
+    if (value == NULL) {
+        return sprintf(buf, "NULL");
+    }
+    buf[0] = '\'';
+    len = 1 + mysql_real_escape_string(con, &buf[1], value, strlen(value));
+    buf[len++] = '\'';
+    buf[len] = '\0';
+
+    return len;
+}
+
+/* Upper bound of the escaped row */
+static size_t
+import_row_size (const struct import_user *user)
+{
+    size_t size = 64 + 2 * MAX_UID_STRSZ;
+    int fld;
+
+    for (fld = 0; fld < IMPORT_NR_FIELDS; fld++) {
+        if (user->fields[fld]) {
+            size += 2 * strlen(user->fields[fld]) + 8;
+        }
+    }
+    return size;
+}
+
+static int
+import_run (MYSQL *con, const char *query)
+{
+    if (mysql_query(con, query)) {
+        fprintf(stderr, "%.64s: %s\n", query, mysql_error(con));
+        return -1;
+    }
+    return 0;
+}
+
+/* One batch, users, their phones and profiles, as one transaction */
+static int
+import_batch (MYSQL *con, struct import_set *set, const int *order, int nr,
+              const char *start, char *users_qry, char *phones_qry,
+              char *views_qry)
+{
+    char uid[2 * MAX_UID_STRSZ + 3], val[IMPORT_NR_FIELDS][2 * IMPORT_LINESZ + 3];
+    struct import_user *user;
+    int idx, fld, ulen, plen, vlen;
+
+    ulen = sprintf(users_qry, GWEB_SQL_REGISTRATION_INSERT_USER_ROWS);
+    plen = sprintf(phones_qry, GWEB_SQL_REGISTRATION_INSERT_PHONE_ROWS);
+    vlen = sprintf(views_qry, GWEB_SQL_PROFILE_VIEW_INSERT_ROWS);
+
+    for (idx = 0; idx < nr; idx++) {
+        user = &set->users[order[idx]];
+
+        import_quote(con, uid, user->uid);
+        for (fld = 0; fld < IMPORT_NR_FIELDS; fld++) {
+            import_quote(con, val[fld], user->fields[fld]);
+        }
+
+        if (idx) {
+            users_qry[ulen++] = ',';
+            phones_qry[plen++] = ',';
+            views_qry[vlen++] = ',';
+        }
+        ulen += sprintf(users_qry + ulen, GWEB_SQL_REGISTRATION_USER_ROW, uid,
+                        val[IMPORT_FNAME], val[IMPORT_LNAME], val[IMPORT_EMAIL],
+                        start, val[IMPORT_PASSWORD]);
+        plen += sprintf(phones_qry + plen, GWEB_SQL_REGISTRATION_PHONE_ROW, uid,
+                        val[IMPORT_PHONE]);
+        vlen += sprintf(views_qry + vlen, GWEB_SQL_PROFILE_VIEW_ROW, uid,
+                        val[IMPORT_FNAME], val[IMPORT_LNAME], val[IMPORT_EMAIL],
+                        val[IMPORT_PHONE]);
+    }
+
+    if (import_run(con, users_qry) || import_run(con, phones_qry) ||
+        import_run(con, views_qry) || mysql_commit(con)) {
+        mysql_rollback(con);
+        return -1;
+    }
+    return 0;
+}
+
+static int
+import_load (MYSQL *con, struct import_set *set, const int *order, int nr,
+             int batch_rows)
+{
+    char start[32], *users_qry, *phones_qry, *views_qry;
+    int idx, first = 0, index_dropped, ret = -1;
+    size_t size = 0, row_size;
+    time_t now = time(NULL);
+    struct tm tm;
+
+    /* Registration time, as gweb_get_utc_datetime() */
+    strftime(start, sizeof(start), "%Y-%m-%d %H:%M:%S", gmtime_r(&now, &tm));
+
+    users_qry = malloc(IMPORT_QUERYSZ);
+    phones_qry = malloc(IMPORT_QUERYSZ);
+    views_qry = malloc(IMPORT_QUERYSZ);
+    if (!users_qry || !phones_qry || !views_qry) {
+        goto __bail_out;
+    }
+
+    if (import_run(con, "SET SESSION unique_checks=0") ||
+        import_run(con, "SET SESSION foreign_key_checks=0") ||
+        mysql_autocommit(con, 0)) {
+        goto __bail_out;
+    }
+
+    /* Absent before schema v7 */
+    index_dropped = (mysql_query(con, DROP_INDEX_UserPhone) == 0);
+
+    for (idx = 0; idx < nr; idx++) {
+        row_size = import_row_size(&set->users[order[idx]]);
+        if (idx > first &&
+            (idx - first == batch_rows || size + row_size >= IMPORT_QUERYSZ - 256)) {
+            if (import_batch(con, set, &order[first], idx - first, start,
+                             users_qry, phones_qry, views_qry)) {
+                goto __restore;
+            }
+            first = idx;
+            size = 0;
+        }
+        size += row_size;
+    }
+
+    if (idx > first && import_batch(con, set, &order[first], idx - first, start,
+                                    users_qry, phones_qry, views_qry)) {
+        goto __restore;
+    }
+    ret = 0;
+
+__restore:
+    if (ret) {
+        fprintf(stderr, "batch at row %d failed, %d row(s) imported\n",
+                first, first);
+    }
+    if (index_dropped && import_run(con, ADD_INDEX_UserPhone)) {
+        ret = -1;
+    }
+
+__bail_out:
+    free(users_qry);
+    free(phones_qry);
+    free(views_qry);
+    return ret;
+}
+
+static void
+import_free (struct import_set *set)
+{
+    int idx, fld;
+
+    for (idx = 0; idx < set->nr; idx++) {
+        for (fld = 0; fld < IMPORT_NR_FIELDS; fld++) {
+            free(set->users[idx].fields[fld]);
+        }
+    }
+    free(set->users);
+}
+
+int main (int argc, char *argv[])
+{
+    struct import_set set = { 0 };
+    struct mysql_config *cfg;
+    const char *path = NULL;
+    MYSQL *con = NULL;
+    FILE *fp = NULL;
+    int *order = NULL;
+    int idx, nr, jsonl = -1, dry_run = 0, ret = 1;
+    int nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int batch_rows = IMPORT_BATCH_ROWS;
+    double t_start, t_parse, t_uid, t_dedupe, t_load;
+
+    for (idx = 1; idx < argc; idx++) {
+        if (strcmp(argv[idx], "-csv") == 0) {
+            jsonl = 0;
+        } else if (strcmp(argv[idx], "-jsonl") == 0) {
+            jsonl = 1;
+        } else if (strcmp(argv[idx], "-t") == 0 && idx + 1 < argc) {
+            nr_threads = atoi(argv[++idx]);
+        } else if (strcmp(argv[idx], "-b") == 0 && idx + 1 < argc) {
+            batch_rows = atoi(argv[++idx]);
+        } else if (strcmp(argv[idx], "-n") == 0) {
+            dry_run = 1;
+        } else if (argv[idx][0] != '-' && path == NULL) {
+            path = argv[idx];
+        } else {
+            path = NULL;
+            break;
+        }
+    }
+
+    if (path == NULL || batch_rows <= 0) {
+        fprintf(stderr, "usage: %s [-csv | -jsonl] [-t threads] [-b batch-rows] "
+                "[-n] <file>\n", argv[0]);
+        return 1;
+    }
+    if (nr_threads < 1) {
+        nr_threads = 1;
+    } else if (nr_threads > IMPORT_MAX_THREADS) {
+        nr_threads = IMPORT_MAX_THREADS;
+    }
+
+    /* Format by extension unless given */
+    if (jsonl < 0) {
+        const char *ext = strrchr(path, '.');
+        jsonl = ext && (strcasecmp(ext, ".jsonl") == 0 || strcasecmp(ext, ".json") == 0);
+    }
+
+    if (config_parse_and_load(argc, argv) || (cfg = config_load_mysqldb()) == NULL) {
+        fprintf(stderr, "No MySQL connect information found\n");
+        return 1;
+    }
+
+    if ((con = mysql_init(NULL)) == NULL ||
+        mysql_real_connect(con, cfg->host, cfg->username, cfg->password,
+                           cfg->database, 0, NULL, 0) == NULL) {
+        fprintf(stderr, "connect: %s\n", con ? mysql_error(con) : "no memory");
+        goto __bail_out;
+    }
+
+    t_start = import_now();
+
+    if (import_load_existing(con, &set)) {
+        goto __bail_out;
+    }
+
+    if ((fp = fopen(path, "r")) == NULL) {
+        perror(path);
+        goto __bail_out;
+    }
+    if ((jsonl ? import_read_jsonl(fp, &set) : import_read_csv(fp, &set))) {
+        fprintf(stderr, "%s: read failed\n", path);
+        goto __bail_out;
+    }
+    t_parse = import_now();
+
+    if (import_compute_uids(&set.users[set.nr_existing], set.nr - set.nr_existing,
+                            nr_threads)) {
+        goto __bail_out;
+    }
+    t_uid = import_now();
+
+    if (set.nr && (order = malloc(set.nr * sizeof(int))) == NULL) {
+        fprintf(stderr, "unable to allocate memory!\n");
+        goto __bail_out;
+    }
+    nr = set.nr ? import_dedupe(&set, order) : 0;
+    t_dedupe = import_now();
+
+    printf("%d row(s) read, %d registered user(s), %d thread(s)\n",
+           set.nr - set.nr_existing + set.nr_rejected, set.nr_existing, nr_threads);
+    printf("  rejected          %8d  (no email or phone)\n", set.nr_rejected);
+    printf("  already registered%8d\n", set.nr_state[IMPORT_REGISTERED]);
+    printf("  duplicates        %8d\n", set.nr_state[IMPORT_DUPLICATE]);
+    printf("  UID collisions    %8d\n", set.nr_state[IMPORT_COLLISION]);
+    printf("  to import         %8d\n", nr);
+    printf("  parse %.2f s, UIDs %.2f s, dedupe %.2f s\n", t_parse - t_start,
+           t_uid - t_parse, t_dedupe - t_uid);
+
+    if (!dry_run && nr) {
+        if (import_load(con, &set, order, nr, batch_rows)) {
+            goto __bail_out;
+        }
+        t_load = import_now();
+        printf("  load %.2f s, %.0f rows/s\n", t_load - t_dedupe,
+               nr / (t_load - t_dedupe));
+    }
+    ret = 0;
+
+__bail_out:
+    if (fp) {
+        fclose(fp);
+    }
+    if (con) {
+        mysql_close(con);
+    }
+    free(order);
+    import_free(&set);
+
+    return ret;
+}
@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <strings.h>
 
 #include <mysql.h>
 
@@ -17,6 +18,8 @@
 #include <gweb/common.h>
 #include <gweb/config.h>
 #include <gweb/mysqldb_log.h>
+#include <gweb/sql_gen.h>
+#include <gweb/stmt_gen.h>
 
 /* SQL Macros */
 #define DROP_TABLE_UserRegInfo                  \
@@ -43,6 +46,9 @@
 #define DROP_TABLE_UserGeoLocation              \
     "DROP TABLE IF EXISTS UserGeoLocation"
 
+#define DROP_TABLE_UserProfileView              \
+    "DROP TABLE IF EXISTS UserProfileView"
+
 #define CREATE_TABLE_UserRegInfo                                        \
     "CREATE TABLE IF NOT EXISTS UserRegInfo (UID VARCHAR(16) BINARY "   \
     "NOT NULL UNIQUE, FirstName VARCHAR(20), LastName VARCHAR(20), "    \
@@ -79,11 +85,79 @@
 
 #define CREATE_TABLE_UserGeoLocation                                    \
     "CREATE TABLE IF NOT EXISTS UserGeoLocation (UID VARCHAR(16) BINARY NOT NULL, " \
-    "Location POINT NOT NULL, SeenAt DATETIME, Expiry INTEGER, Radius Integer)"
+    "Location POINT NOT NULL SRID 0, SeenAt DATETIME, Expiry INTEGER, Radius Integer)"
 
 #define ALTER_TABLE_V2_UserRegInfo                                      \
     "ALTER TABLE UserRegInfo ADD ProfileFlags VARCHAR(10) DEFAULT 'public'"
 
+/*
+ * MySQL 8 only uses a spatial index on a column restricted to one SRID,
+ * without it MBRContains scans the table. Point() builds SRID 0 values,
+ * so the rows already stored satisfy the restriction.
+ */
+#define ALTER_TABLE_V5_UserGeoLocation                                  \
+    "ALTER TABLE UserGeoLocation MODIFY Location POINT NOT NULL SRID 0, " \
+    "ADD SPATIAL INDEX GeoLocationIndex (Location)"
+
+#define ALTER_TABLE_V6_UserGeoLocation                                  \
+    "ALTER TABLE UserGeoLocation ADD ExpiresAt DATETIME, "              \
+    "ADD INDEX GeoExpiresIndex (ExpiresAt)",                            \
+    "UPDATE UserGeoLocation SET ExpiresAt = "                           \
+    "IF(Expiry = -1, NULL, SeenAt + INTERVAL Expiry SECOND)"
+
+/*
+ * Keyset pages of connection lists seek on the owner UID, the optional
+ * flag/channel filter, then the page order. Profiles join UserPhone on
+ * UID.
+ */
+#define ALTER_TABLE_V7_UserPhone                                        \
+    "ALTER TABLE UserPhone ADD INDEX PhoneUIDIndex (UID)"
+
+#define ALTER_TABLE_V7_UserConnectRequest                               \
+    "ALTER TABLE UserConnectRequest "                                   \
+    "ADD INDEX RequestFromIndex (FromUID, SentOn, ToUID), "             \
+    "ADD INDEX RequestFromFlagIndex (FromUID, Flags, SentOn, ToUID), "  \
+    "ADD INDEX RequestToIndex (ToUID, SentOn, FromUID), "               \
+    "ADD INDEX RequestToFlagIndex (ToUID, Flags, SentOn, FromUID)"
+
+#define ALTER_TABLE_V7_UserConnectChannel                               \
+    "ALTER TABLE UserConnectChannel "                                   \
+    "ADD INDEX ChannelFromIndex (FromUID, ConnectedOn, ToUID, ChannelId), " \
+    "ADD INDEX ChannelFromTypeIndex (FromUID, ChannelId, ConnectedOn, ToUID), " \
+    "ADD INDEX ChannelToIndex (ToUID, ConnectedOn, FromUID, ChannelId), " \
+    "ADD INDEX ChannelToTypeIndex (ToUID, ChannelId, ConnectedOn, FromUID)"
+
+#define ALTER_TABLE_V7_UserGeoLocation                                  \
+    "ALTER TABLE UserGeoLocation ADD INDEX GeoSeenIndex (SeenAt)"
+
+/*
+ * Profile projection, one row per user read by UID or Email without a
+ * join. Registration, profile and avatar updates write it in the same
+ * transaction as the tables it is built from. The backfill rebuilds it
+ * from those, run it again after loading users by other means.
+ */
+#define CREATE_TABLE_V8_UserProfileView                                 \
+    "CREATE TABLE IF NOT EXISTS UserProfileView (UID VARCHAR(16) BINARY NOT NULL, " \
+    "FirstName VARCHAR(20), LastName VARCHAR(20), "                     \
+    "Email VARCHAR(40) NOT NULL UNIQUE, Phone VARCHAR(10), "            \
+    "Address1 VARCHAR(40), Address2 VARCHAR(40), Address3 VARCHAR(40), " \
+    "Country VARCHAR(20), State VARCHAR(20), Pincode VARCHAR(6), "      \
+    "FacebookHandle VARCHAR(40), TwitterHandle VARCHAR(40), "           \
+    "AvatarURL VARCHAR(100), ProfileFlags VARCHAR(10) DEFAULT 'public', " \
+    "PRIMARY KEY (`UID`))"
+
+#define BACKFILL_V8_UserProfileView                                     \
+    "REPLACE INTO UserProfileView SELECT R.UID, R.FirstName, "          \
+    "R.LastName, R.Email, "                                             \
+    "(SELECT Phone FROM UserPhone WHERE UID=R.UID LIMIT 1), "           \
+    "A.Address1, A.Address2, A.Address3, A.Country, A.State, A.Pincode, " \
+    "(SELECT NetworkHandle FROM UserSocialNetwork WHERE UID=R.UID "     \
+    "AND NetworkType='facebook'), "                                     \
+    "(SELECT NetworkHandle FROM UserSocialNetwork WHERE UID=R.UID "     \
+    "AND NetworkType='twitter'), "                                      \
+    "R.AvatarURL, R.ProfileFlags FROM UserRegInfo R "                   \
+    "LEFT JOIN UserAddress A ON A.UID=R.UID AND A.AddressType='permanent'"
+
 #define ALTER_TABLE_UserRegInfo                                         \
     "ALTER TABLE UserRegInfo CHANGE UID UID VARCHAR(16) BINARY NOT NULL UNIQUE"
 
@@ -106,6 +180,46 @@
     "CHANGE FromUID FromUID VARCHAR(16) BINARY NOT NULL, "              \
     "CHANGE ToUID ToUID VARCHAR(16) BINARY NOT NULL"
 
+/*
+ * Add a unique key to a table that may already hold duplicates. Rows
+ * are copied into a keyed twin in <order>, the first row of a key wins,
+ * and the tables are swapped.
+ */
+#define REKEY_TABLE(t, key, order)                                      \
+    "DROP TABLE IF EXISTS " t "_rekey",                                 \
+    "CREATE TABLE " t "_rekey LIKE " t,                                 \
+    "ALTER TABLE " t "_rekey ADD " key,                                 \
+    "INSERT IGNORE INTO " t "_rekey SELECT * FROM " t " ORDER BY " order, \
+    "RENAME TABLE " t " TO " t "_old, " t "_rekey TO " t,               \
+    "DROP TABLE " t "_old"
+
+/*
+ * Keys for single statement upserts. Of duplicates, requests and
+ * locations keep the latest row. Channels keep the earliest, the date
+ * the UIDs first connected on it, as CXN_CHANNEL_INSERT keeps an
+ * existing row.
+ */
+#define REKEY_TABLE_UserAddress                                         \
+    REKEY_TABLE("UserAddress", "UNIQUE KEY (UID, AddressType)", "UID")
+
+#define REKEY_TABLE_UserSocialNetwork                                   \
+    REKEY_TABLE("UserSocialNetwork", "UNIQUE KEY (UID, NetworkType)", "UID")
+
+#define REKEY_TABLE_UserConnectRequest                                  \
+    REKEY_TABLE("UserConnectRequest", "UNIQUE KEY (FromUID, ToUID)",    \
+                "SentOn DESC")
+
+#define REKEY_TABLE_UserConnectChannel                                  \
+    REKEY_TABLE("UserConnectChannel",                                   \
+                "UNIQUE KEY (FromUID, ToUID, ChannelId)", "ConnectedOn")
+
+#define REKEY_TABLE_UserConnectPreferences                              \
+    REKEY_TABLE("UserConnectPreferences", "UNIQUE KEY (UID, ChannelId)", \
+                "UID")
+
+#define REKEY_TABLE_UserGeoLocation                                     \
+    REKEY_TABLE("UserGeoLocation", "PRIMARY KEY (UID)", "SeenAt DESC")
+
 #define DROP_FUNCTION_LocationAPIs                      \
     "DROP FUNCTION IF EXISTS libgeod_info",             \
     "DROP FUNCTION IF EXISTS libgeod_inverse"
@@ -127,6 +241,7 @@ static const char *mysql_drop_query[] = {
     DROP_TABLE_UserConnectChannel,
     DROP_TABLE_UserConnectPreferences,
     DROP_TABLE_UserGeoLocation,
+    DROP_TABLE_UserProfileView,
 };
 
 /* Version 0 */
@@ -162,6 +277,39 @@ static const char *mysql_db_update_v3[] = {
     CREATE_FUNCTION_LocationAPIs,
 };
 
+static const char *mysql_db_update_v4[] = {
+    REKEY_TABLE_UserAddress,
+    REKEY_TABLE_UserSocialNetwork,
+    REKEY_TABLE_UserConnectRequest,
+    REKEY_TABLE_UserConnectChannel,
+    REKEY_TABLE_UserConnectPreferences,
+    REKEY_TABLE_UserGeoLocation,
+};
+
+/* Bounding box searches on UserGeoLocation */
+static const char *mysql_db_update_v5[] = {
+    ALTER_TABLE_V5_UserGeoLocation,
+};
+
+/* Indexed expiry deadline, deleted by the server once past */
+static const char *mysql_db_update_v6[] = {
+    ALTER_TABLE_V6_UserGeoLocation,
+};
+
+/* Indexes for connection lists, profile joins and location age */
+static const char *mysql_db_update_v7[] = {
+    ALTER_TABLE_V7_UserPhone,
+    ALTER_TABLE_V7_UserConnectRequest,
+    ALTER_TABLE_V7_UserConnectChannel,
+    ALTER_TABLE_V7_UserGeoLocation,
+};
+
+/* Denormalized profile reads */
+static const char *mysql_db_update_v8[] = {
+    CREATE_TABLE_V8_UserProfileView,
+    BACKFILL_V8_UserProfileView,
+};
+
 static struct mysql_config *g_mysql_cfg;
 
 #define MYSQL_RUN_QUERY(q, ctx, table)            \
@@ -173,10 +321,246 @@ static struct mysql_config *g_mysql_cfg;
         }                                         \
     } while(0)
 
+/*
+ * Self-check (-check): EXPLAIN every prepared statement and SQL
+ * template against the live schema, fail if any plan scans a whole
+ * table. Placeholders are filled with the first registered user so
+ * that lookups find a row and the rest of the join gets planned too.
+ */
+#define MYSQL_CHECK_QUERYSZ       (4096)
+#define MYSQL_CHECK_VALUESZ       (128)
+#define MYSQL_CHECK_DATE          "'2000-01-01 00:00:00'"
+
+/* Full scans by design: startup loads and the UDF fallback search */
+static const int mysql_check_exempt[] = {
+    GWEB_STMT_REGISTERED_USERS,
+    GWEB_STMT_CXN_REQUEST_EDGES,
+    GWEB_STMT_CXN_CHANNEL_EDGES,
+    GWEB_STMT_LOCATION_LIVE,
+    GWEB_STMT_NEIGHBOURS,
+};
+
+struct mysql_check_sample {
+    char uid[MYSQL_CHECK_VALUESZ];
+    char email[MYSQL_CHECK_VALUESZ];
+};
+
+static int
+mysql_check_sample_load (MYSQL *con, struct mysql_check_sample *sample)
+{
+    MYSQL_RES *res;
+    MYSQL_ROW row;
+    const char *uid = "0", *email = "0";
+
+    if (mysql_query(con, "SELECT UID, Email FROM UserRegInfo LIMIT 1") ||
+        (res = mysql_store_result(con)) == NULL) {
+        report_mysql_error_noaction(con);
+        return -1;
+    }
+
+    if ((row = mysql_fetch_row(res)) != NULL && row[0] && row[1] &&
+        strlen(row[0]) < MYSQL_CHECK_VALUESZ / 2 - 2 &&
+        strlen(row[1]) < MYSQL_CHECK_VALUESZ / 2 - 2) {
+        uid = row[0];
+        email = row[1];
+    } else {
+        log_notice("No registered users, lookups are planned on misses\n");
+    }
+
+    sample->uid[0] = sample->email[0] = '\'';
+    mysql_real_escape_string(con, &sample->uid[1], uid, strlen(uid));
+    mysql_real_escape_string(con, &sample->email[1], email, strlen(email));
+    strcat(sample->uid, "'");
+    strcat(sample->email, "'");
+
+    mysql_free_result(res);
+
+    return 0;
+}
+
+/* Sample value for a "t:name" schema parameter */
+static const char *
+mysql_check_value (const char *param, struct mysql_check_sample *sample)
+{
+    const char *name = param + 2;
+
+    switch (param[0]) {
+    case 'd':
+        return "0";
+    case 'i':
+        return "1";
+    default:
+        break;
+    }
+
+    if (strstr(name, "email")) {
+        return sample->email;
+    }
+    if (strstr(name, "date") || strcmp(name, "sent") == 0 ||
+        strcmp(name, "connected") == 0 || strcmp(name, "seen") == 0 ||
+        strcmp(name, "start") == 0) {
+        return MYSQL_CHECK_DATE;
+    }
+    return sample->uid;
+}
+
+/* "EXPLAIN <sql>" with placeholders filled in, -1 if it does not fit */
+static int
+mysql_check_query (char *query, const char *sql, const char *params,
+                   struct mysql_check_sample *sample)
+{
+    char param[MYSQL_CHECK_VALUESZ];
+    const char *next = params;
+    int len, plen;
+
+    len = snprintf(query, MYSQL_CHECK_QUERYSZ, "EXPLAIN ");
+    for (; *sql; sql++) {
+        if (*sql != '?') {
+            if (len + 1 >= MYSQL_CHECK_QUERYSZ) {
+                return -1;
+            }
+            query[len++] = *sql;
+            continue;
+        }
+
+        while (*next == ' ') {
+            next++;
+        }
+        plen = strcspn(next, " ");
+        if (plen == 0 || plen >= sizeof(param)) {
+            return -1;
+        }
+        memcpy(param, next, plen);
+        param[plen] = '\0';
+        next += plen;
+
+        len += snprintf(&query[len], MYSQL_CHECK_QUERYSZ - len, "%s",
+                        mysql_check_value(param, sample));
+        if (len >= MYSQL_CHECK_QUERYSZ) {
+            return -1;
+        }
+    }
+    query[len] = '\0';
+
+    return 0;
+}
+
+/* Number of full table scans in the plan, -1 on error */
+static int
+mysql_check_explain (MYSQL *con, const char *name, const char *query)
+{
+    MYSQL_RES *res;
+    MYSQL_FIELD *fields;
+    MYSQL_ROW row;
+    int col, nr_fields, nr_scans = 0;
+    int type_col = -1, table_col = -1, select_col = -1;
+
+    if (mysql_query(con, query) || (res = mysql_store_result(con)) == NULL) {
+        log_error("%s: %s\n", name, mysql_error(con));
+        return -1;
+    }
+
+    fields = mysql_fetch_fields(res);
+    nr_fields = mysql_num_fields(res);
+    for (col = 0; col < nr_fields; col++) {
+        if (strcasecmp(fields[col].name, "type") == 0) {
+            type_col = col;
+        } else if (strcasecmp(fields[col].name, "table") == 0) {
+            table_col = col;
+        } else if (strcasecmp(fields[col].name, "select_type") == 0) {
+            select_col = col;
+        }
+    }
+
+    if (type_col < 0 || table_col < 0 || select_col < 0) {
+        log_error("%s: unexpected EXPLAIN output\n", name);
+        mysql_free_result(res);
+        return -1;
+    }
+
+    while ((row = mysql_fetch_row(res)) != NULL) {
+        /* The target row of an INSERT is always planned as ALL */
+        if (row[select_col] && (strcmp(row[select_col], "INSERT") == 0 ||
+                                strcmp(row[select_col], "REPLACE") == 0)) {
+            continue;
+        }
+        if (row[type_col] && strcmp(row[type_col], "ALL") == 0) {
+            log_error("%s: full scan of %s\n", name,
+                      row[table_col] ? row[table_col] : "<derived>");
+            nr_scans++;
+        }
+    }
+    mysql_free_result(res);
+
+    return nr_scans;
+}
+
+static int
+mysql_check_exempted (int stmt)
+{
+    int idx;
+
+    for (idx = 0; idx < ARRAY_SIZE(mysql_check_exempt); idx++) {
+        if (mysql_check_exempt[idx] == stmt) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Returns the number of failing statements */
+static int
+mysql_check_plans (MYSQL *con)
+{
+    struct mysql_check_sample sample;
+    char query[MYSQL_CHECK_QUERYSZ];
+    char sql[MYSQL_CHECK_QUERYSZ];
+    int stmt, nr_failed = 0;
+
+    if (mysql_check_sample_load(con, &sample) < 0) {
+        return 1;
+    }
+
+    for (stmt = 0; stmt < GWEB_STMT_MAX; stmt++) {
+        if (mysql_check_exempted(stmt)) {
+            log_debug("%s: skipped, full scan by design\n", gweb_stmt_name[stmt]);
+            continue;
+        }
+        if (mysql_check_query(query, gweb_stmt_sql[stmt], gweb_stmt_params[stmt],
+                              &sample) < 0) {
+            log_error("%s: unable to fill in parameters\n", gweb_stmt_name[stmt]);
+            nr_failed++;
+        } else if (mysql_check_explain(con, gweb_stmt_name[stmt], query)) {
+            nr_failed++;
+        }
+    }
+
+    /* Templates, rows or values appended as the server does */
+    snprintf(sql, sizeof(sql), "%s%s)", GWEB_SQL_NEIGHBOUR_NAMES, "?");
+    if (mysql_check_query(query, sql, "s:uid", &sample) < 0 ||
+        mysql_check_explain(con, "NEIGHBOUR_NAMES", query)) {
+        nr_failed++;
+    }
+
+    snprintf(sql, sizeof(sql), GWEB_SQL_LOCATION_REAP, 1);
+    if (mysql_check_query(query, sql, "", &sample) < 0 ||
+        mysql_check_explain(con, "LOCATION_REAP", query)) {
+        nr_failed++;
+    }
+
+    if (nr_failed) {
+        log_error("Plan check failed, %d statement(s)\n", nr_failed);
+    } else {
+        log_debug("Plan check passed, no full table scans\n");
+    }
+
+    return nr_failed;
+}
+
 int main (int argc, char *argv[])
 {
     MYSQL *con;
-    int query, drop_tables = 0, version = -1;
+    int query, drop_tables = 0, version = -1, check_plans = 0;
 
     log_debug("Initializing schema, MySQL version = %s\n",
 	      mysql_get_client_info());
@@ -194,6 +578,18 @@ int main (int argc, char *argv[])
             version = 2;
         } else if (strcmp(argv[1], "-v3") == 0) {
             version = 3;
+        } else if (strcmp(argv[1], "-v4") == 0) {
+            version = 4;
+        } else if (strcmp(argv[1], "-v5") == 0) {
+            version = 5;
+        } else if (strcmp(argv[1], "-v6") == 0) {
+            version = 6;
+        } else if (strcmp(argv[1], "-v7") == 0) {
+            version = 7;
+        } else if (strcmp(argv[1], "-v8") == 0) {
+            version = 8;
+        } else if (strcmp(argv[1], "-check") == 0) {
+            check_plans = 1;
         }
     }
 
@@ -241,10 +637,30 @@ int main (int argc, char *argv[])
     case 3:
         MYSQL_RUN_QUERY(query, con, mysql_db_update_v3);
         break;
+    case 4:
+        MYSQL_RUN_QUERY(query, con, mysql_db_update_v4);
+        break;
+    case 5:
+        MYSQL_RUN_QUERY(query, con, mysql_db_update_v5);
+        break;
+    case 6:
+        MYSQL_RUN_QUERY(query, con, mysql_db_update_v6);
+        break;
+    case 7:
+        MYSQL_RUN_QUERY(query, con, mysql_db_update_v7);
+        break;
+    case 8:
+        MYSQL_RUN_QUERY(query, con, mysql_db_update_v8);
+        break;
     default:
         break;
     }
 
+    if (check_plans && mysql_check_plans(con)) {
+        mysql_close(con);
+        return 1;
+    }
+
     mysql_close(con);
 
     return 0;
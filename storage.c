@@ -0,0 +1,56 @@
+/*
+ * Storage backend selection
+ *
+ * The "type" of the first db_config entry picks the backend: "memdb"
+ * keeps everything in process memory (memdb.c), anything else is
+ * MySQL (mysqldb_storage.c).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <gweb/common.h>
+#include <gweb/config.h>
+#include <gweb/mysqldb_api.h>
+#include <gweb/storage.h>
+
+static const struct gweb_storage_ops *g_storage_backends[] = {
+    &gweb_mysql_storage,
+    &gweb_memdb_storage,
+};
+
+#define NR_STORAGE_BACKENDS \
+    (sizeof(g_storage_backends) / sizeof(g_storage_backends[0]))
+
+const struct gweb_storage_ops *gweb_storage = &gweb_mysql_storage;
+
+int
+gweb_storage_init (void)
+{
+    const char *type = config_load_storage();
+    size_t idx;
+
+    for (idx = 0; idx < NR_STORAGE_BACKENDS; idx++) {
+        if (strcasecmp(type, g_storage_backends[idx]->name) == 0) {
+            gweb_storage = g_storage_backends[idx];
+            log_notice("Storage backend: %s\n", gweb_storage->name);
+            return (*gweb_storage->init)();
+        }
+    }
+
+    log_error("%s: unknown storage backend '%s'\n", __func__, type);
+    return MYSQL_STATUS_FAIL;
+}
+
+int
+gweb_storage_shutdown (void)
+{
+    return (*gweb_storage->shutdown)();
+}
+
+int
+gweb_storage_check_uid (const char *uid)
+{
+    return (*gweb_storage->check_uid)(uid);
+}
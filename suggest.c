@@ -0,0 +1,342 @@
+/*
+ * Friend of friend ranking kernels
+ *
+ * A user is suggested the peers of their connections they are not
+ * connected to yet, ranked by the number of connections they share.
+ * Adjacency is held as ascending vertex id arrays, so the count for a
+ * candidate is the size of the intersection of two sorted arrays.
+ *
+ * Candidates are the peers of friends with at most
+ * GWEB_SUGGEST_MAX_FANOUT peers, radix sorted so that a candidate shows
+ * up once per such friend it shares. Friends with longer lists (and
+ * those past GWEB_SUGGEST_MAX_CANDIDATES) are not scanned; they are
+ * counted by intersecting them with the list of each candidate. The
+ * best k are kept in a min-heap.
+ *
+ * The AVX2 intersection compares blocks of 8 against the 8 rotations
+ * of the other block and moves past the block with the lower maximum;
+ * when one array is GWEB_SUGGEST_SKEW times the other, each value of
+ * the short one is searched in the long one instead.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include <gweb/suggest.h>
+
+#ifdef GWEB_SUGGEST_AVX2
+#include <immintrin.h>
+#endif
+
+uint32_t
+gweb_suggest_intersect_scalar (const uint32_t *a, uint32_t na,
+                               const uint32_t *b, uint32_t nb)
+{
+    uint32_t ia = 0, ib = 0, count = 0;
+
+    while (ia < na && ib < nb) {
+        if (a[ia] < b[ib]) {
+            ia++;
+        } else if (a[ia] > b[ib]) {
+            ib++;
+        } else {
+            count++;
+            ia++;
+            ib++;
+        }
+    }
+    return count;
+}
+
+/* Each value of a searched in b, widening from the last match */
+uint32_t
+gweb_suggest_intersect_gallop (const uint32_t *a, uint32_t na,
+                               const uint32_t *b, uint32_t nb)
+{
+    uint32_t ia, lo = 0, hi, mid, step, count = 0;
+
+    for (ia = 0; ia < na && lo < nb; ia++) {
+        /* b[lo - 1] < a[ia], until b[hi] >= a[ia] */
+        for (step = 1, hi = lo; hi < nb && b[hi] < a[ia]; step *= 2) {
+            lo = hi + 1;
+            hi += step;
+        }
+        if (hi > nb) {
+            hi = nb;
+        }
+
+        while (lo < hi) {
+            mid = lo + (hi - lo) / 2;
+            if (b[mid] < a[ia]) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo < nb && b[lo] == a[ia]) {
+            count++;
+            lo++;
+        }
+    }
+    return count;
+}
+
+#ifdef GWEB_SUGGEST_AVX2
+
+#define GWEB_AVX2   __attribute__((target("avx2")))
+
+GWEB_AVX2 uint32_t
+gweb_suggest_intersect_avx2 (const uint32_t *a, uint32_t na,
+                             const uint32_t *b, uint32_t nb)
+{
+    const __m256i rotate = _mm256_set_epi32(0, 7, 6, 5, 4, 3, 2, 1);
+    __m256i va, vb, eq;
+    uint32_t ia = 0, ib = 0, count = 0, amax, bmax;
+    int rot;
+
+    while (ia + 8 <= na && ib + 8 <= nb) {
+        va = _mm256_loadu_si256((const __m256i *)&a[ia]);
+        vb = _mm256_loadu_si256((const __m256i *)&b[ib]);
+
+        /* Lane i of eq set when a[ia + i] is anywhere in the b block */
+        eq = _mm256_cmpeq_epi32(va, vb);
+        for (rot = 1; rot < 8; rot++) {
+            vb = _mm256_permutevar8x32_epi32(vb, rotate);
+            eq = _mm256_or_si256(eq, _mm256_cmpeq_epi32(va, vb));
+        }
+        count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(eq)));
+
+        amax = a[ia + 7];
+        bmax = b[ib + 7];
+        ia += (amax <= bmax) ? 8 : 0;
+        ib += (bmax <= amax) ? 8 : 0;
+    }
+
+    return count + gweb_suggest_intersect_scalar(&a[ia], na - ia, &b[ib], nb - ib);
+}
+
+#endif /* GWEB_SUGGEST_AVX2 */
+
+typedef uint32_t (*gweb_suggest_fn) (const uint32_t *, uint32_t,
+                                     const uint32_t *, uint32_t);
+
+static gweb_suggest_fn
+gweb_suggest_select (void)
+{
+#ifdef GWEB_SUGGEST_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        return gweb_suggest_intersect_avx2;
+    }
+#endif
+    return gweb_suggest_intersect_scalar;
+}
+
+uint32_t
+gweb_suggest_intersect (const uint32_t *a, uint32_t na,
+                        const uint32_t *b, uint32_t nb)
+{
+    static gweb_suggest_fn kernel;
+
+    if (na > nb) {
+        return gweb_suggest_intersect(b, nb, a, na);
+    }
+    if ((uint64_t)na * GWEB_SUGGEST_SKEW < nb) {
+        return gweb_suggest_intersect_gallop(a, na, b, nb);
+    }
+
+    /* Racing threads pick the same kernel */
+    if (kernel == NULL) {
+        kernel = gweb_suggest_select();
+    }
+    return kernel(a, na, b, nb);
+}
+
+const char *
+gweb_suggest_kernel (void)
+{
+    return (gweb_suggest_select() == gweb_suggest_intersect_scalar) ? "scalar" : "avx2";
+}
+
+static inline uint32_t
+gweb_suggest_degree (const struct gweb_suggest_graph *graph, uint32_t vid)
+{
+    if (vid >= graph->nr_vertices) {
+        return 0;
+    }
+    return graph->offsets[vid + 1] - graph->offsets[vid];
+}
+
+static inline const uint32_t *
+gweb_suggest_peers (const struct gweb_suggest_graph *graph, uint32_t vid)
+{
+    return (vid < graph->nr_vertices) ? &graph->peers[graph->offsets[vid]] : NULL;
+}
+
+/* More mutual connections first, then the lower vertex */
+static inline int
+gweb_suggest_better (const struct gweb_suggestion *a, const struct gweb_suggestion *b)
+{
+    if (a->mutual != b->mutual) {
+        return a->mutual > b->mutual;
+    }
+    return a->vid < b->vid;
+}
+
+/* Min-heap on rank, the worst suggestion kept at the root */
+static void
+gweb_suggest_sift_down (struct gweb_suggestion *heap, int nr, int idx)
+{
+    struct gweb_suggestion tmp;
+    int child;
+
+    while ((child = 2 * idx + 1) < nr) {
+        if (child + 1 < nr && gweb_suggest_better(&heap[child], &heap[child + 1])) {
+            child++;
+        }
+        if (!gweb_suggest_better(&heap[idx], &heap[child])) {
+            break;
+        }
+        tmp = heap[idx];
+        heap[idx] = heap[child];
+        heap[child] = tmp;
+        idx = child;
+    }
+}
+
+static void
+gweb_suggest_sift_up (struct gweb_suggestion *heap, int idx)
+{
+    struct gweb_suggestion tmp;
+    int parent;
+
+    while (idx > 0) {
+        parent = (idx - 1) / 2;
+        if (!gweb_suggest_better(&heap[parent], &heap[idx])) {
+            break;
+        }
+        tmp = heap[idx];
+        heap[idx] = heap[parent];
+        heap[parent] = tmp;
+        idx = parent;
+    }
+}
+
+#define GWEB_SUGGEST_RADIX_BITS (11)
+#define GWEB_SUGGEST_RADIX      (1 << GWEB_SUGGEST_RADIX_BITS)
+
+/* LSD radix sort, by as many digits as the largest vertex has */
+static uint32_t *
+gweb_suggest_sort (uint32_t *vids, uint32_t *tmp, uint32_t nr, uint32_t max)
+{
+    uint32_t count[GWEB_SUGGEST_RADIX], *swap, idx, sum, digit;
+    int shift;
+
+    for (shift = 0; shift < 32 && (max >> shift) != 0; shift += GWEB_SUGGEST_RADIX_BITS) {
+        memset(count, 0, sizeof(count));
+        for (idx = 0; idx < nr; idx++) {
+            count[(vids[idx] >> shift) & (GWEB_SUGGEST_RADIX - 1)]++;
+        }
+        for (idx = sum = 0; idx < GWEB_SUGGEST_RADIX; idx++) {
+            digit = count[idx];
+            count[idx] = sum;
+            sum += digit;
+        }
+        for (idx = 0; idx < nr; idx++) {
+            tmp[count[(vids[idx] >> shift) & (GWEB_SUGGEST_RADIX - 1)]++] = vids[idx];
+        }
+        swap = vids;
+        vids = tmp;
+        tmp = swap;
+    }
+    return vids;
+}
+
+int
+gweb_suggest_rank (const struct gweb_suggest_graph *graph, uint32_t self,
+                   const uint32_t *friends, uint32_t nr_friends,
+                   struct gweb_suggestion *top, int k)
+{
+    struct gweb_suggestion next, tmp;
+    uint32_t *cands, *hubs, *sorted, vid, deg, idx, jdx, run;
+    uint32_t nr_cands = 0, nr_hubs = 0, size = 0, max = 0;
+    int nr = 0;
+
+    if (k <= 0) {
+        return 0;
+    }
+
+    for (idx = 0; idx < nr_friends; idx++) {
+        deg = gweb_suggest_degree(graph, friends[idx]);
+        size += (deg <= GWEB_SUGGEST_MAX_FANOUT) ? deg : 0;
+        if (size > GWEB_SUGGEST_MAX_CANDIDATES) {
+            size = GWEB_SUGGEST_MAX_CANDIDATES;
+            break;
+        }
+    }
+
+    /* Room for the candidates and the radix sort scratch */
+    cands = malloc((2 * size + 1) * sizeof(uint32_t));
+    hubs = malloc((nr_friends + 1) * sizeof(uint32_t));
+    if (!cands || !hubs) {
+        free(cands);
+        free(hubs);
+        return -1;
+    }
+
+    /* Lists that do not fit are left to the intersections, whole */
+    for (idx = 0; idx < nr_friends; idx++) {
+        deg = gweb_suggest_degree(graph, friends[idx]);
+        if (deg > GWEB_SUGGEST_MAX_FANOUT || deg > size - nr_cands) {
+            hubs[nr_hubs++] = friends[idx];
+            continue;
+        }
+        memcpy(&cands[nr_cands], gweb_suggest_peers(graph, friends[idx]),
+               deg * sizeof(uint32_t));
+        nr_cands += deg;
+        if (deg && cands[nr_cands - 1] > max) {
+            max = cands[nr_cands - 1];
+        }
+    }
+    sorted = gweb_suggest_sort(cands, &cands[size], nr_cands, max);
+
+    /* A candidate is listed once per expanded friend it shares */
+    for (idx = jdx = 0; idx < nr_cands; idx += run) {
+        vid = sorted[idx];
+        for (run = 1; idx + run < nr_cands && sorted[idx + run] == vid; run++)
+            ;
+
+        while (jdx < nr_friends && friends[jdx] < vid) {
+            jdx++;
+        }
+        if (vid == self || (jdx < nr_friends && friends[jdx] == vid)) {
+            continue;
+        }
+
+        next.vid = vid;
+        next.mutual = run;
+        if (nr_hubs) {
+            next.mutual += gweb_suggest_intersect(hubs, nr_hubs,
+                                                  gweb_suggest_peers(graph, vid),
+                                                  gweb_suggest_degree(graph, vid));
+        }
+
+        if (nr < k) {
+            top[nr] = next;
+            gweb_suggest_sift_up(top, nr++);
+        } else if (gweb_suggest_better(&next, &top[0])) {
+            top[0] = next;
+            gweb_suggest_sift_down(top, nr, 0);
+        }
+    }
+    free(cands);
+    free(hubs);
+
+    /* Worst to the back, best first */
+    for (idx = nr; idx > 1; idx--) {
+        tmp = top[0];
+        top[0] = top[idx - 1];
+        top[idx - 1] = tmp;
+        gweb_suggest_sift_down(top, idx - 1, 0);
+    }
+
+    return nr;
+}
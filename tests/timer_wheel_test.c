@@ -0,0 +1,201 @@
+/*
+ * Timing wheel checks
+ *
+ * Runs timers through expiry, deletion and rearming, and checks what
+ * fires when and that the count of armed timers stays right (a wheel
+ * with none skips ahead). Exits non-zero on the first failure.
+ *
+ *   timer_wheel_test
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <gweb/timer_wheel.h>
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond);  \
+            exit(1);                                                    \
+        }                                                               \
+    } while (0)
+
+/* Take the expired timers off the list, as a caller has to */
+static int
+test_drain (struct gweb_timer_wheel *wheel, struct list *expired,
+            struct gweb_timer *first)
+{
+    struct gweb_timer *timer;
+    int nr = 0;
+
+    while (!list_empty(expired)) {
+        timer = list_entry(expired->next, struct gweb_timer, node);
+        CHECK(first == NULL || timer == first);
+        list_remove(&timer->node);
+        CHECK(!gweb_timer_pending(timer));
+
+        /* Deleting a fired timer is a no-op */
+        gweb_timer_del(wheel, timer);
+        nr++;
+    }
+    return nr;
+}
+
+/* Expire one, delete it, and a later timer still fires */
+static void
+test_expire_del (void)
+{
+    struct gweb_timer_wheel wheel;
+    struct gweb_timer early, late;
+    struct list expired;
+
+    gweb_timer_wheel_init(&wheel, 1000);
+    gweb_timer_init(&early);
+    gweb_timer_init(&late);
+    list_init(&expired);
+
+    gweb_timer_add(&wheel, &early, 1005);
+    gweb_timer_add(&wheel, &late, 6000);
+    CHECK(wheel.nr_timers == 2);
+
+    CHECK(gweb_timer_wheel_advance(&wheel, 1004, &expired) == 0);
+    CHECK(gweb_timer_wheel_advance(&wheel, 1010, &expired) == 1);
+    CHECK(test_drain(&wheel, &expired, &early) == 1);
+    CHECK(wheel.nr_timers == 1);
+    CHECK(gweb_timer_pending(&late));
+
+    CHECK(gweb_timer_wheel_advance(&wheel, 5999, &expired) == 0);
+    CHECK(gweb_timer_wheel_advance(&wheel, 7000, &expired) == 1);
+    CHECK(test_drain(&wheel, &expired, &late) == 1);
+    CHECK(wheel.nr_timers == 0);
+}
+
+/* A deleted timer does not fire, a rearmed one fires at its new time */
+static void
+test_del_rearm (void)
+{
+    struct gweb_timer_wheel wheel;
+    struct gweb_timer gone, moved;
+    struct list expired;
+
+    gweb_timer_wheel_init(&wheel, 0);
+    gweb_timer_init(&gone);
+    gweb_timer_init(&moved);
+    list_init(&expired);
+
+    gweb_timer_add(&wheel, &gone, 100);
+    gweb_timer_add(&wheel, &moved, 100);
+    gweb_timer_del(&wheel, &gone);
+    gweb_timer_add(&wheel, &moved, 5000);
+    CHECK(wheel.nr_timers == 1);
+
+    CHECK(gweb_timer_wheel_advance(&wheel, 4999, &expired) == 0);
+    CHECK(gweb_timer_wheel_advance(&wheel, 5000, &expired) == 1);
+    CHECK(test_drain(&wheel, &expired, &moved) == 1);
+
+    /* Rearmed after it fired */
+    gweb_timer_add(&wheel, &moved, 5010);
+    CHECK(wheel.nr_timers == 1);
+    CHECK(gweb_timer_wheel_advance(&wheel, 6000, &expired) == 1);
+    CHECK(test_drain(&wheel, &expired, &moved) == 1);
+    CHECK(wheel.nr_timers == 0);
+}
+
+/* Deadlines across every level, each fires on its own second */
+static void
+test_levels (void)
+{
+    static const time_t deadlines[] = { 1, 63, 64, 65, 4095, 4096, 4097,
+                                        262143, 262144, 300000, 20000000 };
+    int nr = sizeof(deadlines) / sizeof(deadlines[0]);
+    struct gweb_timer_wheel wheel;
+    struct gweb_timer timers[sizeof(deadlines) / sizeof(deadlines[0])];
+    struct list expired;
+    int idx;
+
+    gweb_timer_wheel_init(&wheel, 0);
+    list_init(&expired);
+    for (idx = 0; idx < nr; idx++) {
+        gweb_timer_init(&timers[idx]);
+        gweb_timer_add(&wheel, &timers[idx], deadlines[idx]);
+    }
+
+    for (idx = 0; idx < nr; idx++) {
+        CHECK(gweb_timer_wheel_advance(&wheel, deadlines[idx] - 1, &expired) == 0);
+        CHECK(gweb_timer_wheel_advance(&wheel, deadlines[idx], &expired) == 1);
+        CHECK(test_drain(&wheel, &expired, &timers[idx]) == 1);
+        CHECK(wheel.nr_timers == nr - idx - 1);
+    }
+}
+
+/*
+ * Random adds, deletes and advances, each timer due to fire on the
+ * first advance that reaches its deadline
+ */
+#define TEST_NR_TIMERS      (1000)
+
+static void
+test_random (void)
+{
+    static struct gweb_timer timers[TEST_NR_TIMERS];
+    static time_t deadlines[TEST_NR_TIMERS];
+    static int armed[TEST_NR_TIMERS];
+    struct gweb_timer_wheel wheel;
+    struct gweb_timer *timer;
+    struct list expired;
+    time_t now = 1000000;
+    int round, idx, nr_armed = 0;
+
+    srandom(1);
+    gweb_timer_wheel_init(&wheel, now);
+    list_init(&expired);
+    for (idx = 0; idx < TEST_NR_TIMERS; idx++) {
+        gweb_timer_init(&timers[idx]);
+    }
+
+    for (round = 0; round < 20000; round++) {
+        idx = random() % TEST_NR_TIMERS;
+        switch (random() % 4) {
+        case 0:
+        case 1:
+            deadlines[idx] = now + 1 + (random() % 4 ? random() % 300 : random() % 500000);
+            nr_armed += !armed[idx];
+            armed[idx] = 1;
+            gweb_timer_add(&wheel, &timers[idx], deadlines[idx]);
+            break;
+        case 2:
+            nr_armed -= armed[idx];
+            armed[idx] = 0;
+            gweb_timer_del(&wheel, &timers[idx]);
+            break;
+        default:
+            now += (random() % 8) ? random() % 70 : random() % 300000;
+            gweb_timer_wheel_advance(&wheel, now, &expired);
+            while (!list_empty(&expired)) {
+                timer = list_entry(expired.next, struct gweb_timer, node);
+                list_remove(&timer->node);
+                idx = timer - timers;
+                CHECK(armed[idx] && deadlines[idx] <= now);
+                armed[idx] = 0;
+                nr_armed--;
+            }
+            for (idx = 0; idx < TEST_NR_TIMERS; idx++) {
+                CHECK(!armed[idx] || deadlines[idx] > now);
+            }
+            break;
+        }
+        CHECK(wheel.nr_timers == nr_armed);
+    }
+}
+
+int
+main (void)
+{
+    test_expire_del();
+    test_del_rearm();
+    test_levels();
+    test_random();
+
+    printf("timer wheel: ok\n");
+    return 0;
+}
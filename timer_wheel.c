@@ -0,0 +1,176 @@
+/*
+ * Hierarchical timing wheel
+ *
+ * Adding and removing a timer is O(1): it is linked into the slot of
+ * the coarsest level that still tells its deadline apart. As time
+ * advances, the slot of a higher level that comes due is cascaded into
+ * the finer levels below, and level 0 slots hand out the expired
+ * timers. Callers serialize access to a wheel.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <gweb/timer_wheel.h>
+
+#define GWEB_TIMER_SLOT_MASK        (GWEB_TIMER_SLOTS - 1)
+
+/* Seconds covered by levels 0..level */
+#define GWEB_TIMER_SPAN(level)                                          \
+    ((time_t)1 << (GWEB_TIMER_SLOT_BITS * ((level) + 1)))
+
+static void
+gweb_timer_queue (struct gweb_timer_wheel *wheel, struct gweb_timer *timer)
+{
+    time_t delta = timer->expires - wheel->now, when = timer->expires;
+    int level;
+
+    /* Already due, fires on the next tick */
+    if (delta <= 0) {
+        when = wheel->now + 1;
+        delta = 1;
+    }
+
+    for (level = 0; level < GWEB_TIMER_LEVELS - 1; level++) {
+        if (delta < GWEB_TIMER_SPAN(level)) {
+            break;
+        }
+    }
+
+    /* Parked beyond the reach of the wheel, cascaded down again later */
+    if (delta >= GWEB_TIMER_SPAN(level)) {
+        when = wheel->now + GWEB_TIMER_SPAN(level) - 1;
+    }
+
+    list_add(&wheel->slots[level][(when >> (GWEB_TIMER_SLOT_BITS * level)) &
+                                  GWEB_TIMER_SLOT_MASK], &timer->node);
+}
+
+/*
+ * Requeue a slot of a higher level relative to the current tick. Those
+ * due on this very tick go to due, requeued they would fire a tick late.
+ */
+static void
+gweb_timer_cascade (struct gweb_timer_wheel *wheel, int level, int idx,
+                    struct list *due)
+{
+    struct list pending, *head = &wheel->slots[level][idx];
+    struct gweb_timer *timer;
+
+    if (list_empty(head)) {
+        return;
+    }
+
+    /* Move the slot aside, requeueing may land in the same slot */
+    list_init(&pending);
+    while (!list_empty(head)) {
+        timer = list_entry(head->next, struct gweb_timer, node);
+        list_remove(&timer->node);
+        list_add(&pending, &timer->node);
+    }
+
+    while (!list_empty(&pending)) {
+        timer = list_entry(pending.next, struct gweb_timer, node);
+        list_remove(&timer->node);
+        if (timer->expires <= wheel->now) {
+            list_add(due, &timer->node);
+        } else {
+            gweb_timer_queue(wheel, timer);
+        }
+    }
+}
+
+void
+gweb_timer_wheel_init (struct gweb_timer_wheel *wheel, time_t now)
+{
+    int level, idx;
+
+    for (level = 0; level < GWEB_TIMER_LEVELS; level++) {
+        for (idx = 0; idx < GWEB_TIMER_SLOTS; idx++) {
+            list_init(&wheel->slots[level][idx]);
+        }
+    }
+    wheel->now = now;
+    wheel->nr_timers = 0;
+}
+
+/* (Re)arm a timer, a pending one is moved to the new deadline */
+void
+gweb_timer_add (struct gweb_timer_wheel *wheel, struct gweb_timer *timer,
+                time_t expires)
+{
+    gweb_timer_del(wheel, timer);
+
+    timer->expires = expires;
+    gweb_timer_queue(wheel, timer);
+    wheel->nr_timers++;
+}
+
+void
+gweb_timer_del (struct gweb_timer_wheel *wheel, struct gweb_timer *timer)
+{
+    if (gweb_timer_pending(timer)) {
+        list_remove(&timer->node);
+        wheel->nr_timers--;
+    }
+}
+
+/*
+ * Run the wheel up to now, moving timers that came due onto the
+ * expired list. Returns the number of timers expired. These are no
+ * longer counted by the wheel, callers list_remove() them before they
+ * are deleted or added again.
+ */
+int
+gweb_timer_wheel_advance (struct gweb_timer_wheel *wheel, time_t now,
+                          struct list *expired)
+{
+    struct gweb_timer *timer;
+    struct list due, *head;
+    int level, nr_expired = 0;
+    time_t tick;
+
+    /* Nothing to run through, skip ahead */
+    if (wheel->nr_timers == 0 && now > wheel->now) {
+        wheel->now = now;
+        return 0;
+    }
+
+    list_init(&due);
+
+    while (wheel->now < now) {
+        tick = ++wheel->now;
+
+        for (level = 1; level < GWEB_TIMER_LEVELS; level++) {
+            if (tick & (((time_t)1 << (GWEB_TIMER_SLOT_BITS * level)) - 1)) {
+                break;
+            }
+            gweb_timer_cascade(wheel, level, (tick >> (GWEB_TIMER_SLOT_BITS * level)) &
+                               GWEB_TIMER_SLOT_MASK, &due);
+        }
+
+        head = &wheel->slots[0][tick & GWEB_TIMER_SLOT_MASK];
+        while (!list_empty(head)) {
+            timer = list_entry(head->next, struct gweb_timer, node);
+            list_remove(&timer->node);
+            list_add(&due, &timer->node);
+        }
+
+        while (!list_empty(&due)) {
+            timer = list_entry(due.next, struct gweb_timer, node);
+            list_remove(&timer->node);
+            if (timer->expires > tick) {
+                gweb_timer_queue(wheel, timer);
+                continue;
+            }
+            list_add(expired, &timer->node);
+            wheel->nr_timers--;
+            nr_expired++;
+        }
+
+        if (wheel->nr_timers == 0) {
+            wheel->now = now;
+        }
+    }
+
+    return nr_expired;
+}
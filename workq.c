@@ -0,0 +1,193 @@
+/*
+ * Work queue between the HTTP event loop and DB workers
+ *
+ * The loop thread never blocks on MySQL or S3: requests needing either
+ * are suspended and queued here. A fixed set of worker threads, sized
+ * to the connection pool, runs them and moves them to the completed
+ * list. A pipe wakes the loop, which resumes the requests.
+ *
+ * Shutdown lets the workers drain the queue, so every submitted work
+ * completes and no request is left suspended.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <mysql.h>
+
+#include <gweb/common.h>
+#include <gweb/list.h>
+#include <gweb/workq.h>
+
+struct gweb_workq {
+    pthread_mutex_t lock;
+    pthread_cond_t  work_avail;
+
+    struct list pending;
+    struct list completed;
+    int running;
+
+    int notify[2];              /* read end polled by the loop */
+    int nr_workers;
+    pthread_t *workers;
+};
+
+static struct gweb_workq g_workq = {
+    .lock       = PTHREAD_MUTEX_INITIALIZER,
+    .work_avail = PTHREAD_COND_INITIALIZER,
+    .notify     = { -1, -1 },
+};
+
+static void *
+gweb_workq_worker (void *arg)
+{
+    struct gweb_workq *wq = arg;
+    struct gweb_work *work;
+    int wakeup;
+
+    mysql_thread_init();
+
+    pthread_mutex_lock(&wq->lock);
+    while (wq->running || !list_empty(&wq->pending)) {
+        if (list_empty(&wq->pending)) {
+            pthread_cond_wait(&wq->work_avail, &wq->lock);
+            continue;
+        }
+        work = list_entry(wq->pending.next, struct gweb_work, node);
+        list_remove(&work->node);
+        pthread_mutex_unlock(&wq->lock);
+
+        work->run(work);
+
+        pthread_mutex_lock(&wq->lock);
+        /* One byte per batch, the loop drains the whole list */
+        wakeup = list_empty(&wq->completed);
+        list_add(&wq->completed, &work->node);
+        if (wakeup && write(wq->notify[1], "w", 1) < 0 && errno != EAGAIN) {
+            log_error("%s: notify failed (%d)\n", __func__, errno);
+        }
+    }
+    pthread_mutex_unlock(&wq->lock);
+
+    mysql_thread_end();
+
+    return NULL;
+}
+
+void
+gweb_workq_submit (struct gweb_work *work)
+{
+    struct gweb_workq *wq = &g_workq;
+
+    pthread_mutex_lock(&wq->lock);
+    list_add(&wq->pending, &work->node);
+    pthread_cond_signal(&wq->work_avail);
+    pthread_mutex_unlock(&wq->lock);
+}
+
+/* Loop thread, runs done() of completed work. Returns the count. */
+int
+gweb_workq_complete (void)
+{
+    struct gweb_workq *wq = &g_workq;
+    struct gweb_work *work;
+    struct list completed;
+    char buf[64];
+    int count = 0;
+
+    while (read(wq->notify[0], buf, sizeof(buf)) > 0)
+        ;
+
+    list_init(&completed);
+    pthread_mutex_lock(&wq->lock);
+    if (!list_empty(&wq->completed)) {
+        /* Splice the whole list out */
+        completed.next = wq->completed.next;
+        completed.prev = wq->completed.prev;
+        completed.next->prev = completed.prev->next = &completed;
+        list_init(&wq->completed);
+    }
+    pthread_mutex_unlock(&wq->lock);
+
+    while (!list_empty(&completed)) {
+        work = list_entry(completed.next, struct gweb_work, node);
+        list_remove(&work->node);
+        work->done(work);
+        count++;
+    }
+
+    return count;
+}
+
+int
+gweb_workq_init (int nr_workers)
+{
+    struct gweb_workq *wq = &g_workq;
+    int idx;
+
+    list_init(&wq->pending);
+    list_init(&wq->completed);
+
+    if (pipe(wq->notify) < 0) {
+        log_error("%s: pipe failed (%d)\n", __func__, errno);
+        return -1;
+    }
+    for (idx = 0; idx < 2; idx++) {
+        fcntl(wq->notify[idx], F_SETFL, fcntl(wq->notify[idx], F_GETFL) | O_NONBLOCK);
+        fcntl(wq->notify[idx], F_SETFD, FD_CLOEXEC);
+    }
+
+    if ((wq->workers = calloc(nr_workers, sizeof(pthread_t))) == NULL) {
+        log_error("%s: unable to allocate memory!\n", __func__);
+        goto __bail_out;
+    }
+
+    wq->running = 1;
+    for (idx = 0; idx < nr_workers; idx++) {
+        if (pthread_create(&wq->workers[idx], NULL, gweb_workq_worker, wq)) {
+            log_error("%s: unable to start worker thread\n", __func__);
+            break;
+        }
+        wq->nr_workers++;
+    }
+
+    if (wq->nr_workers == 0) {
+        wq->running = 0;
+        free(wq->workers);
+        wq->workers = NULL;
+        goto __bail_out;
+    }
+
+    log_debug("Work queue ready, %d worker(s)\n", wq->nr_workers);
+
+    return wq->notify[0];
+
+__bail_out:
+    close(wq->notify[0]);
+    close(wq->notify[1]);
+    wq->notify[0] = wq->notify[1] = -1;
+    return -1;
+}
+
+/* Waits for all submitted work, call gweb_workq_complete() after */
+void
+gweb_workq_shutdown (void)
+{
+    struct gweb_workq *wq = &g_workq;
+    int idx;
+
+    pthread_mutex_lock(&wq->lock);
+    wq->running = 0;
+    pthread_cond_broadcast(&wq->work_avail);
+    pthread_mutex_unlock(&wq->lock);
+
+    for (idx = 0; idx < wq->nr_workers; idx++) {
+        pthread_join(wq->workers[idx], NULL);
+    }
+    wq->nr_workers = 0;
+    free(wq->workers);
+    wq->workers = NULL;
+}